@@ -17,6 +17,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include <acfutils/assert.h>
@@ -69,7 +70,6 @@
 
 #if	GTS820_MODE
 
-#define	NUM_SL		3
 #define	FALLBACK_SL	1
 
 static const SL_t SL_table[NUM_SL] = {
@@ -126,7 +126,6 @@ static const SL_t SL_table[NUM_SL] = {
 /*
  * TCAS II v7.1 mode.
  */
-#define	NUM_SL		8
 #define	FALLBACK_SL	3
 static const SL_t SL_table[NUM_SL] = {
     {	/* SL1 */
@@ -254,27 +253,40 @@ static const SL_t SL_table[NUM_SL] = {
 #endif	/* !GTS820_MODE */
 
 /*
- * Selects the appropriate TCAS sensitivity level based on previously selected
- * sensitivity level (prev_SL_id), altitude AMSL (alt_msl) and altitude AGL
- * (alt_agl). If force_select_SL is non-zero, this forcibly selects the given
- * SL based on SL_id (must be between 1 and 8 inclusive).
+ * Fills `table' with the default sensitivity level table above. Each
+ * TCAS context keeps its own copy, so its thresholds can be tuned at
+ * runtime (see xtcas_set_params).
+ */
+void
+xtcas_SL_table_init(SL_t table[NUM_SL])
+{
+	memcpy(table, SL_table, sizeof (SL_table));
+}
+
+/*
+ * Selects the appropriate TCAS sensitivity level from `table' based on
+ * previously selected sensitivity level (prev_SL_id), altitude AMSL
+ * (alt_msl) and altitude AGL (alt_agl). If force_select_SL is non-zero,
+ * this forcibly selects the given SL based on SL_id (must be between 1
+ * and 8 inclusive).
  */
 const SL_t *
-xtcas_SL_select(unsigned prev_SL_id, double alt_msl, double alt_agl,
-    unsigned force_select_SL, bool_t gear_ext)
+xtcas_SL_select(const SL_t table[NUM_SL], unsigned prev_SL_id,
+    double alt_msl, double alt_agl, unsigned force_select_SL,
+    bool_t gear_ext)
 {
 	if (force_select_SL != 0) {
 		VERIFY3U(force_select_SL, >=, 1);
 		VERIFY3U(force_select_SL, <=, 8);
-		return (&SL_table[force_select_SL - 1]);
+		return (&table[force_select_SL - 1]);
 	}
 	/*
 	 * In case we have no altitude data, fall back to the default SL.
 	 */
 	if (!is_valid_alt_m(alt_msl))
-		return (&SL_table[FALLBACK_SL]);
+		return (&table[FALLBACK_SL]);
 	for (int i = 0; i < NUM_SL; i++) {
-		const SL_t *sl = &SL_table[i];
+		const SL_t *sl = &table[i];
 		double min, max;
 
 		if (prev_SL_id == sl->SL_id) {
@@ -35,6 +35,12 @@ extern "C" {
 #define	INHIBIT_NO_ALT_RPTG_ACF	FEET2MET(15500)
 #define	INHIBIT_CLB_RA		FEET2MET(48000)
 
+#if	GTS820_MODE
+#define	NUM_SL			3
+#else
+#define	NUM_SL			8
+#endif
+
 typedef enum {
 	GEAR_TEST_IGN,
 	GEAR_TEST_DOWN,
@@ -59,8 +65,10 @@ typedef struct SL {
 	gear_test_t	gear_test;
 } SL_t;
 
-const SL_t *xtcas_SL_select(unsigned prev_SL_id, double alt_msl,
-    double alt_agl, unsigned force_select_SL, bool_t gear_ext);
+void xtcas_SL_table_init(SL_t table[NUM_SL]);
+const SL_t *xtcas_SL_select(const SL_t table[NUM_SL], unsigned prev_SL_id,
+    double alt_msl, double alt_agl, unsigned force_select_SL,
+    bool_t gear_ext);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,128 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+*/
+/*
+ * Copyright 2025 Saso Kiselkov. All rights reserved.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <acfutils/assert.h>
+#include <acfutils/helpers.h>
+#include <acfutils/safe_alloc.h>
+
+#include "arena.h"
+
+#define	ARENA_ALIGN(sz) \
+	(((sz) + sizeof (max_align_t) - 1) & ~(sizeof (max_align_t) - 1))
+
+struct arena_chunk {
+	arena_chunk_t	*next;
+	size_t		size;		/* usable bytes in `data' */
+	size_t		used;
+	max_align_t	data[];
+};
+
+void
+xtcas_arena_init(arena_t *arena, size_t chunk_sz)
+{
+	ASSERT(chunk_sz != 0);
+	memset(arena, 0, sizeof (*arena));
+	arena->chunk_sz = chunk_sz;
+}
+
+void
+xtcas_arena_fini(arena_t *arena)
+{
+	arena_chunk_t *chunk, *next;
+
+	for (chunk = arena->first; chunk != NULL; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+	memset(arena, 0, sizeof (*arena));
+}
+
+/*
+ * Chunks for requests larger than chunk_sz are made a power of 2 times
+ * chunk_sz, so that a request which grows a little every cycle (e.g. a
+ * per-contact array) doesn't need a new chunk every time.
+ */
+static arena_chunk_t *
+chunk_alloc(arena_t *arena, size_t sz)
+{
+	arena_chunk_t *chunk;
+	size_t chunk_sz = arena->chunk_sz;
+
+	while (chunk_sz < sz)
+		chunk_sz *= 2;
+	sz = chunk_sz;
+	chunk = safe_malloc(sizeof (*chunk) + sz);
+	chunk->next = NULL;
+	chunk->size = sz;
+	chunk->used = 0;
+	arena->num_heap_allocs++;
+
+	return (chunk);
+}
+
+/*
+ * Returns `sz' bytes of zeroed memory, aligned for any type. The memory
+ * remains valid until the next xtcas_arena_reset.
+ */
+void *
+xtcas_arena_alloc(arena_t *arena, size_t sz)
+{
+	arena_chunk_t *chunk = arena->cur;
+	void *p;
+
+	sz = ARENA_ALIGN(MAX(sz, 1));
+
+	/* Skip over any retained chunks which are too small. */
+	while (chunk != NULL && chunk->size - chunk->used < sz) {
+		if (chunk->next == NULL || chunk->next->size < sz) {
+			arena_chunk_t *new_chunk = chunk_alloc(arena, sz);
+
+			new_chunk->next = chunk->next;
+			chunk->next = new_chunk;
+		}
+		chunk = chunk->next;
+	}
+	if (chunk == NULL) {
+		ASSERT3P(arena->first, ==, NULL);
+		chunk = chunk_alloc(arena, sz);
+		arena->first = chunk;
+	}
+	arena->cur = chunk;
+
+	p = (uint8_t *)chunk->data + chunk->used;
+	chunk->used += sz;
+	memset(p, 0, sz);
+
+	return (p);
+}
+
+/*
+ * Releases all allocations made from the arena. The chunks are retained
+ * for reuse.
+ */
+void
+xtcas_arena_reset(arena_t *arena)
+{
+	for (arena_chunk_t *chunk = arena->first; chunk != NULL;
+	    chunk = chunk->next)
+		chunk->used = 0;
+	arena->cur = arena->first;
+}
@@ -0,0 +1,54 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+*/
+/*
+ * Copyright 2025 Saso Kiselkov. All rights reserved.
+ */
+
+#ifndef	_XTCAS_ARENA_H_
+#define	_XTCAS_ARENA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Bump allocator for short-lived objects. Allocations are never freed
+ * individually, instead the whole arena is rewound in one go with
+ * xtcas_arena_reset. The memory chunks backing the arena are kept
+ * across resets, so once the arena has grown to its working size, it
+ * doesn't touch the heap anymore.
+ */
+typedef struct arena_chunk arena_chunk_t;
+
+typedef struct {
+	arena_chunk_t	*first;
+	arena_chunk_t	*cur;
+	size_t		chunk_sz;
+	uint64_t	num_heap_allocs; /* number of chunks allocated */
+} arena_t;
+
+void xtcas_arena_init(arena_t *arena, size_t chunk_sz);
+void xtcas_arena_fini(arena_t *arena);
+void *xtcas_arena_alloc(arena_t *arena, size_t sz);
+void xtcas_arena_reset(arena_t *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _XTCAS_ARENA_H_ */
@@ -0,0 +1,1138 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+*/
+/*
+ * Copyright 2025 Saso Kiselkov. All rights reserved.
+ */
+
+/*
+ * TCAS pipeline scaling benchmark. For every requested contact count, a
+ * cloud of that many aircraft is synthesized around our aircraft and the
+ * TCAS core is stepped through it in synchronous mode, one cycle per
+ * simulated second. The results are printed to stdout as JSON:
+ *
+ *	{ "threads": <n>, "density": <ac/NM^2> | "radius_nm": <NM>,
+ *	  "encounter_ratio": <r>, "input_op": "fill" | "get",
+ *	  "cycles": <n>, "seed": <n>, "ra_eval": "<impl>",
+ *	  "runs": [ { "contacts": <n>, "radius_nm": <NM>,
+ *	    "max_tracked": <n>, "max_RA_cands": <n>,
+ *	    "step_ns": { "avg": <ns>, "p50": <ns>, "p99": <ns>, "max": <ns> },
+ *	    "ns_per_contact": <ns>, "allocs_per_cycle": <n>,
+ *	    "rerun_allocs": <n>, "input_op": { "allocs_per_cycle": <n>,
+ *	      "ns": { "min": <ns>, "avg": <ns>, "max": <ns> } },
+ *	    "lock_hold_ns": { "<lock>": { "min": <ns>, "avg": <ns>,
+ *	      "max": <ns> }, ... },
+ *	    "stages": { "<stage>": { "avg_ns": <ns>, "p99_ns": <ns>,
+ *	      "max_ns": <ns> }, ... } }, ... ] }
+ *
+ * step_ns is the duration of the entire xtcas_ctx_step call, as measured
+ * by us. The stages are the TCAS core's own timing statistics (see
+ * xtcas_get_timing), plus "collect", which covers update_my_position,
+ * update_bogie_positions and the copy into the worker's snapshot. Their
+ * p99 values are only accurate to within a factor of 2. lock_hold_ns are
+ * the hold times of the locks shared by the collector and the worker,
+ * acf_lock for every collection and snap_lock for every snapshot swap
+ * (see xtcas_timing_t).
+ *
+ * The positions of the other aircraft are handed to the core with the
+ * fill_oth_acf_pos input op, or with get_oth_acf_pos given -g. input_op
+ * has the heap allocations our side of the op makes and how long it
+ * takes. In a real host, that is how long the host's own position lock
+ * is held.
+ *
+ * allocs_per_cycle counts the core's heap allocations, which only happen
+ * while its buffers grow to fit the traffic. To check that the cycle
+ * itself doesn't allocate, the measured cycles are then run again over
+ * the same traffic, and any heap allocation in that rerun (rerun_allocs)
+ * is reported on stderr and makes us exit with status 1.
+ *
+ * The aircraft are spread uniformly over a disc centered on our aircraft,
+ * whose radius is chosen to give the requested density (or set with -r,
+ * in which case the density follows from the contact count), within
+ * 5000 ft of our altitude. An aircraft leaving the disc is replaced by a
+ * new one on the opposite side. The encounter ratio is the fraction of
+ * aircraft which are set up to pass within 500m and 300 ft of us 15-45
+ * seconds into the future. Once an encounter is over, the aircraft is
+ * replaced by a new encounter, so the mix stays the same throughout the
+ * run.
+ *
+ * With -K, the vectorized kernels are instead cross-checked against the
+ * scalar ones and timed, on a mix of degenerate cases and random
+ * traffic for the CPA kernels and random RA evaluation setups with up to
+ * 8 threats. Every kernel available on this machine must reproduce the
+ * scalar kernel's results bit for bit. Mismatches are reported on
+ * stderr and make us exit with status 1. The results are printed as:
+ *
+ *	{ "cpa": { "contacts": <n>, "impl": "<default kernel>",
+ *	  "kernels": [ { "kernel": "<name>", "mismatches": <n>,
+ *	  "ns_per_contact": <ns> }, ... ] },
+ *	  "ra_eval": { "setups": <n>, "candidates": <n>,
+ *	  "impl": "<default kernel>", "kernels": [ { "kernel": "<name>",
+ *	  "mismatches": <n>, "ns_per_pass": { "<threats>": <ns>, ... } },
+ *	  ... ] },
+ *	  "pos": { "tracks": <n>, "updates": <n>,
+ *	  "ns_per_update": { "<interval>": <ns>, ... } },
+ *	  "proj": { "cycles": <n>, "ns_per_cycle": { "<contacts>":
+ *	  { "rebuilt": <ns>, "reused": <ns> }, ... } } }
+ *
+ * ns_per_pass is the time to evaluate a full RA table against 2 to 8
+ * RA threats. ns_per_update is the time the position tracker takes for
+ * one position update of a contact plus reading its trend (gs, track,
+ * vertical speed and its rate), at update intervals of 1 and 0.1 s.
+ * ns_per_cycle is the time to project our own and 64, 1000 and 10000
+ * contacts' positions into the flat projection the core works in, with
+ * the projection rebuilt around us for every cycle and with it reused
+ * (the core only rebuilds it every nautical mile).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if	IBM
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include <acfutils/assert.h>
+#include <acfutils/log.h>
+#include <acfutils/safe_alloc.h>
+
+#include "cpa.h"
+#include "dbg_log.h"
+#include "pos.h"
+#include "ra_eval.h"
+#include "xtcas.h"
+
+#define	DFL_CYCLES	100
+#define	DFL_WARMUP	10
+#define	DFL_DENSITY	0.25		/* aircraft per square NM */
+#define	DFL_ENC_RATIO	0.05
+#define	STEP_T		1.0		/* seconds per cycle */
+#define	REF_LAT		45.0		/* where we start */
+#define	REF_LON		15.0
+#define	MY_ALT		FEET2MET(10000)
+#define	MY_SPD		KT2MPS(250)
+#define	ALT_SPREAD	FEET2MET(5000)
+#define	ENC_MIN_T	15.0		/* time to the encounter's CPA */
+#define	ENC_MAX_T	45.0
+#define	ENC_MISS_H	500.0		/* max miss distance, meters */
+#define	ENC_MISS_V	FEET2MET(300)
+#define	ENC_AFTER_T	20.0		/* replaced this long after CPA */
+#define	M_PER_DEG	NM2MET(60)
+#define	KERN_CONTACTS	1023		/* odd, to exercise the remainders */
+#define	KERN_REPS	10000
+#define	KERN_SETUPS	10000		/* RA evaluation setups checked */
+#define	KERN_MAX_THREATS 8
+#define	KERN_RA_CANDS	26		/* NUM_RA_INFOS in xtcas.c */
+#define	KERN_POS_UPDS	100		/* position updates per track */
+#define	KERN_PROJ_CYCLES 100
+#define	MY_POS		VECT3(0, 0, MY_ALT)	/* for the kernel checks */
+#define	MY_VEL		VECT3(0, MY_SPD, 0)
+
+/*
+ * Synthetic aircraft, in meters east/north of REF_LAT/REF_LON.
+ */
+typedef struct {
+	uintptr_t	id;
+	double		x, y, z;
+	double		vx, vy, vz;
+	bool_t		enc;
+	double		enc_t;		/* time of the encounter's CPA */
+} bench_acf_t;
+
+static const size_t dfl_counts[] = { 16, 64, 256, 1024, 4096, 16384 };
+static const char *const kernels[] = { "scalar", "sse2", "avx2" };
+
+static uint64_t		rng_state;
+static double		sim_t;
+static double		my_y;		/* we fly north along x = 0 */
+static bench_acf_t	*acf = NULL;
+static size_t		num_acf = 0;
+static uintptr_t	next_id = 1;
+static double		radius;		/* meters */
+static double		enc_ratio = DFL_ENC_RATIO;
+
+/* world state saved by world_save */
+static struct {
+	uint64_t	rng_state;
+	double		sim_t;
+	double		my_y;
+	bench_acf_t	*acf;
+	uintptr_t	next_id;
+} saved = { .acf = NULL };
+
+/*
+ * Host side of the input op which hands over the other aircraft's
+ * positions: fill_oth_acf_pos, or get_oth_acf_pos with -g.
+ */
+typedef struct {
+	uint64_t	num_calls;
+	uint64_t	min_ns;
+	uint64_t	max_ns;
+	uint64_t	total_ns;
+	uint64_t	num_allocs;
+} in_op_stats_t;
+
+static bool_t		use_get_op = B_FALSE;
+static in_op_stats_t	in_op;
+
+static void get_my_acf_pos(void *handle, geo_pos3_t *pos, double *alt_agl,
+    double *hdg, bool_t *gear_ext, bool_t *on_ground);
+static void get_oth_acf_pos(void *handle, acf_pos_t **pos_p, size_t *num);
+static size_t fill_oth_acf_pos(void *handle, acf_pos_t *pos_out,
+    size_t cap);
+static void update_contact(void *handle, void *acf_id, double rbrg,
+    double rdist, double ralt, double vs, double trk, double gs,
+    tcas_threat_t level);
+static void delete_contact(void *handle, void *acf_id);
+static void update_RA(void *handle, tcas_adv_t adv, tcas_msg_t msg,
+    tcas_RA_type_t type, tcas_RA_sense_t sense, bool_t crossing,
+    bool_t reversal, double min_sep_cpa, double min_green, double max_green,
+    double min_red_lo, double max_red_lo, double min_red_hi, double max_red_hi);
+
+static const sim_intf_input_ops_t bench_in_ops = {
+	.handle = NULL,
+	.get_my_acf_pos = get_my_acf_pos,
+	.fill_oth_acf_pos = fill_oth_acf_pos
+};
+
+static const sim_intf_input_ops_t bench_get_in_ops = {
+	.handle = NULL,
+	.get_my_acf_pos = get_my_acf_pos,
+	.get_oth_acf_pos = get_oth_acf_pos
+};
+
+static const sim_intf_output_ops_t bench_out_ops = {
+	.handle = NULL,
+	.update_contact = update_contact,
+	.delete_contact = delete_contact,
+	.update_RA = update_RA
+};
+
+static void
+lib_log_func(const char *str)
+{
+	fputs(str, stderr);
+}
+
+static uint64_t
+nanoclock(void)
+{
+#if	IBM
+	LARGE_INTEGER val, freq;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&val);
+	return ((val.QuadPart / freq.QuadPart) * 1000000000llu +
+	    ((val.QuadPart % freq.QuadPart) * 1000000000llu) / freq.QuadPart);
+#else	/* !IBM */
+	struct timespec ts;
+
+	VERIFY0(clock_gettime(CLOCK_MONOTONIC, &ts));
+	return ((uint64_t)ts.tv_sec * 1000000000llu + ts.tv_nsec);
+#endif	/* !IBM */
+}
+
+/*
+ * xorshift64* generator, so that the clouds are the same on every
+ * platform for a given seed.
+ */
+static double
+rnd(double min, double max)
+{
+	uint64_t x = rng_state;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	rng_state = x;
+	x *= 0x2545F4914F6CDD1Dllu;
+
+	return (min + (max - min) * ((x >> 11) * (1.0 / (1llu << 53))));
+}
+
+/*
+ * Sets up `a' as a new aircraft. Encounter aircraft are placed such that
+ * they pass close to us at `enc_t', everything else is placed randomly
+ * in the disc around us.
+ */
+static void
+acf_spawn(bench_acf_t *a, bool_t enc)
+{
+	double hdg = rnd(0, 2 * M_PI);
+	double spd = KT2MPS(rnd(150, 300));
+
+	a->id = next_id++;
+	a->enc = enc;
+	a->vx = spd * sin(hdg);
+	a->vy = spd * cos(hdg);
+	if (enc) {
+		double t = rnd(ENC_MIN_T, ENC_MAX_T);
+		double miss = rnd(-ENC_MISS_H, ENC_MISS_H);
+
+		/* fly back from the CPA along our relative velocity */
+		a->enc_t = sim_t + t;
+		a->x = miss * cos(hdg) - a->vx * t;
+		a->y = my_y + MY_SPD * t - miss * sin(hdg) - a->vy * t;
+		a->vz = FPM2MPS(rnd(-1000, 1000));
+		a->z = MY_ALT + rnd(-ENC_MISS_V, ENC_MISS_V) - a->vz * t;
+	} else {
+		double r = radius * sqrt(rnd(0, 1));
+		double ang = rnd(0, 2 * M_PI);
+
+		a->x = r * sin(ang);
+		a->y = my_y + r * cos(ang);
+		a->z = MY_ALT + rnd(-ALT_SPREAD, ALT_SPREAD);
+		a->vz = FPM2MPS(rnd(-500, 500));
+	}
+}
+
+static void
+world_init(size_t n, double density)
+{
+	radius = NM2MET(sqrt(n / (density * M_PI)));
+	sim_t = 0;
+	my_y = 0;
+	num_acf = n;
+	acf = safe_realloc(acf, n * sizeof (*acf));
+	for (size_t i = 0; i < n; i++)
+		acf_spawn(&acf[i], rnd(0, 1) < enc_ratio);
+}
+
+static void
+world_step(double dt)
+{
+	sim_t += dt;
+	my_y += MY_SPD * dt;
+	for (size_t i = 0; i < num_acf; i++) {
+		bench_acf_t *a = &acf[i];
+		double dx, dy;
+
+		a->x += a->vx * dt;
+		a->y += a->vy * dt;
+		a->z += a->vz * dt;
+		if (a->enc) {
+			if (sim_t > a->enc_t + ENC_AFTER_T)
+				acf_spawn(a, B_TRUE);
+			continue;
+		}
+		dx = a->x;
+		dy = a->y - my_y;
+		if (dx * dx + dy * dy > radius * radius ||
+		    fabs(a->z - MY_ALT) > ALT_SPREAD) {
+			/* re-enter on the opposite side */
+			a->id = next_id++;
+			a->x = -dx;
+			a->y = my_y - dy;
+			a->vz = -a->vz;
+		}
+	}
+}
+
+/*
+ * Saves the state of the world, so that world_restore can later rewind
+ * it and world_step replays the same traffic.
+ */
+static void
+world_save(void)
+{
+	saved.rng_state = rng_state;
+	saved.sim_t = sim_t;
+	saved.my_y = my_y;
+	saved.next_id = next_id;
+	saved.acf = safe_realloc(saved.acf, num_acf * sizeof (*acf));
+	memcpy(saved.acf, acf, num_acf * sizeof (*acf));
+}
+
+static void
+world_restore(void)
+{
+	rng_state = saved.rng_state;
+	sim_t = saved.sim_t;
+	my_y = saved.my_y;
+	next_id = saved.next_id;
+	memcpy(acf, saved.acf, num_acf * sizeof (*acf));
+}
+
+static geo_pos3_t
+acf_geo(double x, double y, double z)
+{
+	return (GEO_POS3(REF_LAT + y / M_PER_DEG, REF_LON + x /
+	    (M_PER_DEG * cos(DEG2RAD(REF_LAT))), z));
+}
+
+static int
+u64_compar(const void *a, const void *b)
+{
+	const uint64_t *ua = a, *ub = b;
+
+	if (*ua < *ub)
+		return (-1);
+	return (*ua > *ub);
+}
+
+static void
+print_stage(const char *name, const xtcas_stage_timing_t *st, bool_t last)
+{
+	printf("\t\t\t\t\"%s\": { \"avg_ns\": %llu, \"p99_ns\": %llu, "
+	    "\"max_ns\": %llu }%s\n", name, (unsigned long long)st->avg_ns,
+	    (unsigned long long)st->p99_ns, (unsigned long long)st->max_ns,
+	    last ? "" : ",");
+}
+
+static void
+print_hold(const char *name, const xtcas_stage_timing_t *st, bool_t last)
+{
+	printf("\t\t\t\t\"%s\": { \"min\": %llu, \"avg\": %llu, "
+	    "\"max\": %llu }%s\n", name, (unsigned long long)st->min_ns,
+	    (unsigned long long)st->avg_ns, (unsigned long long)st->max_ns,
+	    last ? "" : ",");
+}
+
+/*
+ * Runs the benchmark for one cloud of `n' aircraft and prints its JSON
+ * object. Afterwards, the measured cycles are run once more over the
+ * same traffic. By then, the core has grown all of its buffers to fit
+ * this traffic, so any heap allocation in the rerun happens in steady
+ * state. Returns the number of such allocations.
+ */
+static uint64_t
+run_bench(size_t n, double density, unsigned threads, unsigned warmup,
+    unsigned cycles, bool_t last)
+{
+	xtcas_ctx_t *ctx;
+	xtcas_timing_t tm, rerun_tm;
+	uint64_t *step_ns = safe_calloc(cycles, sizeof (*step_ns));
+	uint64_t total_ns = 0, allocs, rerun_allocs;
+	double t_off = cycles * STEP_T;
+	in_op_stats_t op;
+
+	world_init(n, density);
+	ctx = xtcas_ctx_create_sync(use_get_op ? &bench_get_in_ops :
+	    &bench_in_ops, &bench_out_ops);
+	xtcas_ctx_set_mode(ctx, TCAS_MODE_TARA);
+	if (threads != 0)
+		xtcas_ctx_set_threat_threads(ctx, threads);
+
+	for (unsigned i = 0; i < warmup; i++) {
+		world_step(STEP_T);
+		xtcas_ctx_step(ctx, sim_t);
+	}
+	xtcas_ctx_get_timing(ctx, &tm);
+	allocs = tm.num_allocs;
+	xtcas_ctx_reset_timing(ctx);
+	memset(&in_op, 0, sizeof (in_op));
+	world_save();
+
+	for (unsigned i = 0; i < cycles; i++) {
+		uint64_t start;
+
+		world_step(STEP_T);
+		start = nanoclock();
+		xtcas_ctx_step(ctx, sim_t);
+		step_ns[i] = nanoclock() - start;
+		total_ns += step_ns[i];
+	}
+	xtcas_ctx_get_timing(ctx, &tm);
+	/* every step should have run a cycle */
+	VERIFY3U(tm.num_cycles, ==, cycles);
+	op = in_op;
+
+	/*
+	 * The first cycle of the rerun swaps the contacts back to those at
+	 * the start of the run, so it gets to allocate.
+	 */
+	world_restore();
+	world_step(STEP_T);
+	xtcas_ctx_step(ctx, sim_t + t_off);
+	xtcas_ctx_get_timing(ctx, &rerun_tm);
+	rerun_allocs = rerun_tm.num_allocs;
+	for (unsigned i = 1; i < cycles; i++) {
+		world_step(STEP_T);
+		xtcas_ctx_step(ctx, sim_t + t_off);
+	}
+	xtcas_ctx_get_timing(ctx, &rerun_tm);
+	rerun_allocs = rerun_tm.num_allocs - rerun_allocs;
+	xtcas_ctx_destroy(ctx);
+
+	qsort(step_ns, cycles, sizeof (*step_ns), u64_compar);
+
+	printf("\t\t{\n");
+	printf("\t\t\t\"contacts\": %lu,\n", (unsigned long)n);
+	printf("\t\t\t\"radius_nm\": %.1f,\n", MET2NM(radius));
+	printf("\t\t\t\"max_tracked\": %u,\n", tm.max_contacts);
+	printf("\t\t\t\"max_RA_cands\": %u,\n", tm.max_RA_cands);
+	printf("\t\t\t\"step_ns\": { \"avg\": %llu, \"p50\": %llu, "
+	    "\"p99\": %llu, \"max\": %llu },\n",
+	    (unsigned long long)(total_ns / cycles),
+	    (unsigned long long)step_ns[cycles / 2],
+	    (unsigned long long)step_ns[(cycles * 99 + 99) / 100 - 1],
+	    (unsigned long long)step_ns[cycles - 1]);
+	printf("\t\t\t\"ns_per_contact\": %.1f,\n",
+	    (double)total_ns / cycles / n);
+	printf("\t\t\t\"allocs_per_cycle\": %.2f,\n",
+	    (double)(tm.num_allocs - allocs) / cycles);
+	printf("\t\t\t\"rerun_allocs\": %llu,\n",
+	    (unsigned long long)rerun_allocs);
+	printf("\t\t\t\"input_op\": { \"allocs_per_cycle\": %.2f, "
+	    "\"ns\": { \"min\": %llu, \"avg\": %llu, \"max\": %llu } },\n",
+	    (double)op.num_allocs / cycles, (unsigned long long)op.min_ns,
+	    (unsigned long long)(op.total_ns / MAX(op.num_calls, 1)),
+	    (unsigned long long)op.max_ns);
+	printf("\t\t\t\"lock_hold_ns\": {\n");
+	print_hold("acf_lock", &tm.acf_lock_hold, B_FALSE);
+	print_hold("snap_lock", &tm.snap_lock_hold, B_TRUE);
+	printf("\t\t\t},\n");
+	printf("\t\t\t\"stages\": {\n");
+	print_stage("collect", &tm.collect, B_FALSE);
+	for (int i = 0; i < XTCAS_NUM_STAGES; i++) {
+		print_stage(xtcas_stage2str(i), &tm.stages[i],
+		    i + 1 == XTCAS_NUM_STAGES);
+	}
+	printf("\t\t\t}\n");
+	printf("\t\t}%s\n", last ? "" : ",");
+	fflush(stdout);
+
+	free(step_ns);
+
+	return (rerun_allocs);
+}
+
+/*
+ * Fills `soa' with the kernel cross-check contacts: first the degenerate
+ * cases from cpa_cases, twice in a row so that they land in different
+ * vector lanes, then random traffic around us.
+ */
+static void
+cpa_fill(cpa_soa_t *soa, size_t n)
+{
+	/* x, y, z relative to MY_POS, then vx, vy, vz */
+	static const double cpa_cases[][6] = {
+	    { 3000, -2000, 100, 0, MY_SPD, 0 },	/* no relative motion */
+	    { 0, 0, 0, 0, MY_SPD, 0 },		/* ...and collocated */
+	    { 0, 0, 0, 50, 20, 5 },		/* collocated, moving */
+	    { 0, 1000, 0, 0, 2 * MY_SPD, 0 },	/* CPA in the past */
+	    { 0, 2000, 0, 0, MY_SPD - 200, 0 },	/* CPA at exactly 10s */
+	    { 0, 1999.999, 0, 0, MY_SPD - 200, 0 }, /* CPA just before 10s */
+	    { 0, -1e6, 0, 0, MY_SPD + 1e-12, 0 }, /* CPA beyond 2^52 s */
+	    { 0, 0, -600, 0, MY_SPD, 10 },	/* vertical closure only */
+	    { 5, 5, 5, -0.0, MY_SPD, -0.0 }	/* negative zero velocity */
+	};
+	const size_t num_cases = ARRAY_NUM_ELEM(cpa_cases);
+
+	VERIFY3U(n, >=, 2 * num_cases);
+	(void) xtcas_cpa_soa_reserve(soa, n);
+	soa->n = n;
+	for (size_t i = 0; i < n; i++) {
+		if (i < 2 * num_cases) {
+			const double *c = cpa_cases[i % num_cases];
+
+			soa->x[i] = MY_POS.x + c[0];
+			soa->y[i] = MY_POS.y + c[1];
+			soa->z[i] = MY_POS.z + c[2];
+			soa->vx[i] = c[3];
+			soa->vy[i] = c[4];
+			soa->vz[i] = c[5];
+		} else {
+			double hdg = rnd(0, 2 * M_PI);
+			double spd = KT2MPS(rnd(0, 500));
+
+			soa->x[i] = rnd(-NM2MET(20), NM2MET(20));
+			soa->y[i] = rnd(-NM2MET(20), NM2MET(20));
+			soa->z[i] = MY_ALT + rnd(-ALT_SPREAD, ALT_SPREAD);
+			soa->vx[i] = spd * sin(hdg);
+			soa->vy[i] = spd * cos(hdg);
+			soa->vz[i] = FPM2MPS(rnd(-6000, 6000));
+		}
+	}
+}
+
+/*
+ * Cross-checks the CPA kernels against the scalar one, which they must
+ * match bit for bit, and measures their speed. Returns the number of
+ * contacts for which any kernel's results differed.
+ */
+static size_t
+cpa_kernels(void)
+{
+	cpa_soa_t soa = { 0 };
+	size_t n = KERN_CONTACTS, mismatches = 0;
+	double *ref = safe_malloc(3 * n * sizeof (*ref));
+	bool_t first = B_TRUE;
+
+	cpa_fill(&soa, n);
+	VERIFY(xtcas_cpa_compute_impl(&soa, "scalar", MY_POS, MY_VEL));
+	memcpy(ref, soa.t, n * sizeof (*ref));
+	memcpy(&ref[n], soa.d_h, n * sizeof (*ref));
+	memcpy(&ref[2 * n], soa.d_v, n * sizeof (*ref));
+
+	printf("\t\"cpa\": { \"contacts\": %lu, \"impl\": \"%s\", "
+	    "\"kernels\": [\n", (unsigned long)n, xtcas_cpa_impl());
+	for (size_t k = 0; k < ARRAY_NUM_ELEM(kernels); k++) {
+		size_t bad = 0;
+		uint64_t start;
+
+		memset(soa.t, 0, n * sizeof (*soa.t));
+		if (!xtcas_cpa_compute_impl(&soa, kernels[k], MY_POS, MY_VEL))
+			continue;
+		for (size_t i = 0; i < n; i++) {
+			if (memcmp(&soa.t[i], &ref[i], sizeof (double)) != 0 ||
+			    memcmp(&soa.d_h[i], &ref[n + i],
+			    sizeof (double)) != 0 ||
+			    memcmp(&soa.d_v[i], &ref[2 * n + i],
+			    sizeof (double)) != 0) {
+				fprintf(stderr, "cpa %s: contact %lu differs: "
+				    "t %g/%g d_h %g/%g d_v %g/%g\n",
+				    kernels[k], (unsigned long)i, soa.t[i],
+				    ref[i], soa.d_h[i], ref[n + i],
+				    soa.d_v[i], ref[2 * n + i]);
+				bad++;
+			}
+		}
+		mismatches += bad;
+
+		start = nanoclock();
+		for (unsigned r = 0; r < KERN_REPS; r++) {
+			(void) xtcas_cpa_compute_impl(&soa, kernels[k],
+			    MY_POS, MY_VEL);
+		}
+		printf("%s\t\t{ \"kernel\": \"%s\", \"mismatches\": %lu, "
+		    "\"ns_per_contact\": %.2f }", first ? "" : ",\n",
+		    kernels[k], (unsigned long)bad,
+		    (double)(nanoclock() - start) / KERN_REPS / n);
+		first = B_FALSE;
+	}
+	printf("\n\t] }");
+
+	xtcas_cpa_soa_free(&soa);
+	free(ref);
+
+	return (mismatches);
+}
+
+/*
+ * Picks one of the values in `vals' at random.
+ */
+static double
+rnd_pick(const double *vals, size_t n)
+{
+	return (vals[MIN((size_t)rnd(0, n), n - 1)]);
+}
+
+/*
+ * Sets up `ev' for `n_cpas' RA CPAs at `t' and `z' and `n_cands' random
+ * candidates. Besides random values, the CPAs and candidates are often
+ * given degenerate ones: CPAs right now or before the reaction delay is
+ * over, VS bands starting or ending at our current VS (no maneuver) and
+ * no reaction delay.
+ */
+static void
+ra_eval_fill(ra_eval_t *ev, double *t, double *z, double *sep,
+    size_t n_cpas, size_t n_cands)
+{
+	static const double cpa_ts[] = { 0, 1, 2.5, 5, 12, 25, 40 };
+	static const double delays[] = { 0, 2.5, 5 };
+	/* 1/4 g and 1/3 g, like the initial and subsequent RAs */
+	static const double accels[] = { 9.81 / 4, 9.81 / 3 };
+	double vvel = FPM2MPS(rnd_pick((const double[]){ -2000, 0, 1500 },
+	    3) + round(rnd(-100, 100)) * 10);
+
+	for (size_t j = 0; j < n_cpas; j++) {
+		t[j] = (rnd(0, 1) < 0.5 ? rnd_pick(cpa_ts,
+		    ARRAY_NUM_ELEM(cpa_ts)) : rnd(0, 40));
+		z[j] = MY_ALT + rnd(-FEET2MET(1000), FEET2MET(1000));
+	}
+	xtcas_ra_eval_begin(ev, MY_ALT, vvel, roundmul(vvel, FPM2MPS(100)),
+	    t, z, n_cpas, sep);
+	for (size_t i = 0; i < n_cands; i++) {
+		double lo = FPM2MPS(rnd(-6000, 6000));
+		double hi = lo + FPM2MPS(rnd(0, 6000));
+
+		if (rnd(0, 1) < 0.25)
+			lo = vvel;
+		if (rnd(0, 1) < 0.25)
+			hi = MAX(vvel, lo);
+		(void) xtcas_ra_eval_add(ev, MIN((int)rnd(0, 3), RA_EVAL_DOWN),
+		    lo, hi, rnd_pick(delays, ARRAY_NUM_ELEM(delays)),
+		    rnd_pick(accels, ARRAY_NUM_ELEM(accels)));
+	}
+}
+
+/*
+ * Cross-checks the RA evaluation kernels against the scalar one, which
+ * they must match bit for bit, on KERN_SETUPS random setups of 0 to
+ * KERN_MAX_THREATS RA CPAs and 1 to RA_EVAL_MAX_CANDS candidates.
+ * Then times a pass over a full RA table (KERN_RA_CANDS candidates) for
+ * 2 to KERN_MAX_THREATS threats. Returns the number of mismatching setups.
+ */
+static size_t
+ra_eval_kernels(void)
+{
+	static ra_eval_t ev, ref;
+	double t[KERN_MAX_THREATS], z[KERN_MAX_THREATS];
+	double sep[KERN_MAX_THREATS * RA_EVAL_MAX_CANDS];
+	double ref_sep[KERN_MAX_THREATS * RA_EVAL_MAX_CANDS];
+	size_t bad[ARRAY_NUM_ELEM(kernels)] = { 0 }, mismatches = 0;
+	bool_t avail[ARRAY_NUM_ELEM(kernels)];
+	bool_t first = B_TRUE;
+
+	for (size_t k = 0; k < ARRAY_NUM_ELEM(kernels); k++) {
+		ev.n_cands = 0;
+		avail[k] = xtcas_ra_eval_compute_impl(&ev, kernels[k]);
+	}
+	for (unsigned s = 0; s < KERN_SETUPS; s++) {
+		size_t n_cpas = MIN((size_t)rnd(0, KERN_MAX_THREATS + 1),
+		    KERN_MAX_THREATS);
+		size_t n_cands = MIN((size_t)rnd(1, RA_EVAL_MAX_CANDS + 1),
+		    RA_EVAL_MAX_CANDS);
+		size_t sep_sz = n_cpas * RA_EVAL_MAX_CANDS * sizeof (*sep);
+
+		ra_eval_fill(&ev, t, z, sep, n_cpas, n_cands);
+		VERIFY(xtcas_ra_eval_compute_impl(&ev, "scalar"));
+		ref = ev;
+		memcpy(ref_sep, sep, sep_sz);
+		for (size_t k = 1; k < ARRAY_NUM_ELEM(kernels); k++) {
+			bool_t same = B_TRUE;
+
+			if (!avail[k])
+				continue;
+			memset(ev.min_sep, 0, sizeof (ev.min_sep));
+			memset(sep, 0, sep_sz);
+			VERIFY(xtcas_ra_eval_compute_impl(&ev, kernels[k]));
+			same = (memcmp(ev.min_sep, ref.min_sep, n_cands *
+			    sizeof (*ev.min_sep)) == 0);
+			for (size_t j = 0; j < n_cpas; j++) {
+				same &= (memcmp(&RA_EVAL_SEP(&ev, 0, j),
+				    &ref_sep[j * RA_EVAL_MAX_CANDS], n_cands *
+				    sizeof (*sep)) == 0);
+			}
+			if (!same) {
+				fprintf(stderr, "ra_eval %s: setup %u "
+				    "differs (%lu CPAs, %lu candidates)\n",
+				    kernels[k], s, (unsigned long)n_cpas,
+				    (unsigned long)n_cands);
+				bad[k]++;
+			}
+		}
+	}
+
+	printf("\t\"ra_eval\": { \"setups\": %d, \"candidates\": %d, "
+	    "\"impl\": \"%s\", \"kernels\": [\n", KERN_SETUPS, KERN_RA_CANDS,
+	    xtcas_ra_eval_impl());
+	for (size_t k = 0; k < ARRAY_NUM_ELEM(kernels); k++) {
+		if (!avail[k])
+			continue;
+		mismatches += bad[k];
+		printf("%s\t\t{ \"kernel\": \"%s\", \"mismatches\": %lu, "
+		    "\"ns_per_pass\": {", first ? "" : ",\n", kernels[k],
+		    (unsigned long)bad[k]);
+		for (size_t n = 2; n <= KERN_MAX_THREATS; n++) {
+			uint64_t start;
+
+			ra_eval_fill(&ev, t, z, NULL, n, KERN_RA_CANDS);
+			start = nanoclock();
+			for (unsigned r = 0; r < KERN_REPS; r++) {
+				(void) xtcas_ra_eval_compute_impl(&ev,
+				    kernels[k]);
+			}
+			printf("%s \"%lu\": %.1f", n > 2 ? "," : "",
+			    (unsigned long)n,
+			    (double)(nanoclock() - start) / KERN_REPS);
+		}
+		printf(" } }");
+		first = B_FALSE;
+	}
+	printf("\n\t] }");
+
+	return (mismatches);
+}
+
+/*
+ * Times the position tracker on KERN_CONTACTS random tracks, each fed
+ * KERN_POS_UPDS updates. The trend getters are called after every update,
+ * the same way the core does it for every contact.
+ */
+static void
+pos_updates(void)
+{
+	static const double intervals[] = { 1.0, 0.1 };
+	size_t n = KERN_CONTACTS;
+	obj_pos_t *pos = safe_malloc(n * sizeof (*pos));
+	geo_pos3_t *upd = safe_malloc(n * KERN_POS_UPDS * sizeof (*upd));
+	bench_acf_t *a = safe_calloc(n, sizeof (*a));
+	double sink = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		a[i].x = rnd(-NM2MET(20), NM2MET(20));
+		a[i].y = rnd(-NM2MET(20), NM2MET(20));
+		a[i].z = MY_ALT + rnd(-ALT_SPREAD, ALT_SPREAD);
+		a[i].vx = rnd(-MY_SPD, MY_SPD);
+		a[i].vy = rnd(-MY_SPD, MY_SPD);
+		a[i].vz = FPM2MPS(rnd(-3000, 3000));
+	}
+
+	printf("\t\"pos\": { \"tracks\": %lu, \"updates\": %d, "
+	    "\"ns_per_update\": {", (unsigned long)n, KERN_POS_UPDS);
+	for (size_t k = 0; k < ARRAY_NUM_ELEM(intervals); k++) {
+		uint64_t start;
+
+		for (size_t i = 0; i < n; i++) {
+			for (unsigned u = 0; u < KERN_POS_UPDS; u++) {
+				double t = u * intervals[k];
+
+				upd[i * KERN_POS_UPDS + u] = acf_geo(
+				    a[i].x + a[i].vx * t, a[i].y + a[i].vy * t,
+				    a[i].z + a[i].vz * t);
+			}
+		}
+		memset(pos, 0, n * sizeof (*pos));
+
+		start = nanoclock();
+		for (unsigned u = 0; u < KERN_POS_UPDS; u++) {
+			for (size_t i = 0; i < n; i++) {
+				double gs, trk, vvel, d_vvel;
+
+				xtcas_obj_pos_update(&pos[i],
+				    u * intervals[k],
+				    upd[i * KERN_POS_UPDS + u], -1);
+				if (xtcas_obj_pos_get_gs(&pos[i], &gs) &&
+				    xtcas_obj_pos_get_trk(&pos[i], &trk) &&
+				    xtcas_obj_pos_get_vvel(&pos[i], &vvel,
+				    &d_vvel))
+					sink += gs + trk + vvel + d_vvel;
+			}
+		}
+		printf("%s \"%g\": %.1f", k > 0 ? "," : "", intervals[k],
+		    (double)(nanoclock() - start) / (n * KERN_POS_UPDS));
+	}
+	printf(" } }");
+	/* keeps the getters' results from being optimized away */
+	VERIFY(!isnan(sink));
+
+	free(pos);
+	free(upd);
+	free(a);
+}
+
+/*
+ * Times the projection of our own and all contacts' positions into a
+ * flat projection centered on us, once rebuilding it every cycle and
+ * once reusing it.
+ */
+static void
+proj_cycles(void)
+{
+	static const size_t counts[] = { 64, 1000, 10000 };
+	double sink = 0;
+
+	printf("\t\"proj\": { \"cycles\": %d, \"ns_per_cycle\": {",
+	    KERN_PROJ_CYCLES);
+	for (size_t c = 0; c < ARRAY_NUM_ELEM(counts); c++) {
+		size_t n = counts[c];
+		geo_pos2_t *pos = safe_malloc(n * sizeof (*pos));
+		uint64_t ns[2];
+
+		for (size_t i = 0; i < n; i++) {
+			pos[i] = GEO3_TO_GEO2(acf_geo(rnd(-NM2MET(40),
+			    NM2MET(40)), rnd(-NM2MET(40), NM2MET(40)), 0));
+		}
+		for (int reuse = 0; reuse < 2; reuse++) {
+			fpp_t fpp = ortho_fpp_init(GEO3_TO_GEO2(acf_geo(0, 0,
+			    0)), 0, &wgs84, B_FALSE);
+			uint64_t start = nanoclock();
+
+			for (unsigned r = 0; r < KERN_PROJ_CYCLES; r++) {
+				geo_pos2_t me = GEO3_TO_GEO2(acf_geo(0,
+				    r * MY_SPD, 0));
+
+				if (!reuse)
+					fpp = ortho_fpp_init(me, 0, &wgs84,
+					    B_FALSE);
+				sink += geo2fpp(me, &fpp).y;
+				for (size_t i = 0; i < n; i++)
+					sink += geo2fpp(pos[i], &fpp).x;
+			}
+			ns[reuse] = (nanoclock() - start) / KERN_PROJ_CYCLES;
+		}
+		printf("%s \"%lu\": { \"rebuilt\": %llu, \"reused\": %llu }",
+		    c > 0 ? "," : "", (unsigned long)n,
+		    (unsigned long long)ns[0], (unsigned long long)ns[1]);
+		free(pos);
+	}
+	printf(" } }");
+	VERIFY(!isnan(sink));
+}
+
+/*
+ * Parses a comma-separated list of contact counts.
+ */
+static size_t
+parse_counts(char *str, size_t **counts)
+{
+	size_t n = 0;
+
+	for (char *tok = strtok(str, ","); tok != NULL;
+	    tok = strtok(NULL, ",")) {
+		long val = atol(tok);
+
+		if (val <= 0)
+			return (0);
+		*counts = safe_realloc(*counts, (n + 1) * sizeof (**counts));
+		(*counts)[n++] = val;
+	}
+
+	return (n);
+}
+
+int
+main(int argc, char **argv)
+{
+	int opt;
+	size_t *counts = NULL;
+	size_t num_counts = 0;
+	int cycles = DFL_CYCLES;
+	int warmup = DFL_WARMUP;
+	int threads = 0;
+	double density = DFL_DENSITY;
+	double radius_nm = 0;
+	unsigned long long seed = 1;
+	bool_t kern = B_FALSE;
+	bool_t failed = B_FALSE;
+
+	log_init(lib_log_func, "xtcas_bench");
+
+	while ((opt = getopt(argc, argv, "n:c:w:D:r:e:gT:s:Kd")) != -1) {
+		switch (opt) {
+		case 'n':
+			num_counts = parse_counts(optarg, &counts);
+			if (num_counts == 0) {
+				fprintf(stderr, "Invalid options, -n expects "
+				    "a list of positive numbers.\n");
+				return (1);
+			}
+			break;
+		case 'c':
+			cycles = atoi(optarg);
+			break;
+		case 'w':
+			warmup = atoi(optarg);
+			break;
+		case 'D':
+			density = atof(optarg);
+			break;
+		case 'r':
+			radius_nm = atof(optarg);
+			break;
+		case 'e':
+			enc_ratio = atof(optarg);
+			break;
+		case 'g':
+			use_get_op = B_TRUE;
+			break;
+		case 'T':
+			threads = atoi(optarg);
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'K':
+			kern = B_TRUE;
+			break;
+		case 'd':
+			xtcas_dbg.all++;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n <contacts>[,...]] "
+			    "[-c <cycles>] [-w <warmup_cycles>] "
+			    "[-D <density> | -r <radius_nm>] "
+			    "[-e <encounter_ratio>] [-g] "
+			    "[-T <threads>] [-s <seed>] [-K] [-d]\n",
+			    argv[0]);
+			return (1);
+		}
+	}
+	if (cycles < 1 || warmup < 0 || density <= 0 || radius_nm < 0 ||
+	    enc_ratio < 0 || enc_ratio > 1 || threads < 0 || seed == 0) {
+		fprintf(stderr, "Invalid options, -c, -D and -r must be "
+		    "greater than zero, -e must be within 0 and 1 and -s must "
+		    "not be zero.\n");
+		return (1);
+	}
+	if (counts == NULL) {
+		num_counts = ARRAY_NUM_ELEM(dfl_counts);
+		counts = safe_malloc(sizeof (dfl_counts));
+		memcpy(counts, dfl_counts, sizeof (dfl_counts));
+	}
+	rng_state = seed;
+
+	if (kern) {
+		size_t mismatches;
+
+		printf("{\n");
+		mismatches = cpa_kernels();
+		printf(",\n");
+		mismatches += ra_eval_kernels();
+		printf(",\n");
+		pos_updates();
+		printf(",\n");
+		proj_cycles();
+		printf("\n}\n");
+		free(counts);
+		return (mismatches != 0);
+	}
+
+	printf("{\n");
+	printf("\t\"threads\": %d,\n", threads);
+	if (radius_nm != 0)
+		printf("\t\"radius_nm\": %g,\n", radius_nm);
+	else
+		printf("\t\"density\": %g,\n", density);
+	printf("\t\"encounter_ratio\": %g,\n", enc_ratio);
+	printf("\t\"input_op\": \"%s\",\n", use_get_op ? "get" : "fill");
+	printf("\t\"cycles\": %d,\n", cycles);
+	printf("\t\"seed\": %llu,\n", seed);
+	printf("\t\"ra_eval\": \"%s\",\n", xtcas_ra_eval_impl());
+	printf("\t\"runs\": [\n");
+	for (size_t i = 0; i < num_counts; i++) {
+		uint64_t allocs;
+
+		fprintf(stderr, "%lu contacts...\n", (unsigned long)counts[i]);
+		if (radius_nm != 0)
+			density = counts[i] / (M_PI * POW2(radius_nm));
+		allocs = run_bench(counts[i], density, threads, warmup, cycles,
+		    i + 1 == num_counts);
+		if (allocs != 0) {
+			fprintf(stderr, "%lu contacts: %llu heap allocations "
+			    "in steady state\n", (unsigned long)counts[i],
+			    (unsigned long long)allocs);
+			failed = B_TRUE;
+		}
+	}
+	printf("\t]\n");
+	printf("}\n");
+
+	free(counts);
+	free(acf);
+	free(saved.acf);
+
+	return (failed);
+}
+
+static void
+get_my_acf_pos(void *handle, geo_pos3_t *pos, double *alt_agl, double *hdg,
+    bool_t *gear_ext, bool_t *on_ground)
+{
+	UNUSED(handle);
+	*pos = acf_geo(0, my_y, MY_ALT);
+	*alt_agl = MY_ALT;
+	*hdg = 0;
+	*gear_ext = B_FALSE;
+	*on_ground = B_FALSE;
+}
+
+static void
+in_op_done(uint64_t start)
+{
+	uint64_t ns = nanoclock() - start;
+
+	if (in_op.num_calls == 0 || ns < in_op.min_ns)
+		in_op.min_ns = ns;
+	in_op.max_ns = MAX(in_op.max_ns, ns);
+	in_op.total_ns += ns;
+	in_op.num_calls++;
+}
+
+static void
+fill_positions(acf_pos_t *pos_out, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		const bench_acf_t *a = &acf[i];
+
+		pos_out[i].acf_id = (void *)a->id;
+		pos_out[i].pos = acf_geo(a->x, a->y, a->z);
+		pos_out[i].on_ground = B_FALSE;
+	}
+}
+
+static void
+get_oth_acf_pos(void *handle, acf_pos_t **pos_p, size_t *num)
+{
+	uint64_t start = nanoclock();
+
+	UNUSED(handle);
+	*pos_p = safe_calloc(num_acf, sizeof (**pos_p));
+	in_op.num_allocs++;
+	fill_positions(*pos_p, num_acf);
+	*num = num_acf;
+	in_op_done(start);
+}
+
+static size_t
+fill_oth_acf_pos(void *handle, acf_pos_t *pos_out, size_t cap)
+{
+	uint64_t start = nanoclock();
+
+	UNUSED(handle);
+	fill_positions(pos_out, MIN(num_acf, cap));
+	in_op_done(start);
+
+	return (num_acf);
+}
+
+static void
+update_contact(void *handle, void *acf_id, double rbrg, double rdist,
+    double ralt, double vs, double trk, double gs, tcas_threat_t level)
+{
+	UNUSED(handle);
+	UNUSED(acf_id);
+	UNUSED(rbrg);
+	UNUSED(rdist);
+	UNUSED(ralt);
+	UNUSED(vs);
+	UNUSED(trk);
+	UNUSED(gs);
+	UNUSED(level);
+}
+
+static void
+delete_contact(void *handle, void *acf_id)
+{
+	UNUSED(handle);
+	UNUSED(acf_id);
+}
+
+static void
+update_RA(void *handle, tcas_adv_t adv, tcas_msg_t msg, tcas_RA_type_t type,
+    tcas_RA_sense_t sense, bool_t crossing, bool_t reversal, double min_sep_cpa,
+    double min_green, double max_green, double min_red_lo, double max_red_lo,
+    double min_red_hi, double max_red_hi)
+{
+	UNUSED(handle);
+	UNUSED(adv);
+	UNUSED(msg);
+	UNUSED(type);
+	UNUSED(sense);
+	UNUSED(crossing);
+	UNUSED(reversal);
+	UNUSED(min_sep_cpa);
+	UNUSED(min_green);
+	UNUSED(max_green);
+	UNUSED(min_red_lo);
+	UNUSED(max_red_lo);
+	UNUSED(min_red_hi);
+	UNUSED(max_red_hi);
+}
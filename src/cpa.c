@@ -0,0 +1,326 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+*/
+/*
+ * Copyright 2025 Saso Kiselkov. All rights reserved.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <acfutils/assert.h>
+#include <acfutils/helpers.h>
+#include <acfutils/safe_alloc.h>
+
+#include "cpa.h"
+
+/*
+ * The vectorized kernels need the GCC/Clang target attribute and runtime
+ * CPU feature detection. Everywhere else we only have the scalar kernel.
+ */
+#if	(defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define	CPA_X86_SIMD	1
+#include <immintrin.h>
+#else
+#define	CPA_X86_SIMD	0
+#endif
+
+#define	FLOOR_EXACT	4503599627370496.0	/* 2^52 */
+#define	CPA_SOA_NUM_ARRAYS	10
+
+/*
+ * Makes sure `soa' can hold `n' contacts. All arrays are carved out of a
+ * single allocation. Their contents aren't preserved when they have to be
+ * enlarged. Returns B_TRUE if they had to be reallocated.
+ */
+bool_t
+xtcas_cpa_soa_reserve(cpa_soa_t *soa, size_t n)
+{
+	size_t cap;
+	double *p;
+
+	if (n <= soa->cap)
+		return (B_FALSE);
+	cap = MAX(n, 2 * soa->cap);
+	CTASSERT(sizeof (*soa->idx) <= sizeof (double));
+	free(soa->buf);
+	soa->buf = safe_malloc(CPA_SOA_NUM_ARRAYS * cap * sizeof (double));
+	p = soa->buf;
+	soa->x = p;
+	soa->y = (p += cap);
+	soa->z = (p += cap);
+	soa->vx = (p += cap);
+	soa->vy = (p += cap);
+	soa->vz = (p += cap);
+	soa->t = (p += cap);
+	soa->d_h = (p += cap);
+	soa->d_v = (p += cap);
+	soa->idx = (size_t *)(p + cap);
+	soa->cap = cap;
+
+	return (B_TRUE);
+}
+
+void
+xtcas_cpa_soa_free(cpa_soa_t *soa)
+{
+	free(soa->buf);
+	memset(soa, 0, sizeof (*soa));
+}
+
+/*
+ * Computes the CPA of contacts [start, soa->n). See compute_CPAs in
+ * xtcas.c for a description of the math. The order of operations here
+ * is the reference which the vectorized kernels must reproduce exactly,
+ * so that all kernels produce bit-identical results.
+ */
+static void
+cpa_scalar(cpa_soa_t *soa, size_t start, vect3_t my_pos, vect3_t my_vel)
+{
+	for (size_t i = start; i < soa->n; i++) {
+		double rx = soa->x[i] - my_pos.x;
+		double ry = soa->y[i] - my_pos.y;
+		double rz = soa->z[i] - my_pos.z;
+		double rvx = soa->vx[i] - my_vel.x;
+		double rvy = soa->vy[i] - my_vel.y;
+		double rvz = soa->vz[i] - my_vel.z;
+		double t, dx, dy;
+
+		if (rvx != 0 || rvy != 0 || rvz != 0) {
+			t = floor((-(rx * rvx) - (ry * rvy) - (rz * rvz)) /
+			    (POW2(rvx) + POW2(rvy) + POW2(rvz)));
+			/*
+			 * If CPA is in the past, the current position is the
+			 * CPA.
+			 */
+			t = MAX(t, 0);
+		} else {
+			t = 0;
+		}
+		dx = (my_pos.x + my_vel.x * t) - (soa->x[i] + soa->vx[i] * t);
+		dy = (my_pos.y + my_vel.y * t) - (soa->y[i] + soa->vy[i] * t);
+		soa->t[i] = t;
+		soa->d_h[i] = sqrt(POW2(dx) + POW2(dy));
+		soa->d_v[i] = fabs((my_pos.z + my_vel.z * t) -
+		    (soa->z[i] + soa->vz[i] * t));
+	}
+}
+
+#if	CPA_X86_SIMD
+
+/*
+ * SSE2 has no rounding instruction, so floor() is done by adding and
+ * subtracting 2^52 (which rounds to the nearest integer) and correcting
+ * downward where that rounded up. This is only valid for x >= 0, which
+ * holds because we clamp to zero first. Values >= 2^52 are already
+ * integral and are passed through.
+ */
+__attribute__((target("sse2")))
+static inline __m128d
+floor_pos_sse2(__m128d x)
+{
+	const __m128d magic = _mm_set1_pd(FLOOR_EXACT);
+	__m128d r = _mm_sub_pd(_mm_add_pd(x, magic), magic);
+	__m128d big = _mm_cmpge_pd(x, magic);
+
+	r = _mm_sub_pd(r, _mm_and_pd(_mm_cmpgt_pd(r, x), _mm_set1_pd(1)));
+	return (_mm_or_pd(_mm_and_pd(big, x), _mm_andnot_pd(big, r)));
+}
+
+__attribute__((target("sse2")))
+static size_t
+cpa_sse2(cpa_soa_t *soa, vect3_t my_pos, vect3_t my_vel)
+{
+	const __m128d mpx = _mm_set1_pd(my_pos.x);
+	const __m128d mpy = _mm_set1_pd(my_pos.y);
+	const __m128d mpz = _mm_set1_pd(my_pos.z);
+	const __m128d mvx = _mm_set1_pd(my_vel.x);
+	const __m128d mvy = _mm_set1_pd(my_vel.y);
+	const __m128d mvz = _mm_set1_pd(my_vel.z);
+	const __m128d zero = _mm_setzero_pd();
+	const __m128d sign = _mm_set1_pd(-0.0);
+	size_t i;
+
+	for (i = 0; i + 2 <= soa->n; i += 2) {
+		__m128d x = _mm_loadu_pd(&soa->x[i]);
+		__m128d y = _mm_loadu_pd(&soa->y[i]);
+		__m128d z = _mm_loadu_pd(&soa->z[i]);
+		__m128d vx = _mm_loadu_pd(&soa->vx[i]);
+		__m128d vy = _mm_loadu_pd(&soa->vy[i]);
+		__m128d vz = _mm_loadu_pd(&soa->vz[i]);
+		__m128d rx = _mm_sub_pd(x, mpx);
+		__m128d ry = _mm_sub_pd(y, mpy);
+		__m128d rz = _mm_sub_pd(z, mpz);
+		__m128d rvx = _mm_sub_pd(vx, mvx);
+		__m128d rvy = _mm_sub_pd(vy, mvy);
+		__m128d rvz = _mm_sub_pd(vz, mvz);
+		__m128d num, den, still, t, dx, dy, dz;
+
+		num = _mm_sub_pd(_mm_sub_pd(_mm_xor_pd(_mm_mul_pd(rx, rvx),
+		    sign), _mm_mul_pd(ry, rvy)), _mm_mul_pd(rz, rvz));
+		den = _mm_add_pd(_mm_add_pd(_mm_mul_pd(rvx, rvx),
+		    _mm_mul_pd(rvy, rvy)), _mm_mul_pd(rvz, rvz));
+		still = _mm_and_pd(_mm_and_pd(_mm_cmpeq_pd(rvx, zero),
+		    _mm_cmpeq_pd(rvy, zero)), _mm_cmpeq_pd(rvz, zero));
+		/* max_pd returns the second operand on NaN, like MAX() */
+		t = floor_pos_sse2(_mm_max_pd(_mm_div_pd(num, den), zero));
+		t = _mm_andnot_pd(still, t);
+
+		dx = _mm_sub_pd(_mm_add_pd(mpx, _mm_mul_pd(mvx, t)),
+		    _mm_add_pd(x, _mm_mul_pd(vx, t)));
+		dy = _mm_sub_pd(_mm_add_pd(mpy, _mm_mul_pd(mvy, t)),
+		    _mm_add_pd(y, _mm_mul_pd(vy, t)));
+		dz = _mm_sub_pd(_mm_add_pd(mpz, _mm_mul_pd(mvz, t)),
+		    _mm_add_pd(z, _mm_mul_pd(vz, t)));
+
+		_mm_storeu_pd(&soa->t[i], t);
+		_mm_storeu_pd(&soa->d_h[i], _mm_sqrt_pd(_mm_add_pd(
+		    _mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy))));
+		_mm_storeu_pd(&soa->d_v[i], _mm_andnot_pd(sign, dz));
+	}
+
+	return (i);
+}
+
+__attribute__((target("avx2")))
+static size_t
+cpa_avx2(cpa_soa_t *soa, vect3_t my_pos, vect3_t my_vel)
+{
+	const __m256d mpx = _mm256_set1_pd(my_pos.x);
+	const __m256d mpy = _mm256_set1_pd(my_pos.y);
+	const __m256d mpz = _mm256_set1_pd(my_pos.z);
+	const __m256d mvx = _mm256_set1_pd(my_vel.x);
+	const __m256d mvy = _mm256_set1_pd(my_vel.y);
+	const __m256d mvz = _mm256_set1_pd(my_vel.z);
+	const __m256d zero = _mm256_setzero_pd();
+	const __m256d sign = _mm256_set1_pd(-0.0);
+	size_t i;
+
+	for (i = 0; i + 4 <= soa->n; i += 4) {
+		__m256d x = _mm256_loadu_pd(&soa->x[i]);
+		__m256d y = _mm256_loadu_pd(&soa->y[i]);
+		__m256d z = _mm256_loadu_pd(&soa->z[i]);
+		__m256d vx = _mm256_loadu_pd(&soa->vx[i]);
+		__m256d vy = _mm256_loadu_pd(&soa->vy[i]);
+		__m256d vz = _mm256_loadu_pd(&soa->vz[i]);
+		__m256d rx = _mm256_sub_pd(x, mpx);
+		__m256d ry = _mm256_sub_pd(y, mpy);
+		__m256d rz = _mm256_sub_pd(z, mpz);
+		__m256d rvx = _mm256_sub_pd(vx, mvx);
+		__m256d rvy = _mm256_sub_pd(vy, mvy);
+		__m256d rvz = _mm256_sub_pd(vz, mvz);
+		__m256d num, den, still, t, dx, dy, dz;
+
+		num = _mm256_sub_pd(_mm256_sub_pd(_mm256_xor_pd(
+		    _mm256_mul_pd(rx, rvx), sign), _mm256_mul_pd(ry, rvy)),
+		    _mm256_mul_pd(rz, rvz));
+		den = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(rvx, rvx),
+		    _mm256_mul_pd(rvy, rvy)), _mm256_mul_pd(rvz, rvz));
+		still = _mm256_and_pd(_mm256_and_pd(
+		    _mm256_cmp_pd(rvx, zero, _CMP_EQ_OQ),
+		    _mm256_cmp_pd(rvy, zero, _CMP_EQ_OQ)),
+		    _mm256_cmp_pd(rvz, zero, _CMP_EQ_OQ));
+		t = _mm256_round_pd(_mm256_max_pd(_mm256_div_pd(num, den),
+		    zero), _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+		t = _mm256_andnot_pd(still, t);
+
+		dx = _mm256_sub_pd(_mm256_add_pd(mpx, _mm256_mul_pd(mvx, t)),
+		    _mm256_add_pd(x, _mm256_mul_pd(vx, t)));
+		dy = _mm256_sub_pd(_mm256_add_pd(mpy, _mm256_mul_pd(mvy, t)),
+		    _mm256_add_pd(y, _mm256_mul_pd(vy, t)));
+		dz = _mm256_sub_pd(_mm256_add_pd(mpz, _mm256_mul_pd(mvz, t)),
+		    _mm256_add_pd(z, _mm256_mul_pd(vz, t)));
+
+		_mm256_storeu_pd(&soa->t[i], t);
+		_mm256_storeu_pd(&soa->d_h[i], _mm256_sqrt_pd(_mm256_add_pd(
+		    _mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy))));
+		_mm256_storeu_pd(&soa->d_v[i], _mm256_andnot_pd(sign, dz));
+	}
+
+	return (i);
+}
+
+#endif	/* CPA_X86_SIMD */
+
+/*
+ * Returns the name of the kernel which xtcas_cpa_compute will use on
+ * this machine.
+ */
+const char *
+xtcas_cpa_impl(void)
+{
+#if	CPA_X86_SIMD
+	if (__builtin_cpu_supports("avx2"))
+		return ("avx2");
+	if (__builtin_cpu_supports("sse2"))
+		return ("sse2");
+#endif
+	return ("scalar");
+}
+
+/*
+ * Computes t, d_h and d_v for all soa->n contacts in `soa'. `my_pos' and
+ * `my_vel' are our aircraft's position and velocity in the same fpp
+ * space as the contacts. The best kernel supported by the CPU is picked
+ * on every call (the feature check is just a load from libgcc's CPU
+ * model), with any remainder that doesn't fill a whole vector handled
+ * by the scalar kernel.
+ */
+void
+xtcas_cpa_compute(cpa_soa_t *soa, vect3_t my_pos, vect3_t my_vel)
+{
+	size_t done = 0;
+
+	ASSERT3U(soa->n, <=, soa->cap);
+#if	CPA_X86_SIMD
+	if (__builtin_cpu_supports("avx2"))
+		done = cpa_avx2(soa, my_pos, my_vel);
+	else if (__builtin_cpu_supports("sse2"))
+		done = cpa_sse2(soa, my_pos, my_vel);
+#endif
+	cpa_scalar(soa, done, my_pos, my_vel);
+}
+
+/*
+ * Same as xtcas_cpa_compute, but uses the kernel named `impl' ("scalar",
+ * "sse2" or "avx2"), with the remainder again handled by the scalar
+ * kernel. Used to cross-check and benchmark the kernels against each
+ * other (see xtcas_bench -K). Returns B_FALSE if the kernel isn't
+ * available on this machine.
+ */
+bool_t
+xtcas_cpa_compute_impl(cpa_soa_t *soa, const char *impl, vect3_t my_pos,
+    vect3_t my_vel)
+{
+	size_t done = 0;
+
+	ASSERT3U(soa->n, <=, soa->cap);
+	if (strcmp(impl, "scalar") == 0) {
+		done = 0;
+#if	CPA_X86_SIMD
+	} else if (strcmp(impl, "avx2") == 0 &&
+	    __builtin_cpu_supports("avx2")) {
+		done = cpa_avx2(soa, my_pos, my_vel);
+	} else if (strcmp(impl, "sse2") == 0 &&
+	    __builtin_cpu_supports("sse2")) {
+		done = cpa_sse2(soa, my_pos, my_vel);
+#endif
+	} else {
+		return (B_FALSE);
+	}
+	cpa_scalar(soa, done, my_pos, my_vel);
+
+	return (B_TRUE);
+}
@@ -0,0 +1,66 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+*/
+/*
+ * Copyright 2025 Saso Kiselkov. All rights reserved.
+ */
+
+#ifndef	_XTCAS_CPA_H_
+#define	_XTCAS_CPA_H_
+
+#include <stddef.h>
+
+#include <acfutils/geom.h>
+#include <acfutils/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Closest-point-of-approach kernel. The hot kinematic fields of all the
+ * contacts which are eligible for CPA computation are kept in a
+ * structure-of-arrays, so that the kernel can process several contacts
+ * per instruction. Positions and velocities are in our aircraft's fpp
+ * space (meters and m/s, X east, Y north, Z elevation).
+ */
+typedef struct {
+	size_t	n;		/* number of contacts filled in */
+	size_t	cap;		/* allocated length of each array */
+	void	*buf;		/* backing storage of all arrays */
+
+	/* inputs */
+	double	*x, *y, *z;	/* contact position */
+	double	*vx, *vy, *vz;	/* contact velocity */
+	size_t	*idx;		/* caller's back-reference, not used here */
+
+	/* outputs */
+	double	*t;		/* seconds until CPA, >= 0 */
+	double	*d_h;		/* horizontal separation at CPA */
+	double	*d_v;		/* vertical separation at CPA */
+} cpa_soa_t;
+
+bool_t xtcas_cpa_soa_reserve(cpa_soa_t *soa, size_t n);
+void xtcas_cpa_soa_free(cpa_soa_t *soa);
+
+void xtcas_cpa_compute(cpa_soa_t *soa, vect3_t my_pos, vect3_t my_vel);
+bool_t xtcas_cpa_compute_impl(cpa_soa_t *soa, const char *impl,
+    vect3_t my_pos, vect3_t my_vel);
+const char *xtcas_cpa_impl(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _XTCAS_CPA_H_ */
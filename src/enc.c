@@ -0,0 +1,586 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+*/
+/*
+ * Copyright 2025 Saso Kiselkov. All rights reserved.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <acfutils/assert.h>
+#include <acfutils/helpers.h>
+#include <acfutils/log.h>
+#include <acfutils/safe_alloc.h>
+
+#include "enc.h"
+
+/*
+ * Dataset file format. The file starts with an enc_hdr_t, followed by
+ * the columns, each of which starts at an ENC_ALIGN-byte aligned offset
+ * given in the header:
+ *
+ * ENC_COL_ENC_TRK: the index of the first track of every encounter, plus
+ *	num_trk at the end (num_enc + 1 uint64_t)
+ * ENC_COL_ENC_GND: the ground elevation of every encounter in meters
+ *	(num_enc double)
+ * ENC_COL_TRK_SMP: the index of the first sample of every track, plus
+ *	num_smp at the end (num_trk + 1 uint64_t)
+ * ENC_COL_T, ENC_COL_LAT, ENC_COL_LON, ENC_COL_ELEV, ENC_COL_HDG: the
+ *	time (seconds), latitude, longitude (degrees), elevation (meters
+ *	MSL) and true heading (degrees) of every sample (num_smp double)
+ * ENC_COL_FLAGS: the ENC_GEAR_EXT and ENC_ON_GROUND flags of every
+ *	sample (num_smp uint8_t)
+ *
+ * The tracks of an encounter are consecutive, our own aircraft's coming
+ * first, and so are the samples of a track.
+ */
+#define	ENC_MAGIC	"XTCASENC"
+#define	ENC_MAGIC_LEN	8
+#define	ENC_VERSION	1
+#define	ENC_ALIGN	8
+#define	ENC_COPY_SZ	(64 << 10)	/* bytes per column copy */
+
+#define	ENC_GEAR_EXT	(1 << 0)
+#define	ENC_ON_GROUND	(1 << 1)
+
+typedef enum {
+	ENC_COL_ENC_TRK,
+	ENC_COL_ENC_GND,
+	ENC_COL_TRK_SMP,
+	ENC_COL_T,
+	ENC_COL_LAT,
+	ENC_COL_LON,
+	ENC_COL_ELEV,
+	ENC_COL_HDG,
+	ENC_COL_FLAGS,
+	ENC_NUM_COLS
+} enc_col_t;
+
+static const size_t col_elem_sz[ENC_NUM_COLS] = {
+	sizeof (uint64_t), sizeof (double), sizeof (uint64_t),
+	sizeof (double), sizeof (double), sizeof (double), sizeof (double),
+	sizeof (double), sizeof (uint8_t)
+};
+
+typedef struct {
+	char		magic[ENC_MAGIC_LEN];
+	uint32_t	version;
+	uint32_t	reserved;
+	uint64_t	num_enc;
+	uint64_t	num_trk;
+	uint64_t	num_smp;
+	uint64_t	col_off[ENC_NUM_COLS];
+} enc_hdr_t;
+
+struct xtcas_enc_wr {
+	char		*path;
+	char		*col_path[ENC_NUM_COLS];
+	FILE		*col_fp[ENC_NUM_COLS];
+	uint64_t	num_enc;
+	uint64_t	num_trk;
+	uint64_t	num_smp;
+	uint64_t	trk_start;	/* first sample of the current track */
+	double		last_t;		/* of the current track */
+	bool_t		error;
+};
+
+struct xtcas_enc {
+	char		*path;
+	void		*map;
+	size_t		map_len;
+	uint64_t	num_enc;
+	uint64_t	num_trk;
+	uint64_t	num_smp;
+	const uint64_t	*enc_trk;
+	const double	*enc_gnd;
+	const uint64_t	*trk_smp;
+	const double	*t;
+	const double	*lat;
+	const double	*lon;
+	const double	*elev;
+	const double	*hdg;
+	const uint8_t	*flags;
+};
+
+struct xtcas_enc_play {
+	const xtcas_enc_t	*enc;
+	sim_intf_input_ops_t	ops;
+
+	/* the current encounter */
+	double			gnd_elev;
+	double			t;		/* of the current sample */
+	uint64_t		my_smp;		/* current sample */
+	uint64_t		my_end;
+	bool_t			started;
+	size_t			num_oth;
+	/*
+	 * For every intruder, the next sample to consume and the end of
+	 * its track. Intruder i's latest sample is next[i] - 1, if that's
+	 * still within its track.
+	 */
+	uint64_t		*oth_start;
+	uint64_t		*oth_next;
+	uint64_t		*oth_end;
+	size_t			oth_cap;
+};
+
+static uint64_t
+col_count(const enc_hdr_t *hdr, enc_col_t col)
+{
+	switch (col) {
+	case ENC_COL_ENC_TRK:
+		return (hdr->num_enc + 1);
+	case ENC_COL_ENC_GND:
+		return (hdr->num_enc);
+	case ENC_COL_TRK_SMP:
+		return (hdr->num_trk + 1);
+	default:
+		return (hdr->num_smp);
+	}
+}
+
+static inline uint64_t
+enc_align(uint64_t off)
+{
+	return ((off + ENC_ALIGN - 1) & ~(uint64_t)(ENC_ALIGN - 1));
+}
+
+static void
+wr_put(xtcas_enc_wr_t *wr, enc_col_t col, const void *data, size_t len)
+{
+	if (fwrite(data, len, 1, wr->col_fp[col]) != 1 && !wr->error) {
+		logMsg("Error writing dataset %s: %s", wr->path,
+		    strerror(errno));
+		wr->error = B_TRUE;
+	}
+}
+
+xtcas_enc_wr_t *
+xtcas_enc_wr_open(const char *path)
+{
+	xtcas_enc_wr_t *wr = safe_calloc(1, sizeof (*wr));
+
+	wr->path = safe_strdup(path);
+	/*
+	 * The columns are spooled next to the dataset, rather than into
+	 * the temporary directory, as they take up as much space as the
+	 * dataset itself.
+	 */
+	for (int i = 0; i < ENC_NUM_COLS; i++) {
+		size_t len = strlen(path) + 16;
+
+		wr->col_path[i] = safe_malloc(len);
+		snprintf(wr->col_path[i], len, "%s.%d.tmp", path, i);
+		wr->col_fp[i] = fopen(wr->col_path[i], "w+b");
+		if (wr->col_fp[i] == NULL) {
+			logMsg("Error creating %s: %s", wr->col_path[i],
+			    strerror(errno));
+			wr->error = B_TRUE;
+			(void) xtcas_enc_wr_close(wr);
+			return (NULL);
+		}
+	}
+
+	return (wr);
+}
+
+void
+xtcas_enc_wr_begin_enc(xtcas_enc_wr_t *wr, double gnd_elev)
+{
+	wr_put(wr, ENC_COL_ENC_TRK, &wr->num_trk, sizeof (wr->num_trk));
+	wr_put(wr, ENC_COL_ENC_GND, &gnd_elev, sizeof (gnd_elev));
+	wr->num_enc++;
+}
+
+void
+xtcas_enc_wr_begin_trk(xtcas_enc_wr_t *wr)
+{
+	ASSERT(wr->num_enc != 0);
+	wr_put(wr, ENC_COL_TRK_SMP, &wr->num_smp, sizeof (wr->num_smp));
+	wr->num_trk++;
+	wr->trk_start = wr->num_smp;
+}
+
+void
+xtcas_enc_wr_sample(xtcas_enc_wr_t *wr, double t, geo_pos3_t pos,
+    double hdg, bool_t gear_ext, bool_t on_ground)
+{
+	uint8_t flags = (gear_ext ? ENC_GEAR_EXT : 0) |
+	    (on_ground ? ENC_ON_GROUND : 0);
+
+	ASSERT(wr->num_trk != 0);
+	ASSERT(wr->num_smp == wr->trk_start || t > wr->last_t);
+	wr->last_t = t;
+
+	wr_put(wr, ENC_COL_T, &t, sizeof (t));
+	wr_put(wr, ENC_COL_LAT, &pos.lat, sizeof (pos.lat));
+	wr_put(wr, ENC_COL_LON, &pos.lon, sizeof (pos.lon));
+	wr_put(wr, ENC_COL_ELEV, &pos.elev, sizeof (pos.elev));
+	wr_put(wr, ENC_COL_HDG, &hdg, sizeof (hdg));
+	wr_put(wr, ENC_COL_FLAGS, &flags, sizeof (flags));
+	wr->num_smp++;
+}
+
+/*
+ * Appends the spooled column `col' to the dataset at offset `off'.
+ */
+static bool_t
+wr_copy_col(xtcas_enc_wr_t *wr, FILE *fp, enc_col_t col, uint64_t off,
+    uint8_t *buf)
+{
+	FILE *col_fp = wr->col_fp[col];
+	size_t n;
+
+	while ((uint64_t)ftell(fp) < off) {
+		if (fputc(0, fp) == EOF)
+			return (B_FALSE);
+	}
+	if (fflush(col_fp) != 0 || fseek(col_fp, 0, SEEK_SET) != 0)
+		return (B_FALSE);
+	while ((n = fread(buf, 1, ENC_COPY_SZ, col_fp)) != 0) {
+		if (fwrite(buf, 1, n, fp) != n)
+			return (B_FALSE);
+	}
+
+	return (!ferror(col_fp));
+}
+
+/*
+ * Writes out the header and the columns, in that order.
+ */
+static bool_t
+wr_assemble(xtcas_enc_wr_t *wr)
+{
+	enc_hdr_t hdr;
+	uint64_t off = enc_align(sizeof (hdr));
+	uint8_t *buf;
+	FILE *fp;
+	bool_t ok;
+
+	wr_put(wr, ENC_COL_ENC_TRK, &wr->num_trk, sizeof (wr->num_trk));
+	wr_put(wr, ENC_COL_TRK_SMP, &wr->num_smp, sizeof (wr->num_smp));
+	if (wr->error)
+		return (B_FALSE);
+
+	memset(&hdr, 0, sizeof (hdr));
+	memcpy(hdr.magic, ENC_MAGIC, ENC_MAGIC_LEN);
+	hdr.version = ENC_VERSION;
+	hdr.num_enc = wr->num_enc;
+	hdr.num_trk = wr->num_trk;
+	hdr.num_smp = wr->num_smp;
+	for (int i = 0; i < ENC_NUM_COLS; i++) {
+		hdr.col_off[i] = off;
+		off = enc_align(off + col_count(&hdr, i) * col_elem_sz[i]);
+	}
+
+	fp = fopen(wr->path, "wb");
+	if (fp == NULL)
+		return (B_FALSE);
+	buf = safe_malloc(ENC_COPY_SZ);
+	ok = (fwrite(&hdr, sizeof (hdr), 1, fp) == 1);
+	for (int i = 0; ok && i < ENC_NUM_COLS; i++)
+		ok = wr_copy_col(wr, fp, i, hdr.col_off[i], buf);
+	free(buf);
+	if (fclose(fp) != 0)
+		ok = B_FALSE;
+
+	return (ok);
+}
+
+bool_t
+xtcas_enc_wr_close(xtcas_enc_wr_t *wr)
+{
+	bool_t ok = (!wr->error && wr_assemble(wr));
+
+	if (!ok && !wr->error) {
+		logMsg("Error writing dataset %s: %s", wr->path,
+		    strerror(errno));
+	}
+	for (int i = 0; i < ENC_NUM_COLS; i++) {
+		if (wr->col_fp[i] != NULL) {
+			fclose(wr->col_fp[i]);
+			remove(wr->col_path[i]);
+		}
+		free(wr->col_path[i]);
+	}
+	free(wr->path);
+	free(wr);
+
+	return (ok);
+}
+
+/*
+ * Checks that the header describes columns which fit into the file.
+ */
+static bool_t
+hdr_valid(const enc_hdr_t *hdr, size_t len)
+{
+	if (memcmp(hdr->magic, ENC_MAGIC, ENC_MAGIC_LEN) != 0 ||
+	    hdr->version != ENC_VERSION)
+		return (B_FALSE);
+	/* this also keeps the column sizes below from overflowing */
+	if (hdr->num_enc >= len || hdr->num_trk >= len ||
+	    hdr->num_smp >= len)
+		return (B_FALSE);
+	for (int i = 0; i < ENC_NUM_COLS; i++) {
+		uint64_t off = hdr->col_off[i];
+
+		if (off % ENC_ALIGN != 0 || off < sizeof (*hdr) || off > len ||
+		    col_count(hdr, i) * col_elem_sz[i] > len - off)
+			return (B_FALSE);
+	}
+
+	return (B_TRUE);
+}
+
+xtcas_enc_t *
+xtcas_enc_open(const char *path)
+{
+	xtcas_enc_t *enc;
+	const enc_hdr_t *hdr;
+	const uint8_t *base;
+	struct stat st;
+	void *map;
+	int fd = open(path, O_RDONLY);
+
+	if (fd == -1) {
+		logMsg("Error opening dataset %s: %s", path,
+		    strerror(errno));
+		return (NULL);
+	}
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof (*hdr)) {
+		logMsg("Error opening dataset %s: not an X-TCAS encounter "
+		    "dataset", path);
+		close(fd);
+		return (NULL);
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		logMsg("Error mapping dataset %s: %s", path,
+		    strerror(errno));
+		return (NULL);
+	}
+	hdr = map;
+	base = map;
+	if (!hdr_valid(hdr, st.st_size) ||
+	    ((const uint64_t *)&base[hdr->col_off[ENC_COL_ENC_TRK]])
+	    [hdr->num_enc] != hdr->num_trk ||
+	    ((const uint64_t *)&base[hdr->col_off[ENC_COL_TRK_SMP]])
+	    [hdr->num_trk] != hdr->num_smp) {
+		logMsg("Error opening dataset %s: not an X-TCAS encounter "
+		    "dataset, unsupported version or truncated", path);
+		munmap(map, st.st_size);
+		return (NULL);
+	}
+	/* encounters are mostly read front to back */
+	(void) posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+
+	enc = safe_calloc(1, sizeof (*enc));
+	enc->path = safe_strdup(path);
+	enc->map = map;
+	enc->map_len = st.st_size;
+	enc->num_enc = hdr->num_enc;
+	enc->num_trk = hdr->num_trk;
+	enc->num_smp = hdr->num_smp;
+	enc->enc_trk = (const void *)&base[hdr->col_off[ENC_COL_ENC_TRK]];
+	enc->enc_gnd = (const void *)&base[hdr->col_off[ENC_COL_ENC_GND]];
+	enc->trk_smp = (const void *)&base[hdr->col_off[ENC_COL_TRK_SMP]];
+	enc->t = (const void *)&base[hdr->col_off[ENC_COL_T]];
+	enc->lat = (const void *)&base[hdr->col_off[ENC_COL_LAT]];
+	enc->lon = (const void *)&base[hdr->col_off[ENC_COL_LON]];
+	enc->elev = (const void *)&base[hdr->col_off[ENC_COL_ELEV]];
+	enc->hdg = (const void *)&base[hdr->col_off[ENC_COL_HDG]];
+	enc->flags = (const void *)&base[hdr->col_off[ENC_COL_FLAGS]];
+
+	return (enc);
+}
+
+void
+xtcas_enc_close(xtcas_enc_t *enc)
+{
+	munmap(enc->map, enc->map_len);
+	free(enc->path);
+	free(enc);
+}
+
+uint64_t
+xtcas_enc_count(const xtcas_enc_t *enc)
+{
+	return (enc->num_enc);
+}
+
+uint64_t
+xtcas_enc_num_samples(const xtcas_enc_t *enc)
+{
+	return (enc->num_smp);
+}
+
+static double
+play_get_time(void *handle)
+{
+	xtcas_enc_play_t *play = handle;
+
+	return (play->t);
+}
+
+static void
+play_get_my_acf_pos(void *handle, geo_pos3_t *pos, double *alt_agl,
+    double *hdg, bool_t *gear_ext, bool_t *on_ground)
+{
+	xtcas_enc_play_t *play = handle;
+	const xtcas_enc_t *enc = play->enc;
+	uint64_t i = play->my_smp;
+
+	*pos = GEO_POS3(enc->lat[i], enc->lon[i], enc->elev[i]);
+	*alt_agl = enc->elev[i] - play->gnd_elev;
+	*hdg = enc->hdg[i];
+	*gear_ext = ((enc->flags[i] & ENC_GEAR_EXT) != 0);
+	*on_ground = ((enc->flags[i] & ENC_ON_GROUND) != 0);
+}
+
+static size_t
+play_fill_oth_acf_pos(void *handle, acf_pos_t *pos, size_t cap)
+{
+	xtcas_enc_play_t *play = handle;
+	const xtcas_enc_t *enc = play->enc;
+	size_t n = 0;
+
+	for (size_t i = 0; i < play->num_oth; i++) {
+		uint64_t j = play->oth_next[i] - 1;
+
+		/* not started yet, or ended before now */
+		if (play->oth_next[i] == play->oth_start[i] ||
+		    (play->oth_next[i] == play->oth_end[i] &&
+		    enc->t[j] < play->t))
+			continue;
+		if (n < cap) {
+			pos[n].acf_id = (void *)(uintptr_t)(i + 1);
+			pos[n].pos = GEO_POS3(enc->lat[j], enc->lon[j],
+			    enc->elev[j]);
+			pos[n].on_ground =
+			    ((enc->flags[j] & ENC_ON_GROUND) != 0);
+		}
+		n++;
+	}
+
+	return (n);
+}
+
+xtcas_enc_play_t *
+xtcas_enc_play_create(const xtcas_enc_t *enc)
+{
+	xtcas_enc_play_t *play = safe_calloc(1, sizeof (*play));
+
+	play->enc = enc;
+	play->ops.handle = play;
+	play->ops.get_time = play_get_time;
+	play->ops.get_my_acf_pos = play_get_my_acf_pos;
+	play->ops.fill_oth_acf_pos = play_fill_oth_acf_pos;
+
+	return (play);
+}
+
+void
+xtcas_enc_play_destroy(xtcas_enc_play_t *play)
+{
+	free(play->oth_start);
+	free(play->oth_next);
+	free(play->oth_end);
+	free(play);
+}
+
+const sim_intf_input_ops_t *
+xtcas_enc_play_get_ops(xtcas_enc_play_t *play)
+{
+	return (&play->ops);
+}
+
+bool_t
+xtcas_enc_play_start(xtcas_enc_play_t *play, uint64_t idx)
+{
+	const xtcas_enc_t *enc = play->enc;
+	uint64_t trk, trk_end;
+
+	ASSERT3U(idx, <, enc->num_enc);
+	trk = enc->enc_trk[idx];
+	trk_end = enc->enc_trk[idx + 1];
+	/* the indices come straight from the file, so check them */
+	if (trk >= trk_end || trk_end > enc->num_trk)
+		goto errout;
+	for (uint64_t i = trk; i < trk_end; i++) {
+		if (enc->trk_smp[i] > enc->trk_smp[i + 1] ||
+		    enc->trk_smp[i + 1] > enc->num_smp)
+			goto errout;
+	}
+	if (enc->trk_smp[trk] == enc->trk_smp[trk + 1])
+		goto errout;
+
+	play->gnd_elev = enc->enc_gnd[idx];
+	play->my_smp = enc->trk_smp[trk];
+	play->my_end = enc->trk_smp[trk + 1];
+	play->started = B_FALSE;
+	play->num_oth = trk_end - trk - 1;
+	if (play->num_oth > play->oth_cap) {
+		play->oth_cap = play->num_oth;
+		play->oth_start = safe_realloc(play->oth_start,
+		    play->oth_cap * sizeof (*play->oth_start));
+		play->oth_next = safe_realloc(play->oth_next,
+		    play->oth_cap * sizeof (*play->oth_next));
+		play->oth_end = safe_realloc(play->oth_end,
+		    play->oth_cap * sizeof (*play->oth_end));
+	}
+	for (size_t i = 0; i < play->num_oth; i++) {
+		play->oth_start[i] = enc->trk_smp[trk + 1 + i];
+		play->oth_next[i] = play->oth_start[i];
+		play->oth_end[i] = enc->trk_smp[trk + 2 + i];
+	}
+
+	return (B_TRUE);
+errout:
+	logMsg("Error reading dataset %s: encounter %llu is malformed",
+	    enc->path, (unsigned long long)idx);
+	return (B_FALSE);
+}
+
+bool_t
+xtcas_enc_play_next(xtcas_enc_play_t *play, double *t)
+{
+	const xtcas_enc_t *enc = play->enc;
+
+	if (play->started) {
+		if (play->my_smp + 1 >= play->my_end)
+			return (B_FALSE);
+		play->my_smp++;
+	}
+	play->started = B_TRUE;
+	play->t = enc->t[play->my_smp];
+	*t = play->t;
+
+	for (size_t i = 0; i < play->num_oth; i++) {
+		while (play->oth_next[i] < play->oth_end[i] &&
+		    enc->t[play->oth_next[i]] <= play->t)
+			play->oth_next[i]++;
+	}
+
+	return (B_TRUE);
+}
@@ -0,0 +1,92 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+*/
+/*
+ * Copyright 2025 Saso Kiselkov. All rights reserved.
+ */
+
+#ifndef	_XTCAS_ENC_H_
+#define	_XTCAS_ENC_H_
+
+#include <stdint.h>
+
+#include <acfutils/geom.h>
+#include <acfutils/types.h>
+
+#include "xtcas.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Encounter dataset. A dataset file holds any number of encounters, each
+ * consisting of the tracks (trajectories) of our own aircraft and of the
+ * intruders, as timed position samples. The samples are stored one
+ * column per field (see enc.c), so a dataset can be memory-mapped and
+ * its encounters streamed through the TCAS core without any parsing or
+ * per-sample allocation.
+ *
+ * Datasets are written with xtcas_enc_wr_*. xtcas_enc_wr_begin_enc
+ * starts a new encounter, xtcas_enc_wr_begin_trk starts its next track
+ * (the first one is our own aircraft) and xtcas_enc_wr_sample appends a
+ * sample to the current track, in ascending time order. The columns are
+ * spooled to temporary files while writing, so the writer only needs a
+ * constant amount of memory. xtcas_enc_wr_close assembles the dataset
+ * and returns B_FALSE if anything went wrong. Like recordings (see
+ * rec.h), datasets use the host's byte order. Datasets are mapped with
+ * POSIX mmap, so like the tools which use them, this is not available on
+ * Windows.
+ */
+typedef struct xtcas_enc_wr xtcas_enc_wr_t;
+
+xtcas_enc_wr_t *xtcas_enc_wr_open(const char *path);
+bool_t xtcas_enc_wr_close(xtcas_enc_wr_t *wr);
+void xtcas_enc_wr_begin_enc(xtcas_enc_wr_t *wr, double gnd_elev);
+void xtcas_enc_wr_begin_trk(xtcas_enc_wr_t *wr);
+void xtcas_enc_wr_sample(xtcas_enc_wr_t *wr, double t, geo_pos3_t pos,
+    double hdg, bool_t gear_ext, bool_t on_ground);
+
+/*
+ * Dataset reader. xtcas_enc_open maps a dataset into memory. The
+ * encounters are played back one at a time by an xtcas_enc_play_t, which
+ * can be reused for any number of encounters. xtcas_enc_play_start
+ * selects the encounter (returning B_FALSE if it is malformed) and
+ * xtcas_enc_play_next advances to the next sample of our own aircraft,
+ * returning its time in `t', or B_FALSE after the last one. The ops
+ * returned by xtcas_enc_play_get_ops return our own aircraft's position
+ * at that time and the latest position of every intruder whose track
+ * has started and hasn't ended yet. Intruder `i' (counting from 1) is
+ * reported with acf_id `i'. As with xtcas_play_next, the context is
+ * meant to be stepped with xtcas_ctx_step(ctx, t) after every sample.
+ */
+typedef struct xtcas_enc xtcas_enc_t;
+typedef struct xtcas_enc_play xtcas_enc_play_t;
+
+xtcas_enc_t *xtcas_enc_open(const char *path);
+void xtcas_enc_close(xtcas_enc_t *enc);
+uint64_t xtcas_enc_count(const xtcas_enc_t *enc);
+uint64_t xtcas_enc_num_samples(const xtcas_enc_t *enc);
+
+xtcas_enc_play_t *xtcas_enc_play_create(const xtcas_enc_t *enc);
+void xtcas_enc_play_destroy(xtcas_enc_play_t *play);
+const sim_intf_input_ops_t *xtcas_enc_play_get_ops(xtcas_enc_play_t *play);
+bool_t xtcas_enc_play_start(xtcas_enc_play_t *play, uint64_t idx);
+bool_t xtcas_enc_play_next(xtcas_enc_play_t *play, double *t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _XTCAS_ENC_H_ */
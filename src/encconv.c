@@ -0,0 +1,379 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+*/
+/*
+ * Copyright 2025 Saso Kiselkov. All rights reserved.
+ */
+
+/*
+ * Encounter dataset converter (see enc.h for the dataset format). Every
+ * input file is converted and all of them are appended to the dataset
+ * given by -o, in the order given.
+ *
+ * By default, the input files are scenario command files (see
+ * xtcas_scen_read), each of which becomes one encounter. A scenario is
+ * flown without TCAS for -t seconds (300 by default), sampling all
+ * aircraft every 100ms. As no RAs are issued, auto-maneuvers never start.
+ * The samples are taken at the same times that xtcas_replay steps the
+ * TCAS core at, so `xtcas_replay -E' on the dataset gives the same
+ * results as xtcas_replay on a scenario without auto-maneuvers.
+ *
+ * With -c, the input files are CSV track logs, with one sample per line:
+ *
+ *	<encounter>,<aircraft>,<time>,<lat>,<lon>,<alt_ft>,<hdg>,<on_ground>
+ *
+ * The encounter and aircraft are integer IDs, time is in seconds, lat,
+ * lon and hdg are in degrees, alt_ft is the altitude in feet MSL and
+ * on_ground is 0 or 1. The lines of an encounter must be consecutive, as
+ * must be those of an aircraft within the encounter, and the times of an
+ * aircraft must increase. The first aircraft of every encounter is our
+ * own. A first line which doesn't start with a digit (a column heading)
+ * and lines starting with '#' are ignored. -g sets the ground elevation
+ * in feet used to compute our own aircraft's height above ground (0 by
+ * default).
+ *
+ * With -S, the files are datasets and for each, its size and the rate at
+ * which all samples of its encounters can be played back are printed:
+ *
+ *	<file> encounters=<n> samples=<n> MB=<size> MB_per_s=<rate>
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <acfutils/assert.h>
+#include <acfutils/list.h>
+#include <acfutils/log.h>
+#include <acfutils/safe_alloc.h>
+#include <acfutils/time.h>
+
+#include "enc.h"
+#include "scen.h"
+#include "xtcas.h"
+
+#define	SIMSTEP		100000		/* microseconds, as in xtcas_replay */
+#define	DFL_MAX_TIME	300		/* seconds */
+#define	SAMPLE_SZ	(5 * sizeof (double) + 1)	/* see enc.c */
+
+typedef struct {
+	double		t;
+	geo_pos3_t	pos;
+	double		hdg;
+} sample_t;
+
+static void
+lib_log_func(const char *str)
+{
+	fputs(str, stderr);
+}
+
+/*
+ * Flies a scenario command file and appends it as one encounter. All
+ * samples of the encounter are collected first, as the dataset needs
+ * them grouped by aircraft.
+ */
+static bool_t
+conv_scen(xtcas_enc_wr_t *wr, const char *filename, double max_time)
+{
+	FILE *fp = fopen(filename, "r");
+	scen_t *scen;
+	size_t num_acf, num_steps;
+	sample_t *smp;
+	acf_pos_t *oth;
+
+	if (fp == NULL) {
+		fprintf(stderr, "Cannot open %s: %s\n", filename,
+		    strerror(errno));
+		return (B_FALSE);
+	}
+	scen = xtcas_scen_read(fp);
+	fclose(fp);
+	if (scen == NULL) {
+		fprintf(stderr, "%s: error reading scenario\n", filename);
+		return (B_FALSE);
+	}
+
+	num_acf = 1 + list_count(&scen->other_acf);
+	num_steps = SEC2USEC(max_time) / SIMSTEP + 1;
+	smp = safe_calloc(num_acf * num_steps, sizeof (*smp));
+	oth = safe_calloc(num_acf, sizeof (*oth));
+
+	for (size_t step = 0; step < num_steps; step++) {
+		uint64_t now = step * SIMSTEP;
+		sample_t *s = &smp[step];
+		const scen_acf_t *acf;
+		double alt_agl;
+
+		xtcas_scen_step(scen, now, SIMSTEP);
+		s->t = USEC2SEC(now);
+		xtcas_scen_get_my_acf_pos(scen, &s->pos, &alt_agl, &s->hdg);
+		VERIFY3U(xtcas_scen_fill_oth_acf_pos(scen, oth, num_acf), ==,
+		    num_acf - 1);
+		acf = list_head(&scen->other_acf);
+		for (size_t i = 1; i < num_acf; i++) {
+			s = &smp[i * num_steps + step];
+			s->t = USEC2SEC(now);
+			s->pos = oth[i - 1].pos;
+			s->hdg = acf->trk;
+			acf = list_next(&scen->other_acf, acf);
+		}
+	}
+
+	xtcas_enc_wr_begin_enc(wr, scen->gnd_elev);
+	for (size_t i = 0; i < num_acf; i++) {
+		xtcas_enc_wr_begin_trk(wr);
+		for (size_t step = 0; step < num_steps; step++) {
+			const sample_t *s = &smp[i * num_steps + step];
+
+			xtcas_enc_wr_sample(wr, s->t, s->pos, s->hdg,
+			    B_FALSE, B_FALSE);
+		}
+	}
+
+	free(oth);
+	free(smp);
+	xtcas_scen_free(scen);
+
+	return (B_TRUE);
+}
+
+/*
+ * Appends the encounters of a CSV track log.
+ */
+static bool_t
+conv_csv(xtcas_enc_wr_t *wr, const char *filename, double gnd_elev)
+{
+	FILE *fp = fopen(filename, "r");
+	char *line = NULL;
+	size_t cap = 0;
+	long long enc_id = 0, acf_id = 0;
+	long long *seen = NULL;
+	size_t num_seen = 0, seen_cap = 0;
+	double last_t = 0;
+	bool_t have_enc = B_FALSE;
+	bool_t ok = B_TRUE;
+
+	if (fp == NULL) {
+		fprintf(stderr, "Cannot open %s: %s\n", filename,
+		    strerror(errno));
+		return (B_FALSE);
+	}
+	for (unsigned linenr = 1; ok && getline(&line, &cap, fp) > 0;
+	    linenr++) {
+		long long e, a;
+		double t, lat, lon, alt, hdg;
+		int on_ground;
+
+		if (line[0] == '#' || line[0] == '\n' ||
+		    (linenr == 1 && (line[0] < '0' || line[0] > '9')))
+			continue;
+		if (sscanf(line, "%lld,%lld,%lf,%lf,%lf,%lf,%lf,%d", &e, &a,
+		    &t, &lat, &lon, &alt, &hdg, &on_ground) != 8 ||
+		    !is_valid_lat(lat) || !is_valid_lon(lon)) {
+			fprintf(stderr, "%s:%u: malformed line\n", filename,
+			    linenr);
+			ok = B_FALSE;
+			break;
+		}
+		if (!have_enc || e != enc_id) {
+			xtcas_enc_wr_begin_enc(wr, gnd_elev);
+			enc_id = e;
+			have_enc = B_TRUE;
+			num_seen = 0;
+		}
+		if (num_seen == 0 || a != acf_id) {
+			for (size_t i = 0; i < num_seen; i++) {
+				if (seen[i] == a) {
+					fprintf(stderr, "%s:%u: lines of "
+					    "aircraft %lld aren't "
+					    "consecutive\n", filename,
+					    linenr, a);
+					ok = B_FALSE;
+				}
+			}
+			if (num_seen == seen_cap) {
+				seen_cap = MAX(2 * seen_cap, 8);
+				seen = safe_realloc(seen,
+				    seen_cap * sizeof (*seen));
+			}
+			seen[num_seen++] = a;
+			acf_id = a;
+			xtcas_enc_wr_begin_trk(wr);
+		} else if (t <= last_t) {
+			fprintf(stderr, "%s:%u: time doesn't increase\n",
+			    filename, linenr);
+			ok = B_FALSE;
+		}
+		if (ok) {
+			xtcas_enc_wr_sample(wr, t,
+			    GEO_POS3(lat, lon, FEET2MET(alt)), hdg, B_FALSE,
+			    on_ground != 0);
+			last_t = t;
+		}
+	}
+	if (ferror(fp)) {
+		fprintf(stderr, "Error reading %s: %s\n", filename,
+		    strerror(errno));
+		ok = B_FALSE;
+	}
+	free(seen);
+	free(line);
+	fclose(fp);
+
+	return (ok);
+}
+
+/*
+ * Plays back every encounter of a dataset, reading all of its samples.
+ */
+static bool_t
+stat_dataset(const char *filename)
+{
+	xtcas_enc_t *enc = xtcas_enc_open(filename);
+	xtcas_enc_play_t *play;
+	const sim_intf_input_ops_t *ops;
+	acf_pos_t *oth = NULL;
+	size_t oth_cap = 0;
+	double sum = 0;
+	uint64_t start;
+	double dur, mb;
+	bool_t ok = B_TRUE;
+
+	if (enc == NULL)
+		return (B_FALSE);
+	play = xtcas_enc_play_create(enc);
+	ops = xtcas_enc_play_get_ops(play);
+
+	start = microclock();
+	for (uint64_t i = 0; ok && i < xtcas_enc_count(enc); i++) {
+		double t;
+
+		ok = xtcas_enc_play_start(play, i);
+		while (ok && xtcas_enc_play_next(play, &t)) {
+			geo_pos3_t pos;
+			double alt_agl, hdg;
+			bool_t gear_ext, on_ground;
+			size_t n;
+
+			ops->get_my_acf_pos(ops->handle, &pos, &alt_agl, &hdg,
+			    &gear_ext, &on_ground);
+			sum += pos.lat;
+			while ((n = ops->fill_oth_acf_pos(ops->handle, oth,
+			    oth_cap)) > oth_cap) {
+				oth_cap = n;
+				oth = safe_realloc(oth,
+				    oth_cap * sizeof (*oth));
+			}
+			for (size_t j = 0; j < n; j++)
+				sum += oth[j].pos.lat;
+		}
+	}
+	dur = USEC2SEC(microclock() - start);
+
+	mb = xtcas_enc_num_samples(enc) * SAMPLE_SZ / 1e6;
+	if (ok) {
+		printf("%s encounters=%llu samples=%llu MB=%.1f "
+		    "MB_per_s=%.1f\n", filename,
+		    (unsigned long long)xtcas_enc_count(enc),
+		    (unsigned long long)xtcas_enc_num_samples(enc), mb,
+		    mb / MAX(dur, 1e-6));
+	}
+	/* keeps the reads from being optimized out */
+	if (sum == 1)
+		fprintf(stderr, "\n");
+
+	free(oth);
+	xtcas_enc_play_destroy(play);
+	xtcas_enc_close(enc);
+
+	return (ok);
+}
+
+int
+main(int argc, char **argv)
+{
+	int opt;
+	bool_t csv = B_FALSE, stat = B_FALSE;
+	double gnd_elev = 0;
+	double max_time = DFL_MAX_TIME;
+	const char *out = NULL;
+	xtcas_enc_wr_t *wr;
+	int errs = 0;
+
+	log_init(lib_log_func, "xtcas_encconv");
+
+	while ((opt = getopt(argc, argv, "cg:t:o:S")) != -1) {
+		switch (opt) {
+		case 'c':
+			csv = B_TRUE;
+			break;
+		case 'g':
+			gnd_elev = FEET2MET(atof(optarg));
+			break;
+		case 't':
+			max_time = atof(optarg);
+			break;
+		case 'o':
+			out = optarg;
+			break;
+		case 'S':
+			stat = B_TRUE;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-c [-g <gnd_elev_ft>]] "
+			    "[-t <max_time>] -o <dataset> <file>...\n"
+			    "       %s -S <dataset>...\n", argv[0], argv[0]);
+			return (1);
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if (argc < 1 || (out == NULL) == !stat) {
+		fprintf(stderr, "Invalid options, expected -o or -S and at "
+		    "least one file.\n");
+		return (1);
+	}
+	if (max_time <= 0) {
+		fprintf(stderr, "Invalid options, -t must be greater than "
+		    "zero.\n");
+		return (1);
+	}
+
+	if (stat) {
+		for (int i = 0; i < argc; i++)
+			errs += !stat_dataset(argv[i]);
+		return (errs != 0);
+	}
+
+	wr = xtcas_enc_wr_open(out);
+	if (wr == NULL)
+		return (1);
+	for (int i = 0; i < argc && errs == 0; i++) {
+		if (csv)
+			errs += !conv_csv(wr, argv[i], gnd_elev);
+		else
+			errs += !conv_scen(wr, argv[i], max_time);
+	}
+	if (!xtcas_enc_wr_close(wr))
+		errs++;
+	if (errs != 0)
+		remove(out);
+
+	return (errs != 0);
+}
@@ -110,6 +110,8 @@ static void update_contact(void *handle, void *acf_id, double rbrg,
     double rdist, double ralt, double vs, double trk, double gs,
     tcas_threat_t level);
 static void delete_contact(void *handle, void *acf_id);
+static void update_contacts_batch(void *handle,
+    const xtcas_contact_frame_t *frame);
 static void update_RA(void *handle, tcas_adv_t adv, tcas_msg_t msg,
     tcas_RA_type_t type, tcas_RA_sense_t sense, bool_t crossing,
     bool_t reversal, double min_sep_cpa, double min_green,
@@ -122,6 +124,7 @@ static const sim_intf_output_ops_t ops = {
 	.handle = NULL,
 	.update_contact = update_contact,
 	.delete_contact = delete_contact,
+	.update_contacts_batch = update_contacts_batch,
 	.update_RA = update_RA,
 };
 
@@ -520,21 +523,16 @@ ff_a320_update(double step, void *tag)
 }
 
 static void
-update_contact(void *handle, void *acf_id, double rbrg, double rdist,
-    double ralt, double vs, double trk, double gs, tcas_threat_t level)
+update_contact_locked(void *acf_id, double rbrg, double rdist, double ralt,
+    double vs, double trk, tcas_threat_t level)
 {
 	contact_t srch, *ctc;
 	avl_index_t where;
 
-	UNUSED(handle);
-	UNUSED(gs);
-
 	dbg_log(ff_a320, 2, "update_contact acf_id:%p rpos:%.0fx%.0fx%.0f "
 	    "vs:%.2f lvl:%d", acf_id, rbrg, rdist, ralt, vs, level);
 
 	srch.acf_id = acf_id;
-
-	mutex_enter(&lock);
 	ctc = avl_find(&contacts_tree, &srch, &where);
 	if (ctc == NULL) {
 		for (int i = 0; i < MAX_CONTACTS; i++) {
@@ -548,7 +546,6 @@ update_contact(void *handle, void *acf_id, double rbrg, double rdist,
 		if (ctc == NULL) {
 			logMsg("CAUTION: X-TCAS is out of contact slots! "
 			    "Dropping contact %p.", acf_id);
-			mutex_exit(&lock);
 			return;
 		}
 		ctc->in_use = B_TRUE;
@@ -561,18 +558,14 @@ update_contact(void *handle, void *acf_id, double rbrg, double rdist,
 	ctc->vs = vs;
 	ctc->level = level;
 	ctc->trk = trk;
-	mutex_exit(&lock);
 }
 
 static void
-delete_contact(void *handle, void *acf_id)
+delete_contact_locked(void *acf_id)
 {
 	contact_t srch, *ctc;
 
-	UNUSED(handle);
-
 	srch.acf_id = acf_id;
-	mutex_enter(&lock);
 	ctc = avl_find(&contacts_tree, &srch, NULL);
 	if (ctc != NULL) {
 		dbg_log(ff_a320, 2, "delete_contact acf_id:%p", acf_id);
@@ -580,6 +573,44 @@ delete_contact(void *handle, void *acf_id)
 		ctc->in_use = B_FALSE;
 		ctc->deleted = B_TRUE;
 	}
+}
+
+static void
+update_contact(void *handle, void *acf_id, double rbrg, double rdist,
+    double ralt, double vs, double trk, double gs, tcas_threat_t level)
+{
+	UNUSED(handle);
+	UNUSED(gs);
+
+	mutex_enter(&lock);
+	update_contact_locked(acf_id, rbrg, rdist, ralt, vs, trk, level);
+	mutex_exit(&lock);
+}
+
+static void
+delete_contact(void *handle, void *acf_id)
+{
+	UNUSED(handle);
+
+	mutex_enter(&lock);
+	delete_contact_locked(acf_id);
+	mutex_exit(&lock);
+}
+
+static void
+update_contacts_batch(void *handle, const xtcas_contact_frame_t *frame)
+{
+	UNUSED(handle);
+
+	mutex_enter(&lock);
+	for (size_t i = 0; i < frame->num_deleted; i++)
+		delete_contact_locked(frame->deleted[i]);
+	for (size_t i = 0; i < frame->num_contacts; i++) {
+		const xtcas_contact_t *c = &frame->contacts[i];
+
+		update_contact_locked(c->acf_id, c->rbrg, c->rdist, c->ralt,
+		    c->vs, c->trk, c->level);
+	}
 	mutex_exit(&lock);
 }
 
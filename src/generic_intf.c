@@ -25,6 +25,8 @@ static void generic_update_contact(void *handle, void *acf_id, double rbrg,
     double rdist, double ralt, double vs, double trk, double gs,
     tcas_threat_t level);
 static void generic_delete_contact(void *handle, void *acf_id);
+static void generic_update_contacts_batch(void *handle,
+    const xtcas_contact_frame_t *frame);
 static void generic_update_RA(void *handle, tcas_adv_t adv, tcas_msg_t msg,
     tcas_RA_type_t type, tcas_RA_sense_t sense, bool_t crossing,
     bool_t reversal, double min_sep_cpa, double min_green,
@@ -46,6 +48,7 @@ static sim_intf_output_ops_t my_ops = {
     .handle = NULL,
     .update_contact = generic_update_contact,
     .delete_contact = generic_delete_contact,
+    .update_contacts_batch = generic_update_contacts_batch,
     .update_RA = generic_update_RA,
     .update_RA_prediction = generic_update_RA_prediction,
     .play_audio_msg = generic_play_audio_msg
@@ -68,11 +71,11 @@ static xtcas_generic_intf_t generic_ops = {
     .test = generic_test,
     .test_is_in_prog = generic_test_is_in_prog,
     .set_output_ops = generic_set_output_ops,
-    .set_has_RA = xtcas_set_has_RA,
-    .set_has_WOW = xtcas_set_has_WOW,
-    .set_RA = xtcas_set_RA,
-    .set_WOW = xtcas_set_WOW,
-    .set_gear_ext = xtcas_set_gear_ext
+    .set_has_RA = generic_set_has_RA,
+    .set_has_WOW = generic_set_has_WOW,
+    .set_RA = generic_set_RA,
+    .set_WOW = generic_set_WOW,
+    .set_gear_ext = generic_set_gear_ext
 };
 
 static void
@@ -105,6 +108,39 @@ generic_delete_contact(void *handle, void *acf_id)
 	mutex_exit(&out_ops_lock);
 }
 
+/*
+ * The external plugins' ops structures might predate
+ * update_contacts_batch, so we never look at that member and instead
+ * forward the frame one contact at a time, though under a single
+ * acquisition of out_ops_lock.
+ */
+static void
+generic_update_contacts_batch(void *handle,
+    const xtcas_contact_frame_t *frame)
+{
+	UNUSED(handle);
+
+	if (!inited)
+		return;
+	mutex_enter(&out_ops_lock);
+	if (out_ops != NULL && out_ops->delete_contact != NULL) {
+		for (size_t i = 0; i < frame->num_deleted; i++) {
+			out_ops->delete_contact(out_ops->handle,
+			    frame->deleted[i]);
+		}
+	}
+	if (out_ops != NULL && out_ops->update_contact != NULL) {
+		for (size_t i = 0; i < frame->num_contacts; i++) {
+			const xtcas_contact_t *c = &frame->contacts[i];
+
+			out_ops->update_contact(out_ops->handle, c->acf_id,
+			    c->rbrg, c->rdist, c->ralt, c->vs, c->trk, c->gs,
+			    c->level);
+		}
+	}
+	mutex_exit(&out_ops_lock);
+}
+
 static void
 generic_update_RA(void *handle, tcas_adv_t adv, tcas_msg_t msg,
     tcas_RA_type_t type, tcas_RA_sense_t sense, bool_t crossing,
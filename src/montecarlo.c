@@ -0,0 +1,928 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+*/
+/*
+ * Copyright 2025 Saso Kiselkov. All rights reserved.
+ */
+
+/*
+ * Monte Carlo encounter evaluator. Generates a large number of random
+ * encounters between our aircraft and one or more intruders, flies each
+ * of them twice, once without TCAS and once with TCAS and the pilot of
+ * our aircraft following its RAs, and prints the safety statistics over
+ * all of them:
+ *
+ *	encounters=<n> multi_threat=<n> RA=<n> RA_rate=<x>
+ *	reversals=<n> reversal_rate=<x>
+ *	NMAC_without=<n> NMAC_with=<n> risk_ratio=<x>
+ *	induced_NMAC=<n> induced_rate=<x>
+ *
+ * RA_rate is the fraction of encounters with an RA, reversal_rate the
+ * fraction of those containing a sense reversal. An NMAC is a loss of
+ * separation to within 150m horizontally and 100 ft vertically (same as
+ * the d_h_min/d_v_min separations of xtcas_replay). risk_ratio is the
+ * number of NMACs with TCAS divided by the number without. An induced
+ * NMAC is an NMAC with TCAS in an encounter which had none without it,
+ * induced_rate is their fraction of all encounters. risk_ratio is "-"
+ * if there were no NMACs without TCAS.
+ *
+ * Every encounter is set up to have its closest point of approach 50 to
+ * 80 seconds in, with the intruder passing within a random horizontal
+ * and vertical miss distance (at most -H and -V feet) of where our
+ * aircraft would be if it just flew on. Both aircraft start out at a
+ * random ground speed and vertical speed (level half of the time) and
+ * the intruder approaches from a random direction. A fraction (-m) of
+ * the encounters are multi-threat encounters with 2 or 3 intruders.
+ * Intruders never maneuver.
+ *
+ * Our pilot follows the RAs using the auto-maneuver model of the
+ * scenario files (see xtcas_scen_RA_update): the RA is followed after a
+ * delay of 5 seconds (2.5 seconds for subsequent RAs) at 1/4 g (1/3 g),
+ * the same as what the TCAS core itself assumes when picking the RA. The
+ * delays are scaled by a reaction factor drawn uniformly from the -r
+ * range for every encounter and a fraction of the pilots (1 - the -p
+ * value) ignore the RAs altogether.
+ *
+ * Encounter `i' of a run with seed `s' is always the same, irrespective
+ * of the number of threads, so an individual encounter can be re-run and
+ * inspected (e.g. with -d) using -i. The encounters are spread across
+ * all CPUs using a work-stealing thread pool (see xtcas_pool_run_steal).
+ *
+ * Parameter sweeps: each -P <param>[:<SL>]=<value>[,<value>...] option
+ * adds a tuning parameter (see xtcas_params_t) to sweep over, and the
+ * encounters are flown with TCAS once for every combination of the
+ * values given. Each parameter set is run by a single thread over all
+ * encounters, with the sets spread across the threads. The outcomes
+ * without TCAS are computed once up front and shared by all sets. The
+ * per-SL parameters are tau_TA, tau_RA (seconds), dmod_TA, dmod_RA (NM),
+ * zthr_TA, zthr_RA and alim_RA (feet). With an SL number, the values are
+ * used for that SL, without one, they are factors applied to the values
+ * of all SLs. The other parameters are crossing_RA_penalty,
+ * reversal_RA_penalty, hint_h_fact, hint_v_fact and state_chg_delay
+ * (seconds). A table is printed instead of the summary, with one row
+ * per parameter set, holding the parameter values and then TA_rate (the
+ * fraction of encounters with a TA or RA), RA_rate, reversal_rate,
+ * NMAC_with, risk_ratio and induced_rate as above.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <acfutils/assert.h>
+#include <acfutils/geom.h>
+#include <acfutils/log.h>
+#include <acfutils/thread.h>
+#include <acfutils/time.h>
+
+#include "dbg_log.h"
+#include "pool.h"
+#include "scen.h"
+#include "xtcas.h"
+
+#define	SIMSTEP		100000		/* microseconds */
+#define	DFL_ENCOUNTERS	100000
+#define	DFL_HMD_MAX	3000		/* feet */
+#define	DFL_VMD_MAX	1000		/* feet */
+#define	DFL_MULTI	0.1
+#define	DFL_REACT_MIN	0.6
+#define	DFL_REACT_MAX	1.6
+#define	MIN_CPA_T	50.0		/* seconds */
+#define	MAX_CPA_T	80.0		/* seconds */
+#define	POST_CPA_T	20.0		/* how long we fly on after CPA */
+#define	MIN_ALT		FEET2MET(3000)
+#define	MAX_ALT		FEET2MET(35000)
+#define	NMAC_DIST_V	FEET2MET(100)
+#define	GRAIN		16		/* encounters per work item */
+#define	MAX_AXES	8		/* -P options */
+
+typedef struct {
+	double		hmd_max;	/* meters */
+	double		vmd_max;	/* meters */
+	double		multi;
+	double		react_min;
+	double		react_max;
+	double		comply;
+	uint64_t	seed;
+} mc_params_t;
+
+typedef struct {
+	uint64_t	n;
+	uint64_t	multi;
+	uint64_t	TA;
+	uint64_t	RA;
+	uint64_t	reversals;
+	uint64_t	nmac_without;
+	uint64_t	nmac_with;
+	uint64_t	nmac_induced;
+} mc_stats_t;
+
+/*
+ * State of the TCAS run of an encounter, passed to the interface ops.
+ */
+typedef struct {
+	scen_t		*scen;
+	uint64_t	now;
+	bool_t		TA;		/* TA or RA */
+	bool_t		RA;
+	bool_t		reversal;
+} mc_enc_t;
+
+typedef struct {
+	const mc_params_t	*params;
+	mutex_t			lock;
+	mc_stats_t		stats;		/* protected by lock */
+	uint64_t		total;
+	uint64_t		next_report;	/* protected by lock */
+} mc_run_t;
+
+/*
+ * A tuning parameter which can be swept using -P. `off' is its offset in
+ * xtcas_SL_params_t for per-SL parameters and in xtcas_params_t for all
+ * others. Values are given in units of `unit' meters or seconds.
+ */
+typedef struct {
+	const char	*name;
+	size_t		off;
+	bool_t		per_SL;
+	double		unit;
+} sweep_param_t;
+
+static const sweep_param_t sweep_params[] = {
+    { "tau_TA", offsetof(xtcas_SL_params_t, tau_TA), B_TRUE, 1 },
+    { "tau_RA", offsetof(xtcas_SL_params_t, tau_RA), B_TRUE, 1 },
+    { "dmod_TA", offsetof(xtcas_SL_params_t, dmod_TA), B_TRUE, NM2MET(1) },
+    { "dmod_RA", offsetof(xtcas_SL_params_t, dmod_RA), B_TRUE, NM2MET(1) },
+    { "zthr_TA", offsetof(xtcas_SL_params_t, zthr_TA), B_TRUE, FEET2MET(1) },
+    { "zthr_RA", offsetof(xtcas_SL_params_t, zthr_RA), B_TRUE, FEET2MET(1) },
+    { "alim_RA", offsetof(xtcas_SL_params_t, alim_RA), B_TRUE, FEET2MET(1) },
+    { "crossing_RA_penalty", offsetof(xtcas_params_t, crossing_RA_penalty),
+      B_FALSE, 1 },
+    { "reversal_RA_penalty", offsetof(xtcas_params_t, reversal_RA_penalty),
+      B_FALSE, 1 },
+    { "hint_h_fact", offsetof(xtcas_params_t, hint_h_fact), B_FALSE, 1 },
+    { "hint_v_fact", offsetof(xtcas_params_t, hint_v_fact), B_FALSE, 1 },
+    { "state_chg_delay", offsetof(xtcas_params_t, state_chg_delay),
+      B_FALSE, 1 }
+};
+
+/*
+ * One -P option. For a per-SL parameter, SL is 0 if the values are
+ * factors applied to all SLs.
+ */
+typedef struct {
+	const sweep_param_t	*param;
+	unsigned		SL;
+	char			name[64];	/* as given by the user */
+	double			*vals;
+	size_t			n_vals;
+} sweep_axis_t;
+
+typedef struct {
+	const mc_params_t	*params;
+	const sweep_axis_t	*axes;
+	size_t			n_axes;
+	size_t			n_sets;
+	uint64_t		n;
+	/* shared read-only outcomes of the encounters without TCAS */
+	bool_t			*nmac_without;
+	bool_t			*multi;
+	mc_stats_t		*results;	/* per set */
+	mutex_t			lock;
+	size_t			sets_done;	/* protected by lock */
+} mc_sweep_t;
+
+static void get_my_acf_pos(void *handle, geo_pos3_t *pos, double *alt_agl,
+    double *hdg, bool_t *gear_ext, bool_t *on_ground);
+static size_t fill_oth_acf_pos(void *handle, acf_pos_t *pos_out,
+    size_t cap);
+static void update_contact(void *handle, void *acf_id, double rbrg,
+    double rdist, double ralt, double vs, double trk, double gs,
+    tcas_threat_t level);
+static void delete_contact(void *handle, void *acf_id);
+static void update_RA(void *handle, tcas_adv_t adv, tcas_msg_t msg,
+    tcas_RA_type_t type, tcas_RA_sense_t sense, bool_t crossing,
+    bool_t reversal, double min_sep_cpa, double min_green, double max_green,
+    double min_red_lo, double max_red_lo, double min_red_hi, double max_red_hi);
+
+static void
+lib_log_func(const char *str)
+{
+	fputs(str, stderr);
+}
+
+/*
+ * splitmix64, used to derive every encounter's independent random number
+ * stream from the run seed and the encounter's index.
+ */
+static uint64_t
+splitmix64(uint64_t x)
+{
+	x += 0x9E3779B97F4A7C15llu;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9llu;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBllu;
+	return (x ^ (x >> 31));
+}
+
+/*
+ * xorshift64* generator, returns a uniformly distributed random number
+ * in [min, max).
+ */
+static double
+rnd(uint64_t *state, double min, double max)
+{
+	uint64_t x = *state;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	x *= 0x2545F4914F6CDD1Dllu;
+
+	return (min + (max - min) * ((x >> 11) * (1.0 / (1llu << 53))));
+}
+
+static double
+rnd_vs(uint64_t *state, double max_fpm)
+{
+	double vs = FPM2MPS(rnd(state, -max_fpm, max_fpm));
+
+	return (rnd(state, 0, 1) < 0.5 ? 0 : vs);
+}
+
+/*
+ * Sets up encounter number `idx'. With `equipped' set, our aircraft's
+ * pilot follows the RAs (unless this encounter's pilot is one who
+ * doesn't). The random numbers drawn don't depend on `equipped', so
+ * both versions of an encounter have the same geometry.
+ */
+static scen_t *
+gen_encounter(const mc_params_t *params, uint64_t idx, bool_t equipped,
+    double *end_t)
+{
+	uint64_t state = splitmix64(params->seed ^ splitmix64(idx));
+	scen_t *scen = xtcas_scen_new();
+	scen_acf_t *my_acf = &scen->my_acf;
+	int n_intr = 1;
+	bool_t comply;
+
+	/* the state must never be zero, or xorshift gets stuck */
+	if (state == 0)
+		state = 1;
+
+	scen->mode_set = B_TRUE;
+	scen->mode = TCAS_MODE_TARA;
+	scen->refpt = GEO_POS2(rnd(&state, -60, 60), rnd(&state, -180, 180));
+	scen->fpp = ortho_fpp_init(scen->refpt, scen->refrot, &wgs84, B_TRUE);
+	scen->reaction_fact = rnd(&state, params->react_min,
+	    params->react_max);
+	comply = (rnd(&state, 0, 1) < params->comply);
+	if (rnd(&state, 0, 1) < params->multi)
+		n_intr = (rnd(&state, 0, 1) < 0.5 ? 2 : 3);
+
+	my_acf->pos = VECT3(0, 0, rnd(&state, MIN_ALT, MAX_ALT));
+	my_acf->trk = rnd(&state, 0, 360);
+	my_acf->gs = KT2MPS(rnd(&state, 120, 350));
+	my_acf->vs = rnd_vs(&state, 2000);
+	/* don't descend into the ground */
+	if (my_acf->pos.z + my_acf->vs * (MAX_CPA_T + POST_CPA_T) < MIN_ALT)
+		my_acf->vs = -my_acf->vs;
+	if (equipped && comply)
+		xtcas_scen_add_man(my_acf)->automan = B_TRUE;
+
+	*end_t = 0;
+	for (int i = 0; i < n_intr; i++) {
+		scen_acf_t *acf = xtcas_scen_add_acf(scen);
+		double t_cpa = rnd(&state, MIN_CPA_T, MAX_CPA_T);
+		double hmd = rnd(&state, 0, params->hmd_max);
+		double hmd_dir = rnd(&state, 0, 360);
+		double vmd = rnd(&state, -params->vmd_max, params->vmd_max);
+		vect2_t my_cpa, cpa, v;
+
+		acf->trk = fmod(my_acf->trk + rnd(&state, 0, 360), 360);
+		acf->gs = KT2MPS(rnd(&state, 120, 450));
+		acf->vs = rnd_vs(&state, 3000);
+		if (my_acf->pos.z + vmd - acf->vs * t_cpa < MIN_ALT)
+			acf->vs = -acf->vs;
+
+		/* where we'll be at CPA, offset by the miss distance */
+		my_cpa = vect2_set_abs(hdg2dir(my_acf->trk),
+		    my_acf->gs * t_cpa);
+		cpa = vect2_add(my_cpa, vect2_set_abs(hdg2dir(hmd_dir), hmd));
+		/* and back from there along the intruder's velocity */
+		v = vect2_set_abs(hdg2dir(acf->trk), acf->gs * t_cpa);
+		acf->pos = VECT3(cpa.x - v.x, cpa.y - v.y,
+		    my_acf->pos.z + my_acf->vs * t_cpa + vmd -
+		    acf->vs * t_cpa);
+		*end_t = MAX(*end_t, t_cpa + POST_CPA_T);
+	}
+
+	return (scen);
+}
+
+static bool_t
+is_nmac(const scen_t *scen)
+{
+	return (scen->d_v_min < NMAC_DIST_V);
+}
+
+/*
+ * Flies the encounter without TCAS and returns whether it ended in an
+ * NMAC. The number of intruders is returned in `n_intr'.
+ */
+static bool_t
+run_unequipped(const mc_params_t *params, uint64_t idx, size_t *n_intr)
+{
+	double end_t;
+	scen_t *scen = gen_encounter(params, idx, B_FALSE, &end_t);
+	bool_t nmac;
+
+	for (uint64_t now = 0; USEC2SEC(now) <= end_t; now += SIMSTEP)
+		xtcas_scen_step(scen, now, SIMSTEP);
+	nmac = is_nmac(scen);
+	*n_intr = list_count(&scen->other_acf);
+	xtcas_scen_free(scen);
+
+	return (nmac);
+}
+
+/*
+ * Flies the encounter with TCAS, using a private synchronous TCAS
+ * context with the tuning parameters `tcas_params' (or the defaults, if
+ * NULL). Returns whether it ended in an NMAC. The advisories issued are
+ * returned in `enc'.
+ */
+static bool_t
+run_equipped(const mc_params_t *params, const xtcas_params_t *tcas_params,
+    uint64_t idx, mc_enc_t *enc)
+{
+	const sim_intf_input_ops_t in_ops = {
+		.handle = enc,
+		.get_my_acf_pos = get_my_acf_pos,
+		.fill_oth_acf_pos = fill_oth_acf_pos
+	};
+	const sim_intf_output_ops_t out_ops = {
+		.handle = enc,
+		.update_contact = update_contact,
+		.delete_contact = delete_contact,
+		.update_RA = update_RA
+	};
+	double end_t;
+	xtcas_ctx_t *ctx;
+	bool_t nmac;
+
+	memset(enc, 0, sizeof (*enc));
+	enc->scen = gen_encounter(params, idx, B_TRUE, &end_t);
+
+	ctx = xtcas_ctx_create_sync(&in_ops, &out_ops);
+	xtcas_ctx_set_mode(ctx, enc->scen->mode);
+	xtcas_ctx_set_threat_threads(ctx, 1);
+	if (tcas_params != NULL)
+		xtcas_ctx_set_params(ctx, tcas_params);
+	for (enc->now = 0; USEC2SEC(enc->now) <= end_t;
+	    enc->now += SIMSTEP) {
+		xtcas_scen_step(enc->scen, enc->now, SIMSTEP);
+		xtcas_ctx_step(ctx, USEC2SEC(enc->now));
+	}
+	xtcas_ctx_destroy(ctx);
+
+	nmac = is_nmac(enc->scen);
+	xtcas_scen_free(enc->scen);
+	enc->scen = NULL;
+
+	return (nmac);
+}
+
+static void
+stats_count(mc_stats_t *stats, bool_t multi, bool_t nmac_without,
+    bool_t nmac_with, const mc_enc_t *enc)
+{
+	stats->n++;
+	stats->multi += multi;
+	stats->TA += enc->TA;
+	stats->RA += enc->RA;
+	stats->reversals += enc->reversal;
+	stats->nmac_without += nmac_without;
+	stats->nmac_with += nmac_with;
+	stats->nmac_induced += (nmac_with && !nmac_without);
+}
+
+static void
+run_encounter(const mc_params_t *params, uint64_t idx, mc_stats_t *stats)
+{
+	size_t n_intr;
+	bool_t nmac_without = run_unequipped(params, idx, &n_intr);
+	mc_enc_t enc;
+	bool_t nmac_with = run_equipped(params, NULL, idx, &enc);
+
+	stats_count(stats, n_intr > 1, nmac_without, nmac_with, &enc);
+}
+
+static void
+stats_add(mc_stats_t *to, const mc_stats_t *from)
+{
+	to->n += from->n;
+	to->multi += from->multi;
+	to->TA += from->TA;
+	to->RA += from->RA;
+	to->reversals += from->reversals;
+	to->nmac_without += from->nmac_without;
+	to->nmac_with += from->nmac_with;
+	to->nmac_induced += from->nmac_induced;
+}
+
+/*
+ * xtcas_pool_run_steal callback, runs encounters [start, end).
+ */
+static void
+run_range(void *arg, size_t start, size_t end)
+{
+	mc_run_t *run = arg;
+	mc_stats_t stats;
+
+	memset(&stats, 0, sizeof (stats));
+	for (size_t i = start; i < end; i++)
+		run_encounter(run->params, i, &stats);
+
+	mutex_enter(&run->lock);
+	stats_add(&run->stats, &stats);
+	if (run->stats.n >= run->next_report) {
+		fprintf(stderr, "%llu/%llu encounters done\n",
+		    (unsigned long long)run->stats.n,
+		    (unsigned long long)run->total);
+		run->next_report += MAX(run->total / 10, 1);
+	}
+	mutex_exit(&run->lock);
+}
+
+static double
+ratio(uint64_t a, uint64_t b)
+{
+	return (b != 0 ? (double)a / b : 0);
+}
+
+static void
+print_stats(const mc_stats_t *stats)
+{
+	printf("encounters=%llu multi_threat=%llu TA=%llu TA_rate=%.4f "
+	    "RA=%llu RA_rate=%.4f\n", (unsigned long long)stats->n,
+	    (unsigned long long)stats->multi, (unsigned long long)stats->TA,
+	    ratio(stats->TA, stats->n), (unsigned long long)stats->RA,
+	    ratio(stats->RA, stats->n));
+	printf("reversals=%llu reversal_rate=%.4f\n",
+	    (unsigned long long)stats->reversals,
+	    ratio(stats->reversals, stats->RA));
+	printf("NMAC_without=%llu NMAC_with=%llu risk_ratio=",
+	    (unsigned long long)stats->nmac_without,
+	    (unsigned long long)stats->nmac_with);
+	if (stats->nmac_without != 0)
+		printf("%.4f\n", ratio(stats->nmac_with, stats->nmac_without));
+	else
+		printf("-\n");
+	printf("induced_NMAC=%llu induced_rate=%.6f\n",
+	    (unsigned long long)stats->nmac_induced,
+	    ratio(stats->nmac_induced, stats->n));
+}
+
+/*
+ * Parses a -P option.
+ */
+static bool_t
+parse_axis(const char *spec, sweep_axis_t *axis)
+{
+	const char *eq = strchr(spec, '=');
+	char name[64];
+	char *colon;
+	xtcas_params_t dflt;
+
+	memset(axis, 0, sizeof (*axis));
+	if (eq == NULL || eq == spec || eq - spec >= (int)sizeof (name))
+		return (B_FALSE);
+	strlcpy(name, spec, eq - spec + 1);
+	strlcpy(axis->name, name, sizeof (axis->name));
+	colon = strchr(name, ':');
+	if (colon != NULL) {
+		*colon = 0;
+		axis->SL = atoi(colon + 1);
+	}
+	for (size_t i = 0; i < ARRAY_NUM_ELEM(sweep_params); i++) {
+		if (strcmp(sweep_params[i].name, name) == 0)
+			axis->param = &sweep_params[i];
+	}
+	xtcas_get_dflt_params(&dflt);
+	if (axis->param == NULL ||
+	    (colon != NULL && (!axis->param->per_SL || axis->SL < 1 ||
+	    axis->SL > dflt.num_SL)))
+		return (B_FALSE);
+
+	for (const char *val = eq + 1; *val != 0;) {
+		char *end;
+		double v = strtod(val, &end);
+
+		if (end == val || (*end != ',' && *end != 0)) {
+			free(axis->vals);
+			axis->vals = NULL;
+			return (B_FALSE);
+		}
+		axis->vals = safe_realloc(axis->vals,
+		    (axis->n_vals + 1) * sizeof (*axis->vals));
+		axis->vals[axis->n_vals++] = v;
+		val = (*end == ',' ? end + 1 : end);
+	}
+
+	return (axis->n_vals != 0);
+}
+
+/*
+ * Index into the values of axis `a' in parameter set `set'. The first
+ * axis changes the slowest.
+ */
+static size_t
+axis_val_idx(const mc_sweep_t *sweep, size_t set, size_t a)
+{
+	for (size_t i = sweep->n_axes; i-- > a + 1;)
+		set /= sweep->axes[i].n_vals;
+	return (set % sweep->axes[a].n_vals);
+}
+
+static void
+sweep_set_params(const mc_sweep_t *sweep, size_t set, xtcas_params_t *tp)
+{
+	xtcas_get_dflt_params(tp);
+	for (size_t a = 0; a < sweep->n_axes; a++) {
+		const sweep_axis_t *axis = &sweep->axes[a];
+		const sweep_param_t *param = axis->param;
+		double val = axis->vals[axis_val_idx(sweep, set, a)];
+
+		if (!param->per_SL) {
+			*(double *)((uint8_t *)tp + param->off) =
+			    val * param->unit;
+		} else if (axis->SL != 0) {
+			*(double *)((uint8_t *)&tp->SL[axis->SL - 1] +
+			    param->off) = val * param->unit;
+		} else {
+			for (unsigned i = 0; i < tp->num_SL; i++) {
+				*(double *)((uint8_t *)&tp->SL[i] +
+				    param->off) *= val;
+			}
+		}
+	}
+}
+
+/*
+ * xtcas_pool_run_steal callback, flies encounters [start, end) without
+ * TCAS for the sweep.
+ */
+static void
+sweep_corpus_range(void *arg, size_t start, size_t end)
+{
+	mc_sweep_t *sweep = arg;
+
+	for (size_t i = start; i < end; i++) {
+		size_t n_intr;
+
+		sweep->nmac_without[i] = run_unequipped(sweep->params, i,
+		    &n_intr);
+		sweep->multi[i] = (n_intr > 1);
+	}
+}
+
+/*
+ * xtcas_pool_run_steal callback, flies all encounters with TCAS using
+ * the parameter sets [start, end).
+ */
+static void
+sweep_sets_range(void *arg, size_t start, size_t end)
+{
+	mc_sweep_t *sweep = arg;
+
+	for (size_t set = start; set < end; set++) {
+		xtcas_params_t tp;
+		mc_stats_t *stats = &sweep->results[set];
+
+		sweep_set_params(sweep, set, &tp);
+		memset(stats, 0, sizeof (*stats));
+		for (uint64_t i = 0; i < sweep->n; i++) {
+			mc_enc_t enc;
+			bool_t nmac_with = run_equipped(sweep->params, &tp, i,
+			    &enc);
+
+			stats_count(stats, sweep->multi[i],
+			    sweep->nmac_without[i], nmac_with, &enc);
+		}
+
+		mutex_enter(&sweep->lock);
+		sweep->sets_done++;
+		fprintf(stderr, "%lu/%lu parameter sets done\n",
+		    (unsigned long)sweep->sets_done,
+		    (unsigned long)sweep->n_sets);
+		mutex_exit(&sweep->lock);
+	}
+}
+
+static void
+print_sweep(const mc_sweep_t *sweep)
+{
+	printf("%5s", "set");
+	for (size_t a = 0; a < sweep->n_axes; a++)
+		printf("  %10s", sweep->axes[a].name);
+	printf("  %8s  %8s  %13s  %9s  %10s  %12s\n", "TA_rate", "RA_rate",
+	    "reversal_rate", "NMAC_with", "risk_ratio", "induced_rate");
+
+	for (size_t set = 0; set < sweep->n_sets; set++) {
+		const mc_stats_t *stats = &sweep->results[set];
+
+		printf("%5lu", (unsigned long)set);
+		for (size_t a = 0; a < sweep->n_axes; a++) {
+			const sweep_axis_t *axis = &sweep->axes[a];
+
+			printf("  %*g", (int)MAX(strlen(axis->name), 10),
+			    axis->vals[axis_val_idx(sweep, set, a)]);
+		}
+		printf("  %8.4f  %8.4f  %13.4f  %9llu  ",
+		    ratio(stats->TA, stats->n), ratio(stats->RA, stats->n),
+		    ratio(stats->reversals, stats->RA),
+		    (unsigned long long)stats->nmac_with);
+		if (stats->nmac_without != 0) {
+			printf("%10.4f", ratio(stats->nmac_with,
+			    stats->nmac_without));
+		} else {
+			printf("%10s", "-");
+		}
+		printf("  %12.6f\n", ratio(stats->nmac_induced, stats->n));
+	}
+}
+
+/*
+ * Runs the parameter sweep over the -P axes and prints the table.
+ */
+static void
+run_sweep(const mc_params_t *params, const sweep_axis_t *axes,
+    size_t n_axes, uint64_t n, xtcas_pool_t *pool)
+{
+	mc_sweep_t sweep;
+
+	memset(&sweep, 0, sizeof (sweep));
+	sweep.params = params;
+	sweep.axes = axes;
+	sweep.n_axes = n_axes;
+	sweep.n_sets = 1;
+	for (size_t a = 0; a < n_axes; a++)
+		sweep.n_sets *= axes[a].n_vals;
+	sweep.n = n;
+	sweep.nmac_without = safe_calloc(n, sizeof (*sweep.nmac_without));
+	sweep.multi = safe_calloc(n, sizeof (*sweep.multi));
+	sweep.results = safe_calloc(sweep.n_sets, sizeof (*sweep.results));
+	mutex_init(&sweep.lock);
+
+	xtcas_pool_run_steal(pool, sweep_corpus_range, &sweep, n, GRAIN);
+	xtcas_pool_run_steal(pool, sweep_sets_range, &sweep, sweep.n_sets, 1);
+	print_sweep(&sweep);
+
+	mutex_destroy(&sweep.lock);
+	free(sweep.results);
+	free(sweep.multi);
+	free(sweep.nmac_without);
+}
+
+/*
+ * Parses a reaction factor range, either "<min>,<max>" or a single
+ * value for a fixed reaction factor.
+ */
+static bool_t
+parse_react(const char *str, double *min, double *max)
+{
+	int n = sscanf(str, "%lf,%lf", min, max);
+
+	if (n == 1)
+		*max = *min;
+
+	return (n >= 1 && *min > 0 && *max >= *min);
+}
+
+int
+main(int argc, char **argv)
+{
+	int opt;
+	long long n = DFL_ENCOUNTERS;
+	long long single = -1;
+	long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	mc_params_t params = {
+		.hmd_max = FEET2MET(DFL_HMD_MAX),
+		.vmd_max = FEET2MET(DFL_VMD_MAX),
+		.multi = DFL_MULTI,
+		.react_min = DFL_REACT_MIN,
+		.react_max = DFL_REACT_MAX,
+		.comply = 1.0,
+		.seed = 1
+	};
+	mc_run_t run;
+	sweep_axis_t axes[MAX_AXES];
+	size_t n_axes = 0;
+	xtcas_pool_t pool;
+	uint64_t start;
+	double dur;
+
+	log_init(lib_log_func, "xtcas_montecarlo");
+
+	while ((opt = getopt(argc, argv, "n:T:H:V:m:r:p:s:i:P:d")) != -1) {
+		switch (opt) {
+		case 'n':
+			n = atoll(optarg);
+			break;
+		case 'T':
+			nthreads = atol(optarg);
+			break;
+		case 'H':
+			params.hmd_max = FEET2MET(atof(optarg));
+			break;
+		case 'V':
+			params.vmd_max = FEET2MET(atof(optarg));
+			break;
+		case 'm':
+			params.multi = atof(optarg);
+			break;
+		case 'r':
+			if (!parse_react(optarg, &params.react_min,
+			    &params.react_max)) {
+				fprintf(stderr, "Invalid options, -r expects "
+				    "<min>,<max> or a single positive "
+				    "number.\n");
+				return (1);
+			}
+			break;
+		case 'p':
+			params.comply = atof(optarg);
+			break;
+		case 's':
+			params.seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'i':
+			single = atoll(optarg);
+			break;
+		case 'P':
+			if (n_axes == MAX_AXES) {
+				fprintf(stderr, "Invalid options, at most %d "
+				    "-P options are supported.\n", MAX_AXES);
+				return (1);
+			}
+			if (!parse_axis(optarg, &axes[n_axes])) {
+				fprintf(stderr, "Invalid options, -P expects "
+				    "<param>[:<SL>]=<value>[,<value>...], "
+				    "see the header of montecarlo.c for the "
+				    "parameter names.\n");
+				return (1);
+			}
+			n_axes++;
+			break;
+		case 'd':
+			xtcas_dbg.all++;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n <encounters>] "
+			    "[-T <threads>] [-H <max_hmd_ft>] "
+			    "[-V <max_vmd_ft>] [-m <multi_threat_ratio>] "
+			    "[-r <min_react>[,<max_react>]] "
+			    "[-p <compliance>] [-s <seed>] [-i <encounter>] "
+			    "[-P <param>[:<SL>]=<value>[,<value>...]] "
+			    "[-d]\n", argv[0]);
+			return (1);
+		}
+	}
+	if (n < 1 || n > UINT32_MAX || nthreads < 1 ||
+	    params.hmd_max < 0 || params.vmd_max < 0 ||
+	    params.multi < 0 || params.multi > 1 ||
+	    params.comply < 0 || params.comply > 1) {
+		fprintf(stderr, "Invalid options, -n and -T must be greater "
+		    "than zero, -H and -V must not be negative and -m and "
+		    "-p must be within 0 and 1.\n");
+		return (1);
+	}
+
+	memset(&run, 0, sizeof (run));
+	run.params = &params;
+
+	if (single >= 0) {
+		size_t n_intr;
+		mc_enc_t enc;
+		bool_t nmac_without = run_unequipped(&params, single, &n_intr);
+		bool_t nmac_with = run_equipped(&params, NULL, single, &enc);
+
+		printf("encounter=%lld intruders=%lu RA=%d reversal=%d "
+		    "NMAC_without=%d NMAC_with=%d\n", single,
+		    (unsigned long)n_intr, enc.RA, enc.reversal, nmac_without,
+		    nmac_with);
+		return (0);
+	}
+
+	if (n_axes != 0) {
+		xtcas_pool_init(&pool, nthreads);
+		start = microclock();
+		run_sweep(&params, axes, n_axes, n, &pool);
+		dur = USEC2SEC(microclock() - start);
+		xtcas_pool_fini(&pool);
+		for (size_t a = 0; a < n_axes; a++)
+			free(axes[a].vals);
+		fprintf(stderr, "sweep of %lld encounters in %.3f s on %ld "
+		    "threads\n", n, dur, nthreads);
+		return (0);
+	}
+
+	mutex_init(&run.lock);
+	run.total = n;
+	run.next_report = MAX(run.total / 10, 1);
+	xtcas_pool_init(&pool, nthreads);
+
+	start = microclock();
+	xtcas_pool_run_steal(&pool, run_range, &run, n, GRAIN);
+	dur = USEC2SEC(microclock() - start);
+
+	xtcas_pool_fini(&pool);
+	mutex_destroy(&run.lock);
+
+	print_stats(&run.stats);
+	fprintf(stderr, "%lld encounters in %.3f s (%.1f encounters/s) on "
+	    "%ld threads\n", n, dur, n / MAX(dur, 1e-6), nthreads);
+
+	return (0);
+}
+
+static void
+get_my_acf_pos(void *handle, geo_pos3_t *pos, double *alt_agl, double *hdg,
+    bool_t *gear_ext, bool_t *on_ground)
+{
+	mc_enc_t *enc = handle;
+
+	xtcas_scen_get_my_acf_pos(enc->scen, pos, alt_agl, hdg);
+	*gear_ext = B_FALSE;
+	*on_ground = B_FALSE;
+}
+
+static size_t
+fill_oth_acf_pos(void *handle, acf_pos_t *pos_out, size_t cap)
+{
+	mc_enc_t *enc = handle;
+
+	return (xtcas_scen_fill_oth_acf_pos(enc->scen, pos_out, cap));
+}
+
+static void
+update_contact(void *handle, void *acf_id, double rbrg, double rdist,
+    double ralt, double vs, double trk, double gs, tcas_threat_t level)
+{
+	UNUSED(handle);
+	UNUSED(acf_id);
+	UNUSED(rbrg);
+	UNUSED(rdist);
+	UNUSED(ralt);
+	UNUSED(vs);
+	UNUSED(trk);
+	UNUSED(gs);
+	UNUSED(level);
+}
+
+static void
+delete_contact(void *handle, void *acf_id)
+{
+	UNUSED(handle);
+	UNUSED(acf_id);
+}
+
+static void
+update_RA(void *handle, tcas_adv_t adv, tcas_msg_t msg, tcas_RA_type_t type,
+    tcas_RA_sense_t sense, bool_t crossing, bool_t reversal, double min_sep_cpa,
+    double min_green, double max_green, double min_red_lo, double max_red_lo,
+    double min_red_hi, double max_red_hi)
+{
+	mc_enc_t *enc = handle;
+
+	UNUSED(msg);
+	UNUSED(type);
+	UNUSED(sense);
+	UNUSED(crossing);
+	UNUSED(min_sep_cpa);
+
+	if (adv >= ADV_STATE_TA)
+		enc->TA = B_TRUE;
+	if (adv == ADV_STATE_RA) {
+		enc->RA = B_TRUE;
+		if (reversal)
+			enc->reversal = B_TRUE;
+	}
+	xtcas_scen_RA_update(enc->scen, adv, reversal, min_green, max_green,
+	    min_red_lo, max_red_lo, min_red_hi, max_red_hi,
+	    USEC2SEC(enc->now));
+}
@@ -0,0 +1,306 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+*/
+/*
+ * Copyright 2025 Saso Kiselkov. All rights reserved.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <acfutils/assert.h>
+#include <acfutils/helpers.h>
+#include <acfutils/safe_alloc.h>
+
+#include "pool.h"
+
+struct xtcas_pool_thr {
+	xtcas_pool_t	*pool;
+	unsigned	idx;		/* slice number, helpers start at 1 */
+	thread_t	thread;
+};
+
+/*
+ * Slice `idx' of `nthreads' of the index range [0, n).
+ */
+static inline void
+slice(size_t n, unsigned nthreads, unsigned idx, size_t *start, size_t *end)
+{
+	*start = (n * idx) / nthreads;
+	*end = (n * (idx + 1)) / nthreads;
+}
+
+static inline uint64_t
+range_pack(size_t start, size_t end)
+{
+	return (((uint64_t)end << 32) | start);
+}
+
+static inline void
+range_unpack(uint64_t range, size_t *start, size_t *end)
+{
+	*start = range & UINT32_MAX;
+	*end = range >> 32;
+}
+
+/*
+ * Takes up to `grain' indices off the start of `r'. Returns B_FALSE if
+ * `r' is empty.
+ */
+static bool_t
+range_take(xtcas_pool_range_t *r, size_t grain, size_t *start, size_t *end)
+{
+	uint64_t old = atomic_load_explicit(&r->range, memory_order_relaxed);
+
+	for (;;) {
+		size_t s, e, next;
+
+		range_unpack(old, &s, &e);
+		if (s >= e)
+			return (B_FALSE);
+		next = s + MIN(grain, e - s);
+		if (atomic_compare_exchange_weak_explicit(&r->range, &old,
+		    range_pack(next, e), memory_order_relaxed,
+		    memory_order_relaxed)) {
+			*start = s;
+			*end = next;
+			return (B_TRUE);
+		}
+	}
+}
+
+/*
+ * Moves the upper half of the largest range of any other thread into
+ * the (empty) range of thread `idx'. Only the owner ever puts work into
+ * an empty range, so that can be a plain store. Returns B_FALSE once
+ * there is nothing left to steal.
+ */
+static bool_t
+range_steal(xtcas_pool_t *pool, unsigned idx)
+{
+	for (;;) {
+		xtcas_pool_range_t *victim = NULL;
+		uint64_t victim_range = 0;
+		size_t best = 0, s, e, mid;
+
+		for (unsigned i = 1; i < pool->nthreads; i++) {
+			xtcas_pool_range_t *r =
+			    &pool->ranges[(idx + i) % pool->nthreads];
+			uint64_t range = atomic_load_explicit(&r->range,
+			    memory_order_relaxed);
+
+			range_unpack(range, &s, &e);
+			if (s < e && e - s > best) {
+				best = e - s;
+				victim = r;
+				victim_range = range;
+			}
+		}
+		if (victim == NULL)
+			return (B_FALSE);
+
+		range_unpack(victim_range, &s, &e);
+		mid = e - (e - s + 1) / 2;
+		if (atomic_compare_exchange_strong_explicit(&victim->range,
+		    &victim_range, range_pack(s, mid), memory_order_relaxed,
+		    memory_order_relaxed)) {
+			atomic_store_explicit(&pool->ranges[idx].range,
+			    range_pack(mid, e), memory_order_relaxed);
+			return (B_TRUE);
+		}
+	}
+}
+
+/*
+ * Thread `idx's share of an xtcas_pool_run_steal job.
+ */
+static void
+run_stealing(xtcas_pool_t *pool, unsigned idx, xtcas_pool_func_t func,
+    void *arg, size_t grain)
+{
+	xtcas_pool_range_t *r = &pool->ranges[idx];
+	size_t start, end;
+
+	do {
+		while (range_take(r, grain, &start, &end))
+			func(arg, start, end);
+	} while (range_steal(pool, idx));
+}
+
+static void
+pool_worker(void *arg)
+{
+	xtcas_pool_thr_t *thr = arg;
+	xtcas_pool_t *pool = thr->pool;
+	uint64_t gen = 0;
+
+	thread_set_name("X-TCAS pool");
+
+	mutex_enter(&pool->lock);
+	while (!pool->shutdown) {
+		if (pool->gen != gen) {
+			xtcas_pool_func_t func = pool->func;
+			void *func_arg = pool->arg;
+			size_t grain = pool->grain;
+			size_t start, end;
+
+			gen = pool->gen;
+			slice(pool->n, pool->nthreads, thr->idx, &start, &end);
+			mutex_exit(&pool->lock);
+
+			if (grain != 0)
+				run_stealing(pool, thr->idx, func, func_arg,
+				    grain);
+			else if (start < end)
+				func(func_arg, start, end);
+
+			mutex_enter(&pool->lock);
+			ASSERT(pool->busy != 0);
+			if (--pool->busy == 0)
+				cv_broadcast(&pool->done_cv);
+			continue;
+		}
+		cv_wait(&pool->work_cv, &pool->lock);
+	}
+	mutex_exit(&pool->lock);
+}
+
+void
+xtcas_pool_init(xtcas_pool_t *pool, unsigned nthreads)
+{
+	ASSERT(nthreads != 0);
+
+	memset(pool, 0, sizeof (*pool));
+	pool->nthreads = nthreads;
+	mutex_init(&pool->lock);
+	cv_init(&pool->work_cv);
+	cv_init(&pool->done_cv);
+
+	if (nthreads > 1) {
+		pool->ranges = safe_calloc(nthreads, sizeof (*pool->ranges));
+		for (unsigned i = 0; i < nthreads; i++)
+			atomic_init(&pool->ranges[i].range, 0);
+		pool->thrs = safe_calloc(nthreads - 1, sizeof (*pool->thrs));
+		for (unsigned i = 0; i + 1 < nthreads; i++) {
+			xtcas_pool_thr_t *thr = &pool->thrs[i];
+
+			thr->pool = pool;
+			thr->idx = i + 1;
+			VERIFY(thread_create(&thr->thread, pool_worker, thr));
+		}
+	}
+}
+
+void
+xtcas_pool_fini(xtcas_pool_t *pool)
+{
+	if (pool->nthreads == 0)
+		return;
+
+	mutex_enter(&pool->lock);
+	ASSERT0(pool->busy);
+	pool->shutdown = B_TRUE;
+	cv_broadcast(&pool->work_cv);
+	mutex_exit(&pool->lock);
+
+	for (unsigned i = 0; i + 1 < pool->nthreads; i++)
+		thread_join(&pool->thrs[i].thread);
+	free(pool->thrs);
+	free(pool->ranges);
+
+	cv_destroy(&pool->done_cv);
+	cv_destroy(&pool->work_cv);
+	mutex_destroy(&pool->lock);
+	memset(pool, 0, sizeof (*pool));
+}
+
+/*
+ * Hands the job to the helpers, runs the caller's share of it and waits
+ * for the helpers to finish theirs.
+ */
+static void
+pool_dispatch(xtcas_pool_t *pool, xtcas_pool_func_t func, void *arg,
+    size_t n, size_t grain)
+{
+	size_t start, end;
+
+	mutex_enter(&pool->lock);
+	ASSERT0(pool->busy);
+	pool->func = func;
+	pool->arg = arg;
+	pool->n = n;
+	pool->grain = grain;
+	pool->busy = pool->nthreads - 1;
+	pool->gen++;
+	cv_broadcast(&pool->work_cv);
+	mutex_exit(&pool->lock);
+
+	if (grain != 0) {
+		run_stealing(pool, 0, func, arg, grain);
+	} else {
+		slice(n, pool->nthreads, 0, &start, &end);
+		if (start < end)
+			func(arg, start, end);
+	}
+
+	mutex_enter(&pool->lock);
+	while (pool->busy != 0)
+		cv_wait(&pool->done_cv, &pool->lock);
+	pool->func = NULL;
+	pool->arg = NULL;
+	mutex_exit(&pool->lock);
+}
+
+void
+xtcas_pool_run(xtcas_pool_t *pool, xtcas_pool_func_t func, void *arg,
+    size_t n)
+{
+	ASSERT(pool->nthreads != 0);
+	ASSERT(func != NULL);
+
+	if (pool->nthreads == 1) {
+		if (n != 0)
+			func(arg, 0, n);
+		return;
+	}
+	pool_dispatch(pool, func, arg, n, 0);
+}
+
+void
+xtcas_pool_run_steal(xtcas_pool_t *pool, xtcas_pool_func_t func, void *arg,
+    size_t n, size_t grain)
+{
+	ASSERT(pool->nthreads != 0);
+	ASSERT(func != NULL);
+	ASSERT(grain != 0);
+	VERIFY3U(n, <=, UINT32_MAX);
+
+	if (pool->nthreads == 1) {
+		for (size_t i = 0; i < n; i += grain)
+			func(arg, i, MIN(i + grain, n));
+		return;
+	}
+	/*
+	 * The ranges are only seeded here, before the helpers are woken
+	 * up. The pool lock taken in pool_dispatch publishes them.
+	 */
+	for (unsigned i = 0; i < pool->nthreads; i++) {
+		size_t start, end;
+
+		slice(n, pool->nthreads, i, &start, &end);
+		atomic_store_explicit(&pool->ranges[i].range,
+		    range_pack(start, end), memory_order_relaxed);
+	}
+	pool_dispatch(pool, func, arg, n, grain);
+}
@@ -0,0 +1,91 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+*/
+/*
+ * Copyright 2025 Saso Kiselkov. All rights reserved.
+ */
+
+#ifndef	_XTCAS_POOL_H_
+#define	_XTCAS_POOL_H_
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <acfutils/thread.h>
+#include <acfutils/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Small fork-join thread pool for data-parallel loops. xtcas_pool_run
+ * splits the index range [0, n) into one contiguous slice per thread and
+ * calls `func' on each slice, with the calling thread processing the
+ * first slice itself. It returns once all slices are done. A pool of
+ * `nthreads' threads spawns `nthreads - 1' helper threads, so a pool of
+ * 1 simply runs `func' on the caller's thread.
+ *
+ * xtcas_pool_run_steal is meant for loops whose iterations vary widely
+ * in cost. Every thread again starts out on its own slice, but works
+ * through it `grain' indices at a time, so `func' is called many times
+ * per thread. Once a thread's slice is used up, it steals the upper half
+ * of the largest slice left over in any other thread and continues with
+ * that, until no work is left anywhere. `n' must fit into 32 bits.
+ */
+typedef void (*xtcas_pool_func_t)(void *arg, size_t start, size_t end);
+
+typedef struct xtcas_pool_thr xtcas_pool_thr_t;
+
+#define	XTCAS_POOL_CACHELINE	64
+
+/*
+ * What is left of a thread's slice in xtcas_pool_run_steal, with the
+ * start index in the low and the end index in the high 32 bits.
+ */
+typedef struct {
+	_Atomic uint64_t	range;
+	uint8_t			pad[XTCAS_POOL_CACHELINE - sizeof (uint64_t)];
+} xtcas_pool_range_t;
+
+typedef struct {
+	unsigned		nthreads;
+	xtcas_pool_thr_t	*thrs;		/* nthreads - 1 helpers */
+
+	mutex_t			lock;
+	condvar_t		work_cv;	/* new job or shutdown */
+	condvar_t		done_cv;	/* all helpers finished */
+	uint64_t		gen;		/* job generation number */
+	unsigned		busy;		/* helpers still working */
+	bool_t			shutdown;
+	xtcas_pool_func_t	func;
+	void			*arg;
+	size_t			n;
+	size_t			grain;		/* 0 unless stealing */
+	xtcas_pool_range_t	*ranges;	/* nthreads */
+} xtcas_pool_t;
+
+void xtcas_pool_init(xtcas_pool_t *pool, unsigned nthreads);
+void xtcas_pool_fini(xtcas_pool_t *pool);
+void xtcas_pool_run(xtcas_pool_t *pool, xtcas_pool_func_t func, void *arg,
+    size_t n);
+void xtcas_pool_run_steal(xtcas_pool_t *pool, xtcas_pool_func_t func,
+    void *arg, size_t n, size_t grain);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _XTCAS_POOL_H_ */
@@ -16,34 +16,193 @@
  * Copyright 2017 Saso Kiselkov. All rights reserved.
  */
 
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+
 #include <acfutils/assert.h>
 #include <acfutils/helpers.h>
 
 #include "pos.h"
 
-#define	STEP_BACK(step)	((step) == 0 ? (NUM_POS_STEPS - 1) : (step) - 1)
 #define	MAX_UPD_GS	500	/* m/s */
 
+/*
+ * Filter tuning. The measurement noise is the expected 1-sigma error of
+ * a position update. The process noise is the spectral density of the
+ * white noise which drives the highest modeled derivative: acceleration
+ * for the horizontal axes and jerk for the vertical axis.
+ */
+#define	POS_SIGMA_H	3.0	/* meters */
+#define	POS_SIGMA_V	5.0	/* meters */
+#define	PROC_NOISE_H	16.0	/* (m/s^2)^2 per Hz */
+#define	PROC_NOISE_V	1.0	/* (m/s^3)^2 per Hz */
+
+/*
+ * Initial state variances. A fresh filter knows nothing about the
+ * object's velocity, so the second update effectively computes a plain
+ * finite difference. Vertical acceleration is seeded with a realistic
+ * maneuvering limit (about 0.5G) to keep it from absorbing noise.
+ */
+#define	VEL_VAR_INIT	1e6	/* (m/s)^2 */
+#define	ACC_VAR_INIT	25.0	/* (m/s^2)^2 */
+
+/*
+ * The velocity outputs are only reported once their variance drops below
+ * this. At 1 Hz that happens on the second update, at higher update rates
+ * it takes a little under a second.
+ */
+#define	VEL_READY_VAR	100.0	/* (m/s)^2 */
+
+static void
+kf_init(pos_kf_t *kf, double z, double r)
+{
+	memset(kf, 0, sizeof (*kf));
+	kf->x[0] = z;
+	kf->P[0][0] = r;
+	kf->P[1][1] = VEL_VAR_INIT;
+	kf->P[2][2] = ACC_VAR_INIT;
+}
+
+/*
+ * Advances the first `n' states of the filter by `dt' seconds. The process
+ * noise matrix of the n-state model is the bottom-right n x n block of the
+ * 3-state one, so we only need to write that one down.
+ */
+static void
+kf_predict(pos_kf_t *kf, unsigned n, double dt, double q)
+{
+	const double dt2 = dt * dt, dt3 = dt2 * dt;
+	const double F[3][3] = {
+	    { 1, dt, dt2 / 2 },
+	    { 0, 1, dt },
+	    { 0, 0, 1 }
+	};
+	const double Q[3][3] = {
+	    { dt3 * dt2 / 20, dt2 * dt2 / 8, dt3 / 6 },
+	    { dt2 * dt2 / 8, dt3 / 3, dt2 / 2 },
+	    { dt3 / 6, dt2 / 2, dt }
+	};
+	const unsigned o = 3 - n;
+	double FP[3][3], x[3];
+
+	ASSERT(n == 2 || n == 3);
+
+	for (unsigned i = 0; i < n; i++) {
+		x[i] = 0;
+		for (unsigned k = 0; k < n; k++) {
+			x[i] += F[i][k] * kf->x[k];
+			FP[i][k] = 0;
+			for (unsigned j = 0; j < n; j++)
+				FP[i][k] += F[i][j] * kf->P[j][k];
+		}
+	}
+	for (unsigned i = 0; i < n; i++) {
+		kf->x[i] = x[i];
+		for (unsigned j = 0; j < n; j++) {
+			double p = q * Q[o + i][o + j];
+
+			for (unsigned k = 0; k < n; k++)
+				p += FP[i][k] * F[j][k];
+			kf->P[i][j] = p;
+		}
+	}
+}
+
+/*
+ * Folds a position measurement `z' with variance `r' into the first `n'
+ * states of the filter.
+ */
+static void
+kf_update(pos_kf_t *kf, unsigned n, double z, double r)
+{
+	double S = kf->P[0][0] + r;
+	double y = z - kf->x[0];
+	double K[3], P0[3];
+
+	for (unsigned i = 0; i < n; i++) {
+		K[i] = kf->P[i][0] / S;
+		P0[i] = kf->P[0][i];
+	}
+	for (unsigned i = 0; i < n; i++) {
+		kf->x[i] += K[i] * y;
+		for (unsigned j = 0; j < n; j++)
+			kf->P[i][j] -= K[i] * P0[j];
+	}
+}
+
+/*
+ * Sets up the tangent plane at `anchor'. The scale factors are the
+ * meridional and prime vertical radii of curvature of the WGS84 ellipsoid.
+ */
+static void
+set_anchor(obj_pos_t *pos, geo_pos2_t anchor)
+{
+	double s = sin(DEG2RAD(anchor.lat));
+	double w = 1 - wgs84.ecc2 * POW2(s);
+
+	pos->anchor = anchor;
+	pos->m_per_deg_lat = DEG2RAD(wgs84.a * (1 - wgs84.ecc2) /
+	    (w * sqrt(w)));
+	pos->m_per_deg_lon = DEG2RAD(wgs84.a / sqrt(w) *
+	    cos(DEG2RAD(anchor.lat)));
+}
+
+static vect2_t
+geo2local(const obj_pos_t *pos, geo_pos3_t p)
+{
+	double dlon = p.lon - pos->anchor.lon;
+
+	if (dlon > 180)
+		dlon -= 360;
+	else if (dlon < -180)
+		dlon += 360;
+
+	return (VECT2(dlon * pos->m_per_deg_lon,
+	    (p.lat - pos->anchor.lat) * pos->m_per_deg_lat));
+}
+
+static void
+restart(obj_pos_t *pos, double t, geo_pos3_t upd, double rad_alt)
+{
+	set_anchor(pos, GEO3_TO_GEO2(upd));
+	kf_init(&pos->kf_x, 0, POW2(POS_SIGMA_H));
+	kf_init(&pos->kf_y, 0, POW2(POS_SIGMA_H));
+	pos->num_upd = 1;
+	if (!isnan(upd.elev)) {
+		kf_init(&pos->kf_z, upd.elev, POW2(POS_SIGMA_V));
+		pos->num_upd_v = 1;
+		pos->time_v = t;
+	} else {
+		pos->num_upd_v = 0;
+	}
+	pos->time = t;
+	pos->rad_alt = rad_alt;
+	pos->pos = upd;
+}
+
 /*
  * Puts a position update into `pos'. The time of the update is `t'.
+ * Updates of an object with no altitude reporting (NAN elevation) only
+ * advance the horizontal filter.
  */
 void
 xtcas_obj_pos_update(obj_pos_t *pos, double t, geo_pos3_t upd, double rad_alt)
 {
-	unsigned next_step = (pos->latest_step + 1) % NUM_POS_STEPS;
-	double gs;
+	vect2_t p;
+	double dt;
 
-	if (pos->populated_steps > 0)
-		ASSERT3F(pos->time[pos->latest_step], <, t);
+	if (pos->num_upd == 0) {
+		restart(pos, t, upd, rad_alt);
+		return;
+	}
 
-	pos->time[next_step] = t;
-	pos->rad_alt[next_step] = rad_alt;
-	pos->pos[next_step] = upd;
-	if (pos->populated_steps < NUM_POS_STEPS)
-		pos->populated_steps++;
-	pos->latest_step = next_step;
+	ASSERT3F(pos->time, <, t);
+	dt = t - pos->time;
 
-	if (xtcas_obj_pos_get_gs(pos, &gs) && gs > MAX_UPD_GS) {
+	p = geo2local(pos, upd);
+	if (vect2_abs(vect2_sub(p, geo2local(pos, pos->pos))) / dt >
+	    MAX_UPD_GS) {
 		/*
 		 * If the groundspeed between two position updates is
 		 * excessive, then we are dealing with a replaced
@@ -52,109 +211,145 @@ xtcas_obj_pos_update(obj_pos_t *pos, double t, geo_pos3_t upd, double rad_alt)
 		 * start rebuilding it, as the old data is unusable
 		 * anymore.
 		 */
-		pos->time[0] = t;
-		pos->rad_alt[0] = rad_alt;
-		pos->pos[0] = upd;
-		pos->populated_steps = 1;
-		pos->latest_step = 0;
+		restart(pos, t, upd, rad_alt);
+		return;
 	}
+	if (vect2_abs(p) > POS_ANCHOR_DIST) {
+		/*
+		 * Move the tangent plane under the object to keep the
+		 * flat-earth error negligible. Velocities carry over as-is.
+		 */
+		pos->kf_x.x[0] -= p.x;
+		pos->kf_y.x[0] -= p.y;
+		set_anchor(pos, GEO3_TO_GEO2(upd));
+		p = ZERO_VECT2;
+	}
+
+	kf_predict(&pos->kf_x, 2, dt, PROC_NOISE_H);
+	kf_update(&pos->kf_x, 2, p.x, POW2(POS_SIGMA_H));
+	kf_predict(&pos->kf_y, 2, dt, PROC_NOISE_H);
+	kf_update(&pos->kf_y, 2, p.y, POW2(POS_SIGMA_H));
+	if (pos->num_upd < UINT_MAX)
+		pos->num_upd++;
+
+	if (!isnan(upd.elev)) {
+		if (pos->num_upd_v == 0) {
+			kf_init(&pos->kf_z, upd.elev, POW2(POS_SIGMA_V));
+		} else {
+			/*
+			 * The vertical filter might have skipped some
+			 * updates, so predict from its own last update.
+			 */
+			kf_predict(&pos->kf_z, 3, t - pos->time_v,
+			    PROC_NOISE_V);
+			kf_update(&pos->kf_z, 3, upd.elev, POW2(POS_SIGMA_V));
+		}
+		if (pos->num_upd_v < UINT_MAX)
+			pos->num_upd_v++;
+		pos->time_v = t;
+	}
+
+	pos->time = t;
+	pos->rad_alt = rad_alt;
+	pos->pos = upd;
+}
+
+static bool_t
+h_ready(const obj_pos_t *pos)
+{
+	return (pos->num_upd >= 2 && pos->kf_x.P[1][1] <= VEL_READY_VAR &&
+	    pos->kf_y.P[1][1] <= VEL_READY_VAR);
 }
 
 /*
- * Given an object's position, calculate its groundspeed/velocity heading and
- * first derivative.
+ * Given an object's position, calculate its groundspeed in m/s.
  */
 bool_t
 xtcas_obj_pos_get_gs(const obj_pos_t *pos, double *gs)
 {
-	geo_pos3_t p1_2d, p2_2d;
-	vect3_t p1, p2;
-	double dt1;
-
-	/*
-	 * Strip the elevation part from the positions to transform the
-	 * groundspeed readout into a true along-the-ground value, instead
-	 * of incorporating the vertical velocity portion.
-	 */
-	p1_2d = pos->pos[pos->latest_step];
-	p1_2d.elev = 0;
-	p2_2d = pos->pos[STEP_BACK(pos->latest_step)];
-	p2_2d.elev = 0;
-
-	p1 = geo2ecef_ft(p1_2d, &wgs84);
-	p2 = geo2ecef_ft(p2_2d, &wgs84);
-	dt1 = pos->time[pos->latest_step] -
-	    pos->time[STEP_BACK(pos->latest_step)];
-	if (gs != NULL) {
-		if (pos->populated_steps >= 2) {
-			ASSERT3F(dt1, >, 0.0);
-			*gs = vect3_abs(vect3_sub(p1, p2)) / dt1;
-		} else {
-			return (B_FALSE);
-		}
-	}
-
+	if (!h_ready(pos))
+		return (B_FALSE);
+	if (gs != NULL)
+		*gs = sqrt(POW2(pos->kf_x.x[1]) + POW2(pos->kf_y.x[1]));
 	return (B_TRUE);
 }
 
 /*
- * Given an object's position, calculate its true track heading and first
- * derivative.
+ * Given an object's position, calculate its true track heading.
  */
 bool_t
 xtcas_obj_pos_get_trk(const obj_pos_t *pos, double *trk)
 {
-	fpp_t fpp;
-	geo_pos3_t p1 = pos->pos[pos->latest_step];
-	geo_pos3_t p2 = pos->pos[STEP_BACK(pos->latest_step)];
-	vect2_t tp1, tp2;
-
-	fpp = ortho_fpp_init(GEO3_TO_GEO2(p2), 0, &wgs84, B_FALSE);
-	tp1 = geo2fpp(GEO3_TO_GEO2(p1), &fpp);
-	tp2 = geo2fpp(GEO3_TO_GEO2(p2), &fpp);
-
-	if (trk != NULL) {
-		if (pos->populated_steps >= 2)
-			*trk = dir2hdg(vect2_sub(tp1, tp2));
-		else
-			return (B_FALSE);
-	}
+	if (!h_ready(pos))
+		return (B_FALSE);
+	if (trk != NULL)
+		*trk = dir2hdg(VECT2(pos->kf_x.x[1], pos->kf_y.x[1]));
 	return (B_TRUE);
 }
 
 /*
  * Given an object's position, calculate its vertical velocity and first
- * derivative.
+ * derivative. For objects without altitude reporting, both are NAN.
  */
 bool_t
 xtcas_obj_pos_get_vvel(const obj_pos_t *pos, double *vvel, double *d_vvel)
 {
-	double e1, e2, e3;
-	double dt1 = pos->time[pos->latest_step] -
-	    pos->time[STEP_BACK(pos->latest_step)];
-	double dt2 = pos->time[STEP_BACK(pos->latest_step)] -
-	    pos->time[STEP_BACK(STEP_BACK(pos->latest_step))];
-
-	e1 = pos->pos[pos->latest_step].elev;
-	e2 = pos->pos[STEP_BACK(pos->latest_step)].elev;
-	e3 = pos->pos[STEP_BACK(STEP_BACK(pos->latest_step))].elev;
-
-	if (vvel != NULL) {
-		if (pos->populated_steps >= 2) {
-			ASSERT3F(dt1, >, 0.0);
-			*vvel = (e1 - e2) / dt1;
-		} else {
+	if (pos->num_upd_v == 0) {
+		if (!h_ready(pos))
 			return (B_FALSE);
-		}
+		if (vvel != NULL)
+			*vvel = NAN;
+		if (d_vvel != NULL)
+			*d_vvel = NAN;
+		return (B_TRUE);
 	}
+	if (pos->num_upd_v < 2 || pos->kf_z.P[1][1] > VEL_READY_VAR)
+		return (B_FALSE);
+	if (vvel != NULL)
+		*vvel = pos->kf_z.x[1];
 	if (d_vvel != NULL) {
-		if (pos->populated_steps >= 3) {
-			ASSERT3F(dt1, >, 0.0);
-			ASSERT3F(dt2, >, 0.0);
-			*d_vvel = ((e1 - e2) / dt1) - ((e2 - e3) / dt2);
-		} else {
+		if (pos->num_upd_v < 3)
 			return (B_FALSE);
-		}
+		*d_vvel = pos->kf_z.x[2];
+	}
+	return (B_TRUE);
+}
+
+/*
+ * Returns the variances of the outputs of the getters above, in the same
+ * units, except for track, which is in degrees squared. The groundspeed
+ * and track variances are the velocity variance projected along and
+ * across the direction of travel, respectively. Any of the output
+ * pointers may be NULL. Returns B_FALSE if the trend isn't available yet.
+ */
+bool_t
+xtcas_obj_pos_get_var(const obj_pos_t *pos, double *gs_var,
+    double *trk_var, double *vvel_var, double *d_vvel_var)
+{
+	double vx = pos->kf_x.x[1], vy = pos->kf_y.x[1];
+	double gs2 = POW2(vx) + POW2(vy);
+	double Pxx = pos->kf_x.P[1][1], Pyy = pos->kf_y.P[1][1];
+	double along, across;
+
+	if (!h_ready(pos))
+		return (B_FALSE);
+
+	/* The two horizontal axes are independent, so Pxy = 0. */
+	if (gs2 > 0) {
+		along = (POW2(vx) * Pxx + POW2(vy) * Pyy) / gs2;
+		across = (POW2(vy) * Pxx + POW2(vx) * Pyy) / gs2;
+	} else {
+		along = across = MAX(Pxx, Pyy);
+	}
+	if (gs_var != NULL)
+		*gs_var = along;
+	if (trk_var != NULL) {
+		*trk_var = (gs2 > 0) ? POW2(RAD2DEG(1)) * across / gs2 :
+		    INFINITY;
 	}
+	if (vvel_var != NULL)
+		*vvel_var = (pos->num_upd_v >= 2 ? pos->kf_z.P[1][1] : NAN);
+	if (d_vvel_var != NULL)
+		*d_vvel_var = (pos->num_upd_v >= 3 ? pos->kf_z.P[2][2] : NAN);
 	return (B_TRUE);
 }
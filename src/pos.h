@@ -27,20 +27,47 @@ extern "C" {
 
 /*
  * Position tracking funtions.
+ *
+ * Every tracked object runs its position updates through a small Kalman
+ * filter. The filter works in a local tangent plane (meters, X east,
+ * Y north, Z elevation) anchored near the object, which gets re-anchored
+ * once the object wanders more than POS_ANCHOR_DIST away from it. The
+ * horizontal axes use a constant-velocity model, the vertical axis a
+ * constant-acceleration model. Updates may arrive at any interval and
+ * each one costs the same fixed amount of arithmetic, so the core can
+ * run at whatever cadence it likes without the derivatives getting noisy.
+ */
+
+#define	POS_ANCHOR_DIST		10000	/* meters */
+
+/*
+ * State & covariance of a single filter axis. The horizontal axes only
+ * use the first two states (position & velocity).
  */
+typedef struct {
+	double	x[3];		/* position, velocity, acceleration */
+	double	P[3][3];	/* state covariance */
+} pos_kf_t;
 
-#define NUM_POS_STEPS 3
 typedef struct obj_pos {
-	unsigned latest_step;
-	unsigned populated_steps;
-	double time[NUM_POS_STEPS];
-	double rad_alt[NUM_POS_STEPS];
-	geo_pos3_t pos[NUM_POS_STEPS];
+	unsigned	num_upd;	/* horizontal updates since (re)start */
+	unsigned	num_upd_v;	/* vertical updates since (re)start */
+	double		time;		/* time of latest update */
+	double		time_v;		/* time of latest vertical update */
+	double		rad_alt;	/* latest radio altitude */
+	geo_pos3_t	pos;		/* latest position update */
+
+	geo_pos2_t	anchor;		/* origin of the tangent plane */
+	double		m_per_deg_lat;
+	double		m_per_deg_lon;
+	pos_kf_t	kf_x;
+	pos_kf_t	kf_y;
+	pos_kf_t	kf_z;
 } obj_pos_t;
 
-#define	CUR_OBJ_POS3(op)	((op)->pos[(op)->latest_step])
-#define	CUR_OBJ_ALT_MSL(op)	((op)->pos[(op)->latest_step].elev)
-#define	CUR_OBJ_ALT_AGL(op)	((op)->rad_alt[(op)->latest_step])
+#define	CUR_OBJ_POS3(op)	((op)->pos)
+#define	CUR_OBJ_ALT_MSL(op)	((op)->pos.elev)
+#define	CUR_OBJ_ALT_AGL(op)	((op)->rad_alt)
 
 void xtcas_obj_pos_update(obj_pos_t *pos, double t, geo_pos3_t upd,
     double rad_alt);
@@ -48,6 +75,8 @@ bool_t xtcas_obj_pos_get_gs(const obj_pos_t *pos, double *gs);
 bool_t xtcas_obj_pos_get_trk(const obj_pos_t *pos, double *trk);
 bool_t xtcas_obj_pos_get_vvel(const obj_pos_t *pos, double *vvel,
     double *d_vvel);
+bool_t xtcas_obj_pos_get_var(const obj_pos_t *pos, double *gs_var,
+    double *trk_var, double *vvel_var, double *d_vvel_var);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,354 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+*/
+/*
+ * Copyright 2025 Saso Kiselkov. All rights reserved.
+ */
+
+#include <string.h>
+
+#include <acfutils/assert.h>
+#include <acfutils/helpers.h>
+
+#include "ra_eval.h"
+
+/* See cpa.c */
+#if	(defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define	RA_EVAL_X86_SIMD	1
+#include <immintrin.h>
+#else
+#define	RA_EVAL_X86_SIMD	0
+#endif
+
+/*
+ * Starts a new evaluation pass. `elev', `vvel' and `vvel_rnd' are our
+ * aircraft's current elevation, vertical velocity and vertical velocity
+ * rounded to the altitude rounding multiple. `cpa_t' and `cpa_z' hold
+ * the time to and the intruder's elevation at each of the `n_cpas' RA
+ * CPAs. The CPA arrays must remain valid until the pass is computed.
+ * If `sep' isn't NULL, it must have room for n_cpas * RA_EVAL_MAX_CANDS
+ * values and receives the separation of each candidate at each CPA,
+ * which is accessed using RA_EVAL_SEP.
+ */
+void
+xtcas_ra_eval_begin(ra_eval_t *ev, double elev, double vvel,
+    double vvel_rnd, const double *cpa_t, const double *cpa_z,
+    size_t n_cpas, double *sep)
+{
+	ASSERT(n_cpas == 0 || (cpa_t != NULL && cpa_z != NULL));
+
+	ev->elev = elev;
+	ev->vvel = vvel;
+	ev->vvel_rnd = vvel_rnd;
+	ev->cpa_t = cpa_t;
+	ev->cpa_z = cpa_z;
+	ev->n_cpas = n_cpas;
+	ev->n_cands = 0;
+	ev->sep = sep;
+}
+
+/*
+ * Drops all candidates, but keeps our aircraft's state and the CPAs, so
+ * that another set of candidates can be evaluated for the same encounter.
+ */
+void
+xtcas_ra_eval_clear(ra_eval_t *ev)
+{
+	ev->n_cands = 0;
+}
+
+/*
+ * Adds a candidate RA with the given sense and output VS band [vs_min,
+ * vs_max]. `delay_t' is the pilot reaction time and `accel' the vertical
+ * acceleration of the maneuver. The parts of the elevation prediction
+ * which don't depend on the CPA are precomputed here. Returns the index
+ * of the candidate's result in ev->min_sep.
+ */
+size_t
+xtcas_ra_eval_add(ra_eval_t *ev, ra_eval_sense_t sense, double vs_min,
+    double vs_max, double delay_t, double accel)
+{
+	size_t i = ev->n_cands;
+
+	ASSERT3U(i, <, RA_EVAL_MAX_CANDS);
+	ASSERT3U(sense, <=, RA_EVAL_DOWN);
+
+	ev->sense[i] = sense;
+	/* no reaction delay if we're already at or beyond the VS */
+	ev->vsr_lo[i] = vs_min;
+	ev->dly_lo[i] = (vs_min > ev->vvel ? delay_t : 0);
+	ev->acc_lo[i] = (vs_min < ev->vvel ? -accel : accel);
+	ev->man_lo[i] = (vs_min - ev->vvel) / ev->acc_lo[i];
+	ev->vsr_hi[i] = vs_max;
+	ev->dly_hi[i] = (vs_max < ev->vvel ? delay_t : 0);
+	ev->acc_hi[i] = (vs_max < ev->vvel ? -accel : accel);
+	ev->man_hi[i] = (vs_max - ev->vvel) / ev->acc_hi[i];
+	ev->n_cands++;
+
+	return (i);
+}
+
+/*
+ * Predicts our elevation at `cpa_t' if we fly the maneuver to `vsr'.
+ * The elevation change consists of the following segments:
+ * 1) a straight segment at the aircraft's original VVEL for the
+ *	duration of the reaction delay:
+ *	d1 = vs1 * delay_t
+ * 2) an accelerating maneuver segment at the acceleration value,
+ *	which takes a computed amount of time to reach the new
+ *	target VSR:
+ *	d2 = vs1 * man_t + 0.5 * accel * man_t^2
+ * 3) a final straight line segment at the new VSR for the remaining
+ *	time between the end of delay_t + man_t until cpa_t (rmng_t):
+ *	d3 = vsr * rmng_t
+ * We can simplify the first and second portions to obtain:
+ *	d12 = vs1 * (delay_t + man_t) + 0.5 * accel * man_t^2
+ * The maneuver and delay are cut short if the CPA comes first. The
+ * order of operations here is the reference which the vectorized
+ * kernels must reproduce exactly.
+ */
+static inline double
+predict_elev(const ra_eval_t *ev, double cpa_t, double delay_t,
+    double accel, double man_t, double vsr)
+{
+	double rmng_t;
+
+	delay_t = MIN(cpa_t, delay_t);
+	man_t = MIN(cpa_t - delay_t, man_t);
+	rmng_t = cpa_t - (delay_t + man_t);
+
+	return (ev->elev + ev->vvel_rnd * (delay_t + man_t) +
+	    0.5 * accel * POW2(man_t) + vsr * rmng_t);
+}
+
+static void
+ra_eval_scalar(ra_eval_t *ev, size_t start)
+{
+	for (size_t i = start; i < ev->n_cands; i++) {
+		double min_sep = RA_EVAL_NO_SEP;
+
+		for (size_t j = 0; j < ev->n_cpas; j++) {
+			double t = ev->cpa_t[j], z = ev->cpa_z[j];
+			double elev_min = predict_elev(ev, t, ev->dly_lo[i],
+			    ev->acc_lo[i], ev->man_lo[i], ev->vsr_lo[i]);
+			double elev_max = predict_elev(ev, t, ev->dly_hi[i],
+			    ev->acc_hi[i], ev->man_hi[i], ev->vsr_hi[i]);
+			double sep;
+
+			if (ev->sense[i] == RA_EVAL_UP)
+				sep = elev_min - z;
+			else if (ev->sense[i] == RA_EVAL_LEVEL)
+				sep = MAX(elev_min - z, z - elev_max);
+			else
+				sep = z - elev_max;
+			if (ev->sep != NULL)
+				RA_EVAL_SEP(ev, i, j) = sep;
+			min_sep = MIN(sep, min_sep);
+		}
+		ev->min_sep[i] = min_sep;
+	}
+}
+
+#if	RA_EVAL_X86_SIMD
+
+/*
+ * min_pd/max_pd return the second operand unless the comparison holds,
+ * exactly like MIN()/MAX(), so the argument order below matters.
+ */
+__attribute__((target("sse2")))
+static inline __m128d
+predict_elev_sse2(__m128d elev, __m128d vv, __m128d t, __m128d dly,
+    __m128d acc, __m128d man, __m128d vsr)
+{
+	__m128d half = _mm_set1_pd(0.5);
+	__m128d d = _mm_min_pd(t, dly);
+	__m128d m = _mm_min_pd(_mm_sub_pd(t, d), man);
+	__m128d dm = _mm_add_pd(d, m);
+
+	return (_mm_add_pd(_mm_add_pd(_mm_add_pd(elev, _mm_mul_pd(vv, dm)),
+	    _mm_mul_pd(_mm_mul_pd(half, acc), _mm_mul_pd(m, m))),
+	    _mm_mul_pd(vsr, _mm_sub_pd(t, dm))));
+}
+
+__attribute__((target("sse2")))
+static size_t
+ra_eval_sse2(ra_eval_t *ev)
+{
+	const __m128d elev = _mm_set1_pd(ev->elev);
+	const __m128d vv = _mm_set1_pd(ev->vvel_rnd);
+	size_t i;
+
+	for (i = 0; i + 2 <= ev->n_cands; i += 2) {
+		__m128d sense = _mm_loadu_pd(&ev->sense[i]);
+		__m128d up = _mm_cmpeq_pd(sense, _mm_set1_pd(RA_EVAL_UP));
+		__m128d dn = _mm_cmpeq_pd(sense, _mm_set1_pd(RA_EVAL_DOWN));
+		__m128d ud = _mm_or_pd(up, dn);
+		__m128d vsr_lo = _mm_loadu_pd(&ev->vsr_lo[i]);
+		__m128d dly_lo = _mm_loadu_pd(&ev->dly_lo[i]);
+		__m128d acc_lo = _mm_loadu_pd(&ev->acc_lo[i]);
+		__m128d man_lo = _mm_loadu_pd(&ev->man_lo[i]);
+		__m128d vsr_hi = _mm_loadu_pd(&ev->vsr_hi[i]);
+		__m128d dly_hi = _mm_loadu_pd(&ev->dly_hi[i]);
+		__m128d acc_hi = _mm_loadu_pd(&ev->acc_hi[i]);
+		__m128d man_hi = _mm_loadu_pd(&ev->man_hi[i]);
+		__m128d min_sep = _mm_set1_pd(RA_EVAL_NO_SEP);
+
+		for (size_t j = 0; j < ev->n_cpas; j++) {
+			__m128d t = _mm_set1_pd(ev->cpa_t[j]);
+			__m128d z = _mm_set1_pd(ev->cpa_z[j]);
+			__m128d s_up = _mm_sub_pd(predict_elev_sse2(elev, vv,
+			    t, dly_lo, acc_lo, man_lo, vsr_lo), z);
+			__m128d s_dn = _mm_sub_pd(z, predict_elev_sse2(elev,
+			    vv, t, dly_hi, acc_hi, man_hi, vsr_hi));
+			__m128d sep = _mm_or_pd(_mm_or_pd(
+			    _mm_and_pd(up, s_up), _mm_and_pd(dn, s_dn)),
+			    _mm_andnot_pd(ud, _mm_max_pd(s_up, s_dn)));
+
+			if (ev->sep != NULL)
+				_mm_storeu_pd(&RA_EVAL_SEP(ev, i, j), sep);
+			min_sep = _mm_min_pd(sep, min_sep);
+		}
+		_mm_storeu_pd(&ev->min_sep[i], min_sep);
+	}
+
+	return (i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256d
+predict_elev_avx2(__m256d elev, __m256d vv, __m256d t, __m256d dly,
+    __m256d acc, __m256d man, __m256d vsr)
+{
+	__m256d half = _mm256_set1_pd(0.5);
+	__m256d d = _mm256_min_pd(t, dly);
+	__m256d m = _mm256_min_pd(_mm256_sub_pd(t, d), man);
+	__m256d dm = _mm256_add_pd(d, m);
+
+	return (_mm256_add_pd(_mm256_add_pd(_mm256_add_pd(elev,
+	    _mm256_mul_pd(vv, dm)), _mm256_mul_pd(_mm256_mul_pd(half, acc),
+	    _mm256_mul_pd(m, m))), _mm256_mul_pd(vsr, _mm256_sub_pd(t, dm))));
+}
+
+__attribute__((target("avx2")))
+static size_t
+ra_eval_avx2(ra_eval_t *ev)
+{
+	const __m256d elev = _mm256_set1_pd(ev->elev);
+	const __m256d vv = _mm256_set1_pd(ev->vvel_rnd);
+	size_t i;
+
+	for (i = 0; i + 4 <= ev->n_cands; i += 4) {
+		__m256d sense = _mm256_loadu_pd(&ev->sense[i]);
+		__m256d up = _mm256_cmp_pd(sense, _mm256_set1_pd(RA_EVAL_UP),
+		    _CMP_EQ_OQ);
+		__m256d dn = _mm256_cmp_pd(sense,
+		    _mm256_set1_pd(RA_EVAL_DOWN), _CMP_EQ_OQ);
+		__m256d ud = _mm256_or_pd(up, dn);
+		__m256d vsr_lo = _mm256_loadu_pd(&ev->vsr_lo[i]);
+		__m256d dly_lo = _mm256_loadu_pd(&ev->dly_lo[i]);
+		__m256d acc_lo = _mm256_loadu_pd(&ev->acc_lo[i]);
+		__m256d man_lo = _mm256_loadu_pd(&ev->man_lo[i]);
+		__m256d vsr_hi = _mm256_loadu_pd(&ev->vsr_hi[i]);
+		__m256d dly_hi = _mm256_loadu_pd(&ev->dly_hi[i]);
+		__m256d acc_hi = _mm256_loadu_pd(&ev->acc_hi[i]);
+		__m256d man_hi = _mm256_loadu_pd(&ev->man_hi[i]);
+		__m256d min_sep = _mm256_set1_pd(RA_EVAL_NO_SEP);
+
+		for (size_t j = 0; j < ev->n_cpas; j++) {
+			__m256d t = _mm256_set1_pd(ev->cpa_t[j]);
+			__m256d z = _mm256_set1_pd(ev->cpa_z[j]);
+			__m256d s_up = _mm256_sub_pd(predict_elev_avx2(elev,
+			    vv, t, dly_lo, acc_lo, man_lo, vsr_lo), z);
+			__m256d s_dn = _mm256_sub_pd(z, predict_elev_avx2(
+			    elev, vv, t, dly_hi, acc_hi, man_hi, vsr_hi));
+			__m256d sep = _mm256_or_pd(_mm256_or_pd(
+			    _mm256_and_pd(up, s_up), _mm256_and_pd(dn, s_dn)),
+			    _mm256_andnot_pd(ud, _mm256_max_pd(s_up, s_dn)));
+
+			if (ev->sep != NULL)
+				_mm256_storeu_pd(&RA_EVAL_SEP(ev, i, j), sep);
+			min_sep = _mm256_min_pd(sep, min_sep);
+		}
+		_mm256_storeu_pd(&ev->min_sep[i], min_sep);
+	}
+
+	return (i);
+}
+
+#endif	/* RA_EVAL_X86_SIMD */
+
+/*
+ * Returns the name of the kernel which xtcas_ra_eval_compute will use on
+ * this machine.
+ */
+const char *
+xtcas_ra_eval_impl(void)
+{
+#if	RA_EVAL_X86_SIMD
+	if (__builtin_cpu_supports("avx2"))
+		return ("avx2");
+	if (__builtin_cpu_supports("sse2"))
+		return ("sse2");
+#endif
+	return ("scalar");
+}
+
+/*
+ * Computes min_sep for all ev->n_cands candidates over all RA CPAs. A
+ * candidate's min_sep is RA_EVAL_NO_SEP if there are no CPAs. Kernel
+ * selection works the same as in xtcas_cpa_compute.
+ */
+void
+xtcas_ra_eval_compute(ra_eval_t *ev)
+{
+	size_t done = 0;
+
+	ASSERT3U(ev->n_cands, <=, RA_EVAL_MAX_CANDS);
+#if	RA_EVAL_X86_SIMD
+	if (__builtin_cpu_supports("avx2"))
+		done = ra_eval_avx2(ev);
+	else if (__builtin_cpu_supports("sse2"))
+		done = ra_eval_sse2(ev);
+#endif
+	ra_eval_scalar(ev, done);
+}
+
+/*
+ * Same as xtcas_ra_eval_compute, but uses the kernel named `impl'
+ * ("scalar", "sse2" or "avx2"), like xtcas_cpa_compute_impl. Returns
+ * B_FALSE if the kernel isn't available on this machine.
+ */
+bool_t
+xtcas_ra_eval_compute_impl(ra_eval_t *ev, const char *impl)
+{
+	size_t done = 0;
+
+	ASSERT3U(ev->n_cands, <=, RA_EVAL_MAX_CANDS);
+	if (strcmp(impl, "scalar") == 0) {
+		done = 0;
+#if	RA_EVAL_X86_SIMD
+	} else if (strcmp(impl, "avx2") == 0 &&
+	    __builtin_cpu_supports("avx2")) {
+		done = ra_eval_avx2(ev);
+	} else if (strcmp(impl, "sse2") == 0 &&
+	    __builtin_cpu_supports("sse2")) {
+		done = ra_eval_sse2(ev);
+#endif
+	} else {
+		return (B_FALSE);
+	}
+	ra_eval_scalar(ev, done);
+
+	return (B_TRUE);
+}
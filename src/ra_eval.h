@@ -0,0 +1,94 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+*/
+/*
+ * Copyright 2025 Saso Kiselkov. All rights reserved.
+ */
+
+#ifndef	_XTCAS_RA_EVAL_H_
+#define	_XTCAS_RA_EVAL_H_
+
+#include <stddef.h>
+
+#include <acfutils/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define	RA_EVAL_MAX_CANDS	32
+#define	RA_EVAL_NO_SEP		1e10	/* min_sep if there are no CPAs */
+
+/* Same order as tcas_RA_sense_t */
+typedef enum {
+	RA_EVAL_UP,
+	RA_EVAL_LEVEL,
+	RA_EVAL_DOWN
+} ra_eval_sense_t;
+
+/*
+ * RA candidate evaluation kernel. For every candidate RA it predicts our
+ * elevation at each RA CPA when flying the low and high end of the RA's
+ * VS band, and from that the minimum vertical separation from the RA
+ * threats over the whole encounter. The candidates are kept as flat
+ * arrays so that the kernel can evaluate several of them per
+ * instruction. Elevations are in meters, speeds in m/s.
+ */
+typedef struct {
+	/* our aircraft's state, see xtcas_ra_eval_begin */
+	double		elev;
+	double		vvel;
+	double		vvel_rnd;	/* vvel rounded for prediction */
+
+	/* the RA threats' CPAs, in time order */
+	size_t		n_cpas;
+	const double	*cpa_t;		/* seconds until CPA */
+	const double	*cpa_z;		/* intruder's elevation at CPA */
+
+	/* candidates, see xtcas_ra_eval_add */
+	size_t		n_cands;
+	double		sense[RA_EVAL_MAX_CANDS];
+	double		vsr_lo[RA_EVAL_MAX_CANDS];
+	double		dly_lo[RA_EVAL_MAX_CANDS];
+	double		acc_lo[RA_EVAL_MAX_CANDS];
+	double		man_lo[RA_EVAL_MAX_CANDS];
+	double		vsr_hi[RA_EVAL_MAX_CANDS];
+	double		dly_hi[RA_EVAL_MAX_CANDS];
+	double		acc_hi[RA_EVAL_MAX_CANDS];
+	double		man_hi[RA_EVAL_MAX_CANDS];
+
+	/* outputs */
+	double		min_sep[RA_EVAL_MAX_CANDS];
+	double		*sep;		/* optional, see xtcas_ra_eval_begin */
+} ra_eval_t;
+
+#define	RA_EVAL_SEP(ev, cand, cpa) \
+	((ev)->sep[(cpa) * RA_EVAL_MAX_CANDS + (cand)])
+
+void xtcas_ra_eval_begin(ra_eval_t *ev, double elev, double vvel,
+    double vvel_rnd, const double *cpa_t, const double *cpa_z,
+    size_t n_cpas, double *sep);
+void xtcas_ra_eval_clear(ra_eval_t *ev);
+size_t xtcas_ra_eval_add(ra_eval_t *ev, ra_eval_sense_t sense,
+    double vs_min, double vs_max, double delay_t, double accel);
+
+void xtcas_ra_eval_compute(ra_eval_t *ev);
+bool_t xtcas_ra_eval_compute_impl(ra_eval_t *ev, const char *impl);
+const char *xtcas_ra_eval_impl(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _XTCAS_RA_EVAL_H_ */
@@ -0,0 +1,696 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+*/
+/*
+ * Copyright 2025 Saso Kiselkov. All rights reserved.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <acfutils/assert.h>
+#include <acfutils/helpers.h>
+#include <acfutils/log.h>
+#include <acfutils/safe_alloc.h>
+#include <acfutils/thread.h>
+
+#include "rec.h"
+
+/*
+ * Recording file format. The file starts with REC_MAGIC followed by a
+ * uint32_t version number. After that come the records, each consisting
+ * of a one byte rec_type_t followed by its fields, without any padding:
+ *
+ * REC_MY_POS: t, lat, lon, elev, alt_agl, hdg (double),
+ *	gear_ext, on_ground (uint8_t)
+ * REC_OTH_POS: number of contacts (uint32_t), then for each contact:
+ *	acf_id (uint64_t), lat, lon, elev (double), on_ground (uint8_t)
+ * REC_MODE, REC_FILTER: the new value (uint32_t)
+ * REC_HAS_RA, REC_HAS_WOW, REC_WOW, REC_GEAR_EXT: the new value (uint8_t)
+ * REC_RA: the new value (double)
+ *
+ * A frame is a REC_MY_POS record followed by a REC_OTH_POS record.
+ */
+#define	REC_MAGIC	"XTCASREC"
+#define	REC_MAGIC_LEN	8
+#define	REC_VERSION	2	/* version 1 lacks the WOW & gear records */
+#define	REC_FLUSH_SZ	(64 << 10)	/* bytes buffered before writing */
+#define	REC_MY_POS_SZ	(1 + 6 * sizeof (double) + 2)
+#define	REC_OTH_ACF_SZ	(sizeof (uint64_t) + 3 * sizeof (double) + 1)
+
+typedef enum {
+	REC_MY_POS = 1,
+	REC_OTH_POS,
+	REC_MODE,
+	REC_FILTER,
+	REC_HAS_RA,
+	REC_RA,
+	REC_HAS_WOW,
+	REC_WOW,
+	REC_GEAR_EXT
+} rec_type_t;
+
+typedef struct {
+	uint8_t		*data;
+	size_t		len;
+	size_t		cap;
+} rec_buf_t;
+
+struct xtcas_rec {
+	const sim_intf_input_ops_t	*ops;		/* wrapped ops */
+	sim_intf_input_ops_t		rec_ops;
+	char				*path;
+	FILE				*fp;
+
+	mutex_t		lock;
+	condvar_t	cv;
+	thread_t	writer;
+	bool_t		shutdown;
+	rec_buf_t	bufs[2];
+	rec_buf_t	*cur;		/* being appended to */
+	rec_buf_t	*out;		/* being written out, or NULL */
+	bool_t		error;
+
+	/* last values recorded by the setters, -1 if none yet */
+	int		mode;
+	int		filter;
+	int		has_RA;
+	int		has_WOW;
+	int		WOW;
+	int		gear_ext;
+	bool_t		have_RA;
+	double		RA;
+};
+
+struct xtcas_play {
+	char			*path;
+	FILE			*fp;
+	off_t			size;		/* of the file, in bytes */
+	bool_t			failed;
+	sim_intf_input_ops_t	ops;
+
+	/* the current frame */
+	double			t;
+	geo_pos3_t		pos;
+	double			alt_agl;
+	double			hdg;
+	bool_t			gear_ext;
+	bool_t			on_ground;
+	acf_pos_t		*oth;
+	size_t			num_oth;
+	size_t			oth_cap;
+};
+
+/*
+ * Reserves `len' bytes at the end of the current buffer for a record and
+ * returns a pointer to them. Must be called with rec->lock held.
+ */
+static uint8_t *
+rec_reserve(xtcas_rec_t *rec, size_t len)
+{
+	rec_buf_t *buf = rec->cur;
+	uint8_t *p;
+
+	if (buf->len + len > buf->cap) {
+		buf->cap = MAX(2 * buf->cap, buf->len + len);
+		buf->data = safe_realloc(buf->data, buf->cap);
+	}
+	p = &buf->data[buf->len];
+	buf->len += len;
+
+	return (p);
+}
+
+static inline uint8_t *
+put(uint8_t *p, const void *data, size_t len)
+{
+	memcpy(p, data, len);
+	return (p + len);
+}
+
+static inline uint8_t *
+put_u8(uint8_t *p, unsigned val)
+{
+	*p = val;
+	return (p + 1);
+}
+
+/*
+ * Hands the current buffer over to the writer thread once it has filled
+ * up. If the writer is still busy with the other buffer, we just keep
+ * appending to the current one, so the caller never waits for the disk.
+ * Must be called with rec->lock held.
+ */
+static void
+rec_kick(xtcas_rec_t *rec)
+{
+	if (rec->cur->len < REC_FLUSH_SZ || rec->out != NULL)
+		return;
+	rec->out = rec->cur;
+	rec->cur = (rec->cur == &rec->bufs[0] ? &rec->bufs[1] :
+	    &rec->bufs[0]);
+	ASSERT0(rec->cur->len);
+	cv_broadcast(&rec->cv);
+}
+
+static void
+rec_writer(void *arg)
+{
+	xtcas_rec_t *rec = arg;
+
+	thread_set_name("X-TCAS rec");
+
+	mutex_enter(&rec->lock);
+	for (;;) {
+		rec_buf_t *buf = rec->out;
+		bool_t ok;
+
+		if (buf == NULL) {
+			if (rec->shutdown)
+				break;
+			cv_wait(&rec->cv, &rec->lock);
+			continue;
+		}
+		mutex_exit(&rec->lock);
+		ok = (fwrite(buf->data, 1, buf->len, rec->fp) == buf->len);
+		mutex_enter(&rec->lock);
+
+		if (!ok && !rec->error) {
+			logMsg("Error writing recording %s: %s", rec->path,
+			    strerror(errno));
+			rec->error = B_TRUE;
+		}
+		buf->len = 0;
+		rec->out = NULL;
+	}
+	mutex_exit(&rec->lock);
+}
+
+static double
+rec_get_time(void *handle)
+{
+	xtcas_rec_t *rec = handle;
+
+	return (rec->ops->get_time(rec->ops->handle));
+}
+
+static void
+rec_get_my_acf_pos(void *handle, geo_pos3_t *pos, double *alt_agl,
+    double *hdg, bool_t *gear_ext, bool_t *on_ground)
+{
+	xtcas_rec_t *rec = handle;
+	const sim_intf_input_ops_t *ops = rec->ops;
+	double t;
+	uint8_t *p;
+
+	ops->get_my_acf_pos(ops->handle, pos, alt_agl, hdg, gear_ext,
+	    on_ground);
+	t = ops->get_time(ops->handle);
+
+	mutex_enter(&rec->lock);
+	p = rec_reserve(rec, REC_MY_POS_SZ);
+	p = put_u8(p, REC_MY_POS);
+	p = put(p, &t, sizeof (t));
+	p = put(p, &pos->lat, sizeof (pos->lat));
+	p = put(p, &pos->lon, sizeof (pos->lon));
+	p = put(p, &pos->elev, sizeof (pos->elev));
+	p = put(p, alt_agl, sizeof (*alt_agl));
+	p = put(p, hdg, sizeof (*hdg));
+	p = put_u8(p, *gear_ext != B_FALSE);
+	(void) put_u8(p, *on_ground != B_FALSE);
+	mutex_exit(&rec->lock);
+}
+
+static void
+rec_oth_acf_pos(xtcas_rec_t *rec, const acf_pos_t *pos, size_t num)
+{
+	uint32_t n = num;
+	uint8_t *p;
+
+	mutex_enter(&rec->lock);
+	p = rec_reserve(rec, 1 + sizeof (n) + num * REC_OTH_ACF_SZ);
+	p = put_u8(p, REC_OTH_POS);
+	p = put(p, &n, sizeof (n));
+	for (size_t i = 0; i < num; i++) {
+		uint64_t id = (uintptr_t)pos[i].acf_id;
+
+		p = put(p, &id, sizeof (id));
+		p = put(p, &pos[i].pos.lat, sizeof (pos[i].pos.lat));
+		p = put(p, &pos[i].pos.lon, sizeof (pos[i].pos.lon));
+		p = put(p, &pos[i].pos.elev, sizeof (pos[i].pos.elev));
+		p = put_u8(p, pos[i].on_ground != B_FALSE);
+	}
+	rec_kick(rec);
+	mutex_exit(&rec->lock);
+}
+
+static void
+rec_get_oth_acf_pos(void *handle, acf_pos_t **pos_p, size_t *num)
+{
+	xtcas_rec_t *rec = handle;
+
+	rec->ops->get_oth_acf_pos(rec->ops->handle, pos_p, num);
+	rec_oth_acf_pos(rec, *pos_p, *num);
+}
+
+static size_t
+rec_fill_oth_acf_pos(void *handle, acf_pos_t *pos, size_t cap)
+{
+	xtcas_rec_t *rec = handle;
+	size_t num = rec->ops->fill_oth_acf_pos(rec->ops->handle, pos, cap);
+
+	/* X-TCAS calls us again with a bigger array */
+	if (num <= cap)
+		rec_oth_acf_pos(rec, pos, num);
+
+	return (num);
+}
+
+xtcas_rec_t *
+xtcas_rec_open(const char *path, const sim_intf_input_ops_t *ops)
+{
+	xtcas_rec_t *rec;
+	uint32_t version = REC_VERSION;
+	uint8_t *p;
+	FILE *fp;
+
+	ASSERT(ops != NULL);
+	ASSERT(ops->get_time != NULL);
+	ASSERT(ops->get_my_acf_pos != NULL);
+	ASSERT(ops->get_oth_acf_pos != NULL || ops->fill_oth_acf_pos != NULL);
+
+	fp = fopen(path, "wb");
+	if (fp == NULL) {
+		logMsg("Error creating recording %s: %s", path,
+		    strerror(errno));
+		return (NULL);
+	}
+
+	rec = safe_calloc(1, sizeof (*rec));
+	rec->ops = ops;
+	rec->rec_ops.handle = rec;
+	rec->rec_ops.get_time = rec_get_time;
+	rec->rec_ops.get_my_acf_pos = rec_get_my_acf_pos;
+	if (ops->fill_oth_acf_pos != NULL)
+		rec->rec_ops.fill_oth_acf_pos = rec_fill_oth_acf_pos;
+	else
+		rec->rec_ops.get_oth_acf_pos = rec_get_oth_acf_pos;
+	rec->path = safe_strdup(path);
+	rec->fp = fp;
+
+	mutex_init(&rec->lock);
+	cv_init(&rec->cv);
+	rec->cur = &rec->bufs[0];
+	rec->mode = -1;
+	rec->filter = -1;
+	rec->has_RA = -1;
+	rec->has_WOW = -1;
+	rec->WOW = -1;
+	rec->gear_ext = -1;
+
+	p = rec_reserve(rec, REC_MAGIC_LEN + sizeof (version));
+	p = put(p, REC_MAGIC, REC_MAGIC_LEN);
+	(void) put(p, &version, sizeof (version));
+
+	VERIFY(thread_create(&rec->writer, rec_writer, rec));
+
+	return (rec);
+}
+
+void
+xtcas_rec_close(xtcas_rec_t *rec)
+{
+	mutex_enter(&rec->lock);
+	rec->shutdown = B_TRUE;
+	cv_broadcast(&rec->cv);
+	mutex_exit(&rec->lock);
+	thread_join(&rec->writer);
+
+	/* the writer is gone, so the rest is ours to write out */
+	ASSERT3P(rec->out, ==, NULL);
+	if ((fwrite(rec->cur->data, 1, rec->cur->len, rec->fp) !=
+	    rec->cur->len || fclose(rec->fp) != 0) && !rec->error) {
+		logMsg("Error writing recording %s: %s", rec->path,
+		    strerror(errno));
+	}
+
+	for (int i = 0; i < 2; i++)
+		free(rec->bufs[i].data);
+	cv_destroy(&rec->cv);
+	mutex_destroy(&rec->lock);
+	free(rec->path);
+	free(rec);
+}
+
+const sim_intf_input_ops_t *
+xtcas_rec_get_ops(xtcas_rec_t *rec)
+{
+	return (&rec->rec_ops);
+}
+
+/*
+ * Records a uint32_t setter value if it differs from `*last'.
+ */
+static void
+rec_setter(xtcas_rec_t *rec, rec_type_t type, int *last, int val)
+{
+	uint32_t u32 = val;
+
+	mutex_enter(&rec->lock);
+	if (*last != val) {
+		uint8_t *p = rec_reserve(rec, 1 + sizeof (u32));
+
+		*last = val;
+		p = put_u8(p, type);
+		(void) put(p, &u32, sizeof (u32));
+	}
+	mutex_exit(&rec->lock);
+}
+
+void
+xtcas_rec_set_mode(xtcas_rec_t *rec, tcas_mode_t mode)
+{
+	rec_setter(rec, REC_MODE, &rec->mode, mode);
+}
+
+void
+xtcas_rec_set_filter(xtcas_rec_t *rec, tcas_filter_t filter)
+{
+	rec_setter(rec, REC_FILTER, &rec->filter, filter);
+}
+
+/*
+ * Records a boolean setter value if it differs from `*last'.
+ */
+static void
+rec_flag_setter(xtcas_rec_t *rec, rec_type_t type, int *last, bool_t flag)
+{
+	mutex_enter(&rec->lock);
+	if (*last != (flag != B_FALSE)) {
+		uint8_t *p = rec_reserve(rec, 2);
+
+		*last = (flag != B_FALSE);
+		p = put_u8(p, type);
+		(void) put_u8(p, *last);
+	}
+	mutex_exit(&rec->lock);
+}
+
+void
+xtcas_rec_set_has_RA(xtcas_rec_t *rec, bool_t flag)
+{
+	rec_flag_setter(rec, REC_HAS_RA, &rec->has_RA, flag);
+}
+
+void
+xtcas_rec_set_has_WOW(xtcas_rec_t *rec, bool_t flag)
+{
+	rec_flag_setter(rec, REC_HAS_WOW, &rec->has_WOW, flag);
+}
+
+void
+xtcas_rec_set_WOW(xtcas_rec_t *rec, bool_t on_ground)
+{
+	rec_flag_setter(rec, REC_WOW, &rec->WOW, on_ground);
+}
+
+void
+xtcas_rec_set_gear_ext(xtcas_rec_t *rec, bool_t gear_ext)
+{
+	rec_flag_setter(rec, REC_GEAR_EXT, &rec->gear_ext, gear_ext);
+}
+
+/*
+ * NAN is a valid value (no RA height available), so it is compared
+ * bitwise, as NAN never equals itself.
+ */
+void
+xtcas_rec_set_RA(xtcas_rec_t *rec, double agl_hgt_m)
+{
+	mutex_enter(&rec->lock);
+	if (!rec->have_RA ||
+	    memcmp(&rec->RA, &agl_hgt_m, sizeof (agl_hgt_m)) != 0) {
+		uint8_t *p = rec_reserve(rec, 1 + sizeof (agl_hgt_m));
+
+		rec->have_RA = B_TRUE;
+		rec->RA = agl_hgt_m;
+		p = put_u8(p, REC_RA);
+		(void) put(p, &agl_hgt_m, sizeof (agl_hgt_m));
+	}
+	mutex_exit(&rec->lock);
+}
+
+static double
+play_get_time(void *handle)
+{
+	xtcas_play_t *play = handle;
+
+	return (play->t);
+}
+
+static void
+play_get_my_acf_pos(void *handle, geo_pos3_t *pos, double *alt_agl,
+    double *hdg, bool_t *gear_ext, bool_t *on_ground)
+{
+	xtcas_play_t *play = handle;
+
+	*pos = play->pos;
+	*alt_agl = play->alt_agl;
+	*hdg = play->hdg;
+	*gear_ext = play->gear_ext;
+	*on_ground = play->on_ground;
+}
+
+static size_t
+play_fill_oth_acf_pos(void *handle, acf_pos_t *pos, size_t cap)
+{
+	xtcas_play_t *play = handle;
+
+	for (size_t i = 0; i < MIN(play->num_oth, cap); i++) {
+		pos[i].acf_id = play->oth[i].acf_id;
+		pos[i].pos = play->oth[i].pos;
+		pos[i].on_ground = play->oth[i].on_ground;
+	}
+
+	return (play->num_oth);
+}
+
+static bool_t
+play_read(xtcas_play_t *play, void *data, size_t len)
+{
+	return (fread(data, len, 1, play->fp) == 1);
+}
+
+static bool_t
+play_read_bool(xtcas_play_t *play, bool_t *val)
+{
+	uint8_t u8;
+
+	if (!play_read(play, &u8, sizeof (u8)))
+		return (B_FALSE);
+	*val = (u8 != 0);
+
+	return (B_TRUE);
+}
+
+static bool_t
+play_read_my_pos(xtcas_play_t *play)
+{
+	return (play_read(play, &play->t, sizeof (play->t)) &&
+	    play_read(play, &play->pos.lat, sizeof (play->pos.lat)) &&
+	    play_read(play, &play->pos.lon, sizeof (play->pos.lon)) &&
+	    play_read(play, &play->pos.elev, sizeof (play->pos.elev)) &&
+	    play_read(play, &play->alt_agl, sizeof (play->alt_agl)) &&
+	    play_read(play, &play->hdg, sizeof (play->hdg)) &&
+	    play_read_bool(play, &play->gear_ext) &&
+	    play_read_bool(play, &play->on_ground));
+}
+
+static bool_t
+play_read_oth_pos(xtcas_play_t *play)
+{
+	uint32_t n;
+
+	if (!play_read(play, &n, sizeof (n)))
+		return (B_FALSE);
+	/* a corrupt count must not make us allocate without bounds */
+	if (n > (play->size - ftello(play->fp)) / REC_OTH_ACF_SZ)
+		return (B_FALSE);
+	if (n > play->oth_cap) {
+		play->oth_cap = n;
+		play->oth = safe_realloc(play->oth,
+		    play->oth_cap * sizeof (*play->oth));
+	}
+	play->num_oth = 0;
+	for (uint32_t i = 0; i < n; i++) {
+		acf_pos_t *pos = &play->oth[i];
+		uint64_t id;
+
+		memset(pos, 0, sizeof (*pos));
+		if (!play_read(play, &id, sizeof (id)) ||
+		    !play_read(play, &pos->pos.lat, sizeof (pos->pos.lat)) ||
+		    !play_read(play, &pos->pos.lon, sizeof (pos->pos.lon)) ||
+		    !play_read(play, &pos->pos.elev, sizeof (pos->pos.elev)) ||
+		    !play_read_bool(play, &pos->on_ground))
+			return (B_FALSE);
+		pos->acf_id = (void *)(uintptr_t)id;
+	}
+	play->num_oth = n;
+
+	return (B_TRUE);
+}
+
+xtcas_play_t *
+xtcas_play_open(const char *path)
+{
+	xtcas_play_t *play;
+	char magic[REC_MAGIC_LEN];
+	uint32_t version;
+	FILE *fp = fopen(path, "rb");
+
+	if (fp == NULL) {
+		logMsg("Error opening recording %s: %s", path,
+		    strerror(errno));
+		return (NULL);
+	}
+	if (fread(magic, sizeof (magic), 1, fp) != 1 ||
+	    memcmp(magic, REC_MAGIC, REC_MAGIC_LEN) != 0 ||
+	    fread(&version, sizeof (version), 1, fp) != 1 ||
+	    version < 1 || version > REC_VERSION) {
+		logMsg("Error opening recording %s: not an X-TCAS recording "
+		    "or unsupported version", path);
+		fclose(fp);
+		return (NULL);
+	}
+
+	play = safe_calloc(1, sizeof (*play));
+	play->path = safe_strdup(path);
+	play->fp = fp;
+	if (fseeko(fp, 0, SEEK_END) != 0 || (play->size = ftello(fp)) < 0 ||
+	    fseeko(fp, REC_MAGIC_LEN + sizeof (version), SEEK_SET) != 0) {
+		logMsg("Error opening recording %s: %s", path,
+		    strerror(errno));
+		xtcas_play_close(play);
+		return (NULL);
+	}
+	play->ops.handle = play;
+	play->ops.get_time = play_get_time;
+	play->ops.get_my_acf_pos = play_get_my_acf_pos;
+	play->ops.fill_oth_acf_pos = play_fill_oth_acf_pos;
+
+	return (play);
+}
+
+void
+xtcas_play_close(xtcas_play_t *play)
+{
+	fclose(play->fp);
+	free(play->oth);
+	free(play->path);
+	free(play);
+}
+
+const sim_intf_input_ops_t *
+xtcas_play_get_ops(xtcas_play_t *play)
+{
+	return (&play->ops);
+}
+
+bool_t
+xtcas_play_next(xtcas_play_t *play, xtcas_ctx_t *ctx, double *t)
+{
+	bool_t have_my_pos = B_FALSE;
+	uint8_t type;
+
+	while (play_read(play, &type, sizeof (type))) {
+		uint32_t u32;
+		bool_t flag;
+		double val;
+
+		switch (type) {
+		case REC_MY_POS:
+			if (!play_read_my_pos(play))
+				goto truncated;
+			have_my_pos = B_TRUE;
+			break;
+		case REC_OTH_POS:
+			if (!play_read_oth_pos(play))
+				goto truncated;
+			if (have_my_pos) {
+				*t = play->t;
+				return (B_TRUE);
+			}
+			break;
+		case REC_MODE:
+			if (!play_read(play, &u32, sizeof (u32)))
+				goto truncated;
+			xtcas_ctx_set_mode(ctx, u32);
+			break;
+		case REC_FILTER:
+			if (!play_read(play, &u32, sizeof (u32)))
+				goto truncated;
+			xtcas_ctx_set_filter(ctx, u32);
+			break;
+		case REC_HAS_RA:
+			if (!play_read_bool(play, &flag))
+				goto truncated;
+			xtcas_ctx_set_has_RA(ctx, flag);
+			break;
+		case REC_RA:
+			if (!play_read(play, &val, sizeof (val)))
+				goto truncated;
+			xtcas_ctx_set_RA(ctx, val);
+			break;
+		case REC_HAS_WOW:
+			if (!play_read_bool(play, &flag))
+				goto truncated;
+			xtcas_ctx_set_has_WOW(ctx, flag);
+			break;
+		case REC_WOW:
+			if (!play_read_bool(play, &flag))
+				goto truncated;
+			xtcas_ctx_set_WOW(ctx, flag);
+			break;
+		case REC_GEAR_EXT:
+			if (!play_read_bool(play, &flag))
+				goto truncated;
+			xtcas_ctx_set_gear_ext(ctx, flag);
+			break;
+		default:
+			logMsg("Error reading recording %s: invalid record "
+			    "type %d", play->path, type);
+			play->failed = B_TRUE;
+			return (B_FALSE);
+		}
+	}
+	if (!feof(play->fp))
+		goto truncated;
+
+	return (B_FALSE);
+truncated:
+	logMsg("Error reading recording %s: %s", play->path,
+	    ferror(play->fp) ? strerror(errno) : "truncated record");
+	play->failed = B_TRUE;
+	return (B_FALSE);
+}
+
+bool_t
+xtcas_play_failed(const xtcas_play_t *play)
+{
+	return (play->failed);
+}
@@ -0,0 +1,84 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+*/
+/*
+ * Copyright 2025 Saso Kiselkov. All rights reserved.
+ */
+
+#ifndef	_XTCAS_REC_H_
+#define	_XTCAS_REC_H_
+
+#include <acfutils/types.h>
+
+#include "xtcas.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Input recorder. xtcas_rec_open wraps a set of input ops and returns a
+ * replacement set to pass to xtcas_init, which forwards every call to
+ * the wrapped ops and appends the positions they returned to a binary
+ * recording. Each position collection is recorded as a frame, stamped
+ * with the simulator time from get_time. The host reports its calls of
+ * xtcas_set_mode, xtcas_set_filter, xtcas_set_has_RA, xtcas_set_RA,
+ * xtcas_set_has_WOW, xtcas_set_WOW and xtcas_set_gear_ext using the
+ * matching xtcas_rec_set_* functions (only changes of the value are
+ * recorded), which should be called before xtcas_run, so they are
+ * recorded ahead of the frame they apply to.
+ *
+ * Records are appended to a memory buffer, which a background thread
+ * writes out, so recording never waits for the disk. The wrapped ops
+ * must not be in push mode (get_my_acf_pos must be set). The recording
+ * uses the host's byte order and is only meant to be played back on
+ * the same kind of machine.
+ */
+typedef struct xtcas_rec xtcas_rec_t;
+
+xtcas_rec_t *xtcas_rec_open(const char *path,
+    const sim_intf_input_ops_t *ops);
+void xtcas_rec_close(xtcas_rec_t *rec);
+const sim_intf_input_ops_t *xtcas_rec_get_ops(xtcas_rec_t *rec);
+void xtcas_rec_set_mode(xtcas_rec_t *rec, tcas_mode_t mode);
+void xtcas_rec_set_filter(xtcas_rec_t *rec, tcas_filter_t filter);
+void xtcas_rec_set_has_RA(xtcas_rec_t *rec, bool_t flag);
+void xtcas_rec_set_RA(xtcas_rec_t *rec, double agl_hgt_m);
+void xtcas_rec_set_has_WOW(xtcas_rec_t *rec, bool_t flag);
+void xtcas_rec_set_WOW(xtcas_rec_t *rec, bool_t on_ground);
+void xtcas_rec_set_gear_ext(xtcas_rec_t *rec, bool_t gear_ext);
+
+/*
+ * Recording player. The ops returned by xtcas_play_get_ops return the
+ * positions of the current frame. xtcas_play_next advances to the next
+ * frame, applies the setter calls recorded before it to `ctx' and
+ * returns the frame's simulator time in `t'. The context is meant to be
+ * in synchronous mode (see xtcas_ctx_create_sync) and be stepped with
+ * xtcas_ctx_step(ctx, t) after every frame. Returns B_FALSE at the end
+ * of the recording, or if it is unreadable or corrupt, which
+ * xtcas_play_failed tells apart.
+ */
+typedef struct xtcas_play xtcas_play_t;
+
+xtcas_play_t *xtcas_play_open(const char *path);
+void xtcas_play_close(xtcas_play_t *play);
+const sim_intf_input_ops_t *xtcas_play_get_ops(xtcas_play_t *play);
+bool_t xtcas_play_next(xtcas_play_t *play, xtcas_ctx_t *ctx, double *t);
+bool_t xtcas_play_failed(const xtcas_play_t *play);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _XTCAS_REC_H_ */
@@ -0,0 +1,1023 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+*/
+/*
+ * Copyright 2025 Saso Kiselkov. All rights reserved.
+ */
+
+/*
+ * Headless batch encounter replay tool. Runs any number of scenario
+ * command files (same syntax as the standalone test program) through the
+ * TCAS core in synchronous mode (see xtcas_init_sync) using a virtual
+ * clock, so an encounter runs as fast as the CPU allows. For every
+ * scenario a single summary line is printed:
+ *
+ *	<file> TA=<s> RA=<s> seq=<msg>[,<msg>...] d_h_min=<m> d_v_min=<m>
+ *
+ * TA and RA are the scenario times of the first TA and first RA ("-" if
+ * none was issued), seq is the sequence of RA messages issued and
+ * d_h_min/d_v_min are the minimum horizontal separation and the minimum
+ * vertical separation while horizontally closer than 150m ("-" if never).
+ * Scenarios can be spread across multiple worker processes using -j.
+ *
+ * -T sets the number of threat classification threads. With -S, the
+ * scenarios are instead run once for every thread count from 1 to the -T
+ * value and for each, the average duration of the threat classification
+ * and RA logic stage is printed, together with whether the summaries of
+ * all scenarios matched those of the single-threaded run:
+ *
+ *	threads=<n> resolve_avg_us=<us> speedup=<x> results=<same|DIFFERENT>
+ *
+ * -F sets the fast cycle rate in Hz (see xtcas_set_fast_rate), which the
+ * TCAS cycle runs at while traffic is close. With -F 1, it always runs
+ * once per second, as it did before the fast rate was introduced.
+ *
+ * -P feeds the positions to the TCAS core through the push API
+ * (xtcas_push_own and xtcas_push_contact) instead of the input ops. Our
+ * own position is pushed on every step of the scenario, the other
+ * aircraft's too, unless -u gives a lower rate (in Hz) for those, like
+ * that of a network feed.
+ *
+ * With -R, the files are input recordings (see rec.h) instead of scenario
+ * files. Each is played back in full (-t is ignored) and summarized the
+ * same way, except that the times are simulator times from the recording
+ * and the separations aren't known, so they're always printed as "-".
+ *
+ * With -E, the files are encounter datasets (see enc.h) and every
+ * encounter in them is played back in full and summarized the same way
+ * as recordings, as "<file>:<encounter>". With -j, the encounters of all
+ * datasets are spread across the worker processes.
+ *
+ * With -x, the summaries are also compared with the expected ones in the
+ * given file, which has the same format and may contain '#' comments.
+ * Summaries are matched up by the base name of their file, so the
+ * expected results don't depend on where the files are run from. Any
+ * difference, or a summary without an expected one, is reported on
+ * stderr and makes us exit with status 1.
+ *
+ * -n <h>[:<v>] adds Gaussian noise with a standard deviation of `h'
+ * meters horizontally and `v' meters vertically (default: same as `h')
+ * to every position report of the other aircraft in scenarios, like
+ * that of a jittery multiplayer feed. The noise is drawn from a stream
+ * seeded by -s (default 1) at the start of every scenario, so a given
+ * scenario and seed always see the same noise. Scenarios then always run
+ * for the full -t, as a TA dropping out on a noisy track would otherwise
+ * end "auto_complete" scenarios early. The summaries also show the RA
+ * churn, the number of RA messages issued (the length of seq including
+ * the final clear of conflict):
+ *
+ *	<file> TA=<s> ... d_v_min=<m> churn=<n>
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <acfutils/assert.h>
+#include <acfutils/log.h>
+#include <acfutils/perf.h>
+#include <acfutils/safe_alloc.h>
+#include <acfutils/time.h>
+
+#include "dbg_log.h"
+#include "enc.h"
+#include "rec.h"
+#include "scen.h"
+#include "xtcas.h"
+
+#define	SIMSTEP		100000		/* microseconds */
+#define	DFL_MAX_TIME	300		/* seconds */
+#define	MAX_RA_SEQ	32
+
+typedef struct {
+	double		TA_t;
+	double		RA_t;
+	tcas_msg_t	RA_seq[MAX_RA_SEQ];
+	int		num_RA_seq;
+	int		churn;		/* like num_RA_seq, but uncapped */
+	tcas_adv_t	adv;
+	tcas_msg_t	msg;
+} summary_t;
+
+static scen_t		*scen = NULL;
+static uint64_t		sim_now = 0;
+static summary_t	summary;
+static unsigned		threat_threads = 0;	/* 0 = library default */
+static double		fast_rate = NAN;	/* NAN = library default */
+static bool_t		push_mode = B_FALSE;
+static uint64_t		push_ctc_intval = SIMSTEP;	/* microseconds */
+static bool_t		play_mode = B_FALSE;
+static bool_t		enc_mode = B_FALSE;
+static const char	*expect_path = NULL;
+static double		noise_h = 0;		/* meters, 1-sigma */
+static double		noise_v = 0;		/* meters, 1-sigma */
+static uint64_t		noise_seed = 1;
+static uint64_t		noise_state;
+static acf_pos_t	*push_buf = NULL;
+static size_t		push_buf_cap = 0;
+static uint64_t		resolve_ns = 0;
+static uint64_t		resolve_cycles = 0;
+static uint64_t		step_ns = 0;
+static uint64_t		step_max_ns = 0;
+static uint64_t		num_steps = 0;
+
+static void get_my_acf_pos(void *handle, geo_pos3_t *pos, double *alt_agl,
+    double *hdg, bool_t *gear_ext, bool_t *on_ground);
+static size_t fill_oth_acf_pos(void *handle, acf_pos_t *pos_out,
+    size_t cap);
+static void update_contact(void *handle, void *acf_id, double rbrg,
+    double rdist, double ralt, double vs, double trk, double gs,
+    tcas_threat_t level);
+static void delete_contact(void *handle, void *acf_id);
+static void update_RA(void *handle, tcas_adv_t adv, tcas_msg_t msg,
+    tcas_RA_type_t type, tcas_RA_sense_t sense, bool_t crossing,
+    bool_t reversal, double min_sep_cpa, double min_green, double max_green,
+    double min_red_lo, double max_red_lo, double min_red_hi, double max_red_hi);
+
+static sim_intf_input_ops_t replay_in_ops = {
+	.handle = NULL,
+	.get_my_acf_pos = get_my_acf_pos,
+	.fill_oth_acf_pos = fill_oth_acf_pos
+};
+
+static sim_intf_input_ops_t replay_push_in_ops = {
+	.handle = NULL
+};
+
+static sim_intf_output_ops_t replay_out_ops = {
+	.handle = NULL,
+	.update_contact = update_contact,
+	.delete_contact = delete_contact,
+	.update_RA = update_RA
+};
+
+static void
+lib_log_func(const char *str)
+{
+	fputs(str, stderr);
+}
+
+static void
+print_summary(FILE *fp, const char *name)
+{
+	fprintf(fp, "%s TA=", name);
+	if (!isnan(summary.TA_t))
+		fprintf(fp, "%.1f", summary.TA_t);
+	else
+		fprintf(fp, "-");
+	fprintf(fp, " RA=");
+	if (!isnan(summary.RA_t))
+		fprintf(fp, "%.1f", summary.RA_t);
+	else
+		fprintf(fp, "-");
+	fprintf(fp, " seq=");
+	for (int i = 0; i < summary.num_RA_seq; i++) {
+		fprintf(fp, "%s%s", i > 0 ? "," : "",
+		    xtcas_RA_msg2str(summary.RA_seq[i]));
+	}
+	if (summary.num_RA_seq == 0)
+		fprintf(fp, "-");
+	if (scen == NULL) {
+		fprintf(fp, " d_h_min=- d_v_min=-\n");
+		return;
+	}
+	fprintf(fp, " d_h_min=%.0f d_v_min=", scen->d_h_min);
+	if (isfinite(scen->d_v_min))
+		fprintf(fp, "%.0f", scen->d_v_min);
+	else
+		fprintf(fp, "-");
+	if (noise_h != 0 || noise_v != 0)
+		fprintf(fp, " churn=%d", summary.churn);
+	fprintf(fp, "\n");
+}
+
+static void
+add_timing(const xtcas_timing_t *timing)
+{
+	resolve_ns += timing->stages[XTCAS_STAGE_RESOLVE].total_ns;
+	resolve_cycles += timing->num_cycles;
+	step_ns += timing->step.total_ns;
+	step_max_ns = MAX(step_max_ns, timing->step.max_ns);
+	num_steps += timing->num_steps;
+}
+
+static void
+reset_summary(void)
+{
+	memset(&summary, 0, sizeof (summary));
+	summary.TA_t = NAN;
+	summary.RA_t = NAN;
+	summary.msg = -1u;
+}
+
+/*
+ * splitmix64, to turn the -s seed into the noise generator's state.
+ */
+static uint64_t
+splitmix64(uint64_t x)
+{
+	x += 0x9E3779B97F4A7C15llu;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9llu;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBllu;
+	return (x ^ (x >> 31));
+}
+
+/*
+ * xorshift64* generator, returns a uniformly distributed random number
+ * in (0, 1].
+ */
+static double
+rnd_unit(void)
+{
+	uint64_t x = noise_state;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	noise_state = x;
+	x *= 0x2545F4914F6CDD1Dllu;
+
+	return (((x >> 11) + 1) * (1.0 / (1llu << 53)));
+}
+
+/*
+ * Returns a normally distributed random number with a standard deviation
+ * of `sigma' (Box-Muller).
+ */
+static double
+rnd_gauss(double sigma)
+{
+	double r = sqrt(-2 * log(rnd_unit()));
+
+	return (sigma * r * cos(2 * M_PI * rnd_unit()));
+}
+
+/*
+ * Adds the -n noise to the `n' positions in `pos'.
+ */
+static void
+add_noise(acf_pos_t *pos, size_t n)
+{
+	if (noise_h == 0 && noise_v == 0)
+		return;
+	for (size_t i = 0; i < n; i++) {
+		double north = rnd_gauss(noise_h), east = rnd_gauss(noise_h);
+		double up = rnd_gauss(noise_v);
+
+		pos[i].pos.lat += north / NM2MET(60);
+		pos[i].pos.lon += east / (NM2MET(60) *
+		    cos(DEG2RAD(pos[i].pos.lat)));
+		/* NAN (no altitude reporting) stays NAN */
+		pos[i].pos.elev += up;
+	}
+}
+
+/*
+ * Pushes the current positions of all aircraft in the scenario.
+ */
+static void
+push_positions(void)
+{
+	geo_pos3_t pos;
+	double alt_agl, hdg;
+	size_t n;
+
+	xtcas_scen_get_my_acf_pos(scen, &pos, &alt_agl, &hdg);
+	VERIFY(xtcas_push_own(pos, USEC2SEC(sim_now), alt_agl, hdg, B_FALSE,
+	    B_FALSE));
+	if (sim_now % push_ctc_intval != 0)
+		return;
+
+	while ((n = xtcas_scen_fill_oth_acf_pos(scen, push_buf,
+	    push_buf_cap)) > push_buf_cap) {
+		push_buf_cap = n;
+		push_buf = safe_realloc(push_buf,
+		    push_buf_cap * sizeof (*push_buf));
+	}
+	add_noise(push_buf, n);
+	for (size_t i = 0; i < n; i++) {
+		VERIFY(xtcas_push_contact(push_buf[i].acf_id, push_buf[i].pos,
+		    USEC2SEC(sim_now), push_buf[i].on_ground));
+	}
+}
+
+/*
+ * Runs a single scenario file to completion. A scenario completes either
+ * when "auto_complete" was specified and the RA has been cleared, or when
+ * `max_time' seconds of scenario time have elapsed.
+ */
+static bool_t
+run_scenario(const char *filename, double reaction_fact, double max_time,
+    FILE *out)
+{
+	FILE *fp = fopen(filename, "r");
+	xtcas_timing_t timing;
+
+	if (fp == NULL) {
+		fprintf(stderr, "Cannot open %s: %s\n", filename,
+		    strerror(errno));
+		return (B_FALSE);
+	}
+	scen = xtcas_scen_read(fp);
+	fclose(fp);
+	if (scen == NULL) {
+		fprintf(stderr, "%s: error reading scenario\n", filename);
+		return (B_FALSE);
+	}
+	scen->reaction_fact = reaction_fact;
+	if (noise_h != 0 || noise_v != 0)
+		scen->auto_complete = B_FALSE;
+
+	reset_summary();
+	sim_now = 0;
+	noise_state = splitmix64(noise_seed);
+	/* the state must never be zero, or xorshift gets stuck */
+	if (noise_state == 0)
+		noise_state = 1;
+
+	xtcas_init_sync(push_mode ? &replay_push_in_ops : &replay_in_ops,
+	    &replay_out_ops);
+	xtcas_set_mode(TCAS_MODE_TARA);
+	if (threat_threads != 0)
+		xtcas_set_threat_threads(threat_threads);
+	if (!isnan(fast_rate))
+		xtcas_set_fast_rate(fast_rate);
+	xtcas_scen_apply(scen);
+
+	while (!scen->auto_completed && USEC2SEC(sim_now) <= max_time) {
+		xtcas_scen_step(scen, sim_now, SIMSTEP);
+		if (push_mode)
+			push_positions();
+		xtcas_step(USEC2SEC(sim_now));
+		sim_now += SIMSTEP;
+	}
+
+	xtcas_get_timing(&timing);
+	add_timing(&timing);
+	xtcas_fini();
+
+	print_summary(out, filename);
+	xtcas_scen_free(scen);
+	scen = NULL;
+
+	return (B_TRUE);
+}
+
+/*
+ * Plays back a single input recording to its end.
+ */
+static bool_t
+run_recording(const char *filename, FILE *out)
+{
+	xtcas_play_t *play = xtcas_play_open(filename);
+	xtcas_ctx_t *ctx;
+	xtcas_timing_t timing;
+	double t;
+	bool_t ok;
+
+	if (play == NULL)
+		return (B_FALSE);
+
+	reset_summary();
+
+	ctx = xtcas_ctx_create_sync(xtcas_play_get_ops(play),
+	    &replay_out_ops);
+	if (threat_threads != 0)
+		xtcas_ctx_set_threat_threads(ctx, threat_threads);
+	if (!isnan(fast_rate))
+		xtcas_ctx_set_fast_rate(ctx, fast_rate);
+	while (xtcas_play_next(play, ctx, &t)) {
+		sim_now = SEC2USEC(t);
+		xtcas_ctx_step(ctx, t);
+	}
+
+	xtcas_ctx_get_timing(ctx, &timing);
+	add_timing(&timing);
+	xtcas_ctx_destroy(ctx);
+	ok = !xtcas_play_failed(play);
+	xtcas_play_close(play);
+
+	print_summary(out, filename);
+
+	return (ok);
+}
+
+/*
+ * Plays back encounter `idx' of a dataset.
+ */
+static bool_t
+run_encounter(xtcas_enc_play_t *play, const char *filename, uint64_t idx,
+    FILE *out)
+{
+	xtcas_ctx_t *ctx;
+	xtcas_timing_t timing;
+	char name[512];
+	double t;
+
+	if (!xtcas_enc_play_start(play, idx))
+		return (B_FALSE);
+
+	reset_summary();
+
+	ctx = xtcas_ctx_create_sync(xtcas_enc_play_get_ops(play),
+	    &replay_out_ops);
+	xtcas_ctx_set_mode(ctx, TCAS_MODE_TARA);
+	if (threat_threads != 0)
+		xtcas_ctx_set_threat_threads(ctx, threat_threads);
+	if (!isnan(fast_rate))
+		xtcas_ctx_set_fast_rate(ctx, fast_rate);
+	while (xtcas_enc_play_next(play, &t)) {
+		sim_now = SEC2USEC(t);
+		xtcas_ctx_step(ctx, t);
+	}
+
+	xtcas_ctx_get_timing(ctx, &timing);
+	add_timing(&timing);
+	xtcas_ctx_destroy(ctx);
+
+	snprintf(name, sizeof (name), "%s:%llu", filename,
+	    (unsigned long long)idx);
+	print_summary(out, name);
+
+	return (B_TRUE);
+}
+
+/*
+ * Runs the encounters of a dataset assigned to `worker'. The encounters
+ * of all datasets are numbered consecutively, starting at `*item' for
+ * this one, and handed out to the workers like scenario files are.
+ */
+static int
+run_dataset(const char *filename, int *item, int worker, int nworkers,
+    FILE *out)
+{
+	xtcas_enc_t *enc = xtcas_enc_open(filename);
+	xtcas_enc_play_t *play;
+	int errs = 0;
+
+	if (enc == NULL)
+		return (1);
+	play = xtcas_enc_play_create(enc);
+	for (uint64_t i = 0; i < xtcas_enc_count(enc); i++, (*item)++) {
+		if (*item % nworkers != worker)
+			continue;
+		if (nworkers > 1)
+			fprintf(out, "%d ", *item);
+		if (!run_encounter(play, filename, i, out)) {
+			if (nworkers > 1) {
+				fprintf(out, "%s:%llu error\n", filename,
+				    (unsigned long long)i);
+			}
+			errs++;
+		}
+	}
+	xtcas_enc_play_destroy(play);
+	xtcas_enc_close(enc);
+
+	return (errs);
+}
+
+/*
+ * Returns the number of work items: the number of encounters in all
+ * datasets with -E, otherwise the number of files.
+ */
+static int
+count_items(char **files, int nfiles)
+{
+	int n = 0;
+
+	if (!enc_mode)
+		return (nfiles);
+	for (int i = 0; i < nfiles; i++) {
+		xtcas_enc_t *enc = xtcas_enc_open(files[i]);
+
+		if (enc != NULL) {
+			n += xtcas_enc_count(enc);
+			xtcas_enc_close(enc);
+		}
+	}
+
+	return (n);
+}
+
+/*
+ * Runs every `nworkers'-th scenario starting at index `worker' and
+ * prefixes each summary line with the scenario index, so the parent
+ * can restore the original order after all workers have finished.
+ */
+static int
+run_worker(char **files, int nfiles, int worker, int nworkers,
+    double reaction_fact, double max_time, FILE *out)
+{
+	int errs = 0;
+
+	if (enc_mode) {
+		int item = 0;
+
+		for (int i = 0; i < nfiles; i++)
+			errs += run_dataset(files[i], &item, worker, nworkers,
+			    out);
+		fflush(out);
+		return (errs);
+	}
+	for (int i = worker; i < nfiles; i += nworkers) {
+		if (nworkers > 1)
+			fprintf(out, "%d ", i);
+		bool_t ok;
+
+		if (play_mode) {
+			ok = run_recording(files[i], out);
+		} else {
+			ok = run_scenario(files[i], reaction_fact, max_time,
+			    out);
+		}
+		if (!ok) {
+			if (nworkers > 1)
+				fprintf(out, "%s error\n", files[i]);
+			errs++;
+		}
+	}
+	fflush(out);
+
+	return (errs);
+}
+
+/*
+ * Forks `nworkers' worker processes, each of which writes its summary
+ * lines into a temporary file. Once all workers are done, the lines are
+ * output in the original order of the `nitems' work items (scenario
+ * files, or the encounters of all datasets with -E).
+ */
+static int
+run_parallel(char **files, int nfiles, int nitems, int nworkers,
+    double reaction_fact, double max_time, FILE *out)
+{
+	FILE **tmp = safe_calloc(nworkers, sizeof (*tmp));
+	char **lines = safe_calloc(nitems, sizeof (*lines));
+	int errs = 0;
+
+	for (int i = 0; i < nworkers; i++) {
+		pid_t pid;
+
+		tmp[i] = tmpfile();
+		VERIFY(tmp[i] != NULL);
+		pid = fork();
+		VERIFY(pid >= 0);
+		if (pid == 0) {
+			exit(run_worker(files, nfiles, i, nworkers,
+			    reaction_fact, max_time, tmp[i]) != 0);
+		}
+	}
+	for (int i = 0; i < nworkers; i++) {
+		int status;
+
+		VERIFY(wait(&status) > 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			errs++;
+	}
+	for (int i = 0; i < nworkers; i++) {
+		char *line = NULL;
+		size_t cap = 0;
+
+		rewind(tmp[i]);
+		while (getline(&line, &cap, tmp[i]) > 0) {
+			int idx, n;
+
+			if (sscanf(line, "%d %n", &idx, &n) != 1 ||
+			    idx < 0 || idx >= nitems)
+				continue;
+			free(lines[idx]);
+			lines[idx] = safe_strdup(&line[n]);
+		}
+		free(line);
+		fclose(tmp[i]);
+	}
+	for (int i = 0; i < nitems; i++) {
+		if (lines[i] != NULL)
+			fputs(lines[i], out);
+		free(lines[i]);
+	}
+	free(lines);
+	free(tmp);
+
+	return (errs);
+}
+
+/*
+ * Runs all scenarios with 1 to `max_threads' threat classification
+ * threads and prints how the duration of the resolve stage scales. The
+ * summaries of every run are compared to those of the 1-thread run.
+ */
+static int
+run_scaling(char **files, int nfiles, unsigned max_threads,
+    double reaction_fact, double max_time)
+{
+	char *ref = NULL;
+	size_t ref_len = 0;
+	double base_us = 0;
+	int errs = 0;
+
+	for (unsigned n = 1; n <= max_threads; n++) {
+		char *buf = NULL;
+		size_t len = 0;
+		FILE *out = open_memstream(&buf, &len);
+		double avg_us;
+		bool_t same;
+
+		VERIFY(out != NULL);
+		threat_threads = n;
+		resolve_ns = 0;
+		resolve_cycles = 0;
+		errs += run_worker(files, nfiles, 0, 1, reaction_fact,
+		    max_time, out);
+		fclose(out);
+
+		avg_us = resolve_ns / 1000.0 / MAX(resolve_cycles, 1);
+		if (n == 1) {
+			ref = buf;
+			ref_len = len;
+			base_us = avg_us;
+			buf = NULL;
+		}
+		same = (n == 1 || (len == ref_len &&
+		    memcmp(buf, ref, len) == 0));
+		printf("threads=%u resolve_avg_us=%.1f speedup=%.2f "
+		    "results=%s\n", n, avg_us, base_us / MAX(avg_us, 1e-3),
+		    same ? "same" : "DIFFERENT");
+		if (!same)
+			errs++;
+		free(buf);
+	}
+	free(ref);
+
+	return (errs);
+}
+
+/*
+ * Returns the part of a summary line after the directory of its file.
+ */
+static char *
+summary_base(char *line)
+{
+	char *base = line;
+
+	for (char *p = line; *p != '\0' && *p != ' '; p++) {
+		if (*p == '/' || *p == '\\')
+			base = p + 1;
+	}
+
+	return (base);
+}
+
+/*
+ * Compares the summary lines in `buf' with the expected ones in the file
+ * at `path' (see -x). `buf' is modified. Returns the number of summaries
+ * which differ or have no expected counterpart.
+ */
+static int
+check_expected(char *buf, const char *path)
+{
+	FILE *fp = fopen(path, "r");
+	char **exp = NULL;
+	size_t num_exp = 0, cap = 0;
+	char *line = NULL, *saveptr = NULL;
+	int errs = 0;
+
+	if (fp == NULL) {
+		fprintf(stderr, "Cannot open %s: %s\n", path,
+		    strerror(errno));
+		return (1);
+	}
+	while (getline(&line, &cap, fp) > 0) {
+		line[strcspn(line, "\r\n")] = '\0';
+		if (line[0] == '#' || line[0] == '\0')
+			continue;
+		exp = safe_realloc(exp, (num_exp + 1) * sizeof (*exp));
+		exp[num_exp++] = safe_strdup(summary_base(line));
+	}
+	free(line);
+	fclose(fp);
+
+	for (char *got = strtok_r(buf, "\n", &saveptr); got != NULL;
+	    got = strtok_r(NULL, "\n", &saveptr)) {
+		const char *base = summary_base(got);
+		size_t name_len = strcspn(base, " ");
+		const char *want = NULL;
+
+		for (size_t i = 0; i < num_exp; i++) {
+			if (strncmp(exp[i], base, name_len) == 0 &&
+			    exp[i][name_len] == ' ') {
+				want = exp[i];
+				break;
+			}
+		}
+		if (want == NULL) {
+			fprintf(stderr, "%s: no expected result in %s\n",
+			    got, path);
+			errs++;
+		} else if (strcmp(want, base) != 0) {
+			fprintf(stderr, "%s: expected %s\n", got,
+			    &want[name_len + 1]);
+			errs++;
+		}
+	}
+	if (errs != 0) {
+		fprintf(stderr, "%d results differ from %s\n", errs, path);
+	}
+	for (size_t i = 0; i < num_exp; i++)
+		free(exp[i]);
+	free(exp);
+
+	return (errs);
+}
+
+int
+main(int argc, char **argv)
+{
+	int opt;
+	int nworkers = 1;
+	int nthreads = 0;
+	int nitems;
+	const char *what;
+	bool_t scaling = B_FALSE;
+	double reaction_fact = 1.0;
+	double max_time = DFL_MAX_TIME;
+	double push_rate = NAN;
+	uint64_t start;
+	double dur;
+	int errs;
+	char *buf = NULL;
+	size_t len = 0;
+	FILE *out = stdout;
+
+	log_init(lib_log_func, "xtcas_replay");
+
+	while ((opt = getopt(argc, argv, "j:r:t:T:F:x:n:s:u:SPREd")) != -1) {
+		switch (opt) {
+		case 'j':
+			nworkers = atoi(optarg);
+			break;
+		case 'r':
+			reaction_fact = atof(optarg);
+			break;
+		case 't':
+			max_time = atof(optarg);
+			break;
+		case 'T':
+			nthreads = atoi(optarg);
+			break;
+		case 'F':
+			fast_rate = atof(optarg);
+			break;
+		case 'S':
+			scaling = B_TRUE;
+			break;
+		case 'x':
+			expect_path = optarg;
+			break;
+		case 'n':
+			if (sscanf(optarg, "%lf:%lf", &noise_h, &noise_v) == 1)
+				noise_v = noise_h;
+			break;
+		case 's':
+			noise_seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'u':
+			push_rate = atof(optarg);
+			break;
+		case 'P':
+			push_mode = B_TRUE;
+			break;
+		case 'R':
+			play_mode = B_TRUE;
+			break;
+		case 'E':
+			enc_mode = B_TRUE;
+			break;
+		case 'd':
+			xtcas_dbg.all++;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-j <jobs>] "
+			    "[-r <reaction_factor>] [-t <max_time>] "
+			    "[-T <threads> [-S]] [-F <rate>] "
+			    "[-P [-u <rate>] | -R | -E] "
+			    "[-x <expected>] [-n <h>[:<v>] [-s <seed>]] [-d] "
+			    "<file>...\n",
+			    argv[0]);
+			return (1);
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if (argc < 1) {
+		fprintf(stderr, "Invalid options, expected at least one "
+		    "scenario file.\n");
+		return (1);
+	}
+	if (nworkers < 1 || max_time <= 0) {
+		fprintf(stderr, "Invalid options, -j and -t must be "
+		    "greater than zero.\n");
+		return (1);
+	}
+	if (nthreads < 0 || (scaling && (nthreads < 1 || nworkers > 1))) {
+		fprintf(stderr, "Invalid options, -S requires -T and "
+		    "can't be combined with -j.\n");
+		return (1);
+	}
+	if (scaling && expect_path != NULL) {
+		fprintf(stderr, "Invalid options, -S and -x can't be "
+		    "combined.\n");
+		return (1);
+	}
+	if (noise_h < 0 || noise_v < 0 || ((noise_h != 0 ||
+	    noise_v != 0) && (play_mode || enc_mode))) {
+		fprintf(stderr, "Invalid options, -n must not be negative "
+		    "and can't be combined with -R or -E.\n");
+		return (1);
+	}
+	if (!isnan(fast_rate) && !(fast_rate >= 1 && fast_rate <= 10)) {
+		fprintf(stderr, "Invalid options, -F must be from 1 to "
+		    "10.\n");
+		return (1);
+	}
+	if (!isnan(push_rate) && (!(push_rate > 0) || !push_mode)) {
+		fprintf(stderr, "Invalid options, -u must be greater than "
+		    "zero and requires -P.\n");
+		return (1);
+	}
+	if (!isnan(push_rate)) {
+		/* a whole number of steps */
+		push_ctc_intval = MAX(round(SEC2USEC(1) / push_rate /
+		    SIMSTEP), 1) * SIMSTEP;
+	}
+	if (push_mode + play_mode + enc_mode > 1) {
+		fprintf(stderr, "Invalid options, -P, -R and -E can't be "
+		    "combined.\n");
+		return (1);
+	}
+	threat_threads = nthreads;
+	nitems = count_items(argv, argc);
+	what = (enc_mode ? "encounters" : "scenarios");
+	nworkers = MAX(MIN(nworkers, nitems), 1);
+
+	if (expect_path != NULL) {
+		out = open_memstream(&buf, &len);
+		VERIFY(out != NULL);
+	}
+
+	start = microclock();
+	if (scaling) {
+		errs = run_scaling(argv, argc, nthreads, reaction_fact,
+		    max_time);
+	} else if (nworkers > 1) {
+		errs = run_parallel(argv, argc, nitems, nworkers,
+		    reaction_fact, max_time, out);
+	} else {
+		errs = run_worker(argv, argc, 0, 1, reaction_fact, max_time,
+		    out);
+	}
+	dur = USEC2SEC(microclock() - start);
+
+	if (expect_path != NULL) {
+		fclose(out);
+		fputs(buf, stdout);
+		errs += check_expected(buf, expect_path);
+		free(buf);
+	}
+
+	fprintf(stderr, "%d %s in %.3f s (%.1f %s/s)\n", nitems, what,
+	    dur, nitems / MAX(dur, 1e-6), what);
+	/* the worker processes' steps aren't counted with -j */
+	if (num_steps != 0) {
+		fprintf(stderr, "%llu steps: avg %.1f us, max %.1f us\n",
+		    (unsigned long long)num_steps,
+		    step_ns / 1000.0 / num_steps, step_max_ns / 1000.0);
+	}
+	free(push_buf);
+
+	return (errs != 0);
+}
+
+static void
+get_my_acf_pos(void *handle, geo_pos3_t *pos, double *alt_agl, double *hdg,
+    bool_t *gear_ext, bool_t *on_ground)
+{
+	UNUSED(handle);
+	xtcas_scen_get_my_acf_pos(scen, pos, alt_agl, hdg);
+	*gear_ext = B_FALSE;
+	*on_ground = B_FALSE;
+}
+
+static size_t
+fill_oth_acf_pos(void *handle, acf_pos_t *pos_out, size_t cap)
+{
+	size_t n;
+
+	UNUSED(handle);
+	n = xtcas_scen_fill_oth_acf_pos(scen, pos_out, cap);
+	add_noise(pos_out, MIN(n, cap));
+
+	return (n);
+}
+
+static void
+update_contact(void *handle, void *acf_id, double rbrg, double rdist,
+    double ralt, double vs, double trk, double gs, tcas_threat_t level)
+{
+	scen_acf_t *acf;
+
+	UNUSED(handle);
+	UNUSED(rbrg);
+	UNUSED(rdist);
+	UNUSED(ralt);
+	UNUSED(vs);
+	UNUSED(trk);
+	UNUSED(gs);
+
+	/* recordings have no scenario aircraft to keep track of */
+	if (scen == NULL)
+		return;
+	acf = xtcas_scen_find_acf(scen, acf_id);
+	VERIFY(acf != NULL);
+	acf->threat_level = level;
+}
+
+static void
+delete_contact(void *handle, void *acf_id)
+{
+	scen_acf_t *acf;
+
+	UNUSED(handle);
+
+	if (scen == NULL)
+		return;
+	acf = xtcas_scen_find_acf(scen, acf_id);
+	VERIFY(acf != NULL);
+	acf->threat_level = -1u;
+}
+
+static void
+update_RA(void *handle, tcas_adv_t adv, tcas_msg_t msg, tcas_RA_type_t type,
+    tcas_RA_sense_t sense, bool_t crossing, bool_t reversal, double min_sep_cpa,
+    double min_green, double max_green, double min_red_lo, double max_red_lo,
+    double min_red_hi, double max_red_hi)
+{
+	double now_t = USEC2SEC(sim_now);
+
+	UNUSED(handle);
+	UNUSED(type);
+	UNUSED(sense);
+	UNUSED(crossing);
+	UNUSED(min_sep_cpa);
+
+	if (adv >= ADV_STATE_TA && isnan(summary.TA_t))
+		summary.TA_t = now_t;
+	if (adv == ADV_STATE_RA && isnan(summary.RA_t))
+		summary.RA_t = now_t;
+	/*
+	 * An RA that was selected again is passed on with no message (-1),
+	 * as it's not annunciated again. It's still the same RA.
+	 */
+	if (adv == ADV_STATE_RA && summary.adv == ADV_STATE_RA &&
+	    (int)msg == -1)
+		msg = summary.msg;
+	/*
+	 * Record every new RA annunciation, plus the final "clear of
+	 * conflict" when the RA is terminated.
+	 */
+	if ((adv == ADV_STATE_RA && (summary.adv != ADV_STATE_RA ||
+	    msg != summary.msg)) || (adv != ADV_STATE_RA &&
+	    summary.adv == ADV_STATE_RA)) {
+		if (summary.num_RA_seq < MAX_RA_SEQ) {
+			summary.RA_seq[summary.num_RA_seq++] =
+			    (adv == ADV_STATE_RA ? msg : RA_MSG_CLEAR);
+		}
+		summary.churn++;
+	}
+	summary.adv = adv;
+	summary.msg = msg;
+
+	if (scen != NULL) {
+		xtcas_scen_RA_update(scen, adv, reversal, min_green,
+		    max_green, min_red_lo, max_red_lo, min_red_hi, max_red_hi,
+		    now_t);
+	}
+}
@@ -0,0 +1,86 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+*/
+/*
+ * Copyright 2025 Saso Kiselkov. All rights reserved.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <acfutils/assert.h>
+#include <acfutils/safe_alloc.h>
+
+#include "ring.h"
+
+void
+xtcas_ring_init(xtcas_ring_t *ring, size_t elem_sz, size_t cap)
+{
+	ASSERT(elem_sz != 0);
+	ASSERT(cap != 0 && (cap & (cap - 1)) == 0);
+
+	ring->buf = safe_calloc(cap, elem_sz);
+	ring->elem_sz = elem_sz;
+	ring->mask = cap - 1;
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+}
+
+void
+xtcas_ring_fini(xtcas_ring_t *ring)
+{
+	free(ring->buf);
+	ring->buf = NULL;
+}
+
+/*
+ * Appends a copy of `elem' to the ring. Returns B_FALSE if the ring is
+ * full. Must only be called by the producer.
+ */
+bool_t
+xtcas_ring_push(xtcas_ring_t *ring, const void *elem)
+{
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+	if (head - tail > ring->mask)
+		return (B_FALSE);
+	memcpy(&ring->buf[(head & ring->mask) * ring->elem_sz], elem,
+	    ring->elem_sz);
+	/* publish the element only once it has been written */
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+	return (B_TRUE);
+}
+
+/*
+ * Removes the oldest element from the ring and copies it to `elem'.
+ * Returns B_FALSE if the ring is empty. Must only be called by the
+ * consumer.
+ */
+bool_t
+xtcas_ring_pop(xtcas_ring_t *ring, void *elem)
+{
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+	if (head == tail)
+		return (B_FALSE);
+	memcpy(elem, &ring->buf[(tail & ring->mask) * ring->elem_sz],
+	    ring->elem_sz);
+	/* hand the slot back to the producer only once we've read it */
+	atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+	return (B_TRUE);
+}
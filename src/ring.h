@@ -0,0 +1,61 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+*/
+/*
+ * Copyright 2025 Saso Kiselkov. All rights reserved.
+ */
+
+#ifndef	_XTCAS_RING_H_
+#define	_XTCAS_RING_H_
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <acfutils/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define	XTCAS_RING_CACHELINE	64
+
+/*
+ * Lock-free single-producer/single-consumer ring of fixed-size elements.
+ * One thread may push while another pops, without either ever blocking.
+ * `head' and `tail' are free-running counters, each written by only one
+ * side, and are kept on separate cache lines so that the producer and
+ * consumer don't contend for them. The capacity must be a power of two.
+ */
+typedef struct {
+	uint8_t		*buf;
+	size_t		elem_sz;
+	size_t		mask;		/* capacity - 1 */
+	uint8_t		pad0[XTCAS_RING_CACHELINE];
+	atomic_size_t	head;		/* written by the producer */
+	uint8_t		pad1[XTCAS_RING_CACHELINE];
+	atomic_size_t	tail;		/* written by the consumer */
+	uint8_t		pad2[XTCAS_RING_CACHELINE];
+} xtcas_ring_t;
+
+void xtcas_ring_init(xtcas_ring_t *ring, size_t elem_sz, size_t cap);
+void xtcas_ring_fini(xtcas_ring_t *ring);
+bool_t xtcas_ring_push(xtcas_ring_t *ring, const void *elem);
+bool_t xtcas_ring_pop(xtcas_ring_t *ring, void *elem);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _XTCAS_RING_H_ */
@@ -0,0 +1,557 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+*/
+/*
+ * Copyright 2025 Saso Kiselkov. All rights reserved.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stddef.h>
+
+#include <acfutils/assert.h>
+#include <acfutils/geom.h>
+#include <acfutils/list.h>
+#include <acfutils/perf.h>
+#include <acfutils/safe_alloc.h>
+
+#include "scen.h"
+
+static void
+acf_init(scen_acf_t *acf, int id)
+{
+	acf->id = id;
+	list_create(&acf->maneuvers, sizeof (scen_man_t),
+	    offsetof(scen_man_t, node));
+}
+
+static void
+acf_fini(scen_acf_t *acf)
+{
+	scen_man_t *man;
+
+	while ((man = list_remove_head(&acf->maneuvers)) != NULL)
+		free(man);
+	list_destroy(&acf->maneuvers);
+}
+
+/*
+ * Creates an empty scenario, containing only our own aircraft (with ID
+ * 0) at the reference point. Intruders are added using
+ * xtcas_scen_add_acf. Callers setting up a scenario this way must
+ * initialize `fpp' themselves once the reference point is set.
+ */
+scen_t *
+xtcas_scen_new(void)
+{
+	scen_t *scen = safe_calloc(1, sizeof (*scen));
+
+	scen->scaleh = 100;
+	scen->scalev = 200;
+	scen->reaction_fact = 1.0;
+	scen->d_h_min = INFINITY;
+	scen->d_v_min = INFINITY;
+	acf_init(&scen->my_acf, 0);
+	list_create(&scen->other_acf, sizeof (scen_acf_t),
+	    offsetof(scen_acf_t, node));
+
+	return (scen);
+}
+
+/*
+ * Adds a new intruder to the scenario, with the next free ID.
+ */
+scen_acf_t *
+xtcas_scen_add_acf(scen_t *scen)
+{
+	scen_acf_t *last = list_tail(&scen->other_acf);
+	scen_acf_t *acf = safe_calloc(1, sizeof (*acf));
+
+	acf_init(acf, (last != NULL ? last->id : 0) + 1);
+	list_insert_tail(&scen->other_acf, acf);
+
+	return (acf);
+}
+
+/*
+ * Appends an empty maneuver to the aircraft's maneuver list.
+ */
+scen_man_t *
+xtcas_scen_add_man(scen_acf_t *acf)
+{
+	scen_man_t *man = safe_calloc(1, sizeof (*man));
+
+	list_insert_tail(&acf->maneuvers, man);
+
+	return (man);
+}
+
+/*
+ * Reads a scenario command file. The file consists of whitespace-separated
+ * keywords, each optionally followed by arguments. Lines starting with '#'
+ * are comments. The recognized keywords are:
+ *	filter ALL|THRT|ABV|BLW: sets the TCAS display/threat filter
+ *	mode STBY|TAONLY|TARA: sets the TCAS operating mode
+ *	reflat <deg>, reflon <deg>, refrot <deg>: sets the reference point
+ *		and rotation of the local coordinate system
+ *	gnd <m>: sets the ground elevation
+ *	scaleh <m>, scalev <m>: display scale of the standalone test GUI
+ *	acf: starts the definition of a new aircraft. The first aircraft
+ *		defined is our own aircraft, all others are intruders.
+ *	pos <x> <y> <z>: initial aircraft position (meters)
+ *	trk <deg>, vs <m/s>, gs <m/s>: initial track, vertical speed and
+ *		ground speed
+ *	man <s>: appends a maneuver of the given duration to the aircraft.
+ *		Followed by any of: turn <deg/s>, clb <m/s^2>, spd <m/s^2>
+ *	auto: our own aircraft will automatically follow any RAs issued
+ *	auto_complete: the scenario ends after a "clear of conflict"
+ * Returns the parsed scenario or NULL if a syntax error was encountered.
+ */
+scen_t *
+xtcas_scen_read(FILE *fp)
+{
+	char cmd[64];
+	scen_acf_t *acf = NULL;
+	scen_t *scen = xtcas_scen_new();
+
+	while (!feof(fp)) {
+		if (fscanf(fp, "%63s", cmd) != 1)
+			break;
+
+		if (cmd[0] == '#') {
+			int c;
+			do {
+				c = fgetc(fp);
+			} while (c != '\n' && c != EOF);
+			continue;
+		}
+
+		if (strcmp(cmd, "filter") == 0) {
+			if (fscanf(fp, "%63s", cmd) != 1)
+				*cmd = 0;
+			scen->filter_set = B_TRUE;
+			if (strcasecmp(cmd, "all") == 0) {
+				scen->filter = TCAS_FILTER_ALL;
+			} else if (strcasecmp(cmd, "thrt") == 0) {
+				scen->filter = TCAS_FILTER_THRT;
+			} else if (strcasecmp(cmd, "abv") == 0) {
+				scen->filter = TCAS_FILTER_ABV;
+			} else if (strcasecmp(cmd, "blw") == 0) {
+				scen->filter = TCAS_FILTER_BLW;
+			} else {
+				fprintf(stderr, "Command file syntax error: "
+				    "\"filter\" must be followed by one of "
+				    "ALL, THRT, ABV or BLW\n");
+				goto errout;
+			}
+		} else if (strcmp(cmd, "mode") == 0) {
+			if (fscanf(fp, "%63s", cmd) != 1)
+				*cmd = 0;
+			scen->mode_set = B_TRUE;
+			if (strcasecmp(cmd, "stby") == 0) {
+				scen->mode = TCAS_MODE_STBY;
+			} else if (strcasecmp(cmd, "taonly") == 0) {
+				scen->mode = TCAS_MODE_TAONLY;
+			} else if (strcasecmp(cmd, "tara") == 0) {
+				scen->mode = TCAS_MODE_TARA;
+			} else {
+				fprintf(stderr, "Command file syntax error: "
+				    "\"mode\" must be followed by one of "
+				    "STBY, TAONLY, TARA\n");
+				goto errout;
+			}
+		} else if (strcmp(cmd, "reflat") == 0) {
+			if (fscanf(fp, "%lf", &scen->refpt.lat) != 1) {
+				fprintf(stderr, "Command file syntax error: "
+				    "expected a number following \"reflat\"\n");
+				goto errout;
+			}
+		} else if (strcmp(cmd, "reflon") == 0) {
+			if (fscanf(fp, "%lf", &scen->refpt.lon) != 1) {
+				fprintf(stderr, "Command file syntax error: "
+				    "expected a number following \"reflon\"\n");
+				goto errout;
+			}
+		} else if (strcmp(cmd, "refrot") == 0) {
+			if (fscanf(fp, "%lf", &scen->refrot) != 1) {
+				fprintf(stderr, "Command file syntax error: "
+				    "expected a number following \"refrot\"\n");
+				goto errout;
+			}
+		} else if (strcmp(cmd, "gnd") == 0) {
+			if (fscanf(fp, "%lf", &scen->gnd_elev) != 1) {
+				fprintf(stderr, "Command file syntax error: "
+				    "expected a number following \"gnd\"\n");
+				goto errout;
+			}
+		} else if (strcmp(cmd, "scaleh") == 0) {
+			if (fscanf(fp, "%lf", &scen->scaleh) != 1) {
+				fprintf(stderr, "Command file syntax error: "
+				    "expected a number following \"scaleh\"\n");
+				goto errout;
+			}
+		} else if (strcmp(cmd, "scalev") == 0) {
+			if (fscanf(fp, "%lf", &scen->scalev) != 1) {
+				fprintf(stderr, "Command file syntax error: "
+				    "expected a number following \"scalev\"\n");
+				goto errout;
+			}
+		} else if (strcmp(cmd, "acf") == 0) {
+			if (acf == NULL)
+				acf = &scen->my_acf;
+			else
+				acf = xtcas_scen_add_acf(scen);
+		} else if (strcmp(cmd, "pos") == 0) {
+			if (acf == NULL) {
+				fprintf(stderr, "Command file syntax error: "
+				    "\"pos\" must be preceded by \"acf\"\n");
+				goto errout;
+			}
+			if (fscanf(fp, "%lf %lf %lf", &acf->pos.x,
+			    &acf->pos.y, &acf->pos.z) != 3) {
+				fprintf(stderr, "Command file syntax error: "
+				    "expected three numbers following "
+				    "\"pos\"\n");
+				goto errout;
+			}
+		} else if (strcmp(cmd, "trk") == 0) {
+			if (acf == NULL) {
+				fprintf(stderr, "Command file syntax error: "
+				    "\"trk\" must be preceded by \"acf\"\n");
+				goto errout;
+			}
+			if (fscanf(fp, "%lf", &acf->trk) != 1) {
+				fprintf(stderr, "Command file syntax error: "
+				    "expected a number following \"trk\"\n");
+				goto errout;
+			}
+		} else if (strcmp(cmd, "vs") == 0) {
+			if (acf == NULL) {
+				fprintf(stderr, "Command file syntax error: "
+				    "\"vs\" must be preceded by \"acf\"\n");
+				goto errout;
+			}
+			if (fscanf(fp, "%lf", &acf->vs) != 1) {
+				fprintf(stderr, "Command file syntax error: "
+				    "expected a number following \"vs\"\n");
+				goto errout;
+			}
+		} else if (strcmp(cmd, "gs") == 0) {
+			if (acf == NULL) {
+				fprintf(stderr, "Command file syntax error: "
+				    "\"gs\" must be preceded by \"acf\"\n");
+				goto errout;
+			}
+			if (fscanf(fp, "%lf", &acf->gs) != 1) {
+				fprintf(stderr, "Command file syntax error: "
+				    "expected a number following \"gs\"\n");
+				goto errout;
+			}
+		} else if (strcmp(cmd, "man") == 0) {
+			scen_man_t *man;
+			if (acf == NULL) {
+				fprintf(stderr, "Command file syntax error: "
+				    "\"man\" must be preceded by \"acf\"\n");
+				goto errout;
+			}
+			man = xtcas_scen_add_man(acf);
+			if (fscanf(fp, "%lf", &man->d_t) != 1) {
+				fprintf(stderr, "Command file syntax error: "
+				    "expected a number following \"man\"\n");
+				goto errout;
+			}
+		} else if (strcmp(cmd, "turn") == 0) {
+			scen_man_t *man;
+			if (acf == NULL ||
+			    (man = list_tail(&acf->maneuvers)) == NULL) {
+				fprintf(stderr, "Command file syntax error: "
+				    "\"turn\" must be preceded by \"man\"\n");
+				goto errout;
+			}
+			if (fscanf(fp, "%lf", &man->d_h) != 1) {
+				fprintf(stderr, "Command file syntax error: "
+				    "expected a number following \"turn\"\n");
+				goto errout;
+			}
+		} else if (strcmp(cmd, "clb") == 0) {
+			scen_man_t *man;
+			if (acf == NULL ||
+			    (man = list_tail(&acf->maneuvers)) == NULL) {
+				fprintf(stderr, "Command file syntax error: "
+				    "\"clb\" must be preceded by \"man\"\n");
+				goto errout;
+			}
+			if (fscanf(fp, "%lf", &man->d_vs) != 1) {
+				fprintf(stderr, "Command file syntax error: "
+				    "expected a number following \"clb\"\n");
+				goto errout;
+			}
+		} else if (strcmp(cmd, "spd") == 0) {
+			scen_man_t *man;
+			if (acf == NULL ||
+			    (man = list_tail(&acf->maneuvers)) == NULL) {
+				fprintf(stderr, "Command file syntax error: "
+				    "\"spd\" must be preceded by \"man\"\n");
+				goto errout;
+			}
+			if (fscanf(fp, "%lf", &man->d_gs) != 1) {
+				fprintf(stderr, "Command file syntax error: "
+				    "expected a number following \"spd\"\n");
+				goto errout;
+			}
+		} else if (strcmp(cmd, "auto") == 0) {
+			scen_man_t *man;
+			if (acf == NULL || acf->id != 0) {
+				fprintf(stderr, "Command file syntax error: "
+				    "\"auto\" must be preceded by \"acf\" "
+				    "and may only be used for own "
+				    "(non-intruder) aircraft.\n");
+				goto errout;
+			}
+			man = xtcas_scen_add_man(acf);
+			man->automan = B_TRUE;
+		} else if (strcmp(cmd, "auto_complete") == 0) {
+			scen->auto_complete = B_TRUE;
+		} else {
+			fprintf(stderr, "Command file syntax error: "
+			    "unknown keyword \"%s\"\n", cmd);
+			goto errout;
+		}
+	}
+
+	if (acf == NULL) {
+		fprintf(stderr, "Command file error: no aircraft defined\n");
+		goto errout;
+	}
+
+	scen->fpp = ortho_fpp_init(scen->refpt, scen->refrot, &wgs84, B_TRUE);
+
+	return (scen);
+errout:
+	xtcas_scen_free(scen);
+	return (NULL);
+}
+
+void
+xtcas_scen_free(scen_t *scen)
+{
+	scen_acf_t *acf;
+
+	acf_fini(&scen->my_acf);
+	while ((acf = list_remove_head(&scen->other_acf)) != NULL) {
+		acf_fini(acf);
+		free(acf);
+	}
+	list_destroy(&scen->other_acf);
+	free(scen);
+}
+
+/*
+ * Applies the TCAS mode and filter settings specified in the scenario.
+ */
+void
+xtcas_scen_apply(const scen_t *scen)
+{
+	if (scen->mode_set)
+		xtcas_set_mode(scen->mode);
+	if (scen->filter_set)
+		xtcas_set_filter(scen->filter);
+}
+
+static inline double
+vs2tgt(double cur_vs, double targ_vs, double vs)
+{
+	return (cur_vs < targ_vs ? vs : -vs);
+}
+
+static void
+step_acf(scen_t *scen, scen_acf_t *acf, uint64_t now, uint64_t step)
+{
+	double step_s = USEC2SEC(step);
+	double d_h = 0, d_vs = 0, d_gs = 0;
+	vect2_t dir;
+
+	for (;;) {
+		scen_man_t *man = list_head(&acf->maneuvers);
+		if (man == NULL)
+			break;
+		if (!man->started) {
+			/* just started this maneuver */
+			man->started = B_TRUE;
+			man->s_t = now;
+			man->auto_vs = acf->vs;
+		}
+		if (man->s_t + SEC2USEC(man->d_t) <= now && !man->automan) {
+			/* maneuver has ended */
+			list_remove(&acf->maneuvers, man);
+			free(man);
+		} else if (man->automan) {
+			double delay = (scen->RA_counter <= 1 ? 5.0 : 2.5) *
+			    scen->reaction_fact;
+			double d_vs_man = (scen->RA_counter <= 1 ? 2.5 : 3.3);
+
+			/* auto-maneuver our own aircraft */
+			if (scen->RA_counter == 0) {
+				if (acf->vs != man->auto_vs) {
+					d_vs = vs2tgt(acf->vs, man->auto_vs,
+					    d_vs_man);
+					if (fabs(d_vs) > acf->vs)
+						d_vs /= 2;
+				}
+				break;
+			}
+			if (USEC2SEC(now) < scen->RA_start + delay)
+				break;
+			d_vs = vs2tgt(acf->vs, scen->RA_tgt, d_vs_man);
+			break;
+		} else {
+			/* maneuver is active */
+			d_h = man->d_h;
+			d_vs = man->d_vs;
+			d_gs = man->d_gs;
+			break;
+		}
+	}
+
+	acf->trk += d_h * step_s;
+	if (acf->trk < 0.0)
+		acf->trk += 360.0;
+	else if (acf->trk >= 360.0)
+		acf->trk -= 360.0;
+	acf->vs += d_vs * step_s;
+	acf->gs += d_gs * step_s;
+	dir = vect2_set_abs(hdg2dir(acf->trk), acf->gs * step_s);
+	acf->pos.x += dir.x;
+	acf->pos.y += dir.y;
+	acf->pos.z += acf->vs * step_s;
+}
+
+/*
+ * Advances all aircraft in the scenario by `step' microseconds. `now' is
+ * the absolute scenario time in microseconds. Also keeps track of the
+ * minimum horizontal and vertical separation achieved so far.
+ */
+void
+xtcas_scen_step(scen_t *scen, uint64_t now, uint64_t step)
+{
+	step_acf(scen, &scen->my_acf, now, step);
+	for (scen_acf_t *acf = list_head(&scen->other_acf); acf != NULL;
+	    acf = list_next(&scen->other_acf, acf)) {
+		double d_h;
+
+		step_acf(scen, acf, now, step);
+		d_h = vect2_abs(vect2_sub(VECT3_TO_VECT2(acf->pos),
+		    VECT3_TO_VECT2(scen->my_acf.pos)));
+		scen->d_h_min = MIN(scen->d_h_min, d_h);
+		if (d_h < 150) {
+			scen->d_v_min = MIN(scen->d_v_min,
+			    ABS(scen->my_acf.pos.z - acf->pos.z));
+		}
+	}
+}
+
+scen_acf_t *
+xtcas_scen_find_acf(scen_t *scen, void *acf_id)
+{
+	for (scen_acf_t *acf = list_head(&scen->other_acf); acf != NULL;
+	    acf = list_next(&scen->other_acf, acf)) {
+		if (acf_id == (void *)(uintptr_t)acf->id)
+			return (acf);
+	}
+	return (NULL);
+}
+
+/*
+ * Feeds an RA update from the TCAS core into the auto-maneuver logic of
+ * our own aircraft. The arguments correspond to those of the update_RA
+ * output op. `now_t' is the current scenario time in seconds.
+ */
+void
+xtcas_scen_RA_update(scen_t *scen, tcas_adv_t adv, bool_t reversal,
+    double min_green, double max_green, double min_red_lo, double max_red_lo,
+    double min_red_hi, double max_red_hi, double now_t)
+{
+	const scen_acf_t *my_acf = &scen->my_acf;
+
+	if (adv == ADV_STATE_NONE) {
+		/* clear of conflict */
+		scen->RA_counter = 0;
+		scen->RA_tgt = 0;
+		if (scen->auto_complete)
+			scen->auto_completed = B_TRUE;
+	} else if (adv == ADV_STATE_RA) {
+		if (fabs(my_acf->vs - scen->RA_tgt) < 0.5 ||
+		    scen->RA_counter == 0 || reversal)
+			scen->RA_start = now_t;
+		scen->RA_counter++;
+
+		if (min_green != max_green) {
+			if (min_red_lo != max_red_lo &&
+			    min_red_hi != max_red_hi) {
+				scen->RA_tgt = (max_green + min_green) / 2;
+			} else {
+				scen->RA_tgt = (min_red_lo != max_red_lo ?
+				    min_green : max_green);
+			}
+		} else if (min_red_lo != max_red_lo) {
+			scen->RA_tgt = (fabs(my_acf->vs - min_red_hi) <
+			    fabs(my_acf->vs - max_red_lo)) ?
+			    min_red_lo : max_red_lo;
+		} else {
+			scen->RA_tgt = (fabs(my_acf->vs - min_red_hi) <
+			    fabs(my_acf->vs - max_red_hi)) ?
+			    min_red_hi : max_red_hi;
+		}
+	}
+}
+
+void
+xtcas_scen_get_my_acf_pos(const scen_t *scen, geo_pos3_t *pos,
+    double *alt_agl, double *hdg)
+{
+	const scen_acf_t *my_acf = &scen->my_acf;
+	geo_pos2_t pos2 = fpp2geo(VECT3_TO_VECT2(my_acf->pos), &scen->fpp);
+
+	*pos = GEO_POS3(pos2.lat, pos2.lon, my_acf->pos.z);
+	*alt_agl = my_acf->pos.z - scen->gnd_elev;
+	*hdg = my_acf->trk;
+}
+
+/*
+ * Fills the intruder position array lent to us by the fill_oth_acf_pos
+ * input op. Returns the total number of intruders, which can be more
+ * than `cap'.
+ */
+size_t
+xtcas_scen_fill_oth_acf_pos(const scen_t *scen, acf_pos_t *pos_out,
+    size_t cap)
+{
+	size_t i = 0;
+
+	for (const scen_acf_t *acf = list_head(&scen->other_acf); acf != NULL;
+	    acf = list_next(&scen->other_acf, acf), i++) {
+		geo_pos2_t pos2;
+
+		if (i >= cap)
+			continue;
+		pos2 = fpp2geo(VECT3_TO_VECT2(acf->pos), &scen->fpp);
+		pos_out[i].acf_id = (void *)(uintptr_t)acf->id;
+		pos_out[i].pos = GEO_POS3(pos2.lat, pos2.lon, acf->pos.z);
+		pos_out[i].on_ground = B_FALSE;
+	}
+
+	return (i);
+}
@@ -0,0 +1,117 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+*/
+/*
+ * Copyright 2025 Saso Kiselkov. All rights reserved.
+ */
+
+#ifndef	_XTCAS_SCEN_H_
+#define	_XTCAS_SCEN_H_
+
+#include <stdio.h>
+
+#include <acfutils/geom.h>
+#include <acfutils/list.h>
+
+#include "xtcas.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * Encounter scenario model shared by the standalone test program and the
+ * headless replay tool. A scenario is read from a command file (see
+ * xtcas_scen_read for the syntax) and consists of our own aircraft plus
+ * any number of intruders, each following a list of timed maneuvers. The
+ * scenario is stepped in a local flat-plane coordinate system (meters,
+ * X east, Y north, Z up) centered on the reference point.
+ */
+
+typedef struct {
+	bool_t		started;
+	uint64_t	s_t;	/* absolute start time in microseconds */
+	double		d_t;	/* delta-t (duration) */
+	double		d_h;	/* rate-of-change in heading (deg/s) */
+	double		d_vs;	/* rate-of-change in vertical speed (m/s^2) */
+	double		d_gs;	/* rate-of-change in ground speed (m/s^2) */
+	bool_t		automan;/* automatically maneuver in response to RAs */
+	double		auto_vs;
+	list_node_t	node;
+} scen_man_t;
+
+typedef struct {
+	int		id;
+	list_t		maneuvers;
+	vect3_t		pos;
+	double		trk;
+	double		vs;
+	double		gs;
+	list_node_t	node;
+	tcas_threat_t	threat_level;
+} scen_acf_t;
+
+typedef struct {
+	fpp_t		fpp;
+	geo_pos2_t	refpt;
+	double		refrot;
+	double		gnd_elev;
+	double		scaleh;
+	double		scalev;
+
+	bool_t		mode_set;
+	tcas_mode_t	mode;
+	bool_t		filter_set;
+	tcas_filter_t	filter;
+
+	scen_acf_t	my_acf;
+	list_t		other_acf;
+
+	bool_t		auto_complete;
+	bool_t		auto_completed;
+
+	/* auto-maneuver state, driven by xtcas_scen_RA_update */
+	double		reaction_fact;
+	double		RA_start;
+	int		RA_counter;
+	double		RA_tgt;
+
+	/* closest approach tracking */
+	double		d_h_min;
+	double		d_v_min;
+} scen_t;
+
+scen_t *xtcas_scen_new(void);
+scen_acf_t *xtcas_scen_add_acf(scen_t *scen);
+scen_man_t *xtcas_scen_add_man(scen_acf_t *acf);
+scen_t *xtcas_scen_read(FILE *fp);
+void xtcas_scen_free(scen_t *scen);
+void xtcas_scen_apply(const scen_t *scen);
+
+void xtcas_scen_step(scen_t *scen, uint64_t now, uint64_t step);
+scen_acf_t *xtcas_scen_find_acf(scen_t *scen, void *acf_id);
+void xtcas_scen_RA_update(scen_t *scen, tcas_adv_t adv, bool_t reversal,
+    double min_green, double max_green, double min_red_lo, double max_red_lo,
+    double min_red_hi, double max_red_hi, double now_t);
+
+void xtcas_scen_get_my_acf_pos(const scen_t *scen, geo_pos3_t *pos,
+    double *alt_agl, double *hdg);
+size_t xtcas_scen_fill_oth_acf_pos(const scen_t *scen, acf_pos_t *pos_out,
+    size_t cap);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _XTCAS_SCEN_H_ */
@@ -16,6 +16,7 @@
  * Copyright 2017 Saso Kiselkov. All rights reserved.
  */
 
+#include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -36,62 +37,26 @@
 #include "dbg_log.h"
 #include "snd_sys.h"
 #include "xtcas.h"
+#include "scen.h"
 #include "test.h"
 
 #define	SIMSTEP		100000	/* microseconds */
 
-typedef struct {
-	uint64_t	s_t;	/* absolute start time in microclock() ticks */
-	double		d_t;	/* delta-t (duration) */
-	double		d_h;	/* rate-of-change in heading (deg/s) */
-	double		d_vs;	/* rate-of-change in vertical speed (m/s^2) */
-	double		d_gs;	/* rate-of-change in ground speed (m/s^2) */
-	bool_t		automan;/* automatically maneuver in response to RAs */
-	double		auto_vs;
-	list_node_t	node;
-} maneuver_t;
-
-typedef struct {
-	int		id;
-	bool_t		inited;
-	list_t		maneuvers;
-	vect3_t		pos;
-	double		trk;
-	double		vs;
-	double		gs;
-	list_t		node;
-	tcas_threat_t	threat_level;
-} acf_t;
-
-static fpp_t		fpp;
-static acf_t		my_acf = { .inited = B_FALSE };
-static list_t		other_acf;
-static geo_pos2_t	refpt = {0, 0};
-static double		refrot = 0;
-static bool_t		auto_complete = B_FALSE;
-static bool_t		auto_completed = B_FALSE;
-static double		gnd_elev = 0;
-static double		scaleh = 100;
-static double		scalev = 200;
+static scen_t		*scen = NULL;
 static double		RA_min_green = 0, RA_max_green = 0;
 static double		RA_min_red_lo = 0, RA_max_red_lo = 0;
 static double		RA_min_red_hi = 0, RA_max_red_hi = 0;
-static double		RA_start = 0;
-static int		RA_counter = 0;
-static double		RA_tgt = 0;
-static double		reaction_fact = 1.0;
 static tcas_msg_t	RA_msg = -1u;
 static tcas_adv_t	RA_adv = ADV_STATE_NONE;
 static double		RA_min_sep_cpa = 0;
-static double		d_h_min = INFINITY;
-static double		d_v_min = INFINITY;
 static bool_t		feet = B_FALSE;
 static bool_t		sound = B_TRUE;
 
 static double get_time(void *handle);
 static void get_my_acf_pos(void *handle, geo_pos3_t *pos, double *alt_agl,
-    double *hdg, bool_t *gear_ext);
-static void get_oth_acf_pos(void *handle, acf_pos_t **pos_p, size_t *num);
+    double *hdg, bool_t *gear_ext, bool_t *on_ground);
+static size_t fill_oth_acf_pos(void *handle, acf_pos_t *pos_out,
+    size_t cap);
 static void update_contact(void *handle, void *acf_id, double rbrg,
     double rdist, double ralt, double vs, double trk, double gs,
     tcas_threat_t level);
@@ -108,7 +73,7 @@ static sim_intf_input_ops_t test_in_ops = {
 	.handle = NULL,
 	.get_time = get_time,
 	.get_my_acf_pos = get_my_acf_pos,
-	.get_oth_acf_pos = get_oth_acf_pos
+	.fill_oth_acf_pos = fill_oth_acf_pos
 };
 
 static sim_intf_output_ops_t test_out_ops = {
@@ -119,302 +84,9 @@ static sim_intf_output_ops_t test_out_ops = {
 	.update_RA_prediction = update_RA_prediction
 };
 
-static bool_t
-read_command_file(FILE *fp)
-{
-	char cmd[64];
-	int acf_id = 0;
-	acf_t *acf = NULL;
-
-	while (!feof(fp)) {
-		if (fscanf(fp, "%63s", cmd) != 1)
-			break;
-
-		if (cmd[0] == '#') {
-			int c;
-			do {
-				c = fgetc(fp);
-			} while (c != '\n' && c != EOF);
-			continue;
-		}
-
-		if (strcmp(cmd, "filter") == 0) {
-			if (fscanf(fp, "%63s", cmd) != 1)
-				*cmd = 0;
-			if (strcasecmp(cmd, "all") == 0) {
-				xtcas_set_filter(TCAS_FILTER_ALL);
-			} else if (strcasecmp(cmd, "thrt") == 0) {
-				xtcas_set_filter(TCAS_FILTER_THRT);
-			} else if (strcasecmp(cmd, "abv") == 0) {
-				xtcas_set_filter(TCAS_FILTER_ABV);
-			} else if (strcasecmp(cmd, "blw") == 0) {
-				xtcas_set_filter(TCAS_FILTER_BLW);
-			} else {
-				fprintf(stderr, "Command file syntax error: "
-				    "\"filter\" must be followed by one of "
-				    "ALL, THRT, ABV or BLW\n");
-				return (B_FALSE);
-			}
-		} else if (strcmp(cmd, "mode") == 0) {
-			if (fscanf(fp, "%63s", cmd) != 1)
-				*cmd = 0;
-			if (strcasecmp(cmd, "stby") == 0) {
-				xtcas_set_mode(TCAS_MODE_STBY);
-			} else if (strcasecmp(cmd, "taonly") == 0) {
-				xtcas_set_mode(TCAS_MODE_TAONLY);
-			} else if (strcasecmp(cmd, "tara") == 0) {
-				xtcas_set_mode(TCAS_MODE_TARA);
-			} else {
-				fprintf(stderr, "Command file syntax error: "
-				    "\"mode\" must be followed by one of "
-				    "STBY, TAONLY, TARA\n");
-				return (B_FALSE);
-			}
-		} else if (strcmp(cmd, "reflat") == 0) {
-			if (fscanf(fp, "%lf", &refpt.lat) != 1) {
-				fprintf(stderr, "Command file syntax error: "
-				    "expected a number following \"reflat\"\n");
-				return (B_FALSE);
-			}
-		} else if (strcmp(cmd, "reflon") == 0) {
-			if (fscanf(fp, "%lf", &refpt.lon) != 1) {
-				fprintf(stderr, "Command file syntax error: "
-				    "expected a number following \"reflon\"\n");
-				return (B_FALSE);
-			}
-		} else if (strcmp(cmd, "refrot") == 0) {
-			if (fscanf(fp, "%lf", &refrot) != 1) {
-				fprintf(stderr, "Command file syntax error: "
-				    "expected a number following \"refrot\"\n");
-				return (B_FALSE);
-			}
-		} else if (strcmp(cmd, "gnd") == 0) {
-			if (fscanf(fp, "%lf", &gnd_elev) != 1) {
-				fprintf(stderr, "Command file syntax error: "
-				    "expected a number following \"gnd\"\n");
-				return (B_FALSE);
-			}
-		} else if (strcmp(cmd, "scaleh") == 0) {
-			if (fscanf(fp, "%lf", &scaleh) != 1) {
-				fprintf(stderr, "Command file syntax error: "
-				    "expected a number following \"scaleh\"\n");
-				return (B_FALSE);
-			}
-		} else if (strcmp(cmd, "scalev") == 0) {
-			if (fscanf(fp, "%lf", &scalev) != 1) {
-				fprintf(stderr, "Command file syntax error: "
-				    "expected a number following \"scalev\"\n");
-				return (B_FALSE);
-			}
-		} else if (strcmp(cmd, "acf") == 0) {
-			if (acf == NULL) {
-				acf = &my_acf;
-			} else {
-				acf = safe_calloc(1, sizeof (*acf));
-				list_insert_tail(&other_acf, acf);
-			}
-			acf->id = acf_id++;
-			list_create(&acf->maneuvers, sizeof (maneuver_t),
-			    offsetof(maneuver_t, node));
-		} else if (strcmp(cmd, "pos") == 0) {
-			if (acf == NULL) {
-				fprintf(stderr, "Command file syntax error: "
-				    "\"pos\" must be preceded by \"acf\"\n");
-				return (B_FALSE);
-			}
-			if (fscanf(fp, "%lf %lf %lf", &acf->pos.x,
-			    &acf->pos.y, &acf->pos.z) != 3) {
-				fprintf(stderr, "Command file syntax error: "
-				    "expected three numbers following "
-				    "\"pos\"\n");
-				return (B_FALSE);
-			}
-		} else if (strcmp(cmd, "trk") == 0) {
-			if (acf == NULL) {
-				fprintf(stderr, "Command file syntax error: "
-				    "\"trk\" must be preceded by \"acf\"\n");
-				return (B_FALSE);
-			}
-			if (fscanf(fp, "%lf", &acf->trk) != 1) {
-				fprintf(stderr, "Command file syntax error: "
-				    "expected a number following \"trk\"\n");
-				return (B_FALSE);
-			}
-		} else if (strcmp(cmd, "vs") == 0) {
-			if (acf == NULL) {
-				fprintf(stderr, "Command file syntax error: "
-				    "\"vs\" must be preceded by \"acf\"\n");
-				return (B_FALSE);
-			}
-			if (fscanf(fp, "%lf", &acf->vs) != 1) {
-				fprintf(stderr, "Command file syntax error: "
-				    "expected a number following \"vs\"\n");
-				return (B_FALSE);
-			}
-		} else if (strcmp(cmd, "gs") == 0) {
-			if (acf == NULL) {
-				fprintf(stderr, "Command file syntax error: "
-				    "\"gs\" must be preceded by \"acf\"\n");
-				return (B_FALSE);
-			}
-			if (fscanf(fp, "%lf", &acf->gs) != 1) {
-				fprintf(stderr, "Command file syntax error: "
-				    "expected a number following \"gs\"\n");
-				return (B_FALSE);
-			}
-		} else if (strcmp(cmd, "man") == 0) {
-			maneuver_t *man;
-			if (acf == NULL) {
-				fprintf(stderr, "Command file syntax error: "
-				    "\"man\" must be preceded by \"acf\"\n");
-				return (B_FALSE);
-			}
-			man = safe_calloc(1, sizeof (*man));
-			list_insert_tail(&acf->maneuvers, man);
-			if (fscanf(fp, "%lf", &man->d_t) != 1) {
-				fprintf(stderr, "Command file syntax error: "
-				    "expected a number following \"man\"\n");
-				return (B_FALSE);
-			}
-		} else if (strcmp(cmd, "turn") == 0) {
-			maneuver_t *man;
-			if (acf == NULL ||
-			    (man = list_tail(&acf->maneuvers)) == NULL) {
-				fprintf(stderr, "Command file syntax error: "
-				    "\"turn\" must be preceded by \"man\"\n");
-				return (B_FALSE);
-			}
-			if (fscanf(fp, "%lf", &man->d_h) != 1) {
-				fprintf(stderr, "Command file syntax error: "
-				    "expected a number following \"turn\"\n");
-				return (B_FALSE);
-			}
-		} else if (strcmp(cmd, "clb") == 0) {
-			maneuver_t *man;
-			if (acf == NULL ||
-			    (man = list_tail(&acf->maneuvers)) == NULL) {
-				fprintf(stderr, "Command file syntax error: "
-				    "\"clb\" must be preceded by \"man\"\n");
-				return (B_FALSE);
-			}
-			if (fscanf(fp, "%lf", &man->d_vs) != 1) {
-				fprintf(stderr, "Command file syntax error: "
-				    "expected a number following \"clb\"\n");
-				return (B_FALSE);
-			}
-		} else if (strcmp(cmd, "spd") == 0) {
-			maneuver_t *man;
-			if (acf == NULL ||
-			    (man = list_tail(&acf->maneuvers)) == NULL) {
-				fprintf(stderr, "Command file syntax error: "
-				    "\"spd\" must be preceded by \"man\"\n");
-				return (B_FALSE);
-			}
-			if (fscanf(fp, "%lf", &man->d_gs) != 1) {
-				fprintf(stderr, "Command file syntax error: "
-				    "expected a number following \"spd\"\n");
-				return (B_FALSE);
-			}
-		} else if (strcmp(cmd, "auto") == 0) {
-			maneuver_t *man = safe_calloc(1, sizeof (*man));
-			if (acf == NULL || acf->id != 0) {
-				fprintf(stderr, "Command file syntax error: "
-				    "\"auto\" must be preceded by \"acf\" "
-				    "and may only be used for own "
-				    "(non-intruder) aircraft.\n");
-				return (B_FALSE);
-			}
-			man->automan = B_TRUE;
-			list_insert_tail(&acf->maneuvers, man);
-		} else if (strcmp(cmd, "auto_complete") == 0) {
-			auto_complete = B_TRUE;
-		} else {
-			fprintf(stderr, "Command file syntax error: "
-			    "unknown keyword \"%s\"\n", cmd);
-			return (B_FALSE);
-		}
-	}
-
-	return (B_TRUE);
-}
-
-static inline double
-vs2tgt(double cur_vs, double targ_vs, double vs)
-{
-	return (cur_vs < targ_vs ? vs : -vs);
-}
-
-static void
-step_acf(acf_t *acf, uint64_t now, uint64_t step)
-{
-	double step_s = USEC2SEC(step);
-	double d_h = 0, d_vs = 0, d_gs = 0;
-	vect2_t dir;
-
-	for (;;) {
-		maneuver_t *man = list_head(&acf->maneuvers);
-		if (man == NULL)
-			break;
-		if (man->s_t == 0) {
-			/* just started this maneuver */
-			man->s_t = now;
-			man->auto_vs = acf->vs;
-		}
-		if (man->s_t + SEC2USEC(man->d_t) <= now && !man->automan) {
-			/* maneuver has ended */
-			list_remove(&acf->maneuvers, man);
-			free(man);
-		} else if (man->automan) {
-			double delay = (RA_counter <= 1 ? 5.0 : 2.5) *
-			    reaction_fact;
-			double d_vs_man = (RA_counter <= 1 ? 2.5 : 3.3);
-
-			/* auto-maneuver our own aircraft */
-			if (RA_counter == 0) {
-				if (acf->vs != man->auto_vs) {
-					d_vs = vs2tgt(acf->vs, man->auto_vs,
-					    d_vs_man);
-					if (fabs(d_vs) > acf->vs)
-						d_vs /= 2;
-				}
-				break;
-			}
-			if (USEC2SEC(now) < RA_start + delay)
-				break;
-			d_vs = vs2tgt(acf->vs, RA_tgt, d_vs_man);
-			break;
-		} else {
-			/* maneuver is active */
-			d_h = man->d_h;
-			d_vs = man->d_vs;
-			d_gs = man->d_gs;
-			break;
-		}
-	}
-
-	acf->trk += d_h * step_s;
-	if (acf->trk < 0.0)
-		acf->trk += 360.0;
-	else if (acf->trk >= 360.0)
-		acf->trk -= 360.0;
-	acf->vs += d_vs * step_s;
-	acf->gs += d_gs * step_s;
-	dir = vect2_set_abs(hdg2dir(acf->trk), acf->gs * step_s);
-	acf->pos.x += dir.x;
-	acf->pos.y += dir.y;
-	acf->pos.z += acf->vs * step_s;
-
-	if (acf != &my_acf) {
-		double d_h = vect2_abs(vect2_sub(VECT3_TO_VECT2(acf->pos),
-		    VECT3_TO_VECT2(my_acf.pos)));
-		d_h_min = MIN(d_h_min, d_h);
-		if (d_h < 150)
-			d_v_min = MIN(d_v_min, ABS(my_acf.pos.z - acf->pos.z));
-	}
-}
-
 static void
-draw_acf(vect3_t my_pos, double my_trk, acf_t *acf, int maxy, int maxx)
+draw_acf(vect3_t my_pos, double my_trk, scen_acf_t *acf, int maxy,
+    int maxx)
 {
 	int cy = (maxy / 3) * 2, cx = maxx / 2;
 	int x, y;
@@ -427,8 +99,8 @@ draw_acf(vect3_t my_pos, double my_trk, acf_t *acf, int maxy, int maxx)
 	double trk = normalize_hdg(acf->trk - my_trk);
 
 	xy = vect2_rot(xy, -my_trk);
-	x = cx - xy.x / scaleh;
-	y = cy + xy.y / scalev;
+	x = cx - xy.x / scen->scaleh;
+	y = cy + xy.y / scen->scalev;
 	if (x - 1 < 5 || x + 6 >= maxx || y - 1 < 3 || y + 2 >= maxy)
 		return;
 
@@ -546,22 +218,22 @@ draw_gui(WINDOW *win)
 	}
 	free(buf);
 
-	int kx = maxx / (1000 / scaleh), ky = maxy / (1000 / scalev),
-	    scalestep = kx / 3;
+	int kx = maxx / (1000 / scen->scaleh),
+	    ky = maxy / (1000 / scen->scalev), scalestep = kx / 3;
 
 	move(0, 0);
 
 	/* draw the position dots 10km around the origin point */
-	for (int i = (int)my_acf.pos.x / 1000 - kx / 2;
-	    i <= (int)my_acf.pos.x / 1000 + kx / 2; i++) {
-		for (int j = (int)my_acf.pos.y / 1000 - (ky / 3);
-		    j <= (int)my_acf.pos.y / 1000 + 2 * (ky / 3); j++) {
-			vect2_t v = VECT2(i * 1000 - my_acf.pos.x,
-			    j * 1000 - my_acf.pos.y);
+	for (int i = (int)scen->my_acf.pos.x / 1000 - kx / 2;
+	    i <= (int)scen->my_acf.pos.x / 1000 + kx / 2; i++) {
+		for (int j = (int)scen->my_acf.pos.y / 1000 - (ky / 3);
+		    j <= (int)scen->my_acf.pos.y / 1000 + 2 * (ky / 3); j++) {
+			vect2_t v = VECT2(i * 1000 - scen->my_acf.pos.x,
+			    j * 1000 - scen->my_acf.pos.y);
 			int x, y;
-			v = vect2_rot(v, -my_acf.trk);
-			x = maxx / 2 + v.x / scaleh;
-			y = 2 * (maxy / 3) - v.y / scalev;
+			v = vect2_rot(v, -scen->my_acf.trk);
+			x = maxx / 2 + v.x / scen->scaleh;
+			y = 2 * (maxy / 3) - v.y / scen->scalev;
 			if (x < 5 || x + 11 >= maxx ||
 			    y < 4 || y >= maxy)
 				continue;
@@ -580,23 +252,23 @@ draw_gui(WINDOW *win)
 
 	move(2 * (maxy / 3), maxx / 2);
 	printw("^");
-	for (acf_t *acf = list_head(&other_acf); acf != NULL;
-	    acf = list_next(&other_acf, acf))
-		draw_acf(my_acf.pos, my_acf.trk, acf, maxy, maxx);
+	for (scen_acf_t *acf = list_head(&scen->other_acf); acf != NULL;
+	    acf = list_next(&scen->other_acf, acf))
+		draw_acf(scen->my_acf.pos, scen->my_acf.trk, acf, maxy, maxx);
 
 	/* draw the heading tape */
 	move(0, maxx / 2 - 1);
-	printw("%03.0f", my_acf.trk);
+	printw("%03.0f", scen->my_acf.trk);
 	move(1, maxx / 2);
 	printw("V");
 	for (int i = -2; i <= 2; i++) {
-		int trk = ((int)my_acf.trk + i * 10) / 10 * 10,
+		int trk = ((int)scen->my_acf.trk + i * 10) / 10 * 10,
 		    trk_disp = trk;
 		if (trk_disp < 0)
 			trk_disp += 360;
 		else if (trk_disp > 359)
 			trk_disp -= 360;
-		move(2, maxx / 2 - ((int)my_acf.trk - trk) - 1);
+		move(2, maxx / 2 - ((int)scen->my_acf.trk - trk) - 1);
 		printw("%03d", trk_disp);
 	}
 
@@ -604,7 +276,8 @@ draw_gui(WINDOW *win)
 	move(maxy / 2 - 1, 0);
 	printw("+---+");
 	move(maxy / 2, 0);
-	printw("|%03.0f|", feet ? MPS2KT(my_acf.gs) : my_acf.gs);
+	printw("|%03.0f|", feet ? MPS2KT(scen->my_acf.gs) :
+	    scen->my_acf.gs);
 	move(maxy / 2 + 1, 0);
 	printw("+---+");
 
@@ -612,28 +285,29 @@ draw_gui(WINDOW *win)
 	move(maxy / 2 - 1, maxx - 11);
 	printw("+-----+");
 	move(maxy / 2, maxx - 11);
-	printw("|%05.0f|", feet ? MET2FEET(my_acf.pos.z) : my_acf.pos.z);
+	printw("|%05.0f|", feet ? MET2FEET(scen->my_acf.pos.z) :
+	    scen->my_acf.pos.z);
 	move(maxy / 2 + 1, maxx - 11);
 	printw("+-----+");
 
 	/* draw the VS tape */
 	move(maxy / 2, maxx - 4);
 	printw("===");
-	if (my_acf.vs >= 1 || my_acf.vs <= -1) {
-		if (my_acf.vs < 0) {
-			for (int i = 1; i < -(int)my_acf.vs; i++) {
+	if (scen->my_acf.vs >= 1 || scen->my_acf.vs <= -1) {
+		if (scen->my_acf.vs < 0) {
+			for (int i = 1; i < -(int)scen->my_acf.vs; i++) {
 				move(maxy / 2 + i, maxx - 3);
 				printw("|");
 			}
 		} else {
-			for (int i = -1; i > -(int)my_acf.vs; i--) {
+			for (int i = -1; i > -(int)scen->my_acf.vs; i--) {
 				move(maxy / 2 + i, maxx - 3);
 				printw("|");
 			}
 		}
-		move(maxy / 2 - (int)my_acf.vs, maxx - 4);
-		printw("%+03.0f", feet ? (MPS2FPM(my_acf.vs) / 100) :
-		    my_acf.vs);
+		move(maxy / 2 - (int)scen->my_acf.vs, maxx - 4);
+		printw("%+03.0f", feet ? (MPS2FPM(scen->my_acf.vs) / 100) :
+		    scen->my_acf.vs);
 	}
 
 	draw_RA_band(maxy, maxx, RA_min_red_lo, RA_max_red_lo, 3, 'X');
@@ -666,11 +340,13 @@ draw_gui(WINDOW *win)
 	}
 
 	move(1, 0);
-	printw("d_h_min: %5.0f%s", isfinite(d_h_min) ? (feet ?
-	    MET2FEET(d_h_min) : d_h_min) : -1.0, feet ? "ft" : "m");
+	printw("d_h_min: %5.0f%s", isfinite(scen->d_h_min) ? (feet ?
+	    MET2FEET(scen->d_h_min) : scen->d_h_min) : -1.0,
+	    feet ? "ft" : "m");
 	move(2, 0);
-	printw("d_v_min: %5.0f%s", isfinite(d_v_min) ? (feet ?
-	    MET2FEET(d_v_min) : d_v_min) : -1.0, feet ? "ft" : "m");
+	printw("d_v_min: %5.0f%s", isfinite(scen->d_v_min) ? (feet ?
+	    MET2FEET(scen->d_v_min) : scen->d_v_min) : -1.0,
+	    feet ? "ft" : "m");
 
 	move(3, 0);
 	printw("CPA:     %5.0f%s", feet ? MET2FEET(RA_min_sep_cpa) :
@@ -708,6 +384,62 @@ draw_gui(WINDOW *win)
 	refresh();
 }
 
+static void
+dump_stage_timing(FILE *fp, const char *name, uint64_t num,
+    const xtcas_stage_timing_t *st)
+{
+	fprintf(fp, "%s,%llu,%llu,%llu,%llu,%llu", name,
+	    (unsigned long long)num, (unsigned long long)st->min_ns,
+	    (unsigned long long)st->avg_ns, (unsigned long long)st->p99_ns,
+	    (unsigned long long)st->max_ns);
+	for (int b = 0; b < XTCAS_TIMING_BUCKETS; b++)
+		fprintf(fp, ",%llu", (unsigned long long)st->hist[b]);
+	fprintf(fp, "\n");
+}
+
+/*
+ * Dumps the worker pipeline timing statistics to `filename' as CSV, one
+ * row per stage, followed by the stage's duration histogram. The last
+ * row is the position collection.
+ */
+static bool_t
+dump_timing(const char *filename)
+{
+	xtcas_timing_t tm;
+	FILE *fp = fopen(filename, "w");
+
+	if (fp == NULL) {
+		fprintf(stderr, "Cannot open %s: %s\n", filename,
+		    strerror(errno));
+		return (B_FALSE);
+	}
+	xtcas_get_timing(&tm);
+
+	fprintf(fp, "# contacts: last %u, max %u; RA candidates: last %u, "
+	    "max %u\n", tm.num_contacts, tm.max_contacts, tm.num_RA_cands,
+	    tm.max_RA_cands);
+	fprintf(fp, "# RA separation memo: last %u/%u, total %llu/%llu "
+	    "hits/lookups\n", tm.num_sep_hits, tm.num_sep_lookups,
+	    (unsigned long long)tm.total_sep_hits,
+	    (unsigned long long)tm.total_sep_lookups);
+	fprintf(fp, "# contact reports: last %u sent, %u suppressed; total "
+	    "%llu sent, %llu suppressed\n", tm.num_ctc_reported,
+	    tm.num_ctc_suppressed, (unsigned long long)tm.total_ctc_reported,
+	    (unsigned long long)tm.total_ctc_suppressed);
+	fprintf(fp, "stage,cycles,min_ns,avg_ns,p99_ns,max_ns");
+	for (int b = 0; b < XTCAS_TIMING_BUCKETS; b++)
+		fprintf(fp, ",hist_%d", b);
+	fprintf(fp, "\n");
+	for (int i = 0; i < XTCAS_NUM_STAGES; i++) {
+		dump_stage_timing(fp, xtcas_stage2str(i), tm.num_cycles,
+		    &tm.stages[i]);
+	}
+	dump_stage_timing(fp, "collect", tm.num_collects, &tm.collect);
+	fclose(fp);
+
+	return (B_TRUE);
+}
+
 static void
 lib_log_func(const char *str)
 {
@@ -728,12 +460,12 @@ main(int argc, char **argv)
 	int flags;
 	WINDOW *win;
 	bool_t gfx = B_TRUE;
+	double reaction_fact = 1.0;
+	const char *timing_file = NULL;
 
 	log_init(lib_log_func, "xtcas");
 
-	list_create(&other_acf, sizeof (acf_t), offsetof(acf_t, node));
-
-	while ((opt = getopt(argc, argv, "Sfr:gdD:s:")) != -1) {
+	while ((opt = getopt(argc, argv, "Sfr:gdD:s:T:")) != -1) {
 		switch (opt) {
 		case 'S':
 			sound = B_FALSE;
@@ -783,6 +515,9 @@ main(int argc, char **argv)
 		case 's':
 			snd_dir = optarg;
 			break;
+		case 'T':
+			timing_file = optarg;
+			break;
 		default:
 			return (1);
 		}
@@ -797,21 +532,22 @@ main(int argc, char **argv)
 		return (1);
 	}
 
-	xtcas_init(&test_in_ops, &test_out_ops);
-	xtcas_set_mode(TCAS_MODE_TARA);
-	if (!xtcas_snd_sys_init(snd_dir))
-		return (1);
-
 	cmdfile = fopen(argv[0], "r");
 	if (cmdfile == NULL) {
 		perror("Cannot open command file");
 		return (1);
 	}
-	if (!read_command_file(cmdfile))
-		return (1);
+	scen = xtcas_scen_read(cmdfile);
 	fclose(cmdfile);
+	if (scen == NULL)
+		return (1);
+	scen->reaction_fact = reaction_fact;
 
-	fpp = ortho_fpp_init(refpt, refrot, &wgs84, B_TRUE);
+	xtcas_init(&test_in_ops, &test_out_ops);
+	xtcas_set_mode(TCAS_MODE_TARA);
+	xtcas_scen_apply(scen);
+	if (!xtcas_snd_sys_init(snd_dir))
+		return (1);
 
 	now = microclock();
 	mutex_init(&mtx);
@@ -835,7 +571,7 @@ main(int argc, char **argv)
 	}
 
 	mutex_enter(&mtx);
-	while (!auto_completed) {
+	while (!scen->auto_completed) {
 		if (gfx) {
 			int c = getch();
 
@@ -878,10 +614,7 @@ main(int argc, char **argv)
 			}
 		}
 
-		step_acf(&my_acf, now, SIMSTEP);
-		for (acf_t *acf = list_head(&other_acf); acf != NULL;
-		    acf = list_next(&other_acf, acf))
-			step_acf(acf, now, SIMSTEP);
+		xtcas_scen_step(scen, now, SIMSTEP);
 
 		xtcas_run();
 
@@ -901,26 +634,12 @@ out:
 	mutex_destroy(&mtx);
 	cv_destroy(&cv);
 
+	if (timing_file != NULL)
+		dump_timing(timing_file);
 	xtcas_fini();
 	xtcas_snd_sys_fini();
 
-	for (maneuver_t *man = list_head(&my_acf.maneuvers); man != NULL;
-	    man = list_head(&my_acf.maneuvers)) {
-		list_remove(&my_acf.maneuvers, man);
-		free(man);
-	}
-	for (acf_t *acf = list_head(&other_acf); acf != NULL;
-	    acf = list_head(&other_acf)) {
-		for (maneuver_t *man = list_head(&acf->maneuvers); man != NULL;
-		    man = list_head(&acf->maneuvers)) {
-			list_remove(&acf->maneuvers, man);
-			free(man);
-		}
-		list_destroy(&acf->maneuvers);
-		list_remove(&other_acf, acf);
-		free(acf);
-	}
-	list_destroy(&other_acf);
+	xtcas_scen_free(scen);
 
 	return (0);
 }
@@ -934,39 +653,27 @@ get_time(void *handle)
 
 static void
 get_my_acf_pos(void *handle, geo_pos3_t *pos, double *alt_agl, double *hdg,
-    bool_t *gear_ext)
+    bool_t *gear_ext, bool_t *on_ground)
 {
-	geo_pos2_t pos2 = fpp2geo(VECT3_TO_VECT2(my_acf.pos), &fpp);
 	UNUSED(handle);
-	*pos = GEO_POS3(pos2.lat, pos2.lon, my_acf.pos.z);
-	*alt_agl = my_acf.pos.z - gnd_elev;
-	*hdg = my_acf.trk;
+	xtcas_scen_get_my_acf_pos(scen, pos, alt_agl, hdg);
 	*gear_ext = B_FALSE;
+	*on_ground = B_FALSE;
 }
 
-static void
-get_oth_acf_pos(void *handle, acf_pos_t **pos_p, size_t *num)
+static size_t
+fill_oth_acf_pos(void *handle, acf_pos_t *pos_out, size_t cap)
 {
-	size_t i = 0, n = 0;
 	UNUSED(handle);
-	for (acf_t *acf = list_head(&other_acf); acf != NULL;
-	    acf = list_next(&other_acf, acf))
-		n++;
-	*num = n;
-	*pos_p = safe_calloc(n, sizeof (acf_pos_t));
-	for (acf_t *acf = list_head(&other_acf); acf != NULL;
-	    acf = list_next(&other_acf, acf)) {
-		acf_pos_t *pos = &(*pos_p)[i++];
-		geo_pos2_t pos2 = fpp2geo(VECT3_TO_VECT2(acf->pos), &fpp);
-		pos->acf_id = (void *)(uintptr_t)acf->id;
-		pos->pos = GEO_POS3(pos2.lat, pos2.lon, acf->pos.z);
-	}
+	return (xtcas_scen_fill_oth_acf_pos(scen, pos_out, cap));
 }
 
 static void
 update_contact(void *handle, void *acf_id, double rbrg, double rdist,
     double ralt, double vs, double trk, double gs, tcas_threat_t level)
 {
+	scen_acf_t *acf = xtcas_scen_find_acf(scen, acf_id);
+
 	UNUSED(handle);
 	UNUSED(vs);
 	UNUSED(rbrg);
@@ -975,28 +682,19 @@ update_contact(void *handle, void *acf_id, double rbrg, double rdist,
 	UNUSED(trk);
 	UNUSED(gs);
 
-	for (acf_t *acf = list_head(&other_acf); acf != NULL;
-	    acf = list_next(&other_acf, acf)) {
-		if (acf_id == (void *)(uintptr_t)acf->id) {
-			acf->threat_level = level;
-			return;
-		}
-	}
-	VERIFY(0);
+	VERIFY(acf != NULL);
+	acf->threat_level = level;
 }
 
 static void
 delete_contact(void *handle, void *acf_id)
 {
+	scen_acf_t *acf = xtcas_scen_find_acf(scen, acf_id);
+
 	UNUSED(handle);
-	for (acf_t *acf = list_head(&other_acf); acf != NULL;
-	    acf = list_next(&other_acf, acf)) {
-		if (acf_id == (void *)(uintptr_t)acf->id) {
-			acf->threat_level = -1u;
-			return;
-		}
-	}
-	VERIFY(0);
+
+	VERIFY(acf != NULL);
+	acf->threat_level = -1u;
 }
 
 static void
@@ -1009,7 +707,6 @@ update_RA(void *handle, tcas_adv_t adv, tcas_msg_t msg, tcas_RA_type_t type,
 	UNUSED(type);
 	UNUSED(sense);
 	UNUSED(crossing);
-	UNUSED(reversal);
 	UNUSED(min_sep_cpa);
 
 	RA_min_green = min_green;
@@ -1021,34 +718,9 @@ update_RA(void *handle, tcas_adv_t adv, tcas_msg_t msg, tcas_RA_type_t type,
 
 	RA_msg = msg;
 	RA_adv = adv;
-	if (adv == ADV_STATE_NONE) {
-		/* clear of conflict */
-		RA_counter = 0;
-		RA_tgt = 0;
-		if (auto_complete)
-			auto_completed = B_TRUE;
-	} else if (adv == ADV_STATE_RA) {
-		if (fabs(my_acf.vs - RA_tgt) < 0.5 || RA_counter == 0 ||
-		    reversal)
-			RA_start = get_time(NULL);
-		RA_counter++;
-
-		if (min_green != max_green) {
-			if (min_red_lo != max_red_lo &&
-			    min_red_hi != max_red_hi) {
-				RA_tgt = (max_green + min_green) / 2;
-			} else {
-				RA_tgt = (min_red_lo != max_red_lo ?
-				    min_green : max_green);
-			}
-		} else if (min_red_lo != max_red_lo) {
-			RA_tgt = (fabs(my_acf.vs - min_red_hi) < fabs(
-			    my_acf.vs - max_red_lo)) ? min_red_lo : max_red_lo;
-		} else {
-			RA_tgt = (fabs(my_acf.vs - min_red_hi) < fabs(
-			    my_acf.vs - max_red_hi)) ? min_red_hi : max_red_hi;
-		}
-	}
+
+	xtcas_scen_RA_update(scen, adv, reversal, min_green, max_green,
+	    min_red_lo, max_red_lo, min_red_hi, max_red_hi, get_time(NULL));
 }
 
 static void
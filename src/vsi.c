@@ -1318,21 +1318,14 @@ vsi_fini(void)
 	inited = B_FALSE;
 }
 
-void
-vsi_update_contact(void *handle, void *acf_id, double rbrg, double rdist,
-    double ralt, double vs, double trk, double gs, tcas_threat_t level)
+static void
+update_ctc_locked(void *acf_id, double rbrg, double rdist, double ralt,
+    double vs, tcas_threat_t level)
 {
 	ctc_t *ctc;
 	const ctc_t srch = { .acf_id = acf_id };
 	avl_index_t where;
 
-	ASSERT(inited);
-	UNUSED(handle);
-	UNUSED(trk);
-	UNUSED(gs);
-
-	mutex_enter(&ctc_lock);
-
 	ctc = avl_find(&ctcs, &srch, &where);
 	if (ctc == NULL) {
 		ctc = safe_calloc(1, sizeof (*ctc));
@@ -1344,23 +1337,59 @@ vsi_update_contact(void *handle, void *acf_id, double rbrg, double rdist,
 	ctc->ralt = ralt;
 	ctc->vs = vs;
 	ctc->level = level;
+}
 
+static void
+delete_ctc_locked(void *acf_id)
+{
+	ctc_t *ctc;
+	const ctc_t srch = { .acf_id = acf_id };
+
+	ctc = avl_find(&ctcs, &srch, NULL);
+	if (ctc != NULL) {
+		avl_remove(&ctcs, ctc);
+		free(ctc);
+	}
+}
+
+void
+vsi_update_contact(void *handle, void *acf_id, double rbrg, double rdist,
+    double ralt, double vs, double trk, double gs, tcas_threat_t level)
+{
+	ASSERT(inited);
+	UNUSED(handle);
+	UNUSED(trk);
+	UNUSED(gs);
+
+	mutex_enter(&ctc_lock);
+	update_ctc_locked(acf_id, rbrg, rdist, ralt, vs, level);
 	mutex_exit(&ctc_lock);
 }
 
 void vsi_delete_contact(void *handle, void *acf_id)
 {
-	ctc_t *ctc;
-	const ctc_t srch = { .acf_id = acf_id };
+	ASSERT(inited);
+	UNUSED(handle);
+
+	mutex_enter(&ctc_lock);
+	delete_ctc_locked(acf_id);
+	mutex_exit(&ctc_lock);
+}
 
+void
+vsi_update_contacts_batch(void *handle, const xtcas_contact_frame_t *frame)
+{
 	ASSERT(inited);
 	UNUSED(handle);
 
 	mutex_enter(&ctc_lock);
-	ctc = avl_find(&ctcs, &srch, NULL);
-	if (ctc != NULL) {
-		avl_remove(&ctcs, ctc);
-		free(ctc);
+	for (size_t i = 0; i < frame->num_deleted; i++)
+		delete_ctc_locked(frame->deleted[i]);
+	for (size_t i = 0; i < frame->num_contacts; i++) {
+		const xtcas_contact_t *c = &frame->contacts[i];
+
+		update_ctc_locked(c->acf_id, c->rbrg, c->rdist, c->ralt,
+		    c->vs, c->level);
 	}
 	mutex_exit(&ctc_lock);
 }
@@ -43,6 +43,8 @@ void vsi_update_contact(void *handle, void *acf_id, double rbrg,
     double rdist, double ralt, double vs, double trk, double gs,
     tcas_threat_t level);
 void vsi_delete_contact(void *handle, void *acf_id);
+void vsi_update_contacts_batch(void *handle,
+    const xtcas_contact_frame_t *frame);
 void vsi_update_RA(void *handle, tcas_adv_t adv, tcas_msg_t msg,
     tcas_RA_type_t type, tcas_RA_sense_t sense, bool_t crossing,
     bool_t reversal, double min_sep_cpa, double min_green, double max_green,
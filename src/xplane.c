@@ -31,7 +31,6 @@
 #include <XPLMUtilities.h>
 
 #include <acfutils/assert.h>
-#include <acfutils/avl.h>
 #include <acfutils/dr.h>
 #include <acfutils/except.h>
 #include <acfutils/geom.h>
@@ -46,6 +45,7 @@
 #include "../xtcas/generic_intf.h"
 #include "dbg_log.h"
 #include "ff_a320_intf.h"
+#include "rec.h"
 #ifndef	XTCAS_NO_AUDIO
 #include "snd_sys.h"
 #endif
@@ -60,6 +60,7 @@
 #define	FLOOP_INTVAL			0.1
 #define	POS_UPDATE_INTVAL		0.1
 #define	STARTUP_DELAY			5.0	/* seconds */
+#define	TIMING_UPD_INTVAL		1.0	/* seconds */
 #define	XTCAS_PLUGIN_NAME		"X-TCAS (%x)"
 #define	XTCAS_PLUGIN_DESCRIPTION \
 	"Generic TCAS II v7.1 implementation for X-Plane"
@@ -68,6 +69,9 @@
 #define	MAX_TCAS_TARGETS	64
 #define	MAX_DR_NAME_LEN		256
 #define	CTC_INACT_DELAY		10	/* seconds */
+#define	LTW_CALIB_DIST		10000.0	/* meters */
+#define	LTW_CHECK_RUNS		100	/* collector runs between checks */
+#define	LTW_MAX_ERR		5.0	/* meters */
 
 #define	BUSNR_DFL	0
 #define	BUSNR_MAX	6
@@ -84,6 +88,8 @@ static struct {
 	dr_t	hdg;
 	dr_t	lat;
 	dr_t	lon;
+	dr_t	lat_ref;		/* local origin */
+	dr_t	lon_ref;
 	dr_t	view_is_ext;
 	dr_t	warn_volume;
 	dr_t	sound_on;
@@ -111,6 +117,23 @@ static struct {
 	dr_t	filter_act;
 	dr_t	fail_dr_name_dr;
 
+	/* worker pipeline timing, indexed by xtcas_stage_t */
+	dr_t	timing_min;		/* us[XTCAS_NUM_STAGES] */
+	dr_t	timing_avg;		/* us[XTCAS_NUM_STAGES] */
+	dr_t	timing_p99;		/* us[XTCAS_NUM_STAGES] */
+	dr_t	timing_max;		/* us[XTCAS_NUM_STAGES] */
+	dr_t	timing_cycles;		/* int */
+	dr_t	timing_collect;		/* us[4]: min, avg, p99, max */
+	dr_t	timing_pos_collector;	/* us[4]: min, avg, p99, max */
+	dr_t	timing_mp_convert;	/* us[4]: min, avg, p99, max */
+	dr_t	timing_mp_convert_err;	/* m */
+	dr_t	timing_contacts;	/* int */
+	dr_t	timing_RA_cands;	/* int */
+	dr_t	timing_sep_lookups;	/* int */
+	dr_t	timing_sep_hits;	/* int */
+	dr_t	timing_ctc_reported;	/* int */
+	dr_t	timing_ctc_suppressed;	/* int */
+
 	/* provided by 3rd party */
 	dr_t	custom_bus_dr;
 } drs;
@@ -121,8 +144,42 @@ static struct {
 	dr_t	z;
 } mp_planes[MAX_MP_PLANES];
 
+/*
+ * Contacts, indexed by their TCAS target or multiplayer plane number
+ * minus one (which is also their acf_id). Being a flat table, the
+ * collector can update all contacts under a single acquisition of
+ * acf_pos_lock, without any lookups or allocations.
+ */
+typedef struct {
+	bool_t		used;
+	geo_pos3_t	pos;
+	bool_t		on_ground;
+	double		last_seen;
+	bool_t		stale;
+} acf_slot_t;
+
+#define	NUM_ACF_SLOTS	(MAX_TCAS_TARGETS - 1)	/* target 0 is us */
+
 static mutex_t acf_pos_lock;
-static avl_tree_t acf_pos_tree;
+static acf_slot_t acf_slots[NUM_ACF_SLOTS];
+
+/*
+ * Cached transform from X-Plane's local coordinates to ECEF, used to
+ * convert the multiplayer plane positions (see mp_local_to_world). It is
+ * rebuilt whenever X-Plane moves the local origin. Only used on the sim
+ * thread.
+ */
+static struct {
+	bool_t		valid;
+	bool_t		failed;		/* check failed, use the SDK */
+	double		lat_ref;	/* local origin it was built for */
+	double		lon_ref;
+	vect3_t		origin;		/* ECEF of local 0,0,0 */
+	vect3_t		axis[3];	/* ECEF of local unit X, Y and Z */
+	unsigned	check_ctr;
+	int		check_slot;	/* next plane to check */
+	double		max_err;	/* largest error found, meters */
+} ltw;
 static geo_pos3_t my_acf_pos;
 static double my_acf_agl = 0;
 static double my_acf_hdg = 0;
@@ -143,13 +200,32 @@ static int filter_req = -1;
 static int filter_act = -1;
 static char fail_dr_name[128] = { 0 };
 
+static struct {
+	float	min[XTCAS_NUM_STAGES];
+	float	avg[XTCAS_NUM_STAGES];
+	float	p99[XTCAS_NUM_STAGES];
+	float	max[XTCAS_NUM_STAGES];
+	int	cycles;
+	float	collect[4];
+	float	pos_collector[4];
+	float	mp_convert[4];
+	float	mp_convert_err;
+	int	contacts;
+	int	RA_cands;
+	int	sep_lookups;
+	int	sep_hits;
+	int	ctc_reported;
+	int	ctc_suppressed;
+} timing;
+
 const conf_t *xtcas_conf = NULL;
 conf_t *conf = NULL;
 
 static double xp_get_time(void *handle);
 static void xp_get_my_acf_pos(void *handle, geo_pos3_t *pos, double *alt_agl,
     double *hdg, bool_t *gear_ext, bool_t *on_ground);
-static void xp_get_oth_acf_pos(void *handle, acf_pos_t **pos_p, size_t *num);
+static size_t xp_fill_oth_acf_pos(void *handle, acf_pos_t *pos_out,
+    size_t cap);
 
 static int tcas_config_handler(XPLMCommandRef, XPLMCommandPhase, void *);
 
@@ -169,7 +245,7 @@ static const sim_intf_input_ops_t xp_intf_in_ops = {
 	.handle = NULL,
 	.get_time = xp_get_time,
 	.get_my_acf_pos = xp_get_my_acf_pos,
-	.get_oth_acf_pos = xp_get_oth_acf_pos,
+	.fill_oth_acf_pos = xp_fill_oth_acf_pos,
 };
 
 #if	VSI_DRAW_MODE
@@ -177,6 +253,7 @@ static const sim_intf_output_ops_t vsi_out_ops = {
 	.handle = NULL,
 	.update_contact = vsi_update_contact,
 	.delete_contact = vsi_delete_contact,
+	.update_contacts_batch = vsi_update_contacts_batch,
 	.update_RA = vsi_update_RA,
 	.update_RA_prediction = NULL
 };
@@ -185,24 +262,68 @@ static const sim_intf_output_ops_t xplane_test_out_ops = {
 	.handle = NULL,
 	.update_contact = xplane_test_update_contact,
 	.delete_contact = xplane_test_delete_contact,
+	.update_contacts_batch = xplane_test_update_contacts_batch,
 	.update_RA = xplane_test_update_RA,
 	.update_RA_prediction = NULL
 };
 #endif	/* !VSI_DRAW_MODE */
 
 static bool_t ff_a320_intf_inited = B_FALSE;
+static xtcas_rec_t *rec = NULL;		/* input recorder, if enabled */
 
-static int
-acf_pos_compar(const void *a, const void *b)
-{
-	const acf_pos_t *pa = a, *pb = b;
+/* duration of the acf_pos_collector runs, only used on the sim thread */
+static xtcas_stage_timing_t pos_collector_timing;
+static uint64_t num_pos_collector_runs = 0;
+static xtcas_stage_timing_t mp_convert_timing;
+static uint64_t num_mp_converts = 0;
+static double timing_upd_time = NAN;
 
-	if (pa->acf_id < pb->acf_id)
-		return (-1);
-	else if (pa->acf_id == pb->acf_id)
-		return (0);
-	else
-		return (1);
+/*
+ * Refreshes the timing datarefs. xtcas_get_timing copies all of the
+ * statistics under the core's lock, so rather than doing that on every
+ * flight loop frame, we only do it once every TIMING_UPD_INTVAL seconds,
+ * which is as often as the worker's slowest cadence produces new ones.
+ */
+static void
+timing_update(void)
+{
+	xtcas_timing_t tm;
+
+	if (!isnan(timing_upd_time) &&
+	    fabs(cur_sim_time - timing_upd_time) < TIMING_UPD_INTVAL)
+		return;
+	timing_upd_time = cur_sim_time;
+
+	xtcas_get_timing(&tm);
+	for (int i = 0; i < XTCAS_NUM_STAGES; i++) {
+		timing.min[i] = tm.stages[i].min_ns / 1000.0;
+		timing.avg[i] = tm.stages[i].avg_ns / 1000.0;
+		timing.p99[i] = tm.stages[i].p99_ns / 1000.0;
+		timing.max[i] = tm.stages[i].max_ns / 1000.0;
+	}
+	timing.cycles = MIN(tm.num_cycles, INT32_MAX);
+	timing.collect[0] = tm.collect.min_ns / 1000.0;
+	timing.collect[1] = tm.collect.avg_ns / 1000.0;
+	timing.collect[2] = tm.collect.p99_ns / 1000.0;
+	timing.collect[3] = tm.collect.max_ns / 1000.0;
+	xtcas_stage_timing_fill(&pos_collector_timing,
+	    num_pos_collector_runs);
+	timing.pos_collector[0] = pos_collector_timing.min_ns / 1000.0;
+	timing.pos_collector[1] = pos_collector_timing.avg_ns / 1000.0;
+	timing.pos_collector[2] = pos_collector_timing.p99_ns / 1000.0;
+	timing.pos_collector[3] = pos_collector_timing.max_ns / 1000.0;
+	xtcas_stage_timing_fill(&mp_convert_timing, num_mp_converts);
+	timing.mp_convert[0] = mp_convert_timing.min_ns / 1000.0;
+	timing.mp_convert[1] = mp_convert_timing.avg_ns / 1000.0;
+	timing.mp_convert[2] = mp_convert_timing.p99_ns / 1000.0;
+	timing.mp_convert[3] = mp_convert_timing.max_ns / 1000.0;
+	timing.mp_convert_err = ltw.max_err;
+	timing.contacts = tm.num_contacts;
+	timing.RA_cands = tm.num_RA_cands;
+	timing.sep_lookups = tm.num_sep_lookups;
+	timing.sep_hits = tm.num_sep_hits;
+	timing.ctc_reported = tm.num_ctc_reported;
+	timing.ctc_suppressed = tm.num_ctc_suppressed;
 }
 
 static void
@@ -214,6 +335,8 @@ sim_intf_init(void)
 	    "sim/cockpit2/gauges/indicators/radio_altimeter_height_ft_pilot");
 	fdr_find(&drs.lat, "sim/flightmodel/position/latitude");
 	fdr_find(&drs.lon, "sim/flightmodel/position/longitude");
+	fdr_find(&drs.lat_ref, "sim/flightmodel/position/lat_ref");
+	fdr_find(&drs.lon_ref, "sim/flightmodel/position/lon_ref");
 	fdr_find(&drs.hdg, "sim/flightmodel/position/true_psi");
 
 	fdr_find(&drs.view_is_ext, "sim/graphics/view/view_is_external");
@@ -244,8 +367,12 @@ sim_intf_init(void)
 	    dr_find(&drs.tcas_target_number,
 	    "sim/cockpit2/tcas/indicators/tcas_num_acf"));
 
-	avl_create(&acf_pos_tree, acf_pos_compar, sizeof (acf_pos_t),
-	    offsetof(acf_pos_t, tree_node));
+	memset(acf_slots, 0, sizeof (acf_slots));
+	memset(&pos_collector_timing, 0, sizeof (pos_collector_timing));
+	num_pos_collector_runs = 0;
+	memset(&mp_convert_timing, 0, sizeof (mp_convert_timing));
+	num_mp_converts = 0;
+	memset(&ltw, 0, sizeof (ltw));
 	mutex_init(&acf_pos_lock);
 	custom_bus = B_FALSE;
 	intf_inited = B_TRUE;
@@ -254,27 +381,146 @@ sim_intf_init(void)
 static void
 sim_intf_fini(void)
 {
-	void *cookie = NULL;
-	acf_pos_t *p;
-
 	memset(&drs, 0, sizeof (drs));
 	memset(&mp_planes, 0, sizeof (mp_planes));
 
-	while ((p = avl_destroy_nodes(&acf_pos_tree, &cookie)) != NULL)
-		free(p);
-	avl_destroy(&acf_pos_tree);
 	mutex_destroy(&acf_pos_lock);
 
 	intf_inited = B_FALSE;
 }
 
+/*
+ * Recomputes the cached local-to-ECEF transform (see ltw) for the local
+ * origin at `lat_ref', `lon_ref'. X-Plane's local coordinates are a
+ * Cartesian frame, so the transform is affine: we convert the local
+ * origin and a point along each of the local axes to ECEF once and from
+ * then on, a local position is converted to ECEF with a few
+ * multiply-adds, followed by a closed-form ECEF-to-geodetic conversion.
+ */
+static void
+ltw_calib(double lat_ref, double lon_ref)
+{
+	geo_pos3_t world;
+
+	XPLMLocalToWorld(0, 0, 0, &world.lat, &world.lon, &world.elev);
+	ltw.origin = geo2ecef_mtr(world, &wgs84);
+	for (int i = 0; i < 3; i++) {
+		vect3_t local = VECT3(i == 0 ? LTW_CALIB_DIST : 0,
+		    i == 1 ? LTW_CALIB_DIST : 0, i == 2 ? LTW_CALIB_DIST : 0);
+
+		XPLMLocalToWorld(local.x, local.y, local.z, &world.lat,
+		    &world.lon, &world.elev);
+		ltw.axis[i] = vect3_scmul(vect3_sub(geo2ecef_mtr(world,
+		    &wgs84), ltw.origin), 1 / LTW_CALIB_DIST);
+	}
+	ltw.lat_ref = lat_ref;
+	ltw.lon_ref = lon_ref;
+	ltw.valid = B_TRUE;
+	ltw.failed = B_FALSE;
+	/* check the new transform on the next run */
+	ltw.check_ctr = LTW_CHECK_RUNS;
+	dbg_log(xplane, 1, "Local origin moved to %f %f", lat_ref, lon_ref);
+}
+
+static inline geo_pos3_t
+ltw_convert(vect3_t local)
+{
+	vect3_t ecef = ltw.origin;
+
+	ecef = vect3_add(ecef, vect3_scmul(ltw.axis[0], local.x));
+	ecef = vect3_add(ecef, vect3_scmul(ltw.axis[1], local.y));
+	ecef = vect3_add(ecef, vect3_scmul(ltw.axis[2], local.z));
+
+	return (ecef2geo(ecef, &wgs84));
+}
+
+/*
+ * Verifies a converted position against XPLMLocalToWorld. If they
+ * disagree by more than LTW_MAX_ERR, we go back to XPLMLocalToWorld
+ * until X-Plane next moves the local origin.
+ */
+static void
+ltw_check(vect3_t local, geo_pos3_t world)
+{
+	geo_pos3_t sdk;
+	double err;
+
+	XPLMLocalToWorld(local.x, local.y, local.z, &sdk.lat, &sdk.lon,
+	    &sdk.elev);
+	err = vect3_abs(vect3_sub(geo2ecef_mtr(sdk, &wgs84),
+	    geo2ecef_mtr(world, &wgs84)));
+	ltw.max_err = MAX(ltw.max_err, err);
+	if (err > LTW_MAX_ERR) {
+		logMsg("Cached local-to-world conversion is off by %.1f m at "
+		    "%.0f/%.0f/%.0f, falling back to XPLMLocalToWorld",
+		    err, local.x, local.y, local.z);
+		ltw.failed = B_TRUE;
+	}
+}
+
+/*
+ * Converts the local positions of the multiplayer planes to world
+ * positions in one batch, using the cached transform. Planes at local
+ * 0,0,0 are unused and get NULL_GEO_POS3.
+ */
+static void
+mp_local_to_world(const vect3_t *local, geo_pos3_t *world, int n)
+{
+	double lat_ref = dr_getf(&drs.lat_ref);
+	double lon_ref = dr_getf(&drs.lon_ref);
+	uint64_t start = xtcas_nanoclock();
+
+	if (!ltw.valid || lat_ref != ltw.lat_ref || lon_ref != ltw.lon_ref)
+		ltw_calib(lat_ref, lon_ref);
+
+	for (int i = 0; i < n; i++) {
+		if (IS_ZERO_VECT3(local[i])) {
+			world[i] = NULL_GEO_POS3;
+		} else if (ltw.failed) {
+			XPLMLocalToWorld(local[i].x, local[i].y, local[i].z,
+			    &world[i].lat, &world[i].lon, &world[i].elev);
+		} else {
+			world[i] = ltw_convert(local[i]);
+		}
+	}
+
+	xtcas_stage_timing_add(&mp_convert_timing, num_mp_converts,
+	    xtcas_nanoclock() - start);
+	num_mp_converts++;
+
+	/* every LTW_CHECK_RUNS runs, check the next plane in use */
+	if (ltw.failed || ++ltw.check_ctr < LTW_CHECK_RUNS)
+		return;
+	for (int i = 0; i < n; i++) {
+		int j = (ltw.check_slot + i) % n;
+
+		if (!IS_ZERO_VECT3(local[j])) {
+			ltw_check(local[j], world[j]);
+			ltw.check_slot = j + 1;
+			ltw.check_ctr = 0;
+			break;
+		}
+	}
+}
+
+/*
+ * Reads the positions of our own and all other aircraft from X-Plane.
+ * The TCAS target arrays are read with a single dr_getvf/dr_getvi call
+ * each and all slots are then updated under one acquisition of
+ * acf_pos_lock. This runs in the sim's flight loop, so the time it takes
+ * is published in xtcas/timing/pos_collector_us.
+ */
 static float
 acf_pos_collector(float elapsed1, float elapsed2, int counter, void *refcon)
 {
 	double gear_deploy[2];
 	int on_ground[3];
-	int num_planes;
+	int num_planes = 0;
 	bool_t use_tcas_targets;
+	geo_pos3_t world[NUM_ACF_SLOTS];
+	bool_t wow[NUM_ACF_SLOTS];
+	unsigned num_used = 0;
+	uint64_t start = xtcas_nanoclock();
 
 	UNUSED(elapsed1);
 	UNUSED(elapsed2);
@@ -298,90 +544,79 @@ acf_pos_collector(float elapsed1, float elapsed2, int counter, void *refcon)
 	use_tcas_targets = (drs.have_tcas_targets &&
 	    dr_geti(&drs.tcas_target_number) > 1);
 	if (use_tcas_targets) {
-		num_planes = MAX_TCAS_TARGETS - 1;
+		double lat[NUM_ACF_SLOTS], lon[NUM_ACF_SLOTS];
+		double elev[NUM_ACF_SLOTS];
+		int gnd[NUM_ACF_SLOTS];
+
+		/* target 0 is our own aircraft */
+		num_planes = dr_getvf(&drs.tcas_target_lat, lat, 1,
+		    NUM_ACF_SLOTS);
+		num_planes = MIN(num_planes, dr_getvf(&drs.tcas_target_lon,
+		    lon, 1, NUM_ACF_SLOTS));
+		num_planes = MIN(num_planes, dr_getvf(&drs.tcas_target_elev,
+		    elev, 1, NUM_ACF_SLOTS));
+		num_planes = MIN(num_planes, dr_getvi(&drs.tcas_target_on_gnd,
+		    gnd, 1, NUM_ACF_SLOTS));
+		for (int i = 0; i < num_planes; i++) {
+			if (lat[i] == 0 && lon[i] == 0)
+				world[i] = NULL_GEO_POS3;
+			else
+				world[i] = GEO_POS3(lat[i], lon[i], elev[i]);
+			wow[i] = (gnd[i] != 0);
+		}
 	} else {
+		vect3_t local[MAX_MP_PLANES];
+
 		num_planes = MAX_MP_PLANES;
-	}
-	if (!use_tcas_targets) {
-		/* Expunge any targets with an ID > MAX_MP_PLANES */
-		for (int i = MAX_MP_PLANES; i < MAX_TCAS_TARGETS; i++) {
-			acf_pos_t srch = {
-			    .acf_id = (void *)(uintptr_t)(i + 1)
-			};
-			acf_pos_t *pos = avl_find(&acf_pos_tree, &srch, NULL);
-			if (pos != NULL) {
-				avl_remove(&acf_pos_tree, pos);
-				free(pos);
-			}
-		}
-	}
-	for (int i = 0; i < num_planes; i++) {
-		geo_pos3_t world = NULL_GEO_POS3;
-		avl_index_t where;
-		acf_pos_t srch;
-		acf_pos_t *pos;
-		bool_t on_ground = B_FALSE;
-
-		if (use_tcas_targets) {
-			dr_getvf(&drs.tcas_target_lat, &world.lat, i + 1, 1);
-			dr_getvf(&drs.tcas_target_lon, &world.lon, i + 1, 1);
-			dr_getvf(&drs.tcas_target_elev, &world.elev, i + 1, 1);
-			if (world.lat == 0 && world.lon == 0)
-				world = NULL_GEO_POS3;
-		} else {
-			vect3_t local = VECT3(dr_getf(&mp_planes[i].x),
+		for (int i = 0; i < num_planes; i++) {
+			local[i] = VECT3(dr_getf(&mp_planes[i].x),
 			    dr_getf(&mp_planes[i].y),
 			    dr_getf(&mp_planes[i].z));
-			if (!IS_ZERO_VECT3(local)) {
-				XPLMLocalToWorld(local.x, local.y, local.z,
-				    &world.lat, &world.lon, &world.elev);
-			}
+			wow[i] = B_FALSE;
 		}
+		mp_local_to_world(local, world, num_planes);
+	}
 
-		mutex_enter(&acf_pos_lock);
-
-		srch.acf_id = (void *)(uintptr_t)(i + 1);
-		pos = avl_find(&acf_pos_tree, &srch, &where);
+	mutex_enter(&acf_pos_lock);
+	for (int i = 0; i < NUM_ACF_SLOTS; i++) {
+		acf_slot_t *slot = &acf_slots[i];
 
-		if (IS_NULL_GEO_POS3(world)) {
-			if (pos != NULL) {
-				avl_remove(&acf_pos_tree, pos);
-				free(pos);
-			}
-		} else {
-			if (pos == NULL) {
-				pos = safe_calloc(1, sizeof (*pos));
-				pos->acf_id = (void *)(uintptr_t)(i + 1);
-				ASSERT(pos->acf_id != NULL);
-				pos->pos = NULL_GEO_POS3;
-				pos->stale = true;
-				avl_insert(&acf_pos_tree, pos, where);
-			}
-			/*
-			 * Since when the slot becomes disused, it simply stops
-			 * being updated. To detect that, we compare the new
-			 * position to the previous position. If the contact
-			 * hasn't moved in a while, we mark it as stale and
-			 * stop forwarding it to the TCAS core. We can't simply
-			 * remove it from the list, as that would result in us
-			 * falsely re-adding it in the very new loop.
-			 */
-			if (!GEO3_EQ(pos->pos, world)) {
-				pos->pos = world;
-				pos->on_ground = on_ground;
-				pos->last_seen = cur_sim_time;
-				pos->stale = B_FALSE;
-			} else if (cur_sim_time - pos->last_seen >
-			    CTC_INACT_DELAY) {
-				pos->stale = B_TRUE;
-			}
+		/* also expunges any slots beyond MAX_MP_PLANES */
+		if (i >= num_planes || IS_NULL_GEO_POS3(world[i])) {
+			slot->used = B_FALSE;
+			continue;
 		}
-
-		mutex_exit(&acf_pos_lock);
+		if (!slot->used) {
+			slot->used = B_TRUE;
+			slot->pos = NULL_GEO_POS3;
+			slot->stale = B_TRUE;
+		}
+		/*
+		 * Since when the slot becomes disused, it simply stops
+		 * being updated. To detect that, we compare the new
+		 * position to the previous position. If the contact
+		 * hasn't moved in a while, we mark it as stale and
+		 * stop forwarding it to the TCAS core. We can't simply
+		 * free the slot, as that would result in us falsely
+		 * re-adding it in the very new loop.
+		 */
+		if (!GEO3_EQ(slot->pos, world[i])) {
+			slot->pos = world[i];
+			slot->last_seen = cur_sim_time;
+			slot->stale = B_FALSE;
+		} else if (cur_sim_time - slot->last_seen > CTC_INACT_DELAY) {
+			slot->stale = B_TRUE;
+		}
+		slot->on_ground = wow[i];
+		num_used++;
 	}
+	mutex_exit(&acf_pos_lock);
 
-	dbg_log(xplane, 1, "Collector run complete, %lu contacts",
-	    avl_numnodes(&acf_pos_tree));
+	xtcas_stage_timing_add(&pos_collector_timing, num_pos_collector_runs,
+	    xtcas_nanoclock() - start);
+	num_pos_collector_runs++;
+
+	dbg_log(xplane, 1, "Collector run complete, %u contacts", num_used);
 
 	return (POS_UPDATE_INTVAL);
 }
@@ -414,33 +649,34 @@ xp_get_my_acf_pos(void *handle, geo_pos3_t *pos, double *alt_agl, double *hdg,
 }
 
 /*
- * Called from X-TCAS to gather intruder aircraft position.
+ * Called from X-TCAS to gather intruder aircraft position. We fill the
+ * array X-TCAS lends us in a single pass over our slots, copying only the
+ * fields that X-TCAS reads, and keep counting past `cap', so that X-TCAS
+ * knows how far to grow the array if it is too small.
  */
-static void
-xp_get_oth_acf_pos(void *handle, acf_pos_t **pos_p, size_t *num)
+static size_t
+xp_fill_oth_acf_pos(void *handle, acf_pos_t *pos_out, size_t cap)
 {
-	size_t i;
-	acf_pos_t *pos;
+	size_t num = 0;
 
 	UNUSED(handle);
 
 	mutex_enter(&acf_pos_lock);
-	*num = 0;
-	for (pos = avl_first(&acf_pos_tree), i = 0; pos != NULL;
-	    pos = AVL_NEXT(&acf_pos_tree, pos), i++) {
-		if (!pos->stale)
-			(*num)++;
-	}
-	*pos_p = safe_calloc(*num, sizeof (*pos));
-	for (pos = avl_first(&acf_pos_tree), i = 0; pos != NULL;
-	    pos = AVL_NEXT(&acf_pos_tree, pos)) {
-		if (!pos->stale) {
-			ASSERT3U(i, <, *num);
-			memcpy(&(*pos_p)[i], pos, sizeof (*pos));
-			i++;
+	for (int i = 0; i < NUM_ACF_SLOTS; i++) {
+		const acf_slot_t *slot = &acf_slots[i];
+
+		if (!slot->used || slot->stale)
+			continue;
+		if (num < cap) {
+			pos_out[num].acf_id = (void *)(uintptr_t)(i + 1);
+			pos_out[num].pos = slot->pos;
+			pos_out[num].on_ground = slot->on_ground;
 		}
+		num++;
 	}
 	mutex_exit(&acf_pos_lock);
+
+	return (num);
 }
 
 /*
@@ -470,6 +706,7 @@ floop_cb(float elapsed_since_last_call, float elapsed_since_last_floop,
 
 	if (!xtcas_inited) {
 		const sim_intf_output_ops_t *out_ops = ff_a320_intf_init();
+		const char *rec_path;
 
 		if (out_ops != NULL) {
 			/* FF A320 integration mode */
@@ -510,7 +747,10 @@ floop_cb(float elapsed_since_last_call, float elapsed_since_last_floop,
 		XPLMRegisterCommandHandler(tcas_test_cmd,
 		    tcas_config_handler, 1, NULL);
 
-		xtcas_init(&xp_intf_in_ops, out_ops);
+		if (conf_get_str(xtcas_conf, "record_file", &rec_path))
+			rec = xtcas_rec_open(rec_path, &xp_intf_in_ops);
+		xtcas_init(rec != NULL ? xtcas_rec_get_ops(rec) :
+		    &xp_intf_in_ops, out_ops);
 		xtcas_inited = B_TRUE;
 	} else if (xtcas_is_powered() && !xtcas_is_failed() &&
 	    mode_req >= TCAS_MODE_STBY && mode_req <= TCAS_MODE_TARA &&
@@ -529,7 +769,12 @@ floop_cb(float elapsed_since_last_call, float elapsed_since_last_floop,
 #endif	/* !VSI_DRAW_MODE */
 		xtcas_set_filter(filter_req);
 		filter_act = filter_req;
+		if (rec != NULL) {
+			xtcas_rec_set_mode(rec, mode_act);
+			xtcas_rec_set_filter(rec, filter_act);
+		}
 		xtcas_run();
+		timing_update();
 #ifndef	XTCAS_NO_AUDIO
 		xtcas_snd_sys_run(volume);
 #endif
@@ -538,6 +783,8 @@ floop_cb(float elapsed_since_last_call, float elapsed_since_last_floop,
 	} else {
 		xtcas_set_mode(TCAS_MODE_STBY);
 		mode_act = TCAS_MODE_STBY;
+		if (rec != NULL)
+			xtcas_rec_set_mode(rec, mode_act);
 #ifndef	XTCAS_NO_AUDIO
 		xtcas_snd_sys_run(volume);
 #endif
@@ -829,6 +1076,36 @@ XPluginEnable(void)
 	dr_create_i(&drs.filter_act, &filter_act, B_FALSE, "xtcas/filter_act");
 	dr_create_b(&drs.fail_dr_name_dr, fail_dr_name, sizeof (fail_dr_name),
 	    B_TRUE, "xtcas/fail_dr");
+	dr_create_vf(&drs.timing_min, timing.min, XTCAS_NUM_STAGES, B_FALSE,
+	    "xtcas/timing/min_us");
+	dr_create_vf(&drs.timing_avg, timing.avg, XTCAS_NUM_STAGES, B_FALSE,
+	    "xtcas/timing/avg_us");
+	dr_create_vf(&drs.timing_p99, timing.p99, XTCAS_NUM_STAGES, B_FALSE,
+	    "xtcas/timing/p99_us");
+	dr_create_vf(&drs.timing_max, timing.max, XTCAS_NUM_STAGES, B_FALSE,
+	    "xtcas/timing/max_us");
+	dr_create_i(&drs.timing_cycles, &timing.cycles, B_FALSE,
+	    "xtcas/timing/cycles");
+	dr_create_vf(&drs.timing_collect, timing.collect, 4, B_FALSE,
+	    "xtcas/timing/collect_us");
+	dr_create_vf(&drs.timing_pos_collector, timing.pos_collector, 4,
+	    B_FALSE, "xtcas/timing/pos_collector_us");
+	dr_create_vf(&drs.timing_mp_convert, timing.mp_convert, 4, B_FALSE,
+	    "xtcas/timing/mp_convert_us");
+	dr_create_f(&drs.timing_mp_convert_err, &timing.mp_convert_err,
+	    B_FALSE, "xtcas/timing/mp_convert_err_m");
+	dr_create_i(&drs.timing_contacts, &timing.contacts, B_FALSE,
+	    "xtcas/timing/contacts");
+	dr_create_i(&drs.timing_RA_cands, &timing.RA_cands, B_FALSE,
+	    "xtcas/timing/RA_cands");
+	dr_create_i(&drs.timing_sep_lookups, &timing.sep_lookups, B_FALSE,
+	    "xtcas/timing/sep_lookups");
+	dr_create_i(&drs.timing_sep_hits, &timing.sep_hits, B_FALSE,
+	    "xtcas/timing/sep_hits");
+	dr_create_i(&drs.timing_ctc_reported, &timing.ctc_reported, B_FALSE,
+	    "xtcas/timing/ctc_reported");
+	dr_create_i(&drs.timing_ctc_suppressed, &timing.ctc_suppressed,
+	    B_FALSE, "xtcas/timing/ctc_suppressed");
 
 	if (conf_get_str(xtcas_conf, "busnr", &s) && strlen(s) > 3 &&
 	    !isdigit(s[0])) {
@@ -876,9 +1153,28 @@ XPluginDisable(void)
 	dr_delete(&drs.filter_req);
 	dr_delete(&drs.filter_act);
 	dr_delete(&drs.fail_dr_name_dr);
+	dr_delete(&drs.timing_min);
+	dr_delete(&drs.timing_avg);
+	dr_delete(&drs.timing_p99);
+	dr_delete(&drs.timing_max);
+	dr_delete(&drs.timing_cycles);
+	dr_delete(&drs.timing_collect);
+	dr_delete(&drs.timing_pos_collector);
+	dr_delete(&drs.timing_mp_convert);
+	dr_delete(&drs.timing_mp_convert_err);
+	dr_delete(&drs.timing_contacts);
+	dr_delete(&drs.timing_RA_cands);
+	dr_delete(&drs.timing_sep_lookups);
+	dr_delete(&drs.timing_sep_hits);
+	dr_delete(&drs.timing_ctc_reported);
+	dr_delete(&drs.timing_ctc_suppressed);
 
 	if (xtcas_inited) {
 		xtcas_fini();
+		if (rec != NULL) {
+			xtcas_rec_close(rec);
+			rec = NULL;
+		}
 
 		if (ff_a320_intf_inited) {
 			/* FF A320 integration mode */
@@ -949,6 +1245,51 @@ generic_set_filter(tcas_filter_t filter)
 	filter_req = filter;
 }
 
+/*
+ * The aircraft's own sensor readings, set through the generic interface.
+ * These go straight to the TCAS core, so they're recorded right away,
+ * ahead of the next position collection they affect.
+ */
+void
+generic_set_has_RA(bool_t flag)
+{
+	xtcas_set_has_RA(flag);
+	if (rec != NULL)
+		xtcas_rec_set_has_RA(rec, flag);
+}
+
+void
+generic_set_has_WOW(bool_t flag)
+{
+	xtcas_set_has_WOW(flag);
+	if (rec != NULL)
+		xtcas_rec_set_has_WOW(rec, flag);
+}
+
+void
+generic_set_RA(double agl_hgt_m)
+{
+	xtcas_set_RA(agl_hgt_m);
+	if (rec != NULL)
+		xtcas_rec_set_RA(rec, agl_hgt_m);
+}
+
+void
+generic_set_WOW(bool_t on_ground)
+{
+	xtcas_set_WOW(on_ground);
+	if (rec != NULL)
+		xtcas_rec_set_WOW(rec, on_ground);
+}
+
+void
+generic_set_gear_ext(bool_t gear_ext)
+{
+	xtcas_set_gear_ext(gear_ext);
+	if (rec != NULL)
+		xtcas_rec_set_gear_ext(rec, gear_ext);
+}
+
 #if	IBM
 BOOL WINAPI
 DllMain(HINSTANCE hinst, DWORD reason, LPVOID resvd)
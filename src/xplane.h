@@ -53,6 +53,11 @@ double xtcas_min_volts(void);
 
 void generic_set_mode(tcas_mode_t mode);
 void generic_set_filter(tcas_filter_t filter);
+void generic_set_has_RA(bool_t flag);
+void generic_set_has_WOW(bool_t flag);
+void generic_set_RA(double agl_hgt_m);
+void generic_set_WOW(bool_t on_ground);
+void generic_set_gear_ext(bool_t gear_ext);
 
 #ifdef __cplusplus
 }
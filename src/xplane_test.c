@@ -231,24 +231,14 @@ xplane_test_fini(void)
 	inited = B_FALSE;
 }
 
-void
-xplane_test_update_contact(void *handle, void *acf_id, double rbrg,
-    double rdist, double ralt, double vs, double trk, double gs,
-    tcas_threat_t level)
+static void
+update_contact_locked(void *acf_id, double rbrg, double rdist, double ralt,
+    double vs, tcas_threat_t level)
 {
 	contact_t srch, *ctc;
 	avl_index_t where;
 
-	UNUSED(handle);
-	UNUSED(trk);
-	UNUSED(gs);
-
-	if (!inited)
-		return;
-
 	srch.acf_id = acf_id;
-
-	mutex_enter(&contacts_lock);
 	ctc = avl_find(&contacts, &srch, &where);
 	if (ctc == NULL) {
 		ctc = safe_calloc(1, sizeof (*ctc));
@@ -261,29 +251,70 @@ xplane_test_update_contact(void *handle, void *acf_id, double rbrg,
 	ctc->ralt = ralt;
 	ctc->vs = vs;
 	ctc->level = level;
+}
 
+static void
+delete_contact_locked(void *acf_id)
+{
+	contact_t srch, *ctc;
+
+	srch.acf_id = acf_id;
+	ctc = avl_find(&contacts, &srch, NULL);
+	if (ctc != NULL) {
+		avl_remove(&contacts, ctc);
+		free(ctc);
+	}
+}
+
+void
+xplane_test_update_contact(void *handle, void *acf_id, double rbrg,
+    double rdist, double ralt, double vs, double trk, double gs,
+    tcas_threat_t level)
+{
+	UNUSED(handle);
+	UNUSED(trk);
+	UNUSED(gs);
+
+	if (!inited)
+		return;
+
+	mutex_enter(&contacts_lock);
+	update_contact_locked(acf_id, rbrg, rdist, ralt, vs, level);
 	mutex_exit(&contacts_lock);
 }
 
 void
 xplane_test_delete_contact(void *handle, void *acf_id)
 {
-	contact_t srch, *ctc;
-
 	UNUSED(handle);
 
 	if (!inited)
 		return;
 
-	srch.acf_id = acf_id;
-
 	mutex_enter(&contacts_lock);
-	ctc = avl_find(&contacts, &srch, NULL);
-	if (ctc != NULL)
-		avl_remove(&contacts, ctc);
+	delete_contact_locked(acf_id);
 	mutex_exit(&contacts_lock);
+}
+
+void
+xplane_test_update_contacts_batch(void *handle,
+    const xtcas_contact_frame_t *frame)
+{
+	UNUSED(handle);
 
-	free(ctc);
+	if (!inited)
+		return;
+
+	mutex_enter(&contacts_lock);
+	for (size_t i = 0; i < frame->num_deleted; i++)
+		delete_contact_locked(frame->deleted[i]);
+	for (size_t i = 0; i < frame->num_contacts; i++) {
+		const xtcas_contact_t *c = &frame->contacts[i];
+
+		update_contact_locked(c->acf_id, c->rbrg, c->rdist, c->ralt,
+		    c->vs, c->level);
+	}
+	mutex_exit(&contacts_lock);
 }
 
 void
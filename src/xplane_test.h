@@ -32,6 +32,8 @@ void xplane_test_update_contact(void *handle, void *acf_id, double rbrg,
     double rdist, double ralt, double vs, double trk, double gs,
     tcas_threat_t level);
 void xplane_test_delete_contact(void *handle, void *acf_id);
+void xplane_test_update_contacts_batch(void *handle,
+    const xtcas_contact_frame_t *frame);
 void xplane_test_update_RA(void *handle, tcas_adv_t adv, tcas_msg_t msg,
     tcas_RA_type_t type, tcas_RA_sense_t sense, bool_t crossing,
     bool_t reversal, double min_sep_cpa, double min_green, double max_green,
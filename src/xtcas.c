@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stddef.h>
+#include <time.h>
 
 #include <acfutils/assert.h>
 #include <acfutils/avl.h>
@@ -32,8 +33,13 @@
 #include <acfutils/thread.h>
 #include <acfutils/time.h>
 
+#include "arena.h"
+#include "cpa.h"
 #include "dbg_log.h"
+#include "pool.h"
 #include "pos.h"
+#include "ra_eval.h"
+#include "ring.h"
 #ifndef	XTCAS_NO_AUDIO
 #include "snd_sys.h"
 #endif
@@ -45,10 +51,23 @@
 #define	D_VVEL_MAN_THRESH	FPM2MPS(200)	/* m/s^2 */
 #define	D_VVEL_MAN_TIME		FPM2MPS(6)	/* seconds */
 #define	NUM_RA_INFOS		26
+#define	NUM_RA_SENSES		(RA_SENSE_DOWNWARD + 1)
+#define	SEP_MEMO_SIZE		256	/* entries, must be a power of 2 */
+#define	SEP_MEMO_Z_TOL		FEET2MET(10)	/* meters */
+#define	SEP_MEMO_VS_TOL		FPM2MPS(10)	/* m/s */
 
 #define	WORKER_LOOP_INTVAL	1		/* seconds */
-#define	WORKER_LOOP_INTVAL_US	((uint64_t)SEC2USEC(WORKER_LOOP_INTVAL))
-#define	STATE_CHG_DELAY		SEC2USEC(4)	/* microseconds */
+#define	FAST_CYCLE_RATE_DFL	4		/* Hz */
+#define	FAST_CYCLE_RATE_MAX	10		/* Hz */
+#define	THREAT_THREADS_DFL	1		/* see BENCHMARKS.md */
+#define	THREAT_THREADS_MAX	16
+#define	THREAT_PAR_MIN_ACF	256	/* contacts to go parallel */
+#define	CYCLE_RATE_FILT		0.2		/* EWMA weight of new sample */
+#define	ARENA_CHUNK_SZ		16384		/* bytes */
+#define	PUSH_RING_SIZE		8192	/* reports, must be a power of 2 */
+#define	PUSH_CTC_TIMEOUT	5		/* seconds */
+#define	PUSH_DRAIN_INTVAL	50000		/* microseconds */
+#define	STATE_CHG_DELAY		4.0		/* seconds */
 #define	EARTH_G			9.81		/* m.s^-2 */
 #define	INITIAL_RA_D_VVEL	(EARTH_G / 4)	/* 1/4 g */
 #define	INITIAL_RA_DELAY	5.0		/* seconds */
@@ -59,10 +78,33 @@
 
 #define	FALSE_CTC_SUPPRESS_GS	2		/* m/s */
 
+/*
+ * A contact is only reported to the avionics again once it has moved or
+ * changed its trend by at least this much since it was last reported.
+ * These are well below what any traffic display can resolve.
+ */
+#define	CTC_REPORT_BRG		0.5		/* degrees */
+#define	CTC_REPORT_DIST		10		/* meters */
+#define	CTC_REPORT_ALT		FEET2MET(10)
+#define	CTC_REPORT_VS		FPM2MPS(50)
+#define	CTC_REPORT_TRK		1		/* degrees */
+#define	CTC_REPORT_GS		KT2MPS(1)
+
 #define	LONG_VERT_FILTER	FEET2MET(9900)	/* Used for the ABV and BLW */
 #define	NORM_VERT_FILTER	FEET2MET(2700)	/* vertical filter modes */
 
 #define	OTH_TFC_DIST_THRESH		NM2MET(40)
+#define	FPP_RECENTER_DIST		NM2MET(1)
+/*
+ * Coarse geographic grid used to pre-filter other traffic. Cells are
+ * GRID_CELL_DEG in size in both latitude and longitude. GRID_REACH_DEG is
+ * OTH_TFC_DIST_THRESH expressed in degrees of latitude (1 NM ~ 1 arc
+ * minute) with a 10% margin to keep the pre-filter conservative.
+ */
+#define	GRID_CELL_DEG			0.25
+#define	GRID_LON_CELLS			((int)(360 / GRID_CELL_DEG))
+#define	GRID_REACH_DEG			(MET2NM(OTH_TFC_DIST_THRESH) / 60 * 1.1)
+#define	GRID_MAX_LAT			89	/* no lon limit beyond this */
 #define	PROX_DIST_THRESH		NM2MET(6)
 #define	PROX_ALT_THRESH			FEET2MET(1200)
 #define	ON_GROUND_AGL_THRESH		FEET2MET(380)
@@ -103,8 +145,9 @@
 	(acf)->on_ground
 
 #define	PRINTF_RI_FMT "%s/%s/%s/%s|%.1f=%.1f->%.1f=%.1f"
-#define	PRINTF_RI_ARGS(ri) RA_msg2str((ri)->msg), RA_type2str((ri)->type), \
-	RA_sense2str((ri)->sense), RA_cross2str((ri)->cross), \
+#define	PRINTF_RI_ARGS(ri) xtcas_RA_msg2str((ri)->msg), \
+	RA_type2str((ri)->type), RA_sense2str((ri)->sense), \
+	RA_cross2str((ri)->cross), \
 	MPS2FPM((ri)->vs.in.min), MPS2FPM((ri)->vs.in.max), \
 	MPS2FPM((ri)->vs.out.min), MPS2FPM((ri)->vs.out.max)
 
@@ -118,9 +161,10 @@ typedef struct cpa cpa_t;
 
 typedef struct tcas_acf {
 	void	*acf_id;	/* identifier - used for locating in tree */
+	uint64_t seq;		/* tells reappearing contacts apart */
 	obj_pos_t pos_upd;	/* position updates */
 	geo_pos3_t cur_pos;	/* current position */
-	vect3_t	cur_pos_3d;	/* current position relative to our aircraft */
+	vect3_t	cur_pos_3d;	/* current position in ctx->fpp space */
 	bool_t	alt_rptg;	/* target altitude is available */
 	double	agl;		/* altitude above ground level in meters */
 	double	gs;		/* true groundspeed (horizontal) in m/s */
@@ -143,10 +187,53 @@ typedef struct tcas_acf {
 	tcas_threat_t	threat;	/* type of TCAS threat */
 	uint64_t ta_time;	/* time when we became a TA threat */
 
-	avl_node_t	node;		/* used by other_acf_glob tree */
+	avl_node_t	node;		/* used by other_acf tree */
 	list_node_t	new_TA_node;	/* used by new_TA_threat list */
+	list_node_t	free_node;	/* used by free_acf list */
 } tcas_acf_t;
 
+/*
+ * A flat snapshot of our own and all other aircraft's state, as handed
+ * from the collector to the worker. Contacts are sorted by acf_id. The
+ * contact array only ever grows and is reused from cycle to cycle, so
+ * taking a snapshot doesn't need any per-contact allocations.
+ */
+typedef struct {
+	double		t;		/* time the snapshot was taken */
+	tcas_acf_t	my_acf;
+	tcas_acf_t	*acf;
+	size_t		num_acf;
+	size_t		cap;
+} acf_snap_t;
+
+/*
+ * A position report pushed by the host, see xtcas_ctx_push_own and
+ * xtcas_ctx_push_contact. The fields after on_ground are only used in
+ * reports of our own aircraft.
+ */
+typedef struct {
+	bool_t		own;		/* report of our own aircraft */
+	void		*acf_id;
+	geo_pos3_t	pos;
+	double		t;
+	bool_t		on_ground;
+	bool_t		gear_ext;
+	double		alt_agl;
+	double		hdg;
+} pos_report_t;
+
+/*
+ * What the avionics were last told about a contact. A contact which is
+ * lost (and deleted by the collector) and later reappears under the same
+ * acf_id comes back with a new `seq', so it is reported as new.
+ */
+typedef struct {
+	void		*acf_id;
+	uint64_t	seq;
+	bool_t		shown;		/* B_FALSE once deleted */
+	xtcas_contact_t	ctc;		/* values last reported, if shown */
+} ctc_report_t;
+
 typedef enum {
 	RA_CROSS_REQ,
 	RA_CROSS_REJ,
@@ -184,9 +271,51 @@ typedef struct {
 	bool_t			alim_achieved; /* min_sep at least ALIM_RA */
 	double			min_sep;	/* Minimum among seps */
 	double			vs_corr_reqd;	/* required VS correction */
-	avl_node_t		node;
+	double			initial_vs;	/* VS at first RA */
 } tcas_RA_t;
 
+/*
+ * Memoized separations of all RA infos from one intruder, along with the
+ * exact encounter geometry they were computed for. An entry is only used
+ * while the time to CPA and the subsequent RA flag are unchanged and the
+ * intruder's relative elevation at CPA and our vvel are within
+ * SEP_MEMO_Z_TOL and SEP_MEMO_VS_TOL of the stored ones (see
+ * sep_memo_lookup). It is reset when a separation has to be computed for
+ * a different geometry, or when another intruder hashes to the same slot.
+ */
+typedef struct {
+	void		*acf_id;	/* intruder, NULL if slot is empty */
+	double		d_t;		/* seconds to CPA */
+	double		dz;		/* intruder's rel. elev at CPA */
+	double		vvel;		/* our vvel */
+	bool_t		subseq;		/* subsequent RA maneuver */
+	uint32_t	valid;		/* bit mask of RA_info indices */
+	double		sep[NUM_RA_INFOS];
+} sep_memo_ent_t;
+
+typedef struct {
+	sep_memo_ent_t	ents[SEP_MEMO_SIZE];
+	unsigned	num_lookups;	/* in this cycle */
+	unsigned	num_hits;	/* in this cycle */
+} sep_memo_t;
+
+/*
+ * Geometry of the RA threats, shared by all candidate RAs of a CAS_logic
+ * call. `dz' is the intruder's elevation at CPA relative to ours.
+ */
+typedef struct {
+	size_t		n_cpas;
+	void		**acf_ids;
+	double		*d_t;
+	double		*dz;
+	double		vvel;
+	bool_t		subseq;
+	bool_t		crosses[NUM_RA_SENSES];	/* see ra_enc_setup */
+	ra_eval_t	*ev;
+	sep_memo_t	*memo;
+	sep_memo_ent_t	**memo_ents;	/* matching entry or NULL per CPA */
+} ra_enc_t;
+
 typedef struct {
 	void		*acf_id;
 	tcas_threat_t	level;
@@ -194,11 +323,24 @@ typedef struct {
 	avl_node_t	node;
 } tcas_RA_hint_t;
 
+/*
+ * A window of grid cells around our aircraft. Any contact in a cell
+ * outside of this window is guaranteed to be farther away than
+ * OTH_TFC_DIST_THRESH.
+ */
+typedef struct {
+	int	lat_cell;
+	int	lon_cell;
+	int	lat_reach;	/* max cell distance in latitude */
+	int	lon_reach;	/* max cell distance in longitude, -1 = any */
+} grid_win_t;
+
 typedef struct {
 	tcas_adv_t	adv_state;
-	tcas_RA_t	*ra;
+	tcas_RA_t	*ra;		/* NULL or points to ra_store */
+	tcas_RA_t	ra_store;
 	double		initial_ra_vs;	/* VS when first RA was issued */
-	uint64_t	change_t;	/* microclock() timestamp */
+	uint64_t	change_t;	/* sim time, us */
 	tcas_mode_t	mode;
 	tcas_filter_t	filter;
 
@@ -218,7 +360,6 @@ struct cpa {
 	tcas_acf_t	*acf_a;
 	tcas_acf_t	*acf_b;
 
-	avl_node_t	node;
 	avl_node_t	ra_node;
 };
 
@@ -504,27 +645,178 @@ static const tcas_RA_info_t RA_info[NUM_RA_INFOS] = {
     }
 };
 
-static mutex_t acf_lock;
-static tcas_acf_t my_acf_glob = {
-    .has_RA = B_TRUE,
-    .has_WOW = B_TRUE
+/*
+ * A TCAS context holds the complete state of one TCAS-equipped aircraft:
+ * the position data of our own and other aircraft, the advisory state
+ * machine and the worker thread that drives it. Contexts share no state,
+ * so a host can run any number of them side by side in one process. The
+ * plain xtcas_* API operates on a built-in default context.
+ */
+struct xtcas_ctx {
+	bool_t		inited;
+
+	mutex_t		acf_lock;	/* protects my_acf and other_acf */
+	tcas_acf_t	my_acf;
+	avl_tree_t	other_acf;
+	list_t		free_acf;	/* lost contacts, for reuse */
+	uint64_t	acf_seq;	/* last tcas_acf_t.seq handed out */
+	double		last_collect_t;
+
+	/*
+	 * Flat, north-up projection into which all positions are placed.
+	 * It is centered on our aircraft, but only re-centered once we
+	 * are more than FPP_RECENTER_DIST away from its center, so our
+	 * own position is generally not (0, 0). Collector-private.
+	 */
+	fpp_t		fpp;
+	bool_t		fpp_valid;
+
+	/* Buffer lent to fill_oth_acf_pos. Collector-private. */
+	acf_pos_t	*pos_buf;
+	size_t		pos_buf_cap;
+
+	/*
+	 * Push mode (the host provides no get_my_acf_pos). The host
+	 * pushes position reports into push_ring and the worker drains
+	 * them into push_own and push_acf, the latest report of each
+	 * contact, before collecting positions itself. Everything except
+	 * push_ring is worker-private.
+	 */
+	bool_t		push;
+	xtcas_ring_t	push_ring;
+	pos_report_t	push_own;
+	bool_t		push_own_valid;
+	avl_tree_t	push_acf;
+
+	/*
+	 * Snapshot buffers. The collector builds a new snapshot in
+	 * snap_back and publishes it by swapping it with snap_ready. The
+	 * worker picks it up by rotating snap_ready into snap_cur, while
+	 * keeping the previous cycle's snapshot in snap_old. Only the
+	 * pointer rotation happens under snap_lock.
+	 */
+	acf_snap_t	snaps[4];
+	mutex_t		snap_lock;	/* protects snap_ready & snap_fresh */
+	acf_snap_t	*snap_back;	/* collector-private */
+	acf_snap_t	*snap_ready;
+	bool_t		snap_fresh;
+
+	/*
+	 * Adaptive cycle scheduling, also protected by snap_lock. While
+	 * any contact is PROX or above, the worker runs its cycle (and
+	 * the collector collects positions) every fast_intval seconds.
+	 * Otherwise, it drops back to WORKER_LOOP_INTVAL. The worker sets
+	 * cycle_intval at the end of every cycle.
+	 */
+	double		cycle_intval;
+	double		cycle_intval_avg;
+	double		fast_intval;
+	xtcas_sched_stats_t sched_stats;
+
+	/* Worker pipeline timing, also protected by snap_lock. */
+	xtcas_timing_t	timing;
+
+	/*
+	 * Number of threads classifying contacts in large contact sets,
+	 * also protected by snap_lock. The worker (re)starts threat_pool
+	 * with that many threads the first time it is needed.
+	 */
+	unsigned	threat_threads;
+	xtcas_pool_t	threat_pool;	/* worker-private */
+
+	/*
+	 * Tuning parameters from xtcas_ctx_set_params, also protected by
+	 * snap_lock. At the start of its next cycle, the worker copies
+	 * them into cur_params and applies them to its copy of the SL
+	 * table.
+	 */
+	xtcas_params_t	params;
+	bool_t		params_chg;
+
+	tcas_state_t	state;
+	int		SL;
+
+	condvar_t	worker_cv;
+	thread_t	worker_thr;
+	mutex_t		worker_lock;
+	bool_t		worker_shutdown;
+	bool_t		sync;		/* driven by xtcas_step */
+
+	/* worker-private cycle state */
+	acf_snap_t	*snap_cur;
+	acf_snap_t	*snap_old;
+	acf_snap_t	test_snap;
+	xtcas_params_t	cur_params;
+	SL_t		SL_table[NUM_SL];
+	const SL_t	*cur_sl;
+	avl_tree_t	RA_hints;
+	double		last_cycle_t;
+	double		sample_t;	/* time of snapshot last used */
+	double		prev_sample_t;	/* time of the one before that */
+	unsigned	num_RA_cands;	/* RA candidates in this cycle */
+	sep_memo_t	sep_memo;
+
+	/*
+	 * Contact state last reported to the avionics, sorted by acf_id.
+	 * update_contacts builds the new state in ctc_rep[1] from the
+	 * snapshot and then swaps the two, so only changes are reported.
+	 */
+	ctc_report_t	*ctc_rep[2];
+	size_t		num_ctc_rep;
+	size_t		ctc_rep_cap;
+	unsigned	num_ctc_reported;	/* in this cycle */
+	unsigned	num_ctc_suppressed;	/* in this cycle */
+
+	/*
+	 * CPA kernel input/output and the resulting CPA records. Both only
+	 * ever grow and are reused from cycle to cycle.
+	 */
+	cpa_soa_t	cpa_soa;
+	cpa_t		*cpas;
+	size_t		num_cpas;
+	size_t		cpas_cap;
+
+	/*
+	 * Short-lived objects of a single cycle (RA candidates, message
+	 * lists) are allocated from `arena', which is reset at the end of
+	 * each cycle. RA hints live until the next cycle and so are kept
+	 * in a separate reusable array. `num_allocs' counts the heap
+	 * allocations done by the cycle, to check that there are none in
+	 * steady state. The worker must allocate through ctx_calloc and
+	 * ctx_realloc, so that none of them are missed.
+	 */
+	arena_t		arena;
+	tcas_RA_hint_t	*hints;
+	size_t		hints_cap;
+	uint64_t	num_allocs;
+
+	const sim_intf_input_ops_t	*in_ops;
+	const sim_intf_output_ops_t	*out_ops;
+};
+
+static xtcas_ctx_t dflt_ctx = {
+    .my_acf = {
+	.has_RA = B_TRUE,
+	.has_WOW = B_TRUE
+    }
 };
-static avl_tree_t other_acf_glob;
-static double last_collect_t = 0;
-static tcas_state_t tcas_state;
-static bool_t inited = B_FALSE;
-static int xtcas_SL = 0;
 
-static condvar_t worker_cv;
-static thread_t worker_thr;
-static mutex_t worker_lock;
-static bool_t worker_shutdown = B_FALSE;
+static void *
+ctx_calloc(xtcas_ctx_t *ctx, size_t nmemb, size_t size)
+{
+	ctx->num_allocs++;
+	return (safe_calloc(nmemb, size));
+}
 
-static const sim_intf_input_ops_t *in_ops = NULL;
-static const sim_intf_output_ops_t *out_ops = NULL;
+static void *
+ctx_realloc(xtcas_ctx_t *ctx, void *ptr, size_t size)
+{
+	ctx->num_allocs++;
+	return (safe_realloc(ptr, size));
+}
 
-static const char *
-RA_msg2str(tcas_msg_t msg)
+const char *
+xtcas_RA_msg2str(tcas_msg_t msg)
 {
 	switch (msg) {
 	case RA_MSG_CLB:
@@ -644,6 +936,19 @@ acf_compar(const void *a, const void *b)
 		return (1);
 }
 
+static int
+acf_pos_compar(const void *a, const void *b)
+{
+	const acf_pos_t *pa = a, *pb = b;
+
+	if (pa->acf_id < pb->acf_id)
+		return (-1);
+	else if (pa->acf_id == pb->acf_id)
+		return (0);
+	else
+		return (1);
+}
+
 static int
 RA_hint_compar(const void *ha, const void *hb)
 {
@@ -656,75 +961,244 @@ RA_hint_compar(const void *ha, const void *hb)
 	return (0);
 }
 
+static inline int
+grid_lat_cell(double lat)
+{
+	return ((int)floor((lat + 90) / GRID_CELL_DEG));
+}
+
+static inline int
+grid_lon_cell(double lon)
+{
+	return ((int)floor((lon + 180) / GRID_CELL_DEG) % GRID_LON_CELLS);
+}
+
+/*
+ * Constructs the grid cell window around `center' which contains all
+ * points within OTH_TFC_DIST_THRESH of it. Longitude cells shrink with
+ * the cosine of latitude, so the longitude reach is computed at the
+ * highest latitude the window touches. Close to the poles, we simply
+ * don't limit longitude at all.
+ */
+static grid_win_t
+grid_win_init(geo_pos2_t center)
+{
+	grid_win_t win;
+	double max_lat = ABS(center.lat) + GRID_REACH_DEG;
+
+	win.lat_cell = grid_lat_cell(center.lat);
+	win.lon_cell = grid_lon_cell(center.lon);
+	win.lat_reach = (int)(GRID_REACH_DEG / GRID_CELL_DEG) + 1;
+	if (max_lat < GRID_MAX_LAT) {
+		win.lon_reach = (int)(GRID_REACH_DEG / cos(DEG2RAD(max_lat)) /
+		    GRID_CELL_DEG) + 1;
+		if (win.lon_reach >= GRID_LON_CELLS / 2)
+			win.lon_reach = -1;
+	} else {
+		win.lon_reach = -1;
+	}
+
+	return (win);
+}
+
+static bool_t
+grid_win_contains(const grid_win_t *win, geo_pos2_t pos)
+{
+	int d_lon;
+
+	if (abs(grid_lat_cell(pos.lat) - win->lat_cell) > win->lat_reach)
+		return (B_FALSE);
+	if (win->lon_reach < 0)
+		return (B_TRUE);
+	d_lon = abs(grid_lon_cell(pos.lon) - win->lon_cell);
+	/* handle wrap-around at the antimeridian */
+	d_lon = MIN(d_lon, GRID_LON_CELLS - d_lon);
+
+	return (d_lon <= win->lon_reach);
+}
+
 static void
-update_my_position(double t)
+update_my_position(xtcas_ctx_t *ctx, double t)
 {
-	double agl;
+	tcas_acf_t *my_acf = &ctx->my_acf;
+	double agl, upd_t = t;
 	bool_t on_ground, gear_ext;
-
-	in_ops->get_my_acf_pos(in_ops->handle, &my_acf_glob.cur_pos,
-	    &agl, &my_acf_glob.hdg, &gear_ext, &on_ground);
-	if (!my_acf_glob.custom_RA)
-		my_acf_glob.agl = agl;
-	if (!my_acf_glob.custom_WOW)
-		my_acf_glob.on_ground = on_ground;
-	if (!my_acf_glob.custom_gear_ext)
-		my_acf_glob.gear_ext = gear_ext;
-	my_acf_glob.cur_pos_3d = VECT3(0, 0, my_acf_glob.cur_pos.elev);
-	xtcas_obj_pos_update(&my_acf_glob.pos_upd, t, my_acf_glob.cur_pos,
-	    my_acf_glob.agl);
-	my_acf_glob.trend_data_ready = (
-	    xtcas_obj_pos_get_gs(&my_acf_glob.pos_upd, &my_acf_glob.gs) &&
-	    xtcas_obj_pos_get_trk(&my_acf_glob.pos_upd, &my_acf_glob.trk) &&
-	    xtcas_obj_pos_get_vvel(&my_acf_glob.pos_upd, &my_acf_glob.vvel,
-	    &my_acf_glob.d_vvel));
-	if (my_acf_glob.trend_data_ready) {
-		my_acf_glob.trk_v = vect2_set_abs(hdg2dir(my_acf_glob.trk),
-		    my_acf_glob.gs);
+	vect2_t proj;
+
+	if (ctx->push) {
+		ASSERT(ctx->push_own_valid);
+		upd_t = ctx->push_own.t;
+		my_acf->cur_pos = ctx->push_own.pos;
+		agl = ctx->push_own.alt_agl;
+		my_acf->hdg = ctx->push_own.hdg;
+		gear_ext = ctx->push_own.gear_ext;
+		on_ground = ctx->push_own.on_ground;
+	} else {
+		ctx->in_ops->get_my_acf_pos(ctx->in_ops->handle,
+		    &my_acf->cur_pos, &agl, &my_acf->hdg, &gear_ext,
+		    &on_ground);
+	}
+	if (!my_acf->custom_RA)
+		my_acf->agl = agl;
+	if (!my_acf->custom_WOW)
+		my_acf->on_ground = on_ground;
+	if (!my_acf->custom_gear_ext)
+		my_acf->gear_ext = gear_ext;
+	if (!ctx->fpp_valid || vect2_abs(geo2fpp(GEO3_TO_GEO2(my_acf->cur_pos),
+	    &ctx->fpp)) > FPP_RECENTER_DIST) {
+		ctx->fpp = ortho_fpp_init(GEO3_TO_GEO2(my_acf->cur_pos), 0,
+		    &wgs84, B_FALSE);
+		ctx->fpp_valid = B_TRUE;
+	}
+	proj = geo2fpp(GEO3_TO_GEO2(my_acf->cur_pos), &ctx->fpp);
+	my_acf->cur_pos_3d = VECT3(proj.x, proj.y, my_acf->cur_pos.elev);
+	/*
+	 * In push mode, the tracker is only fed new reports, with the time
+	 * they were made, so a report isn't taken for standing still if
+	 * we cycle faster than it is pushed.
+	 */
+	if (my_acf->pos_upd.num_upd == 0 || upd_t > my_acf->pos_upd.time) {
+		xtcas_obj_pos_update(&my_acf->pos_upd, upd_t,
+		    my_acf->cur_pos, my_acf->agl);
+	}
+	my_acf->trend_data_ready = (
+	    xtcas_obj_pos_get_gs(&my_acf->pos_upd, &my_acf->gs) &&
+	    xtcas_obj_pos_get_trk(&my_acf->pos_upd, &my_acf->trk) &&
+	    xtcas_obj_pos_get_vvel(&my_acf->pos_upd, &my_acf->vvel,
+	    &my_acf->d_vvel));
+	if (my_acf->trend_data_ready) {
+		my_acf->trk_v = vect2_set_abs(hdg2dir(my_acf->trk),
+		    my_acf->gs);
 	}
 
 	/*
 	 * If we don't have an RA, invalidate our height. This makes
 	 * any check involving our height fail.
 	 */
-	if (!my_acf_glob.has_RA)
-		my_acf_glob.agl = NAN;
-	if (!my_acf_glob.has_WOW)
-		my_acf_glob.on_ground = B_FALSE;
+	if (!my_acf->has_RA)
+		my_acf->agl = NAN;
+	if (!my_acf->has_WOW)
+		my_acf->on_ground = B_FALSE;
 
 	dbg_log(contact, 1, "my_pos: " PRINTF_ACF_FMT,
-	    PRINTF_ACF_ARGS(&my_acf_glob));
+	    PRINTF_ACF_ARGS(my_acf));
+}
+
+/*
+ * Places the latest pushed position of every contact in pos_buf, with
+ * the time of the report in last_seen. Contacts which haven't been
+ * reported for PUSH_CTC_TIMEOUT seconds are dropped and so will be
+ * deleted as lost. If our own aircraft hasn't been reported for that
+ * long, we no longer know where we are, so all contacts are dropped.
+ */
+static size_t
+get_pushed_acf_pos(xtcas_ctx_t *ctx, double t)
+{
+	size_t count = 0;
+	bool_t own_lost = (t - ctx->push_own.t > PUSH_CTC_TIMEOUT);
+
+	if (own_lost) {
+		dbg_log(contact, 1, "own position not pushed since %.1f, "
+		    "dropping all contacts", ctx->push_own.t);
+	}
+
+	if (avl_numnodes(&ctx->push_acf) > ctx->pos_buf_cap) {
+		ctx->pos_buf_cap = MAX(avl_numnodes(&ctx->push_acf),
+		    2 * ctx->pos_buf_cap);
+		ctx->pos_buf = ctx_realloc(ctx, ctx->pos_buf,
+		    ctx->pos_buf_cap * sizeof (*ctx->pos_buf));
+	}
+	for (acf_pos_t *pos = avl_first(&ctx->push_acf), *next = NULL;
+	    pos != NULL; pos = next) {
+		next = AVL_NEXT(&ctx->push_acf, pos);
+		if (own_lost || t - pos->last_seen > PUSH_CTC_TIMEOUT) {
+			avl_remove(&ctx->push_acf, pos);
+			free(pos);
+			continue;
+		}
+		ctx->pos_buf[count].acf_id = pos->acf_id;
+		ctx->pos_buf[count].pos = pos->pos;
+		ctx->pos_buf[count].on_ground = pos->on_ground;
+		ctx->pos_buf[count].last_seen = pos->last_seen;
+		count++;
+	}
+
+	return (count);
+}
+
+/*
+ * Fetches the positions of all other aircraft from the host. If the host
+ * supports fill_oth_acf_pos, or pushes positions to us, the positions are
+ * placed in our reusable pos_buf. Otherwise, the host hands us a new
+ * array, which the caller must free.
+ */
+static size_t
+get_oth_acf_pos(xtcas_ctx_t *ctx, double t, acf_pos_t **pos_p)
+{
+	const sim_intf_input_ops_t *in_ops = ctx->in_ops;
+	size_t count;
+
+	if (ctx->push) {
+		count = get_pushed_acf_pos(ctx, t);
+		*pos_p = ctx->pos_buf;
+		return (count);
+	}
+	if (in_ops->fill_oth_acf_pos == NULL) {
+		in_ops->get_oth_acf_pos(in_ops->handle, pos_p, &count);
+		return (count);
+	}
+	for (;;) {
+		count = in_ops->fill_oth_acf_pos(in_ops->handle, ctx->pos_buf,
+		    ctx->pos_buf_cap);
+		if (count <= ctx->pos_buf_cap)
+			break;
+		ctx->pos_buf_cap = MAX(count, 2 * ctx->pos_buf_cap);
+		ctx->pos_buf = ctx_realloc(ctx, ctx->pos_buf,
+		    ctx->pos_buf_cap * sizeof (*ctx->pos_buf));
+	}
+	*pos_p = ctx->pos_buf;
+
+	return (count);
 }
 
 /*
  * Updates the position of bogies (other aircraft). This calls into the
  * sim interface to grab new aircraft position data. It then computes the
- * deltas
+ * deltas. Contacts which fail the vertical filter or lie outside of our
+ * grid window are rejected before we do any tracking or projection work
+ * on them, since with large multiplayer/AI traffic feeds, the vast
+ * majority of contacts are usually much farther than OTH_TFC_DIST_THRESH.
  */
 static void
-update_bogie_positions(double t, geo_pos3_t my_pos, double my_alt_agl)
+update_bogie_positions(xtcas_ctx_t *ctx, double t, geo_pos3_t my_pos,
+    double my_alt_agl)
 {
+	const sim_intf_output_ops_t *out_ops = ctx->out_ops;
 	acf_pos_t *pos;
 	size_t count;
-	fpp_t fpp = ortho_fpp_init(GEO3_TO_GEO2(my_pos), 0, &wgs84, B_FALSE);
+	vect2_t my_pos_2d = VECT3_TO_VECT2(ctx->my_acf.cur_pos_3d);
 	double gnd_level = (my_alt_agl <= ON_GROUND_AGL_CHK_THRESH) ?
 	    (my_pos.elev - my_alt_agl) : MIN_ELEV;
-	tcas_filter_t filter = tcas_state.filter;
-	tcas_mode_t mode = tcas_state.mode;
+	tcas_filter_t filter = ctx->state.filter;
+	tcas_mode_t mode = ctx->state.mode;
+	grid_win_t win = grid_win_init(GEO3_TO_GEO2(my_pos));
+	unsigned n_grid_rej = 0;
+	uint64_t start = microclock();
 
-	in_ops->get_oth_acf_pos(in_ops->handle, &pos, &count);
+	count = get_oth_acf_pos(ctx, t, &pos);
 	dbg_log(contact, 3, "received %d contacts from sim", (int)count);
 
 	/* walk the tree and mark all acf as out-of-date */
-	for (tcas_acf_t *acf = avl_first(&other_acf_glob); acf != NULL;
-	    acf = AVL_NEXT(&other_acf_glob, acf))
+	for (tcas_acf_t *acf = avl_first(&ctx->other_acf); acf != NULL;
+	    acf = AVL_NEXT(&ctx->other_acf, acf))
 		acf->up_to_date = B_FALSE;
 
 	for (size_t i = 0; i < count; i++) {
 		avl_index_t where;
 		tcas_acf_t srch = { .acf_id = pos[i].acf_id };
-		tcas_acf_t *acf = avl_find(&other_acf_glob, &srch, &where);
+		tcas_acf_t *acf;
 		vect2_t proj;
+		double upd_t = (ctx->push ? pos[i].last_seen : t);
 
 		/*
 		 * Apply our vertical detection filter (ALL/ABV/BLW). The
@@ -756,19 +1230,34 @@ update_bogie_positions(double t, geo_pos3_t my_pos, double my_alt_agl)
 		if (mode == TCAS_MODE_STBY || (isnan(pos[i].pos.elev) &&
 		    my_pos.elev > INHIBIT_NO_ALT_RPTG_ACF))
 			continue;
+		if (!is_valid_lat(pos[i].pos.lat) ||
+		    !is_valid_lon(pos[i].pos.lon) ||
+		    !grid_win_contains(&win, GEO3_TO_GEO2(pos[i].pos))) {
+			n_grid_rej++;
+			continue;
+		}
 
+		acf = avl_find(&ctx->other_acf, &srch, &where);
 		if (acf == NULL) {
-			acf = safe_calloc(1, sizeof (*acf));
+			acf = list_remove_head(&ctx->free_acf);
+			if (acf != NULL)
+				memset(acf, 0, sizeof (*acf));
+			else
+				acf = ctx_calloc(ctx, 1, sizeof (*acf));
 			acf->acf_id = pos[i].acf_id;
+			acf->seq = ++ctx->acf_seq;
 			acf->agl = NAN;
-			avl_insert(&other_acf_glob, acf, where);
+			avl_insert(&ctx->other_acf, acf, where);
 		}
 		acf->alt_rptg = !isnan(pos[i].pos.elev);
 		acf->cur_pos = pos[i].pos;
-		xtcas_obj_pos_update(&acf->pos_upd, t, acf->cur_pos, -1);
-		proj = geo2fpp(GEO3_TO_GEO2(acf->cur_pos), &fpp);
+		/* see update_my_position */
+		if (acf->pos_upd.num_upd == 0 || upd_t > acf->pos_upd.time)
+			xtcas_obj_pos_update(&acf->pos_upd, upd_t, acf->cur_pos,
+			    -1);
+		proj = geo2fpp(GEO3_TO_GEO2(acf->cur_pos), &ctx->fpp);
 		acf->cur_pos_3d = VECT3(proj.x, proj.y, acf->cur_pos.elev);
-		if (vect2_abs(VECT3_TO_VECT2(acf->cur_pos_3d)) >
+		if (vect2_abs(vect2_sub(proj, my_pos_2d)) >
 		    OTH_TFC_DIST_THRESH) {
 			/* Don't bother if the traffic is too far away */
 			continue;
@@ -777,10 +1266,10 @@ update_bogie_positions(double t, geo_pos3_t my_pos, double my_alt_agl)
 		    xtcas_obj_pos_get_gs(&acf->pos_upd, &acf->gs) &&
 		    xtcas_obj_pos_get_trk(&acf->pos_upd, &acf->trk) &&
 		    xtcas_obj_pos_get_vvel(&acf->pos_upd, &acf->vvel,
-		    &my_acf_glob.d_vvel));
+		    &acf->d_vvel));
 		acf->trk_v = (acf->trend_data_ready) ?
 		    vect2_set_abs(hdg2dir(acf->trk), acf->gs) : NULL_VECT2;
-		if (pos->on_ground) {
+		if (pos[i].on_ground) {
 			acf->on_ground = B_TRUE;
 		} else {
 			/*
@@ -799,9 +1288,9 @@ update_bogie_positions(double t, geo_pos3_t my_pos, double my_alt_agl)
 	}
 
 	/* walk the tree again and remove out-of-date aircraft */
-	for (tcas_acf_t *acf = avl_first(&other_acf_glob), *acf_next = NULL;
+	for (tcas_acf_t *acf = avl_first(&ctx->other_acf), *acf_next = NULL;
 	    acf != NULL; acf = acf_next) {
-		acf_next = AVL_NEXT(&other_acf_glob, acf);
+		acf_next = AVL_NEXT(&ctx->other_acf, acf);
 		if (!acf->up_to_date) {
 			dbg_log(contact, 2, "bogie %p contact lost",
 			    acf->acf_id);
@@ -809,122 +1298,261 @@ update_bogie_positions(double t, geo_pos3_t my_pos, double my_alt_agl)
 				out_ops->delete_contact(out_ops->handle,
 				    acf->acf_id);
 			}
-			avl_remove(&other_acf_glob, acf);
-			free(acf);
+			avl_remove(&ctx->other_acf, acf);
+			list_insert_head(&ctx->free_acf, acf);
 		}
 	}
 
-	dbg_log(contact, 1, "total bogies: %lu", avl_numnodes(&other_acf_glob));
+	dbg_log(contact, 1, "total bogies: %lu", avl_numnodes(&ctx->other_acf));
+	dbg_log(contact, 2, "bogie update: %lu received, %u outside grid, "
+	    "took %.3f ms", (unsigned long)count, n_grid_rej,
+	    (microclock() - start) / 1000.0);
 
-	free(pos);
+	if (pos != ctx->pos_buf)
+		free(pos);
 }
 
 /*
- * Copies all of the global aircraft position info (our aircraft and other
- * aircraft) to create a thread-local copy. `my_acf_copy' will be populated
- * with our aircraft's position info, while `other_acf_copy' will be
- * populated with the state of all other aircraft. Neither may be NULL.
- * If `test' is set, the intruder contact tree is populated with TCAS test
- * contacts instead of the real contacts.
+ * Makes sure `snap' can hold `num_acf' contacts.
  */
 static void
-copy_acf_state(tcas_acf_t *my_acf_copy, avl_tree_t *other_acf_copy, bool_t test)
+snap_reserve(xtcas_ctx_t *ctx, acf_snap_t *snap, size_t num_acf)
+{
+	if (num_acf > snap->cap) {
+		snap->cap = MAX(num_acf, 2 * snap->cap);
+		snap->acf = ctx_realloc(ctx, snap->acf,
+		    snap->cap * sizeof (*snap->acf));
+	}
+}
+
+/*
+ * Monotonic clock with nanosecond resolution for the pipeline timers.
+ */
+uint64_t
+xtcas_nanoclock(void)
+{
+#if	IBM
+	LARGE_INTEGER val, freq;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&val);
+	return ((val.QuadPart / freq.QuadPart) * 1000000000llu +
+	    ((val.QuadPart % freq.QuadPart) * 1000000000llu) / freq.QuadPart);
+#else	/* !IBM */
+	struct timespec ts;
+
+	VERIFY0(clock_gettime(CLOCK_MONOTONIC, &ts));
+	return ((uint64_t)ts.tv_sec * 1000000000llu + ts.tv_nsec);
+#endif	/* !IBM */
+}
+
+void
+xtcas_stage_timing_add(xtcas_stage_timing_t *st, uint64_t num, uint64_t ns)
 {
-	ASSERT(my_acf_copy != NULL);
-	ASSERT(other_acf_copy != NULL);
+	unsigned bucket = 0;
 
-	avl_create(other_acf_copy, acf_compar, sizeof (tcas_acf_t),
-	    offsetof(tcas_acf_t, node));
+	if (ns != 0)
+		bucket = 63 - __builtin_clzll(ns);
+	bucket = MIN(bucket, XTCAS_TIMING_BUCKETS - 1);
 
-	mutex_enter(&acf_lock);
+	if (num == 0 || ns < st->min_ns)
+		st->min_ns = ns;
+	st->max_ns = MAX(st->max_ns, ns);
+	st->total_ns += ns;
+	st->hist[bucket]++;
+}
 
-	memcpy(my_acf_copy, &my_acf_glob, sizeof (*my_acf_copy));
+/*
+ * Fills in the average and 99th percentile of `st' from its total and
+ * histogram. `num' is the number of durations added to it.
+ */
+void
+xtcas_stage_timing_fill(xtcas_stage_timing_t *st, uint64_t num)
+{
+	uint64_t limit = (num * 99 + 99) / 100;
+	uint64_t count = 0;
 
-	if (!test) {
-		for (tcas_acf_t *acf = avl_first(&other_acf_glob); acf != NULL;
-		    acf = AVL_NEXT(&other_acf_glob, acf)) {
-			tcas_acf_t *acf_copy = safe_calloc(1, sizeof (*acf));
-			memcpy(acf_copy, acf, sizeof (*acf));
-			avl_add(other_acf_copy, acf_copy);
+	if (num == 0)
+		return;
+	st->avg_ns = st->total_ns / num;
+	for (int b = 0; b < XTCAS_TIMING_BUCKETS; b++) {
+		count += st->hist[b];
+		if (count >= limit) {
+			/* top of the bucket */
+			st->p99_ns = MIN((2llu << b) - 1, st->max_ns);
+			break;
 		}
-	} else {
-		/*
-		 * The TCAS test pattern consists of 4 contacts arranged as
-		 * follows:
-		 * contact 1: 2NM left and 3NM ahead of our aircraft, 1000 ft
-		 *	above, neither climbing nor descending. Classified as
-		 *	other traffic (empty diamond).
-		 * contact 2: 2NM right and 3NM ahead of our aircraft, 1000 ft
-		 *	below, descending. Classificied as proximate traffic
-		 *	(filled diamond).
-		 * contact 3: 2NM left, 200 ft below, climbing, classified as
-		 *	a TRAFFIC threat (solid yellow circle).
-		 * contact 4: 2NM right, 200 ft above, flying level,
-		 *	classified as an RA threat (solid red square).
-		 * When we're built in GTS820 mode, contact 4 will be absent.
-		 */
+	}
+}
+
+/*
+ * Adds a snap_lock hold, from `start' until now, to the timing
+ * statistics. Must be called with snap_lock held.
+ */
+static void
+snap_lock_hold_add(xtcas_ctx_t *ctx, uint64_t start)
+{
+	xtcas_stage_timing_add(&ctx->timing.snap_lock_hold,
+	    ctx->timing.num_snap_swaps, xtcas_nanoclock() - start);
+	ctx->timing.num_snap_swaps++;
+}
+
+/*
+ * Publishes the current state of our own and other aircraft to the
+ * worker. The snapshot is built in snap_back, which is private to the
+ * collector, so snap_lock is only held to swap it into snap_ready. Any
+ * previously published snapshot which the worker hasn't picked up yet is
+ * simply recycled. `start' and `locked' are the nanoclock times at which
+ * the collection started and acquired acf_lock, for the timing
+ * statistics. Must be called with acf_lock held.
+ */
+static void
+publish_snapshot(xtcas_ctx_t *ctx, uint64_t start, uint64_t locked)
+{
+	acf_snap_t *snap = ctx->snap_back;
+	uint64_t swap_start;
+
+	snap_reserve(ctx, snap, avl_numnodes(&ctx->other_acf));
+	snap->t = ctx->last_collect_t;
+	snap->my_acf = ctx->my_acf;
+	snap->num_acf = 0;
+	for (tcas_acf_t *acf = avl_first(&ctx->other_acf); acf != NULL;
+	    acf = AVL_NEXT(&ctx->other_acf, acf))
+		snap->acf[snap->num_acf++] = *acf;
+
+	mutex_enter(&ctx->snap_lock);
+	swap_start = xtcas_nanoclock();
+	ctx->snap_back = ctx->snap_ready;
+	ctx->snap_ready = snap;
+	ctx->snap_fresh = B_TRUE;
+	snap_lock_hold_add(ctx, swap_start);
+	xtcas_stage_timing_add(&ctx->timing.collect, ctx->timing.num_collects,
+	    xtcas_nanoclock() - start);
+	xtcas_stage_timing_add(&ctx->timing.acf_lock_hold,
+	    ctx->timing.num_collects, xtcas_nanoclock() - locked);
+	ctx->timing.num_collects++;
+	mutex_exit(&ctx->snap_lock);
+}
+
+/*
+ * Carries the threat level and TA time of each contact over from the
+ * previous cycle's snapshot. These are only ever computed by the worker,
+ * whereas the collector builds every snapshot from scratch. We need the
+ * previous threat level to detect new TA threats (used in GTS820 mode).
+ * Both snapshots are sorted by acf_id, so this is a single merge pass.
+ */
+static void
+carry_threat_state(const acf_snap_t *old, acf_snap_t *cur)
+{
+	size_t j = 0;
+
+	for (size_t i = 0; i < cur->num_acf; i++) {
+		tcas_acf_t *acf = &cur->acf[i];
+
+		while (j < old->num_acf && old->acf[j].acf_id < acf->acf_id)
+			j++;
+		if (j < old->num_acf && old->acf[j].acf_id == acf->acf_id) {
+			acf->threat = old->acf[j].threat;
+			acf->ta_time = old->acf[j].ta_time;
+		}
+	}
+}
+
+/*
+ * Returns the snapshot of aircraft state the worker should operate on in
+ * this cycle. If the collector has published a new snapshot since the
+ * last cycle, it is rotated in. Otherwise the worker simply re-runs on
+ * the previous cycle's snapshot.
+ */
+static acf_snap_t *
+acquire_snapshot(xtcas_ctx_t *ctx)
+{
+	bool_t fresh;
+	uint64_t start, end;
+
+	mutex_enter(&ctx->snap_lock);
+	start = xtcas_nanoclock();
+	fresh = ctx->snap_fresh;
+	if (fresh) {
+		acf_snap_t *snap = ctx->snap_ready;
+
+		ctx->snap_ready = ctx->snap_old;
+		ctx->snap_old = ctx->snap_cur;
+		ctx->snap_cur = snap;
+		ctx->snap_fresh = B_FALSE;
+	}
+	end = xtcas_nanoclock();
+	snap_lock_hold_add(ctx, start);
+	mutex_exit(&ctx->snap_lock);
+
+	dbg_log(tcas, 2, "snapshot: fresh:%d  contacts:%lu  lock held:%llu ns",
+	    fresh, (unsigned long)ctx->snap_cur->num_acf,
+	    (unsigned long long)(end - start));
+
+	if (fresh)
+		carry_threat_state(ctx->snap_old, ctx->snap_cur);
+
+	return (ctx->snap_cur);
+}
+
+/*
+ * Fills `snap' with a copy of our aircraft from `my_acf' and the TCAS
+ * test contacts. This is used in place of the real contacts while the
+ * TCAS system test is in progress. `snap' must have room for at least
+ * NUM_TEST_CTC contacts.
+ */
+static void
+build_test_snapshot(const tcas_acf_t *my_acf, acf_snap_t *snap)
+{
+	ASSERT3U(snap->cap, >=, NUM_TEST_CTC);
+	snap->my_acf = *my_acf;
+	snap->num_acf = 0;
+
+	/*
+	 * The TCAS test pattern consists of 4 contacts arranged as
+	 * follows:
+	 * contact 1: 2NM left and 3NM ahead of our aircraft, 1000 ft
+	 *	above, neither climbing nor descending. Classified as
+	 *	other traffic (empty diamond).
+	 * contact 2: 2NM right and 3NM ahead of our aircraft, 1000 ft
+	 *	below, descending. Classificied as proximate traffic
+	 *	(filled diamond).
+	 * contact 3: 2NM left, 200 ft below, climbing, classified as
+	 *	a TRAFFIC threat (solid yellow circle).
+	 * contact 4: 2NM right, 200 ft above, flying level,
+	 *	classified as an RA threat (solid red square).
+	 * When we're built in GTS820 mode, contact 4 will be absent.
+	 */
 
 #define	ADD_TEST_CONTACT(id, x_nm, y_nm, rel_alt_ft, trend, threat_lvl) \
 	do { \
-		tcas_acf_t *acf = safe_calloc(1, sizeof (*acf)); \
-		vect2_t v = vect2_rot(VECT2(NM2MET(x_nm), NM2MET(y_nm)), \
-		    my_acf_copy->hdg); \
+		tcas_acf_t *acf = &snap->acf[snap->num_acf++]; \
+		vect2_t v = vect2_add(VECT3_TO_VECT2(my_acf->cur_pos_3d), \
+		    vect2_rot(VECT2(NM2MET(x_nm), NM2MET(y_nm)), \
+		    my_acf->hdg)); \
+		memset(acf, 0, sizeof (*acf)); \
 		acf->acf_id = (void *)id; \
 		acf->cur_pos_3d = VECT3(v.x, v.y, \
-		    my_acf_copy->cur_pos.elev + FEET2MET(rel_alt_ft)); \
+		    my_acf->cur_pos.elev + FEET2MET(rel_alt_ft)); \
 		acf->alt_rptg = B_TRUE; \
 		acf->vvel = trend; \
 		acf->trend_data_ready = B_TRUE; \
 		acf->up_to_date = B_TRUE; \
 		acf->threat = threat_lvl; \
-		avl_add(other_acf_copy, acf); \
 	} while (0)
 
-		ADD_TEST_CONTACT(1, -2, 3, 1000, 0, OTH_THREAT);
-		ADD_TEST_CONTACT(2, 2, 3, -1000, -1000, PROX_THREAT);
-		ADD_TEST_CONTACT(3, -2, 0, -200, 1000, TA_THREAT);
+	ADD_TEST_CONTACT(1, -2, 3, 1000, 0, OTH_THREAT);
+	ADD_TEST_CONTACT(2, 2, 3, -1000, -1000, PROX_THREAT);
+	ADD_TEST_CONTACT(3, -2, 0, -200, 1000, TA_THREAT);
 #if	!GTS820_MODE
-		ADD_TEST_CONTACT(4, 2, 0, 200, 0, RA_THREAT_CORR);
+	ADD_TEST_CONTACT(4, 2, 0, 200, 0, RA_THREAT_CORR);
 #endif
 
 #undef	ADD_TEST_CONTACT
-	}
-
-	mutex_exit(&acf_lock);
-}
-
-static void
-destroy_acf_state(avl_tree_t *other_acf_copy)
-{
-	void *cookie = NULL;
-	tcas_acf_t *acf;
-
-	/*
-	 * We will back up the threat level to the original tcas_acf_t
-	 * object, since we need it in GTS820 mode to determine if a new
-	 * TA threat has come up.
-	 */
-	mutex_enter(&acf_lock);
-
-	while ((acf = avl_destroy_nodes(other_acf_copy, &cookie)) != NULL) {
-		tcas_acf_t *orig_acf;
-
-		ASSERT3P(acf->cpa, ==, NULL);
-		orig_acf = avl_find(&other_acf_glob, acf, NULL);
-		if (orig_acf != NULL) {
-			orig_acf->threat = acf->threat;
-			orig_acf->ta_time = acf->ta_time;
-		}
-		free(acf);
-	}
-
-	mutex_exit(&acf_lock);
-
-	avl_destroy(other_acf_copy);
 }
 
 /*
- * This is the comparator for the CPA tree. We sort CPAs by time order
+ * This is the comparator for the RA CPA tree. We sort CPAs by time order
  * first and then by aircraft pointer value.
  */
 static int
@@ -949,35 +1577,6 @@ cpa_compar(const void *a, const void *b)
 	}
 }
 
-/*
- * Creates a cpa_t.
- * @param d_t Time from now until the CPA.
- * @param acf_a Our aircraft involved in the CPA.
- * @param acf_b Intruder aircraft involved in the CPA.
- * @param pos_a Our aircraft's position at CPA.
- * @param pos_b Intruder aircraft's position at CPA.
- */
-static cpa_t *
-make_cpa(double d_t, tcas_acf_t *acf_a, tcas_acf_t *acf_b,
-    vect3_t pos_a, vect3_t pos_b)
-{
-	cpa_t *cpa = safe_calloc(1, sizeof (*cpa));
-
-	cpa->d_t = d_t;
-
-	cpa->pos_a = pos_a;
-	cpa->pos_b = pos_b;
-	cpa->d_h = vect2_abs(vect2_sub(VECT2(pos_a.x, pos_a.y),
-	    VECT2(pos_b.x, pos_b.y)));
-	cpa->d_v = ABS(pos_a.z - pos_b.z);
-
-	cpa->acf_a = acf_a;
-	cpa->acf_b = acf_b;
-	ASSERT3P(acf_b->cpa, ==, NULL);
-	acf_b->cpa = cpa;
-
-	return (cpa);
-}
 /*
  * Given our and all other aircraft's positions, directions, speeds and
  * vertical velocities, compute where the closest points of approach are
@@ -1017,21 +1616,30 @@ make_cpa(double d_t, tcas_acf_t *acf_a, tcas_acf_t *acf_b,
  *	occurred) or too high (CPA is too far in the future), or the
  *	separation at CPA exceeds a threshold value, we simply don't
  *	generate a cpa_t record for that particular aircraft at all.
+ *
+ * The eligible contacts are first gathered into a structure-of-arrays
+ * and steps 4-8 are done for all of them in one pass of the CPA kernel
+ * (see cpa.c), which uses SIMD instructions where available. The
+ * resulting cpa_t records are kept in a flat array in no particular
+ * order. Only the CPAs of RA threats need to be in time order and those
+ * are sorted in resolve_CPAs.
  */
 static void
-compute_CPAs(avl_tree_t *cpas, tcas_acf_t *my_acf, avl_tree_t *other_acf)
+compute_CPAs(xtcas_ctx_t *ctx, tcas_acf_t *my_acf, acf_snap_t *snap)
 {
+	cpa_soa_t *soa = &ctx->cpa_soa;
 	vect3_t my_pos_3d = my_acf->cur_pos_3d;
 	vect3_t my_vel = VECT3(my_acf->trk_v.x, my_acf->trk_v.y, my_acf->vvel);
+	size_t n = 0;
 
-	avl_create(cpas, cpa_compar, sizeof (cpa_t), offsetof(cpa_t, node));
+	ctx->num_cpas = 0;
+	if (!my_acf->trend_data_ready)
+		return;
 
-	for (tcas_acf_t *acf = avl_first(other_acf); acf != NULL;
-	    acf = AVL_NEXT(other_acf, acf)) {
-		vect2_t dir;
-		vect3_t rel_pos_3d, vel, rel_vel, cpa_pos, my_cpa_pos;
-		double t_cpa;
-		cpa_t *cpa;
+	if (xtcas_cpa_soa_reserve(soa, snap->num_acf))
+		ctx->num_allocs++;
+	for (size_t i = 0; i < snap->num_acf; i++) {
+		tcas_acf_t *acf = &snap->acf[i];
 
 		/*
 		 * Don't compute CPAs for contacts that either:
@@ -1039,60 +1647,69 @@ compute_CPAs(avl_tree_t *cpas, tcas_acf_t *my_acf, avl_tree_t *other_acf)
 		 * 2) Ground speed is zero (false contact).
 		 * 3) Fall outside of our maximum vertical filter boundaries.
 		 */
-		if (!acf->trend_data_ready || !my_acf->trend_data_ready ||
+		if (!acf->trend_data_ready ||
 		    acf->gs < FALSE_CTC_SUPPRESS_GS || ABS(acf->cur_pos.elev -
 		    my_acf->cur_pos.elev) > LONG_VERT_FILTER)
 			continue;
 
-		rel_pos_3d = VECT3(acf->cur_pos_3d.x, acf->cur_pos_3d.y,
-		    acf->cur_pos_3d.z - my_pos_3d.z);
-		dir = acf->trk_v;
-		vel = VECT3(dir.x, dir.y, acf->vvel);
-		rel_vel = vect3_sub(vel, my_vel);
-		if (!IS_ZERO_VECT3(rel_vel)) {
-			t_cpa = floor((-(rel_pos_3d.x * rel_vel.x) -
-			    (rel_pos_3d.y * rel_vel.y) -
-			    (rel_pos_3d.z * rel_vel.z)) /
-			    (POW2(rel_vel.x) + POW2(rel_vel.y) +
-			    POW2(rel_vel.z)));
-			/*
-			 * If CPA is in the past, the current position is the
-			 * CPA.
-			 */
-			t_cpa = MAX(t_cpa, 0);
-		} else {
-			t_cpa = 0;
-		}
+		soa->x[n] = acf->cur_pos_3d.x;
+		soa->y[n] = acf->cur_pos_3d.y;
+		soa->z[n] = acf->cur_pos_3d.z;
+		soa->vx[n] = acf->trk_v.x;
+		soa->vy[n] = acf->trk_v.y;
+		soa->vz[n] = acf->vvel;
+		soa->idx[n] = i;
+		n++;
+	}
+	soa->n = n;
+	if (n == 0)
+		return;
+
+	xtcas_cpa_compute(soa, my_pos_3d, my_vel);
 
-		cpa_pos = vect3_add(acf->cur_pos_3d, vect3_scmul(vel, t_cpa));
-		my_cpa_pos = vect3_add(my_pos_3d, vect3_scmul(my_vel, t_cpa));
+	if (ctx->cpas_cap < n) {
+		ctx->cpas_cap = MAX(n, 2 * ctx->cpas_cap);
+		ctx->cpas = ctx_realloc(ctx, ctx->cpas,
+		    ctx->cpas_cap * sizeof (*ctx->cpas));
+	}
+	for (size_t i = 0; i < n; i++) {
+		tcas_acf_t *acf = &snap->acf[soa->idx[i]];
+		cpa_t *cpa = &ctx->cpas[i];
+		double t = soa->t[i];
+		vect3_t vel = VECT3(soa->vx[i], soa->vy[i], soa->vz[i]);
+
+		cpa->d_t = t;
+		cpa->pos_a = vect3_add(my_pos_3d, vect3_scmul(my_vel, t));
+		cpa->pos_b = vect3_add(acf->cur_pos_3d, vect3_scmul(vel, t));
+		cpa->d_h = soa->d_h[i];
+		cpa->d_v = soa->d_v[i];
+		cpa->acf_a = my_acf;
+		cpa->acf_b = acf;
+		ASSERT3P(acf->cpa, ==, NULL);
+		acf->cpa = cpa;
 
-		cpa = make_cpa(t_cpa, my_acf, acf, my_cpa_pos, cpa_pos);
 		dbg_log(cpa, 1, "bogie %p cpa d_t:%.1f pos_a:%.0fx%.0fx%.0f "
 		    "pos_b:%.0fx%.0fx%.0f d_h:%.0f d_v:%.0f",
 		    acf->acf_id, cpa->d_t,
 		    cpa->pos_a.x, cpa->pos_a.y, cpa->pos_a.z,
 		    cpa->pos_b.x, cpa->pos_b.y, cpa->pos_b.z,
 		    cpa->d_h, cpa->d_v);
-		avl_add(cpas, cpa);
 	}
+	ctx->num_cpas = n;
 }
 
 static void
-destroy_CPAs(avl_tree_t *cpas)
+destroy_CPAs(xtcas_ctx_t *ctx)
 {
-	void *cookie = NULL;
-	cpa_t *cpa;
-	while ((cpa = avl_destroy_nodes(cpas, &cookie)) != NULL) {
-		cpa->acf_b->cpa = NULL;
-		free(cpa);
-	}
-	avl_destroy(cpas);
+	for (size_t i = 0; i < ctx->num_cpas; i++)
+		ctx->cpas[i].acf_b->cpa = NULL;
+	ctx->num_cpas = 0;
 }
 
 /*
- * Given an intruder aircraft and the current SL, assigns the threat level
- * (tcas_threat_t) to that aircraft. Arguments:
+ * Given an intruder aircraft and the current SL, determines the threat level
+ * (tcas_threat_t) of that aircraft. Arguments:
+ * @param ctx The TCAS context which is performing the assignment.
  * @param my_pos_3d Our current position in 3-space vector coordinates.
  * @param oacf The other aircraft contact to which to assign a threat level.
  * @param sl The current sensitivity level selected for TCAS
@@ -1100,7 +1717,11 @@ destroy_CPAs(avl_tree_t *cpas)
  * @param RA_hints A set of external RA-threat hints. When an aircraft
  *	is initially declared an RA threat, it is marked in this tree
  *	to prevent degrading it to a lower threat during maneuvers.
- * @param filter The currently active TCAS altitude filter (see tcas_filter_t).
+ * @param slow_closure Set for RA threats, to indicate whether this is a
+ *	slow-closure encounter. Left untouched otherwise.
+ *
+ * Returns the threat level. This doesn't modify any shared state, so it
+ * can be called for several contacts in parallel.
  *
  * The order of threat assignments here is important. We go from most serious
  * to least serious:
@@ -1118,17 +1739,21 @@ destroy_CPAs(avl_tree_t *cpas)
  *    range & altitude to determine proximate traffic and assign PROX_THREAT.
  * 6) Lastly, any other intruder is other traffic and designated OTH_THREAT.
  */
-static void
-assign_threat_level(tcas_acf_t *my_acf, tcas_acf_t *oacf, const SL_t *sl,
-    avl_tree_t *RA_hints, tcas_filter_t filter, uint64_t now)
+static tcas_threat_t
+assign_threat_level(const xtcas_ctx_t *ctx, const tcas_acf_t *my_acf,
+    const tcas_acf_t *oacf, const SL_t *sl, avl_tree_t *RA_hints,
+    uint64_t now, bool_t *slow_closure)
 {
 	double d_h = vect2_abs(vect2_sub(VECT3_TO_VECT2(oacf->cur_pos_3d),
 	    VECT3_TO_VECT2(my_acf->cur_pos_3d)));
 	double d_v = ABS(my_acf->cur_pos_3d.z - oacf->cur_pos_3d.z);
-	cpa_t *cpa = oacf->cpa;
+	double hint_dmod = sl->dmod_TA * ctx->cur_params.hint_h_fact;
+	double hint_zthr = sl->zthr_TA * ctx->cur_params.hint_v_fact;
+	const cpa_t *cpa = oacf->cpa;
 	double filter_min = my_acf->cur_pos_3d.z;
 	double filter_max = my_acf->cur_pos_3d.z;
 	bool_t vert_filter = B_TRUE;
+	tcas_filter_t filter = ctx->state.filter;
 	tcas_RA_hint_t srch = { .acf_id = oacf->acf_id };
 	tcas_RA_hint_t *hint;
 
@@ -1170,9 +1795,8 @@ assign_threat_level(tcas_acf_t *my_acf, tcas_acf_t *oacf, const SL_t *sl,
 			    "cpa->d_v: %.0f <= %.0f cpa->d_h: %.0f <= %.0f "
 			    "d_t: %.1f", oacf->acf_id, cpa->d_v, sl->alim_RA,
 			    cpa->d_h, sl->dmod_RA, cpa->d_t);
-			oacf->threat = RA_THREAT_CORR;
-			oacf->slow_closure = B_FALSE;
-			return;
+			*slow_closure = B_FALSE;
+			return (RA_THREAT_CORR);
 		}
 		/*
 		 * Slow RA-corrective threat iff:
@@ -1193,9 +1817,8 @@ assign_threat_level(tcas_acf_t *my_acf, tcas_acf_t *oacf, const SL_t *sl,
 			    "%.0f <= %.0f d_h: %.0f <= %.0f d_t: %.1f",
 			    oacf->acf_id, d_v, sl->alim_RA, d_h, sl->dmod_RA,
 			    cpa->d_t);
-			oacf->threat = RA_THREAT_CORR;
-			oacf->slow_closure = B_TRUE;
-			return;
+			*slow_closure = B_TRUE;
+			return (RA_THREAT_CORR);
 		}
 		/*
 		 * If the previous filter didn't find a corrective threat, we
@@ -1212,26 +1835,22 @@ assign_threat_level(tcas_acf_t *my_acf, tcas_acf_t *oacf, const SL_t *sl,
 		 *    TA or RA.
 		 */
 		if (hint != NULL && oacf->alt_rptg &&
-		    (cpa->d_h <= sl->dmod_TA * HINT_H_INCR_FACT ||
-		    d_h <= sl->dmod_TA * HINT_H_INCR_FACT) &&
-		    (cpa->d_v <= sl->zthr_TA * HINT_V_INCR_FACT ||
-		    d_v <= sl->zthr_TA * HINT_V_INCR_FACT) &&
+		    (cpa->d_h <= hint_dmod || d_h <= hint_dmod) &&
+		    (cpa->d_v <= hint_zthr || d_v <= hint_zthr) &&
 		    ((r_vel <= APCH_SPD_THRESH) ||
 		    ((sl->dmod_TA - dist) / ABS(r_vel) >
 		    (r_alt - sl->zthr_TA) / CLEARING_CLIMB_RATE))) {
 			/* Hints cannot exist on initial RAs */
-			ASSERT3U(tcas_state.adv_state, ==, ADV_STATE_RA);
+			ASSERT3U(ctx->state.adv_state, ==, ADV_STATE_RA);
 			dbg_log(threat, 1, "bogie %p RA_HINT(%d,%d) "
 			    "d_t: %.1f > 0 r_vel: %.1f alt_rptg: %d "
 			    "d_h: %.0f|%.0f <= %.0f && d_v: %.0f|%.0f <= %.0f",
 			    oacf->acf_id, hint->level, hint->slow_closure,
 			    cpa->d_t, r_vel, oacf->alt_rptg, cpa->d_h, d_h,
-			    sl->dmod_TA * HINT_H_INCR_FACT, cpa->d_v, d_v,
-			    sl->zthr_TA * HINT_V_INCR_FACT);
+			    hint_dmod, cpa->d_v, d_v, hint_zthr);
 			ASSERT3U(hint->level, >=, RA_THREAT_PREV);
-			oacf->threat = hint->level;
-			oacf->slow_closure = hint->slow_closure;
-			return;
+			*slow_closure = hint->slow_closure;
+			return (hint->level);
 		}
 		/*
 		 * An RA-preventive threat is the same as an RA-corrective
@@ -1248,9 +1867,8 @@ assign_threat_level(tcas_acf_t *my_acf, tcas_acf_t *oacf, const SL_t *sl,
 			    "%.0f <= %.0f d_h: %.0f <= %.0f d_t: %.0f",
 			    oacf->acf_id, cpa->d_v, sl->zthr_RA, cpa->d_h,
 			    sl->dmod_RA, cpa->d_t);
-			oacf->threat = RA_THREAT_PREV;
-			oacf->slow_closure = B_FALSE;
-			return;
+			*slow_closure = B_FALSE;
+			return (RA_THREAT_PREV);
 		}
 		/*
 		 * The preventive version of the slow approach corrective RA.
@@ -1262,9 +1880,8 @@ assign_threat_level(tcas_acf_t *my_acf, tcas_acf_t *oacf, const SL_t *sl,
 			    "%.0f <= %.0f d_h: %.0f <= %.0f d_t: %.0f",
 			    oacf->acf_id, d_v, sl->zthr_RA, d_h, sl->dmod_RA,
 			    cpa->d_t);
-			oacf->threat = RA_THREAT_PREV;
-			oacf->slow_closure = B_TRUE;
-			return;
+			*slow_closure = B_TRUE;
+			return (RA_THREAT_PREV);
 		}
 
 		/*
@@ -1282,8 +1899,7 @@ assign_threat_level(tcas_acf_t *my_acf, tcas_acf_t *oacf, const SL_t *sl,
 		    cpa->d_v <= sl->zthr_TA) && cpa->d_t <= sl->tau_TA &&
 		    r_vel < APCH_SPD_THRESH) {
 			dbg_log(threat, 1, "bogie %p TA(fast)", oacf->acf_id);
-			oacf->threat = TA_THREAT;
-			return;
+			return (TA_THREAT);
 		}
 		/*
 		 * Slow TA threat if:
@@ -1299,8 +1915,7 @@ assign_threat_level(tcas_acf_t *my_acf, tcas_acf_t *oacf, const SL_t *sl,
 		    d_h <= sl->dmod_TA && r_vel < APCH_SPD_THRESH &&
 		    (!oacf->alt_rptg || d_v <= sl->zthr_TA)) {
 			dbg_log(threat, 1, "bogie %p TA(slow)", oacf->acf_id);
-			oacf->threat = TA_THREAT;
-			return;
+			return (TA_THREAT);
 		}
 	}
 
@@ -1309,8 +1924,7 @@ assign_threat_level(tcas_acf_t *my_acf, tcas_acf_t *oacf, const SL_t *sl,
 	 */
 	if (now - oacf->ta_time < TA_THREAT_CANCEL_DELAY) {
 		dbg_log(threat, 1, "bogie %p TA(delay)", oacf->acf_id);
-		oacf->threat = TA_THREAT;
-		return;
+		return (TA_THREAT);
 	}
 
 	/*
@@ -1322,19 +1936,18 @@ assign_threat_level(tcas_acf_t *my_acf, tcas_acf_t *oacf, const SL_t *sl,
 	if (d_h <= PROX_DIST_THRESH && !oacf->on_ground &&
 	    (!oacf->alt_rptg || d_v <= PROX_ALT_THRESH)) {
 		dbg_log(threat, 1, "bogie %p PROX", oacf->acf_id);
-		oacf->threat = PROX_THREAT;
-		return;
+		return (PROX_THREAT);
 	}
 
 	dbg_log(threat, 1, "bogie %p OTH", oacf->acf_id);
-	oacf->threat = OTH_THREAT;
+	return (OTH_THREAT);
 }
 
 static const tcas_RA_t *
 least_departing_RA(const tcas_RA_t *a, const tcas_RA_t *b)
 {
 	const tcas_acf_t *my_acf = ((cpa_t *)avl_first(a->cpas))->acf_a;
-	double init_vs = roundmul(tcas_state.initial_ra_vs, ALT_ROUND_MUL);
+	double init_vs = roundmul(a->initial_vs, ALT_ROUND_MUL);
 	double cur_vs = roundmul(my_acf->vvel, ALT_ROUND_MUL);
 	double d_vs_a = fabs(init_vs - (cur_vs + a->vs_corr_reqd));
 	double d_vs_b = fabs(init_vs - (cur_vs + b->vs_corr_reqd));
@@ -1347,9 +1960,8 @@ least_departing_RA(const tcas_RA_t *a, const tcas_RA_t *b)
 }
 
 static int
-ra_compar_normal(const void *ra_a, const void *ra_b)
+ra_compar_normal(const tcas_RA_t *a, const tcas_RA_t *b)
 {
-	const tcas_RA_t *a = ra_a, *b = ra_b;
 	const tcas_RA_t *x;
 
 	/* RAs can only be sorted if they refer to the same encounter */
@@ -1358,7 +1970,7 @@ ra_compar_normal(const void *ra_a, const void *ra_b)
 
 	/* if the RAs point to the same info, they must be the same RA */
 	if (a->info == b->info) {
-		ASSERT(memcmp(a, b, offsetof(tcas_RA_t, node)) == 0);
+		ASSERT3P(a, ==, b);
 		return (0);
 	}
 
@@ -1459,13 +2071,12 @@ ra_compar_normal(const void *ra_a, const void *ra_b)
 }
 
 static int
-ra_compar_slow(const void *ra_a, const void *ra_b)
+ra_compar_slow(const tcas_RA_t *a, const tcas_RA_t *b)
 {
-	const tcas_RA_t *a = ra_a, *b = ra_b;
 	const tcas_RA_t *x;
 
 	if (a->info == b->info) {
-		ASSERT(memcmp(a, b, offsetof(tcas_RA_t, node)) == 0);
+		ASSERT3P(a, ==, b);
 		return (0);
 	}
 
@@ -1499,67 +2110,6 @@ ra_compar_slow(const void *ra_a, const void *ra_b)
 		return (1);
 }
 
-static double
-predict_elev_at_CPA(const tcas_acf_t *my_acf, double cpa_t, double delay_t,
-    double accel, double vsr)
-{
-	double man_t, rmng_t, result;
-
-	delay_t = MIN(cpa_t, delay_t);
-	if (vsr < my_acf->vvel)
-		accel = -accel;
-	man_t = MIN(cpa_t - delay_t, (vsr - my_acf->vvel) / accel);
-	rmng_t = cpa_t - (delay_t + man_t);
-	/*
-	 * The elevation change consists of the following segments:
-	 * 1) a straight segment at the aircraft's original VVEL for the
-	 *	duration of delay_t:
-	 *	d1 = vs1 * delay_t
-	 * 2) an accelerating maneuver segment at the acceleration value,
-	 *	which takes a computed amount of time to reach the new
-	 *	target VSR:
-	 *	d2 = vs1 * man_t + 0.5 * accel * man_t^2
-	 * 3) a final straight line segment at the new VSR for the remaining
-	 *	time between the end of delay_t + man_t until cpa_t (rmng_t):
-	 *	d3 = vsr * rmng_t
-	 * We can simplify the first and second portions to obtain:
-	 *	d12 = vs1 * (delay_t + man_t) + 0.5 * accel * man_t^2
-	 */
-	result = my_acf->cur_pos.elev + roundmul(my_acf->vvel, ALT_ROUND_MUL) *
-	    (delay_t + man_t) + 0.5 * accel * POW2(man_t) + vsr * rmng_t;
-	return (result);
-}
-
-static double
-compute_separation(const tcas_acf_t *my_acf, cpa_t *cpa,
-    const tcas_RA_info_t *ri, double delay_t, double accel)
-{
-	double elev_min = predict_elev_at_CPA(my_acf, cpa->d_t,
-	    ri->vs.out.min > my_acf->vvel ? delay_t : 0, accel, ri->vs.out.min);
-	double elev_max = predict_elev_at_CPA(my_acf, cpa->d_t,
-	    ri->vs.out.max < my_acf->vvel ? delay_t : 0, accel, ri->vs.out.max);
-	double sep;
-
-	switch (ri->sense) {
-	case RA_SENSE_UPWARD:
-		sep = elev_min - cpa->pos_b.z;
-		break;
-	case RA_SENSE_LEVEL_OFF:
-		sep = MAX(elev_min - cpa->pos_b.z, cpa->pos_b.z - elev_max);
-		break;
-	default:
-		sep = (cpa->pos_b.z - elev_max);
-		break;
-	}
-
-	dbg_log(cpa, 3, "acf %p %s s:%s d_t:%.1f vsmin:%.0f vsmax:%.0f "
-	    "omin:%.0f omax:%.0f sep:%f", cpa->acf_b->acf_id,
-	    RA_msg2str(ri->msg), RA_sense2str(ri->sense), cpa->d_t,
-	    ri->vs.out.min, ri->vs.out.max, elev_min, elev_max, sep);
-
-	return (sep);
-}
-
 /*
  * Check for incompatible sequences of RA message annunciations. Sometimes
  * we want to prevent calling out an RA even if it has changed. For example,
@@ -1603,62 +2153,239 @@ check_black_band(const tcas_RA_info_t *ri, const tcas_acf_t *my_acf,
 	return (B_TRUE);
 }
 
-static tcas_RA_t *
-ra_construct(const tcas_acf_t *my_acf, const tcas_RA_info_t *ri,
-    avl_tree_t *cpas, const SL_t *sl, double delay_t, double accel,
-    bool_t reversal)
+static sep_memo_ent_t *
+sep_memo_slot(const ra_enc_t *enc, size_t cpa)
+{
+	uint64_t h = ((uintptr_t)enc->acf_ids[cpa] >> 3) *
+	    0x9E3779B97F4A7C15llu;
+
+	return (&enc->memo->ents[(h >> 32) & (SEP_MEMO_SIZE - 1)]);
+}
+
+/*
+ * Returns the memo entry for the intruder of `cpa' if its geometry is
+ * within the memo tolerance of the intruder's current one, otherwise
+ * NULL.
+ */
+static sep_memo_ent_t *
+sep_memo_lookup(const ra_enc_t *enc, size_t cpa)
+{
+	sep_memo_ent_t *ent = sep_memo_slot(enc, cpa);
+
+	if (ent->acf_id != enc->acf_ids[cpa] || ent->d_t != enc->d_t[cpa] ||
+	    ent->subseq != enc->subseq ||
+	    fabs(ent->dz - enc->dz[cpa]) > SEP_MEMO_Z_TOL ||
+	    fabs(ent->vvel - enc->vvel) > SEP_MEMO_VS_TOL)
+		return (NULL);
+
+	return (ent);
+}
+
+/*
+ * Returns the memo entry to store the separations computed for the
+ * current geometry of the intruder of `cpa'. Unless the entry already
+ * holds that exact geometry, it is reset, so an entry never mixes
+ * separations computed for different inputs. Should another intruder of
+ * this encounter hash to the same slot, it loses its entry.
+ */
+static sep_memo_ent_t *
+sep_memo_claim(ra_enc_t *enc, size_t cpa)
+{
+	sep_memo_ent_t *ent = sep_memo_slot(enc, cpa);
+
+	if (enc->memo_ents[cpa] == ent && ent->dz == enc->dz[cpa] &&
+	    ent->vvel == enc->vvel)
+		return (ent);
+	for (size_t i = 0; i < enc->n_cpas; i++) {
+		if (enc->memo_ents[i] == ent)
+			enc->memo_ents[i] = NULL;
+	}
+	ent->acf_id = enc->acf_ids[cpa];
+	ent->d_t = enc->d_t[cpa];
+	ent->dz = enc->dz[cpa];
+	ent->vvel = enc->vvel;
+	ent->subseq = enc->subseq;
+	ent->valid = 0;
+	enc->memo_ents[cpa] = ent;
+
+	return (ent);
+}
+
+/*
+ * Gathers the RA CPAs into the flat arrays used by the RA evaluation
+ * kernel and looks up their entries in the separation memo. The kernel
+ * always evaluates the exact geometry; the memo tolerance only decides
+ * which separations can be reused from an earlier evaluation.
+ *
+ * Whether an RA is crossing only depends on its sense, so that is
+ * determined here for all candidates at once. An encounter is crossing
+ * if either:
+ * 1)
+ *	a: the RA sense is upward
+ *	b: currently we are below the intruder
+ * 2)
+ *	a: the RA sense is downward
+ *	b: currently we are above the intruder
+ */
+static void
+ra_enc_setup(arena_t *arena, const tcas_acf_t *my_acf, avl_tree_t *cpas,
+    bool_t subseq, sep_memo_t *memo, ra_enc_t *enc)
+{
+	size_t n_cpas = avl_numnodes(cpas), i = 0;
+	double *d_t = xtcas_arena_alloc(arena, 2 * n_cpas * sizeof (*d_t));
+	double *z = d_t + n_cpas;
+
+	CTASSERT(NUM_RA_INFOS <= RA_EVAL_MAX_CANDS);
+	CTASSERT(NUM_RA_INFOS <= UINT8_MAX);
+	CTASSERT(NUM_RA_INFOS <= 32);	/* sep_memo_ent_t valid mask */
+	CTASSERT((int)RA_SENSE_UPWARD == (int)RA_EVAL_UP);
+	CTASSERT((int)RA_SENSE_LEVEL_OFF == (int)RA_EVAL_LEVEL);
+	CTASSERT((int)RA_SENSE_DOWNWARD == (int)RA_EVAL_DOWN);
+
+	memset(enc, 0, sizeof (*enc));
+	enc->n_cpas = n_cpas;
+	enc->acf_ids = xtcas_arena_alloc(arena,
+	    n_cpas * sizeof (*enc->acf_ids));
+	enc->d_t = d_t;
+	enc->dz = xtcas_arena_alloc(arena, n_cpas * sizeof (*enc->dz));
+	enc->memo_ents = xtcas_arena_alloc(arena,
+	    n_cpas * sizeof (*enc->memo_ents));
+	enc->vvel = my_acf->vvel;
+	enc->subseq = subseq;
+	enc->memo = memo;
+
+	for (cpa_t *cpa = avl_first(cpas); cpa != NULL;
+	    cpa = AVL_NEXT(cpas, cpa), i++) {
+		enc->acf_ids[i] = cpa->acf_b->acf_id;
+		d_t[i] = cpa->d_t;
+		z[i] = cpa->pos_b.z;
+		enc->dz[i] = cpa->pos_b.z - my_acf->cur_pos.elev;
+		enc->memo_ents[i] = sep_memo_lookup(enc, i);
+		if (cpa->acf_b->cur_pos_3d.z - cpa->acf_a->cur_pos_3d.z >
+		    EQ_ALT_THRESH)
+			enc->crosses[RA_SENSE_UPWARD] = B_TRUE;
+		if (cpa->acf_a->cur_pos_3d.z - cpa->acf_b->cur_pos_3d.z >
+		    EQ_ALT_THRESH)
+			enc->crosses[RA_SENSE_DOWNWARD] = B_TRUE;
+	}
+
+	enc->ev = xtcas_arena_alloc(arena, sizeof (*enc->ev));
+	xtcas_ra_eval_begin(enc->ev, my_acf->cur_pos.elev, my_acf->vvel,
+	    roundmul(my_acf->vvel, ALT_ROUND_MUL), d_t, z, n_cpas,
+	    xtcas_arena_alloc(arena,
+	    n_cpas * RA_EVAL_MAX_CANDS * sizeof (double)));
+}
+
+/*
+ * Computes min_sep of the `n' candidate RAs in `cands'. A candidate whose
+ * separations from all intruders are in the memo is served from there.
+ * The remaining ones are evaluated in one pass of the RA evaluation
+ * kernel and their separations added to the memo.
+ */
+static void
+ra_enc_eval(ra_enc_t *enc, tcas_RA_t *cands, size_t n, double delay_t,
+    double accel)
 {
-	tcas_RA_t *ra = safe_calloc(1, sizeof (*ra));
+	ra_eval_t *ev = enc->ev;
+	uint8_t idx[NUM_RA_INFOS], infos[NUM_RA_INFOS];
+	uint32_t hits = UINT32_MAX, misses = 0;
+
+	/* RA infos whose separations from all intruders are memoized */
+	for (size_t j = 0; j < enc->n_cpas; j++) {
+		const sep_memo_ent_t *ent = enc->memo_ents[j];
+
+		hits &= (ent != NULL ? ent->valid : 0);
+	}
+
+	xtcas_ra_eval_clear(ev);
+	for (size_t i = 0; i < n; i++) {
+		tcas_RA_t *ra = &cands[i];
+		const tcas_RA_info_t *ri = ra->info;
+		unsigned info = ri - RA_info;
+
+		if (hits & (1u << info)) {
+			ra->min_sep = RA_EVAL_NO_SEP;
+			for (size_t j = 0; j < enc->n_cpas; j++) {
+				ra->min_sep = MIN(enc->memo_ents[j]->sep[info],
+				    ra->min_sep);
+			}
+			enc->memo->num_hits += enc->n_cpas;
+			continue;
+		}
+		idx[ev->n_cands] = i;
+		infos[ev->n_cands] = info;
+		misses |= (1u << info);
+		xtcas_ra_eval_add(ev, (ra_eval_sense_t)ri->sense,
+		    ri->vs.out.min, ri->vs.out.max, delay_t, accel);
+	}
+	enc->memo->num_lookups += n * enc->n_cpas;
+	if (ev->n_cands == 0)
+		return;
+
+	xtcas_ra_eval_compute(ev);
+	for (size_t k = 0; k < ev->n_cands; k++)
+		cands[idx[k]].min_sep = ev->min_sep[k];
+	for (size_t j = 0; j < enc->n_cpas; j++) {
+		sep_memo_ent_t *ent = sep_memo_claim(enc, j);
+
+		for (size_t k = 0; k < ev->n_cands; k++)
+			ent->sep[infos[k]] = RA_EVAL_SEP(ev, k, j);
+		ent->valid |= misses;
+	}
+}
 
+static void
+ra_construct(tcas_RA_t *ra, const tcas_acf_t *my_acf,
+    const tcas_RA_info_t *ri, avl_tree_t *cpas, const SL_t *sl,
+    bool_t reversal, double initial_vs)
+{
+	memset(ra, 0, sizeof (*ra));
 	ra->info = ri;
 	ra->cpas = cpas;
 	ra->sl = sl;
 	ra->reversal = reversal;
-	ra->min_sep = 1e10;
-	for (cpa_t *cpa = avl_first(cpas); cpa != NULL;
-	    cpa = AVL_NEXT(cpas, cpa)) {
-		double sep = compute_separation(my_acf, cpa, ri, delay_t,
-		    accel);
-		ra->min_sep = MIN(sep, ra->min_sep);
-		/*
-		 * An encounter is crossing if either:
-		 * 1)
-		 *	a: the RA sense is upward
-		 *	b: currently we are below the intruder
-		 * 2)
-		 *	a: the RA sense is downward
-		 *	b: currently we are above the intruder
-		 */
-		ra->crossing |= ((ri->sense == RA_SENSE_UPWARD &&
-		    cpa->acf_b->cur_pos_3d.z - cpa->acf_a->cur_pos_3d.z >
-		    EQ_ALT_THRESH) ||
-		    (ri->sense == RA_SENSE_DOWNWARD &&
-		    cpa->acf_a->cur_pos_3d.z - cpa->acf_b->cur_pos_3d.z >
-		    EQ_ALT_THRESH));
-
+	ra->initial_vs = initial_vs;
+	if (my_acf->vvel < ri->vs.out.min) {
+		ra->vs_corr_reqd = roundmul(ri->vs.out.min - my_acf->vvel,
+		    ALT_ROUND_MUL);
+	} else if (my_acf->vvel > ri->vs.out.max) {
+		ra->vs_corr_reqd = roundmul(ri->vs.out.max - my_acf->vvel,
+		    ALT_ROUND_MUL);
 	}
+}
+
+/*
+ * Fills in the fields of `ra' which depend on min_sep, once ra_enc_eval
+ * has computed it.
+ */
+static void
+ra_complete(tcas_RA_t *ra, const ra_enc_t *enc)
+{
 	ASSERT(isfinite(ra->min_sep));
-	ra->alim_achieved = (ra->min_sep >= sl->alim_RA);
+	ra->crossing = enc->crosses[ra->info->sense];
+	ra->alim_achieved = (ra->min_sep >= ra->sl->alim_RA);
 	/*
 	 * min_sep is computed with a maneuver in mind. We want to
 	 * nullify that and provide some buffer so that another RA
 	 * won't be triggered. So we use the TA zthr instead of RA.
 	 */
-	ra->zthr_achieved = (ra->min_sep >= sl->zthr_TA);
-
-	return (ra);
+	ra->zthr_achieved = (ra->min_sep >= ra->sl->zthr_TA);
 }
 
-static void
-CAS_logic_normal(const tcas_acf_t *my_acf, const tcas_RA_t *prev_ra,
-    avl_tree_t *cpas, const SL_t *sl, bool_t prev_only, avl_tree_t *prio)
+/*
+ * Culls the RA infos which aren't applicable to the encounter, evaluates
+ * the remaining ones and stores the acceptable RAs in `cands'. Returns
+ * the number of acceptable RAs.
+ */
+static size_t
+CAS_logic_normal(const xtcas_params_t *params, const tcas_acf_t *my_acf,
+    const tcas_RA_t *prev_ra, double initial_vs, avl_tree_t *cpas,
+    const SL_t *sl, ra_enc_t *enc, tcas_RA_t *cands)
 {
 	bool_t initial = (prev_ra == NULL);
 	double delay_t = (initial ? INITIAL_RA_DELAY : SUBSEQ_RA_DELAY);
 	double accel = (initial ? INITIAL_RA_D_VVEL : SUBSEQ_RA_D_VVEL);
-
-	avl_create(prio, ra_compar_normal, sizeof (tcas_RA_t),
-	    offsetof(tcas_RA_t, node));
+	size_t n = 0, m = 0;
 
 	for (int i = 0; i < NUM_RA_INFOS; i++) {
 		const tcas_RA_info_t *ri = &RA_info[i];
@@ -1672,8 +2399,6 @@ CAS_logic_normal(const tcas_acf_t *my_acf, const tcas_RA_t *prev_ra,
 		tcas_RA_type_t prev_type = (prev_ra != NULL ?
 		    prev_ra->info->type : -1u);
 		tcas_msg_t msg = ri->msg;
-		double penalty = 0;
-		tcas_RA_t *ra;
 
 		ASSERT3U(ri->msg, >=, 0);
 		ASSERT3U(ri->msg, <, RA_NUM_MSGS);
@@ -1697,12 +2422,6 @@ CAS_logic_normal(const tcas_acf_t *my_acf, const tcas_RA_t *prev_ra,
 			    PRINTF_RI_ARGS(ri));
 			continue;
 		}
-		/* select preventive-only RAs if requested */
-		if (prev_only && ri->type != RA_TYPE_PREVENTIVE) {
-			dbg_log(ra, 4, "CULLRI(norm) PREV " PRINTF_RI_FMT,
-			    PRINTF_RI_ARGS(ri));
-			continue;
-		}
 		/* above FL480 we want to inhibit climb RAs. */
 		if (my_acf->cur_pos.elev > INHIBIT_CLB_RA &&
 		    ri->sense == RA_SENSE_UPWARD) {
@@ -1787,51 +2506,96 @@ CAS_logic_normal(const tcas_acf_t *my_acf, const tcas_RA_t *prev_ra,
 			continue;
 		}
 
-		ra = ra_construct(my_acf, ri, cpas, sl, delay_t, accel,
-		    reversal);
+		ra_construct(&cands[n++], my_acf, ri, cpas, sl, reversal,
+		    initial_vs);
+	}
+
+	ra_enc_eval(enc, cands, n, delay_t, accel);
+
+	for (size_t i = 0; i < n; i++) {
+		tcas_RA_t *ra = &cands[i];
+		const tcas_RA_info_t *ri = ra->info;
+		double penalty = 0;
+
+		ra_complete(ra, enc);
 		if (ra->crossing)
-			penalty += CROSSING_RA_PENALTY;
+			penalty += params->crossing_RA_penalty;
 		if (ra->reversal)
-			penalty += CROSSING_RA_PENALTY;
+			penalty += params->reversal_RA_penalty;
 		ra->min_sep -= ABS(ra->min_sep) * penalty;
-		if (my_acf->vvel < ri->vs.out.min) {
-			ra->vs_corr_reqd = roundmul(ri->vs.out.min -
-			    my_acf->vvel, ALT_ROUND_MUL);
-		} else if (my_acf->vvel > ri->vs.out.max) {
-			ra->vs_corr_reqd = roundmul(ri->vs.out.max -
-			    my_acf->vvel, ALT_ROUND_MUL);
-		}
 
 		/* Honor the RI's crossing restriction. */
 		if ((ri->cross == RA_CROSS_REQ && !ra->crossing) ||
 		    (ri->cross == RA_CROSS_REJ && ra->crossing)) {
 			dbg_log(ra, 4, "CULLRA(norm) cross restr "
 			    PRINTF_RA_FMT, PRINTF_RA_ARGS(ra));
-			free(ra);
+			continue;
+		}
+		dbg_log(ra, 4, "ADD(norm) " PRINTF_RA_FMT, PRINTF_RA_ARGS(ra));
+		if (m != i)
+			cands[m] = *ra;
+		m++;
+	}
+
+	return (m);
+}
+
+/*
+ * Moves the preventive RAs in `cands' which give ALIM to the front,
+ * keeping their order, and returns their number. We are not guaranteed
+ * to find a suitable preventive RA if the preventive RA has vertical
+ * speed ranges that might cause us to dip into the alim threshold. In
+ * those cases, all of the candidates are kept, so that a corrective RA
+ * can be picked instead.
+ */
+static size_t
+select_prev_RAs(tcas_RA_t *cands, size_t n)
+{
+	size_t m = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		tcas_RA_t *ra = &cands[i];
+
+		if (ra->info->type != RA_TYPE_PREVENTIVE) {
+			dbg_log(ra, 4, "CULLRA(norm) PREV " PRINTF_RA_FMT,
+			    PRINTF_RA_ARGS(ra));
 			continue;
 		}
 		/* Don't accept a preventive RA which doesn't give ALIM. */
-		if (prev_only && !ra->alim_achieved) {
+		if (!ra->alim_achieved) {
 			dbg_log(ra, 4, "CULLRA(norm) PREV(w/o alim) "
 			    PRINTF_RA_FMT, PRINTF_RA_ARGS(ra));
-			free(ra);
 			continue;
 		}
-		dbg_log(ra, 4, "ADD(norm) " PRINTF_RA_FMT, PRINTF_RA_ARGS(ra));
-		avl_add(prio, ra);
+		if (m != i) {
+			tcas_RA_t tmp = cands[m];
+
+			cands[m] = *ra;
+			*ra = tmp;
+		}
+		m++;
 	}
+	if (m == 0) {
+		dbg_log(ra, 2, "no preventive RA gives ALIM, trying "
+		    "corrective RAs");
+		return (n);
+	}
+
+	return (m);
 }
 
-static void
+/*
+ * Same as CAS_logic_normal, but for slow-closure encounters.
+ */
+static size_t
 CAS_logic_slow(const tcas_acf_t *my_acf, const tcas_RA_t *prev_ra,
-    avl_tree_t *cpas, const SL_t *sl, avl_tree_t *prio)
+    double initial_vs, avl_tree_t *cpas, const SL_t *sl, ra_enc_t *enc,
+    tcas_RA_t *cands)
 {
 	bool_t initial = (prev_ra == NULL);
 	double delay_t = (initial ? INITIAL_RA_DELAY : SUBSEQ_RA_DELAY);
 	double accel = (initial ? INITIAL_RA_D_VVEL : SUBSEQ_RA_D_VVEL);
-
-	avl_create(prio, ra_compar_slow, sizeof (tcas_RA_t),
-	    offsetof(tcas_RA_t, node));
+	size_t n = 0;
 
 	for (int i = 0; i < NUM_RA_INFOS; i++) {
 		const tcas_RA_info_t *ri = &RA_info[i];
@@ -1842,7 +2606,6 @@ CAS_logic_slow(const tcas_acf_t *my_acf, const tcas_RA_t *prev_ra,
 		bool_t reversal = (prev_sense != RA_SENSE_LEVEL_OFF &&
 		    ri->sense != RA_SENSE_LEVEL_OFF && prev_sense != ri->sense);
 		tcas_msg_t msg = ri->msg;
-		tcas_RA_t *ra;
 
 		ASSERT3U(ri->msg, >=, 0);
 		ASSERT3U(ri->msg, <, RA_NUM_MSGS);
@@ -1914,30 +2677,43 @@ CAS_logic_slow(const tcas_acf_t *my_acf, const tcas_RA_t *prev_ra,
 			continue;
 		}
 
-		ra = ra_construct(my_acf, ri, cpas, sl, delay_t, accel,
-		    reversal);
-		if (my_acf->vvel < ri->vs.out.min) {
-			ra->vs_corr_reqd = roundmul(ri->vs.out.min -
-			    my_acf->vvel, ALT_ROUND_MUL);
-		} else if (my_acf->vvel > ri->vs.out.max) {
-			ra->vs_corr_reqd = roundmul(ri->vs.out.max -
-			    my_acf->vvel, ALT_ROUND_MUL);
-		}
+		ra_construct(&cands[n++], my_acf, ri, cpas, sl, reversal,
+		    initial_vs);
+	}
+
+	ra_enc_eval(enc, cands, n, delay_t, accel);
 
-		dbg_log(ra, 4, "ADD(slow) " PRINTF_RA_FMT, PRINTF_RA_ARGS(ra));
-		avl_add(prio, ra);
+	for (size_t i = 0; i < n; i++) {
+		ra_complete(&cands[i], enc);
+		dbg_log(ra, 4, "ADD(slow) " PRINTF_RA_FMT,
+		    PRINTF_RA_ARGS(&cands[i]));
 	}
+
+	return (n);
 }
 
+/*
+ * Picks the best RA for the RA threats in `cpas'. All candidate RAs are
+ * evaluated in one pass of the RA evaluation kernel and the best one is
+ * then picked with a single linear scan. Candidates whose separations
+ * are still in `memo' from a previous evaluation with nearly the same
+ * geometry skip the kernel. The returned RA is allocated from `arena'
+ * and so is only valid until the end of the cycle. Returns NULL if the
+ * previous RA should stay in effect.
+ */
 static tcas_RA_t *
-CAS_logic(const tcas_acf_t *my_acf, const tcas_RA_t *prev_ra, avl_tree_t *cpas,
-    const SL_t *sl, bool_t prev_only, bool_t slow_closure)
+CAS_logic(arena_t *arena, sep_memo_t *memo, const xtcas_params_t *params,
+    const tcas_acf_t *my_acf, const tcas_RA_t *prev_ra, double initial_vs,
+    avl_tree_t *cpas, const SL_t *sl, bool_t prev_only, bool_t slow_closure,
+    unsigned *num_cands)
 {
 	bool_t initial = (prev_ra == NULL);
 	const cpa_t *last_cpa = avl_last(cpas);
-	avl_tree_t prio;
-	tcas_RA_t *ra, *xra;
-	void *cookie;
+	int (*compar)(const tcas_RA_t *, const tcas_RA_t *) =
+	    (slow_closure ? ra_compar_slow : ra_compar_normal);
+	ra_enc_t enc;
+	tcas_RA_t *cands, *ra;
+	size_t n;
 
 	ASSERT(last_cpa != NULL);
 
@@ -1947,41 +2723,30 @@ CAS_logic(const tcas_acf_t *my_acf, const tcas_RA_t *prev_ra, avl_tree_t *cpas,
 	if (!initial && last_cpa->d_t < SUBSEQ_RA_DELAY)
 		return (NULL);
 
+	ra_enc_setup(arena, my_acf, cpas, !initial, memo, &enc);
+	cands = xtcas_arena_alloc(arena, NUM_RA_INFOS * sizeof (*cands));
+
 	if (!slow_closure) {
-		CAS_logic_normal(my_acf, prev_ra, cpas, sl, prev_only, &prio);
-		/*
-		 * We are not guaranteed to find a suitable preventive RA if
-		 * the preventive RA has vertical speed ranges that might cause
-		 * us to dip into the alim threshold. In those cases, try to
-		 * look for a corrective RA instead.
-		 */
-		if (prev_only && avl_numnodes(&prio) == 0) {
-			avl_destroy(&prio);
-			CAS_logic_normal(my_acf, prev_ra, cpas, sl, B_FALSE,
-			    &prio);
-		}
+		n = CAS_logic_normal(params, my_acf, prev_ra, initial_vs, cpas,
+		    sl, &enc, cands);
+		if (prev_only)
+			n = select_prev_RAs(cands, n);
 	} else {
-		CAS_logic_slow(my_acf, prev_ra, cpas, sl, &prio);
+		n = CAS_logic_slow(my_acf, prev_ra, initial_vs, cpas, sl,
+		    &enc, cands);
 	}
 
-	ASSERT(avl_numnodes(&prio) != 0 || !initial);
+	ASSERT(n != 0 || !initial);
+	*num_cands += n;
 
-	if (xtcas_dbg.ra >= 2) {
-		for (tcas_RA_t *ra = avl_first(&prio); ra != NULL;
-		    ra = AVL_NEXT(&prio, ra)) {
-			dbg_log(ra, 2, "AVAIL " PRINTF_RA_FMT,
-			    PRINTF_RA_ARGS(ra));
-		}
+	ra = NULL;
+	for (size_t i = 0; i < n; i++) {
+		dbg_log(ra, 2, "AVAIL " PRINTF_RA_FMT,
+		    PRINTF_RA_ARGS(&cands[i]));
+		if (ra == NULL || compar(&cands[i], ra) < 0)
+			ra = &cands[i];
 	}
 
-	ra = avl_first(&prio);
-	if (ra != NULL)
-		avl_remove(&prio, ra);
-	cookie = NULL;
-	while ((xra = avl_destroy_nodes(&prio, &cookie)) != NULL)
-		free(xra);
-	avl_destroy(&prio);
-
 	/*
 	 * Now that we have an RA, we need to determine if it's sensible
 	 * given the previously issued RA.
@@ -1991,7 +2756,6 @@ CAS_logic(const tcas_acf_t *my_acf, const tcas_RA_t *prev_ra, avl_tree_t *cpas,
 		if (ra->info->type == prev_ra->info->type &&
 		    ra->info->vs.out.min == prev_ra->info->vs.out.min &&
 		    ra->info->vs.out.max == prev_ra->info->vs.out.max) {
-			free(ra);
 			return (NULL);
 		}
 	}
@@ -2003,19 +2767,33 @@ static void
 destroy_RA_hints(avl_tree_t *RA_hints)
 {
 	void *cookie = NULL;
-	tcas_RA_hint_t *hint;
-	while ((hint = avl_destroy_nodes(RA_hints, &cookie)) != NULL)
-		free(hint);
+	while (avl_destroy_nodes(RA_hints, &cookie) != NULL)
+		;
 }
 
+/*
+ * Builds the RA hints for the next cycle. The hints are stored in the
+ * context's hint array, so RA_hints must have been emptied first.
+ */
 static void
-construct_RA_hints(avl_tree_t *RA_hints, avl_tree_t *RA_cpas)
+construct_RA_hints(xtcas_ctx_t *ctx, avl_tree_t *RA_hints,
+    avl_tree_t *RA_cpas)
 {
-	ASSERT(tcas_state.adv_state == ADV_STATE_RA ||
-	    avl_numnodes(RA_cpas) == 0);
+	size_t n = avl_numnodes(RA_cpas);
+	size_t i = 0;
+
+	ASSERT(ctx->state.adv_state == ADV_STATE_RA || n == 0);
+	ASSERT0(avl_numnodes(RA_hints));
+	if (n > ctx->hints_cap) {
+		ctx->hints_cap = MAX(n, 2 * ctx->hints_cap);
+		ctx->hints = ctx_realloc(ctx, ctx->hints,
+		    ctx->hints_cap * sizeof (*ctx->hints));
+	}
 	for (cpa_t *cpa = avl_first(RA_cpas); cpa != NULL;
 	    cpa = AVL_NEXT(RA_cpas, cpa)) {
-		tcas_RA_hint_t *hint = safe_calloc(1, sizeof (*hint));
+		tcas_RA_hint_t *hint = &ctx->hints[i++];
+
+		memset(hint, 0, sizeof (*hint));
 		hint->acf_id = cpa->acf_b->acf_id;
 		hint->level = cpa->acf_b->threat;
 		ASSERT3U(hint->level, >=, RA_THREAT_PREV);
@@ -2024,6 +2802,23 @@ construct_RA_hints(avl_tree_t *RA_hints, avl_tree_t *RA_cpas)
 	}
 }
 
+/*
+ * Annunciates an audio message on behalf of a context. The built-in sound
+ * system is a process-wide resource, so only the default context drives
+ * it. Every context reports the message to its host through the optional
+ * play_audio_msg output op.
+ */
+static void
+play_msg(const xtcas_ctx_t *ctx, tcas_msg_t msg)
+{
+#ifndef	XTCAS_NO_AUDIO
+	if (ctx == &dflt_ctx)
+		xtcas_play_msg(msg);
+#endif
+	if (ctx->out_ops != NULL && ctx->out_ops->play_audio_msg != NULL)
+		ctx->out_ops->play_audio_msg(ctx->out_ops->handle, msg);
+}
+
 #if	GTS820_MODE
 
 /*
@@ -2032,7 +2827,8 @@ construct_RA_hints(avl_tree_t *RA_hints, avl_tree_t *RA_cpas)
  * "<high|low|same altitude>", "<distance in NM>").
  */
 static void
-gts820_TA_play_msg(const tcas_acf_t *my_acf, const list_t *new_TA_threats)
+gts820_TA_play_msg(xtcas_ctx_t *ctx, const tcas_acf_t *my_acf,
+    const list_t *new_TA_threats)
 {
 	vect2_t my_pos_2d = VECT3_TO_VECT2(my_acf->cur_pos_3d);
 	tcas_msg_t *msgs;
@@ -2043,7 +2839,7 @@ gts820_TA_play_msg(const tcas_acf_t *my_acf, const list_t *new_TA_threats)
 
 	i = 0;
 	n = (4 * list_count(new_TA_threats)) + 1;
-	msgs = safe_calloc(n, sizeof (*msgs));
+	msgs = xtcas_arena_alloc(&ctx->arena, n * sizeof (*msgs));
 	msgs[n - 1] = -1u;
 
 	for (tcas_acf_t *acf = list_head(new_TA_threats); acf != NULL;
@@ -2075,17 +2871,85 @@ gts820_TA_play_msg(const tcas_acf_t *my_acf, const list_t *new_TA_threats)
 		msgs[i++] = dist_msg;
 	}
 
-	xtcas_play_msgs(msgs);
-
-	free(msgs);
+	if (ctx == &dflt_ctx)
+		xtcas_play_msgs(msgs);
 }
 
 #endif	/* GTS820_MODE */
 
+/*
+ * Threat classification of one cycle's contacts. The threat levels are
+ * first determined for all contacts into `threats' and `slow_closure',
+ * possibly on several threads (see classify_threats). Only then are
+ * they applied to the contacts by resolve_CPAs.
+ */
+typedef struct {
+	const xtcas_ctx_t	*ctx;
+	const tcas_acf_t	*my_acf;
+	const acf_snap_t	*snap;
+	const SL_t		*sl;
+	avl_tree_t		*RA_hints;
+	uint64_t		now;
+	tcas_threat_t		*threats;
+	bool_t			*slow_closure;
+} threat_job_t;
+
+static void
+classify_threats_range(void *arg, size_t start, size_t end)
+{
+	threat_job_t *job = arg;
+
+	for (size_t i = start; i < end; i++) {
+		const tcas_acf_t *acf = &job->snap->acf[i];
+
+		job->slow_closure[i] = acf->slow_closure;
+		job->threats[i] = assign_threat_level(job->ctx, job->my_acf,
+		    acf, job->sl, job->RA_hints, job->now,
+		    &job->slow_closure[i]);
+	}
+}
+
+/*
+ * Determines the threat levels of all contacts in `job->snap'. If the
+ * host asked for more than one thread, large contact sets are split
+ * across the threat_pool threads. Since every
+ * contact is classified independently, the result is the same either
+ * way.
+ */
+static void
+classify_threats(xtcas_ctx_t *ctx, threat_job_t *job)
+{
+	size_t n = job->snap->num_acf;
+	unsigned nthreads;
+
+	if (n < THREAT_PAR_MIN_ACF) {
+		classify_threats_range(job, 0, n);
+		return;
+	}
+
+	mutex_enter(&ctx->snap_lock);
+	nthreads = ctx->threat_threads;
+	mutex_exit(&ctx->snap_lock);
+
+	if (nthreads == 1) {
+		classify_threats_range(job, 0, n);
+		return;
+	}
+	if (ctx->threat_pool.nthreads != nthreads) {
+		dbg_log(threat, 1, "starting %u threat classification "
+		    "threads", nthreads);
+		xtcas_pool_fini(&ctx->threat_pool);
+		xtcas_pool_init(&ctx->threat_pool, nthreads);
+	}
+	xtcas_pool_run(&ctx->threat_pool, classify_threats_range, job, n);
+}
+
 static void
-resolve_CPAs(tcas_acf_t *my_acf, avl_tree_t *other_acf, avl_tree_t *cpas,
+resolve_CPAs(xtcas_ctx_t *ctx, tcas_acf_t *my_acf, acf_snap_t *snap,
     const SL_t *sl, avl_tree_t *RA_hints, uint64_t now)
 {
+	const sim_intf_output_ops_t *out_ops = ctx->out_ops;
+	uint64_t state_chg_delay = SEC2USEC(ctx->cur_params.state_chg_delay);
 	bool_t TA_found = B_FALSE;
 	bool_t RA_prev_found = B_FALSE;
 	bool_t RA_corr_found = B_FALSE;
@@ -2093,6 +2957,10 @@ resolve_CPAs(tcas_acf_t *my_acf, avl_tree_t *other_acf, avl_tree_t *cpas,
 	avl_tree_t RA_cpas;
 	void *cookie;
 	list_t new_TA_threats;
+	threat_job_t job = {
+	    .ctx = ctx, .my_acf = my_acf, .snap = snap, .sl = sl,
+	    .RA_hints = RA_hints, .now = now
+	};
 
 	/*
 	 * List of newly discovered TA threats during this cycle. This is
@@ -2102,12 +2970,18 @@ resolve_CPAs(tcas_acf_t *my_acf, avl_tree_t *other_acf, avl_tree_t *cpas,
 	    offsetof(tcas_acf_t, new_TA_node));
 
 	/* Re-assign threat level as necessary. */
-	for (tcas_acf_t *acf = avl_first(other_acf); acf != NULL;
-	    acf = AVL_NEXT(other_acf, acf)) {
+	job.threats = xtcas_arena_alloc(&ctx->arena,
+	    snap->num_acf * sizeof (*job.threats));
+	job.slow_closure = xtcas_arena_alloc(&ctx->arena,
+	    snap->num_acf * sizeof (*job.slow_closure));
+	classify_threats(ctx, &job);
+
+	for (size_t i = 0; i < snap->num_acf; i++) {
+		tcas_acf_t *acf = &snap->acf[i];
 		bool_t non_TA = (acf->threat < TA_THREAT);
 
-		assign_threat_level(my_acf, acf, sl, RA_hints,
-		    tcas_state.filter, now);
+		acf->threat = job.threats[i];
+		acf->slow_closure = job.slow_closure[i];
 
 		TA_found |= (acf->threat == TA_THREAT);
 		RA_prev_found |= (acf->threat == RA_THREAT_PREV);
@@ -2131,40 +3005,49 @@ resolve_CPAs(tcas_acf_t *my_acf, avl_tree_t *other_acf, avl_tree_t *cpas,
 		 * encounters).
 		 */
 		tcas_RA_t *ra;
-		double d_t = NAN;
+		double d_t;
 
-		for (cpa_t *cpa = avl_first(cpas); cpa != NULL;
-		    cpa = AVL_NEXT(cpas, cpa)) {
-			if (cpa->acf_b->threat <= TA_THREAT)
-				continue;
-			if (isnan(d_t))
-				d_t = cpa->d_t;
-			ASSERT3F(d_t, <=, cpa->d_t);
-			if (d_t <= cpa->d_t + INITIAL_RA_DELAY)
+		/*
+		 * Only the RA threats' CPAs need to be in time order, so
+		 * rather than sorting all CPAs, we only sort those.
+		 */
+		for (size_t i = 0; i < ctx->num_cpas; i++) {
+			cpa_t *cpa = &ctx->cpas[i];
+
+			if (cpa->acf_b->threat > TA_THREAT)
 				avl_add(&RA_cpas, cpa);
 		}
-		ASSERT(!isnan(d_t));
 		ASSERT(avl_numnodes(&RA_cpas) != 0);
+		d_t = ((cpa_t *)avl_first(&RA_cpas))->d_t;
+		for (cpa_t *cpa = avl_first(&RA_cpas), *cpa_next;
+		    cpa != NULL; cpa = cpa_next) {
+			cpa_next = AVL_NEXT(&RA_cpas, cpa);
+			if (d_t > cpa->d_t + INITIAL_RA_DELAY)
+				avl_remove(&RA_cpas, cpa);
+		}
 
 		dbg_log(ra, 1, "resolve_CPAs: RA  count:%lu  adv_state:%d  "
 		    "elapsed:%.0f", avl_numnodes(&RA_cpas),
-		    tcas_state.adv_state,
-		    (now - tcas_state.change_t) / 1000000.0);
+		    ctx->state.adv_state,
+		    (now - ctx->state.change_t) / 1000000.0);
 
-		ra = CAS_logic(my_acf, tcas_state.ra, &RA_cpas, sl,
+		ra = CAS_logic(&ctx->arena, &ctx->sep_memo, &ctx->cur_params,
+		    my_acf, ctx->state.ra, ctx->state.initial_ra_vs, &RA_cpas,
+		    sl,
 		    /*
 		     * A preventive RA is only guaranteed to be found when
 		     * climbing/descending below the maximum preventive RA
 		     * vertical rate value.
 		     */
 		    RA_prev_found && !RA_corr_found &&
-		    ABS(my_acf->vvel) < FPM2MPS(2000), slow_closure_only);
+		    ABS(my_acf->vvel) < FPM2MPS(2000), slow_closure_only,
+		    &ctx->num_RA_cands);
 		/* On initial annunciation, we must ALWAYS issue an RA */
-		ASSERT(ra != NULL || tcas_state.ra != NULL);
+		ASSERT(ra != NULL || ctx->state.ra != NULL);
 
-		if (tcas_state.adv_state != ADV_STATE_RA) {
+		if (ctx->state.adv_state != ADV_STATE_RA) {
 			/* memorize what VS we started at */
-			tcas_state.initial_ra_vs = my_acf->vvel;
+			ctx->state.initial_ra_vs = my_acf->vvel;
 		}
 
 		if (ra != NULL) {
@@ -2181,18 +3064,22 @@ resolve_CPAs(tcas_acf_t *my_acf, avl_tree_t *other_acf, avl_tree_t *cpas,
 				    ra->info->sense, ra->crossing,
 				    ra->reversal, ra->min_sep);
 			}
-			if (now - tcas_state.change_t >= STATE_CHG_DELAY) {
+			if (now - ctx->state.change_t >= state_chg_delay) {
 				tcas_msg_t prev_msg = -1;
 				tcas_msg_t msg;
 				const tcas_RA_info_t *ri = ra->info;
 				double min_green = 0, max_green = 0;
-				if (tcas_state.ra != NULL) {
-					prev_msg = tcas_state.ra->info->msg;
-					free(tcas_state.ra);
-				}
-				tcas_state.ra = ra;
-				tcas_state.change_t = now;
-				tcas_state.adv_state = ADV_STATE_RA;
+				if (ctx->state.ra != NULL)
+					prev_msg = ctx->state.ra->info->msg;
+				/*
+				 * `ra' lives in the cycle arena, so copy it
+				 * out to keep it for the next cycles.
+				 */
+				ctx->state.ra_store = *ra;
+				ra = &ctx->state.ra_store;
+				ctx->state.ra = ra;
+				ctx->state.change_t = now;
+				ctx->state.adv_state = ADV_STATE_RA;
 				/* Filter out pointless annunciations */
 				msg = RA_msg_sequence_check(prev_msg,
 				    ra->reversal ? ra->info->rev_msg :
@@ -2212,17 +3099,8 @@ resolve_CPAs(tcas_acf_t *my_acf, avl_tree_t *other_acf, avl_tree_t *cpas,
 				inhibit_audio = (my_acf->agl < INHIBIT_AUDIO ||
 				    my_acf->on_ground);
 #endif	/* !GTS820_MODE */
-				if ((int)msg != -1 && !inhibit_audio) {
-#ifndef	XTCAS_NO_AUDIO
-					xtcas_play_msg(msg);
-#endif
-					if (out_ops != NULL &&
-					    out_ops->play_audio_msg != NULL) {
-						out_ops->play_audio_msg(
-						    out_ops->handle,
-						    msg);
-					}
-				}
+				if ((int)msg != -1 && !inhibit_audio)
+					play_msg(ctx, msg);
 				if (ra->info->type == RA_TYPE_CORRECTIVE) {
 					min_green = ra->info->vs.out.min;
 					max_green = ra->info->vs.out.max;
@@ -2249,7 +3127,6 @@ resolve_CPAs(tcas_acf_t *my_acf, avl_tree_t *other_acf, avl_tree_t *cpas,
 				while ((avl_destroy_nodes(&RA_cpas, &cookie)) !=
 				    NULL)
 					;
-				free(ra);
 			}
 		}
 	} else if (TA_found) {
@@ -2260,65 +3137,49 @@ resolve_CPAs(tcas_acf_t *my_acf, avl_tree_t *other_acf, avl_tree_t *cpas,
 		 * while the traffic still falls into the TA range.
 		 */
 		dbg_log(tcas, 1, "resolve_CPAs: TA  adv_state:%d  "
-		    "elapsed:%.0f", tcas_state.adv_state,
-		    (now - tcas_state.change_t) / 1000000.0);
+		    "elapsed:%.0f", ctx->state.adv_state,
+		    (now - ctx->state.change_t) / 1000000.0);
 		if (
 #if	GTS820_MODE
 		    list_count(&new_TA_threats) != 0
 #else	/* !GTS820_MODE */
-		    tcas_state.adv_state < ADV_STATE_TA &&
-		    now - tcas_state.change_t >= STATE_CHG_DELAY
+		    ctx->state.adv_state < ADV_STATE_TA &&
+		    now - ctx->state.change_t >= state_chg_delay
 #endif	/* !GTS820_MODE */
 		    ) {
 			if (my_acf->agl > INHIBIT_AUDIO || isnan(my_acf->agl)) {
 #if	GTS820_MODE
-				gts820_TA_play_msg(my_acf, &new_TA_threats);
+				gts820_TA_play_msg(ctx, my_acf,
+				    &new_TA_threats);
 #else	/* !GTS820_MODE */
-#ifndef	XTCAS_NO_AUDIO
-				xtcas_play_msg(RA_MSG_TFC);
-#endif
-				if (out_ops != NULL &&
-				    out_ops->play_audio_msg != NULL) {
-					out_ops->play_audio_msg(out_ops->handle,
-					    RA_MSG_TFC);
-				}
+				play_msg(ctx, RA_MSG_TFC);
 #endif	/* !GTS820_MODE */
 			}
-			free(tcas_state.ra);
-			tcas_state.ra = NULL;
-			tcas_state.initial_ra_vs = NAN;
-			tcas_state.adv_state = ADV_STATE_TA;
+			ctx->state.ra = NULL;
+			ctx->state.initial_ra_vs = NAN;
+			ctx->state.adv_state = ADV_STATE_TA;
 			if (out_ops != NULL) {
 				out_ops->update_RA(out_ops->handle,
 				    ADV_STATE_TA, RA_MSG_TFC, -1, -1, B_FALSE,
 				    B_FALSE, 0, 0, 0, 0, 0, 0, 0);
 			}
 		}
-	} else if (tcas_state.adv_state != ADV_STATE_NONE &&
-	    now - tcas_state.change_t >= STATE_CHG_DELAY) {
+	} else if (ctx->state.adv_state != ADV_STATE_NONE &&
+	    now - ctx->state.change_t >= state_chg_delay) {
 		dbg_log(tcas, 1, "resolve_CPAs: NONE  adv_state:%d  "
-		    "elapsed:%.0f", tcas_state.adv_state,
-		    (now - tcas_state.change_t) / 1000000.0);
-		if (tcas_state.adv_state == ADV_STATE_RA) {
-#ifndef	XTCAS_NO_AUDIO
-			xtcas_play_msg(RA_MSG_CLEAR);
-#endif	/* !defined(XTCAS_NO_AUDIO) */
-			if (out_ops != NULL &&
-			    out_ops->play_audio_msg != NULL) {
-				out_ops->play_audio_msg(out_ops->handle,
-				    RA_MSG_CLEAR);
-			}
-		}
-		free(tcas_state.ra);
+		    "elapsed:%.0f", ctx->state.adv_state,
+		    (now - ctx->state.change_t) / 1000000.0);
+		if (ctx->state.adv_state == ADV_STATE_RA)
+			play_msg(ctx, RA_MSG_CLEAR);
 		if (out_ops != NULL) {
 			out_ops->update_RA(out_ops->handle, ADV_STATE_NONE,
 			    RA_MSG_CLEAR, -1, -1, B_FALSE, B_FALSE,
 			    0, 0, 0, 0, 0, 0, 0);
 		}
-		tcas_state.ra = NULL;
-		tcas_state.initial_ra_vs = NAN;
-		tcas_state.adv_state = ADV_STATE_NONE;
-		tcas_state.change_t = now;
+		ctx->state.ra = NULL;
+		ctx->state.initial_ra_vs = NAN;
+		ctx->state.adv_state = ADV_STATE_NONE;
+		ctx->state.change_t = now;
 	}
 
 	/*
@@ -2326,7 +3187,7 @@ resolve_CPAs(tcas_acf_t *my_acf, avl_tree_t *other_acf, avl_tree_t *cpas,
 	 * hard-marked as RA threats next time.
 	 */
 	destroy_RA_hints(RA_hints);
-	construct_RA_hints(RA_hints, &RA_cpas);
+	construct_RA_hints(ctx, RA_hints, &RA_cpas);
 
 	cookie = NULL;
 	while ((avl_destroy_nodes(&RA_cpas, &cookie)) != NULL)
@@ -2338,427 +3199,1062 @@ resolve_CPAs(tcas_acf_t *my_acf, avl_tree_t *other_acf, avl_tree_t *cpas,
 	list_destroy(&new_TA_threats);
 }
 
+/*
+ * Hands a contact frame to the avionics, either in one go if they
+ * support update_contacts_batch, or one contact at a time.
+ */
+static void
+deliver_contact_frame(const sim_intf_output_ops_t *out_ops,
+    const xtcas_contact_frame_t *frame)
+{
+	if (out_ops->update_contacts_batch != NULL) {
+		out_ops->update_contacts_batch(out_ops->handle, frame);
+		return;
+	}
+	for (size_t i = 0; i < frame->num_deleted; i++)
+		out_ops->delete_contact(out_ops->handle, frame->deleted[i]);
+	for (size_t i = 0; i < frame->num_contacts; i++) {
+		const xtcas_contact_t *ctc = &frame->contacts[i];
+
+		out_ops->update_contact(out_ops->handle, ctc->acf_id,
+		    ctc->rbrg, ctc->rdist, ctc->ralt, ctc->vs, ctc->trk,
+		    ctc->gs, ctc->level);
+	}
+}
+
+/*
+ * Makes sure the contact report buffers can hold `num_acf' contacts.
+ */
+static void
+ctc_rep_reserve(xtcas_ctx_t *ctx, size_t num_acf)
+{
+	if (num_acf > ctx->ctc_rep_cap) {
+		ctx->ctc_rep_cap = MAX(num_acf, 2 * ctx->ctc_rep_cap);
+		for (int i = 0; i < 2; i++) {
+			ctx->ctc_rep[i] = ctx_realloc(ctx, ctx->ctc_rep[i],
+			    ctx->ctc_rep_cap * sizeof (*ctx->ctc_rep[i]));
+		}
+	}
+}
+
+static inline bool_t
+ctc_val_changed(double old_val, double new_val, double delta)
+{
+	if (isnan(old_val) || isnan(new_val))
+		return (isnan(old_val) != isnan(new_val));
+	return (ABS(new_val - old_val) >= delta);
+}
+
+static inline bool_t
+ctc_hdg_changed(double old_hdg, double new_hdg, double delta)
+{
+	if (isnan(old_hdg) || isnan(new_hdg))
+		return (isnan(old_hdg) != isnan(new_hdg));
+	return (ABS(rel_hdg(old_hdg, new_hdg)) >= delta);
+}
+
+/*
+ * Checks if a contact has changed enough since it was last reported to
+ * the avionics (`old') to be worth reporting again.
+ */
+static bool_t
+ctc_changed(const xtcas_contact_t *old, const xtcas_contact_t *ctc)
+{
+	return (old->level != ctc->level ||
+	    ctc_hdg_changed(old->rbrg, ctc->rbrg, CTC_REPORT_BRG) ||
+	    ctc_val_changed(old->rdist, ctc->rdist, CTC_REPORT_DIST) ||
+	    ctc_val_changed(old->ralt, ctc->ralt, CTC_REPORT_ALT) ||
+	    ctc_val_changed(old->vs, ctc->vs, CTC_REPORT_VS) ||
+	    ctc_hdg_changed(old->trk, ctc->trk, CTC_REPORT_TRK) ||
+	    ctc_val_changed(old->gs, ctc->gs, CTC_REPORT_GS));
+}
+
+/*
+ * Tells the avionics about changes in our contacts. We remember what we
+ * last reported for each contact and only report contacts which are new,
+ * whose threat level has changed, or which have moved or changed their
+ * trend by more than the CTC_REPORT_* thresholds. Hidden contacts are
+ * deleted only once. Everything else counts as a suppressed report.
+ * Contacts which drop out of the snapshot are forgotten: those lost by
+ * the collector have already been deleted by it and the rest (during
+ * the system test) are reported as new when they come back.
+ */
 static void
-update_contacts(tcas_acf_t *my_acf, avl_tree_t *other_acf, bool_t test)
+update_contacts(xtcas_ctx_t *ctx, tcas_acf_t *my_acf, acf_snap_t *snap,
+    bool_t test)
 {
+	const sim_intf_output_ops_t *out_ops = ctx->out_ops;
 	vect2_t my_pos_2d = VECT3_TO_VECT2(my_acf->cur_pos_3d);
+	bool_t hide_all = (ctx->state.filter == TCAS_FILTER_THRT &&
+	    ctx->state.adv_state == ADV_STATE_NONE && !test);
+	ctc_report_t *old, *cur;
+	void **deleted;
+	xtcas_contact_t *contacts;
+	xtcas_contact_frame_t frame = { .num_deleted = 0 };
+	size_t j = 0;
+
+	if (out_ops == NULL)
+		return;
+
+	ctc_rep_reserve(ctx, snap->num_acf);
+	old = ctx->ctc_rep[0];
+	cur = ctx->ctc_rep[1];
+	deleted = xtcas_arena_alloc(&ctx->arena,
+	    snap->num_acf * sizeof (*deleted));
+	contacts = xtcas_arena_alloc(&ctx->arena,
+	    snap->num_acf * sizeof (*contacts));
+	frame.deleted = deleted;
+	frame.contacts = contacts;
 
 	/*
 	 * Badly behaved multiplayer plugins such as XSquawkBox tend not
 	 * to delete unused multiplayer aircraft, so they just sit in
-	 * space, stationary. Detect and remove those.
+	 * space, stationary. Those are kept out of the CPA computation
+	 * (see FALSE_CTC_SUPPRESS_GS), but are still displayed.
 	 */
-	for (tcas_acf_t *acf = avl_first(other_acf); acf != NULL;
-	    acf = AVL_NEXT(other_acf, acf)) {
-		if (acf->gs < FALSE_CTC_SUPPRESS_GS && !test &&
-		    out_ops != NULL)
-			out_ops->delete_contact(out_ops->handle, acf->acf_id);
-	}
-
-	if (tcas_state.filter == TCAS_FILTER_THRT &&
-	    tcas_state.adv_state == ADV_STATE_NONE && !test) {
-		for (tcas_acf_t *acf = avl_first(other_acf); acf != NULL;
-		    acf = AVL_NEXT(other_acf, acf)) {
-			if (out_ops != NULL) {
-				out_ops->delete_contact(out_ops->handle,
-				    acf->acf_id);
-			}
-		}
-	} else {
-		for (tcas_acf_t *acf = avl_first(other_acf); acf != NULL;
-		    acf = AVL_NEXT(other_acf, acf)) {
-			if (out_ops == NULL)
-				continue;
-			if (!acf->on_ground) {
-				vect2_t pos_2d =
-				    VECT3_TO_VECT2(acf->cur_pos_3d);
-				vect2_t d_pos_2d = vect2_sub(pos_2d, my_pos_2d);
-				double rdist = vect2_abs(d_pos_2d);
-				double rbrg = (rdist > 0 ?
-				    normalize_hdg(dir2hdg(d_pos_2d) -
-				    my_acf->hdg) : 0);
-				double ralt = acf->cur_pos_3d.z -
-				    my_acf->cur_pos_3d.z;
-				out_ops->update_contact(out_ops->handle,
-				    acf->acf_id, rbrg, rdist, ralt,
-				    acf->trend_data_ready ? acf->vvel : NAN,
-				    acf->trend_data_ready ? acf->trk : NAN,
-				    acf->trend_data_ready ? acf->gs : NAN,
-				    acf->threat);
+	for (size_t i = 0; i < snap->num_acf; i++) {
+		const tcas_acf_t *acf = &snap->acf[i];
+		const ctc_report_t *prev = NULL;
+		ctc_report_t *rep = &cur[i];
+		xtcas_contact_t *ctc = &rep->ctc;
+		vect2_t d_pos_2d;
+
+		while (j < ctx->num_ctc_rep && old[j].acf_id < acf->acf_id)
+			j++;
+		if (j < ctx->num_ctc_rep && old[j].acf_id == acf->acf_id &&
+		    old[j].seq == acf->seq)
+			prev = &old[j];
+		rep->acf_id = acf->acf_id;
+		rep->seq = acf->seq;
+
+		if (hide_all || acf->on_ground) {
+			rep->shown = B_FALSE;
+			if (prev != NULL && !prev->shown) {
+				ctx->num_ctc_suppressed++;
 			} else {
-				out_ops->delete_contact(out_ops->handle,
-				    acf->acf_id);
+				deleted[frame.num_deleted++] = acf->acf_id;
+				ctx->num_ctc_reported++;
 			}
+			continue;
+		}
+
+		rep->shown = B_TRUE;
+		d_pos_2d = vect2_sub(VECT3_TO_VECT2(acf->cur_pos_3d),
+		    my_pos_2d);
+		ctc->acf_id = acf->acf_id;
+		ctc->rdist = vect2_abs(d_pos_2d);
+		ctc->rbrg = (ctc->rdist > 0 ?
+		    normalize_hdg(dir2hdg(d_pos_2d) - my_acf->hdg) : 0);
+		ctc->ralt = acf->cur_pos_3d.z - my_acf->cur_pos_3d.z;
+		ctc->vs = (acf->trend_data_ready ? acf->vvel : NAN);
+		ctc->trk = (acf->trend_data_ready ? acf->trk : NAN);
+		ctc->gs = (acf->trend_data_ready ? acf->gs : NAN);
+		ctc->level = acf->threat;
+
+		if (prev != NULL && prev->shown &&
+		    !ctc_changed(&prev->ctc, ctc)) {
+			/*
+			 * Keep comparing against what the avionics have,
+			 * so that slow drift is eventually reported.
+			 */
+			*ctc = prev->ctc;
+			ctx->num_ctc_suppressed++;
+		} else {
+			contacts[frame.num_contacts++] = *ctc;
+			ctx->num_ctc_reported++;
 		}
 	}
+
+	ctx->ctc_rep[0] = cur;
+	ctx->ctc_rep[1] = old;
+	ctx->num_ctc_rep = snap->num_acf;
+
+	if (frame.num_deleted != 0 || frame.num_contacts != 0)
+		deliver_contact_frame(out_ops, &frame);
 }
 
+/*
+ * Adds the stage durations of one cycle (`ns', indexed by xtcas_stage_t)
+ * to the timing statistics.
+ */
 static void
-main_loop(void *ignored)
+update_timing(xtcas_ctx_t *ctx, const uint64_t ns[XTCAS_NUM_STAGES],
+    unsigned num_contacts)
 {
-	const SL_t *sl = NULL;
-	double last_t = in_ops->get_time(in_ops->handle);
-	avl_tree_t RA_hints;
-
-	thread_set_name("X-TCAS");
+	xtcas_timing_t *tm = &ctx->timing;
+
+	mutex_enter(&ctx->snap_lock);
+	for (int i = 0; i < XTCAS_NUM_STAGES; i++)
+		xtcas_stage_timing_add(&tm->stages[i], tm->num_cycles, ns[i]);
+	tm->num_cycles++;
+	tm->num_contacts = num_contacts;
+	tm->max_contacts = MAX(tm->max_contacts, num_contacts);
+	tm->num_RA_cands = ctx->num_RA_cands;
+	tm->max_RA_cands = MAX(tm->max_RA_cands, ctx->num_RA_cands);
+	tm->num_sep_lookups = ctx->sep_memo.num_lookups;
+	tm->num_sep_hits = ctx->sep_memo.num_hits;
+	tm->total_sep_lookups += ctx->sep_memo.num_lookups;
+	tm->total_sep_hits += ctx->sep_memo.num_hits;
+	tm->num_ctc_reported = ctx->num_ctc_reported;
+	tm->num_ctc_suppressed = ctx->num_ctc_suppressed;
+	tm->total_ctc_reported += ctx->num_ctc_reported;
+	tm->total_ctc_suppressed += ctx->num_ctc_suppressed;
+	tm->num_allocs = ctx->num_allocs + ctx->arena.num_heap_allocs;
+	mutex_exit(&ctx->snap_lock);
+}
 
-	dbg_log(tcas, 4, "main_loop: entry (%.1f)", last_t);
+/*
+ * Picks the interval until the next cycle and updates the scheduling
+ * statistics. While any contact is PROX or above, we run at the fast rate,
+ * otherwise we drop back to WORKER_LOOP_INTVAL.
+ *
+ * The decision latency is the time from a change in the traffic geometry
+ * to the end of the cycle which acts on it. The change can occur just
+ * after the previous position sample has been taken, so this is the time
+ * since that sample.
+ */
+static void
+update_sched(xtcas_ctx_t *ctx, const acf_snap_t *snap, bool_t test,
+    double prev_cycle_t, double now_t)
+{
+	xtcas_sched_stats_t *st = &ctx->sched_stats;
+	bool_t fast = B_FALSE;
+	double latency;
 
-	UNUSED(ignored);
-	ASSERT(inited);
+	for (size_t i = 0; !test && i < snap->num_acf; i++) {
+		if (snap->acf[i].threat >= PROX_THREAT) {
+			fast = B_TRUE;
+			break;
+		}
+	}
 
-	avl_create(&RA_hints, RA_hint_compar, sizeof (tcas_RA_hint_t),
-	    offsetof(tcas_RA_hint_t, node));
+	if (snap->t != ctx->sample_t) {
+		ctx->prev_sample_t = ctx->sample_t;
+		ctx->sample_t = snap->t;
+	}
 
-	mutex_enter(&worker_lock);
-	for (double now = microclock(); !worker_shutdown; now = microclock()) {
-		tcas_acf_t my_acf;
-		avl_tree_t other_acf, cpas;
-		double now_t = in_ops->get_time(in_ops->handle);
-		bool_t test;
+	mutex_enter(&ctx->snap_lock);
 
-		dbg_log(tcas, 4, "main_loop: start (%.1f)", now_t);
+	if (!isnan(ctx->prev_sample_t))
+		latency = now_t - ctx->prev_sample_t;
+	else
+		latency = ctx->cycle_intval + MAX(now_t - snap->t, 0);
+	if (st->num_cycles == 0) {
+		ctx->cycle_intval_avg = ctx->cycle_intval;
+	} else {
+		ctx->cycle_intval_avg += (now_t - prev_cycle_t -
+		    ctx->cycle_intval_avg) * CYCLE_RATE_FILT;
+	}
+	ctx->cycle_intval = (fast ? ctx->fast_intval : WORKER_LOOP_INTVAL);
 
-		/* If sim time hasn't advanced, we're paused. */
-		if (last_t >= now_t) {
-			dbg_log(tcas, 3, "main_loop: time hasn't progressed "
-			    "or STBY mode set (%d)", tcas_state.mode);
-			cv_timedwait(&worker_cv, &worker_lock,
-			    now + WORKER_LOOP_INTVAL_US);
-			continue;
-		}
+	st->num_cycles++;
+	st->fast = fast;
+	if (ctx->cycle_intval_avg > 0)
+		st->cycle_rate = 1 / ctx->cycle_intval_avg;
+	st->latency = latency;
+	st->max_latency = MAX(st->max_latency, latency);
 
-		mutex_enter(&tcas_state.test_lock);
+	mutex_exit(&ctx->snap_lock);
 
-		if (tcas_state.test_in_prog) {
-			if (isnan(tcas_state.test_start_time)) {
-				tcas_state.test_start_time = now_t;
+	dbg_log(tcas, 3, "sched: fast:%d  rate:%.1f Hz  latency:%.2f s  "
+	    "max:%.2f s", fast, st->cycle_rate, latency, st->max_latency);
+}
 
-				if (out_ops != NULL) {
-					/*
-					 * During a system test, we give a
-					 * normal climb indication on the PFD.
-					 */
+/*
+ * Picks up the tuning parameters last set using xtcas_ctx_set_params.
+ * The SL table is updated in place, so cur_sl stays valid and an RA in
+ * progress continues with the new thresholds of its SL.
+ */
+static void
+pickup_params(xtcas_ctx_t *ctx)
+{
+	bool_t chg;
+
+	mutex_enter(&ctx->snap_lock);
+	chg = ctx->params_chg;
+	if (chg) {
+		ctx->cur_params = ctx->params;
+		ctx->params_chg = B_FALSE;
+	}
+	mutex_exit(&ctx->snap_lock);
+	if (!chg)
+		return;
+
+	dbg_log(sl, 1, "new tuning parameters");
+	for (int i = 0; i < NUM_SL; i++) {
+		const xtcas_SL_params_t *p = &ctx->cur_params.SL[i];
+		SL_t *sl = &ctx->SL_table[i];
+
+		sl->tau_TA = p->tau_TA;
+		sl->tau_RA = p->tau_RA;
+		sl->dmod_TA = p->dmod_TA;
+		sl->dmod_RA = p->dmod_RA;
+		sl->zthr_TA = p->zthr_TA;
+		sl->zthr_RA = p->zthr_RA;
+		sl->alim_RA = p->alim_RA;
+	}
+}
+
+/*
+ * Runs a single full TCAS cycle: handles the system test state machine,
+ * takes a snapshot of all aircraft positions, selects the sensitivity
+ * level, computes the CPAs, resolves them into TAs/RAs and updates the
+ * avionics on the status of all contacts. All time-dependent logic inside
+ * of the cycle is driven by `now_t', which is the simulator time. This
+ * makes the cycle independent of the wall clock, so it can be driven
+ * both by the worker thread and inline by xtcas_step.
+ */
+static void
+tcas_cycle(xtcas_ctx_t *ctx, double now_t)
+{
+	const sim_intf_output_ops_t *out_ops = ctx->out_ops;
+	uint64_t now = SEC2USEC(now_t);
+	double prev_cycle_t = ctx->last_cycle_t;
+	acf_snap_t *snap;
+	tcas_acf_t *my_acf;
+	bool_t test;
+	uint64_t stage_ns[XTCAS_NUM_STAGES];
+	uint64_t cycle_start = xtcas_nanoclock(), t0, t1;
+
+	dbg_log(tcas, 4, "cycle: start (%.1f)", now_t);
+
+	mutex_enter(&ctx->state.test_lock);
+
+	if (ctx->state.test_in_prog) {
+		if (isnan(ctx->state.test_start_time)) {
+			ctx->state.test_start_time = now_t;
+
+			if (out_ops != NULL) {
+				/*
+				 * During a system test, we give a
+				 * normal climb indication on the PFD.
+				 */
 #if	GTS820_MODE
-					out_ops->update_RA(out_ops->handle,
-					    ADV_STATE_TA, RA_MSG_TFC,
-					    -1, -1, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+				out_ops->update_RA(out_ops->handle,
+				    ADV_STATE_TA, RA_MSG_TFC,
+				    -1, -1, 0, 0, 0, 0, 0, 0, 0, 0, 0);
 #elif	VSI_DRAW_MODE
-					out_ops->update_RA(out_ops->handle,
-					    ADV_STATE_RA, RA_MSG_CLB,
-					    RA_TYPE_CORRECTIVE, RA_SENSE_UPWARD,
-					    B_FALSE, B_FALSE, 0, FPM2MPS(0),
-					    FPM2MPS(300),
-					    -INF_VS, FPM2MPS(0),
-					    FPM2MPS(2000), INF_VS);
+				out_ops->update_RA(out_ops->handle,
+				    ADV_STATE_RA, RA_MSG_CLB,
+				    RA_TYPE_CORRECTIVE, RA_SENSE_UPWARD,
+				    B_FALSE, B_FALSE, 0, FPM2MPS(0),
+				    FPM2MPS(300),
+				    -INF_VS, FPM2MPS(0),
+				    FPM2MPS(2000), INF_VS);
 #else	/* !VSI_DRAW_MODE */
-					out_ops->update_RA(out_ops->handle,
-					    ADV_STATE_RA, RA_MSG_CLB,
-					    RA_TYPE_CORRECTIVE, RA_SENSE_UPWARD,
-					    B_FALSE, B_FALSE, 0,
-					    0, FPM2MPS(300),
-					    -INF_VS, 0, FPM2MPS(1500), INF_VS);
+				out_ops->update_RA(out_ops->handle,
+				    ADV_STATE_RA, RA_MSG_CLB,
+				    RA_TYPE_CORRECTIVE, RA_SENSE_UPWARD,
+				    B_FALSE, B_FALSE, 0,
+				    0, FPM2MPS(300),
+				    -INF_VS, 0, FPM2MPS(1500), INF_VS);
 #endif	/* !VSI_DRAW_MODE */
+			}
+		} else if (now_t - ctx->state.test_start_time >
+		    TCAS_TEST_DUR) {
+			/* Remove the fake test contacts */
+			if (out_ops != NULL) {
+				for (uintptr_t i = 1; i <= NUM_TEST_CTC; i++) {
+					out_ops->delete_contact(
+					    out_ops->handle, (void *)i);
 				}
-			} else if (now_t - tcas_state.test_start_time >
-			    TCAS_TEST_DUR) {
-				/* Remove the fake test contacts */
-				if (out_ops != NULL) {
-					for (uintptr_t i = 1; i <= NUM_TEST_CTC;
-					    i++) {
-						out_ops->delete_contact(
-						    out_ops->handle, (void *)i);
-					}
-					out_ops->update_RA(out_ops->handle,
-					    ADV_STATE_NONE, RA_MSG_CLEAR, -1,
-					    -1, B_FALSE, B_FALSE, 0, 0, 0, 0,
-					    0, 0, 0);
-				}
-				tcas_state.test_start_time = NAN;
-				tcas_state.test_in_prog = B_FALSE;
-#ifndef	XTCAS_NO_AUDIO
-				xtcas_play_msg(TCAS_TEST_PASS);
-#endif
-				if (out_ops != NULL &&
-				    out_ops->play_audio_msg != NULL) {
-					out_ops->play_audio_msg(out_ops->handle,
-					    TCAS_TEST_PASS);
-				}
+				out_ops->update_RA(out_ops->handle,
+				    ADV_STATE_NONE, RA_MSG_CLEAR, -1,
+				    -1, B_FALSE, B_FALSE, 0, 0, 0, 0,
+				    0, 0, 0);
 			}
+			ctx->state.test_start_time = NAN;
+			ctx->state.test_in_prog = B_FALSE;
+			play_msg(ctx, TCAS_TEST_PASS);
 		}
-		test = tcas_state.test_in_prog;
+	}
+	test = ctx->state.test_in_prog;
 
-		mutex_exit(&tcas_state.test_lock);
+	mutex_exit(&ctx->state.test_lock);
 
-		last_t = now_t;
+	ctx->last_cycle_t = now_t;
+	ctx->num_RA_cands = 0;
+	ctx->sep_memo.num_lookups = 0;
+	ctx->sep_memo.num_hits = 0;
+	ctx->num_ctc_reported = 0;
+	ctx->num_ctc_suppressed = 0;
 
-		/*
-		 * We'll create a local copy of all aircraft positions so
-		 * we don't have to hold acf_lock throughout.
-		 */
-		copy_acf_state(&my_acf, &other_acf, test);
+	/*
+	 * Pick up the latest snapshot of all aircraft positions, so
+	 * we don't have to hold acf_lock throughout. During the system
+	 * test, the intruders are replaced by the test contacts.
+	 */
+	t0 = xtcas_nanoclock();
+	snap = acquire_snapshot(ctx);
+	if (test) {
+		snap_reserve(ctx, &ctx->test_snap, NUM_TEST_CTC);
+		build_test_snapshot(&snap->my_acf, &ctx->test_snap);
+		ctx->test_snap.t = snap->t;
+		snap = &ctx->test_snap;
+	}
+	my_acf = &snap->my_acf;
+	t1 = xtcas_nanoclock();
+	stage_ns[XTCAS_STAGE_SNAP] = t1 - t0;
+	t0 = t1;
 
-		/*
-		 * Based on our altitudes, determine the sensitivity level.
-		 * SL change is prevented while in an RA to avoid excessive
-		 * RA switching. TA-only mode always selects SL2.
-		 */
-		if (sl == NULL || tcas_state.adv_state != ADV_STATE_RA) {
-			sl = xtcas_SL_select(sl != NULL ? sl->SL_id : 1,
-			    my_acf.cur_pos.elev, my_acf.agl,
+	/*
+	 * Based on our altitudes, determine the sensitivity level.
+	 * SL change is prevented while in an RA to avoid excessive
+	 * RA switching. TA-only mode always selects SL2. New tuning
+	 * parameters are applied to the SL table first.
+	 */
+	pickup_params(ctx);
+	if (ctx->cur_sl == NULL || ctx->state.adv_state != ADV_STATE_RA) {
+		ctx->cur_sl = xtcas_SL_select(ctx->SL_table,
+		    ctx->cur_sl != NULL ? ctx->cur_sl->SL_id : 1,
+		    my_acf->cur_pos.elev, my_acf->agl,
 #if	GTS820_MODE
-			    0,
+		    0,
 #else
-			    tcas_state.mode == TCAS_MODE_TAONLY ? 2 : 0,
+		    ctx->state.mode == TCAS_MODE_TAONLY ? 2 : 0,
 #endif
-			    !my_acf.has_RA && my_acf.gear_ext);
-			dbg_log(sl, 1, "SL: %d", sl->SL_id);
-			xtcas_SL = sl->SL_id;
-		}
+		    !my_acf->has_RA && my_acf->gear_ext);
+		dbg_log(sl, 1, "SL: %d", ctx->cur_sl->SL_id);
+		ctx->SL = ctx->cur_sl->SL_id;
+	}
+	t1 = xtcas_nanoclock();
+	stage_ns[XTCAS_STAGE_SL] = t1 - t0;
+	t0 = t1;
 
-		/*
-		 * Determine the CPA for each bogie and place them in the
-		 * correct time order.
-		 */
-		compute_CPAs(&cpas, &my_acf, &other_acf);
+	/*
+	 * Determine the CPA for each bogie and place them in the
+	 * correct time order.
+	 */
+	compute_CPAs(ctx, my_acf, snap);
+	t1 = xtcas_nanoclock();
+	stage_ns[XTCAS_STAGE_CPA] = t1 - t0;
+	t0 = t1;
 
-		/*
-		 * Enter the resolution phase and check if we need to do
-		 * anything. This is the main function where we issue TAs
-		 * and RAs.
-		 * In the test case, the contacts are already generated with
-		 * the appropriate threat levels assigned, so we don't need
-		 * to do any more resolution.
-		 */
-		if (!test) {
-			resolve_CPAs(&my_acf, &other_acf, &cpas, sl,
-			    &RA_hints, now);
+	/*
+	 * Enter the resolution phase and check if we need to do
+	 * anything. This is the main function where we issue TAs
+	 * and RAs.
+	 * In the test case, the contacts are already generated with
+	 * the appropriate threat levels assigned, so we don't need
+	 * to do any more resolution.
+	 */
+	if (!test) {
+		resolve_CPAs(ctx, my_acf, snap, ctx->cur_sl, &ctx->RA_hints,
+		    now);
+	}
+	t1 = xtcas_nanoclock();
+	stage_ns[XTCAS_STAGE_RESOLVE] = t1 - t0;
+	t0 = t1;
+
+	/*
+	 * Update the avionics on the threat status of all the
+	 * contacts that we have.
+	 */
+	update_contacts(ctx, my_acf, snap, test);
+	t1 = xtcas_nanoclock();
+	stage_ns[XTCAS_STAGE_CONTACTS] = t1 - t0;
+	t0 = t1;
+
+	destroy_CPAs(ctx);
+	xtcas_arena_reset(&ctx->arena);
+	t1 = xtcas_nanoclock();
+	stage_ns[XTCAS_STAGE_CLEANUP] = t1 - t0;
+	stage_ns[XTCAS_STAGE_CYCLE] = t1 - cycle_start;
+
+	update_sched(ctx, snap, test, prev_cycle_t, now_t);
+	update_timing(ctx, stage_ns, snap->num_acf);
+
+	dbg_log(tcas, 5, "cycle: end");
+}
+
+/*
+ * Drains the position reports pushed by the host since the last call.
+ * Only the latest report of each aircraft is kept.
+ */
+static void
+drain_push_ring(xtcas_ctx_t *ctx)
+{
+	pos_report_t rep;
+
+	ASSERT(ctx->push);
+
+	while (xtcas_ring_pop(&ctx->push_ring, &rep)) {
+		avl_index_t where;
+		acf_pos_t srch = { .acf_id = rep.acf_id };
+		acf_pos_t *pos;
+
+		if (rep.own) {
+			ctx->push_own = rep;
+			ctx->push_own_valid = B_TRUE;
+			continue;
+		}
+		pos = avl_find(&ctx->push_acf, &srch, &where);
+		if (pos == NULL) {
+			pos = ctx_calloc(ctx, 1, sizeof (*pos));
+			pos->acf_id = rep.acf_id;
+			avl_insert(&ctx->push_acf, pos, where);
 		}
+		pos->pos = rep.pos;
+		pos->on_ground = rep.on_ground;
+		pos->last_seen = rep.t;
+	}
+}
 
-		/*
-		 * Update the avionics on the threat status of all the
-		 * contacts that we have.
-		 */
-		update_contacts(&my_acf, &other_acf, test);
+/*
+ * Collects the positions of our own and all other aircraft and publishes
+ * them to the worker.
+ */
+static void
+collect_positions_now(xtcas_ctx_t *ctx, double t)
+{
+	uint64_t start = xtcas_nanoclock(), locked;
 
-		destroy_CPAs(&cpas);
+	ctx->last_collect_t = t;
+
+	mutex_enter(&ctx->acf_lock);
+	locked = xtcas_nanoclock();
+	update_my_position(ctx, t);
+	update_bogie_positions(ctx, t, ctx->my_acf.cur_pos, ctx->my_acf.agl);
+	publish_snapshot(ctx, start, locked);
+	mutex_exit(&ctx->acf_lock);
+}
+
+/*
+ * Collects our own and other aircraft positions from the sim. Returns
+ * B_TRUE if new positions were collected, or B_FALSE if not enough time
+ * has elapsed since the last collection (or the sim is paused).
+ */
+static bool_t
+collect_positions(xtcas_ctx_t *ctx, double t)
+{
+	double intval;
+
+	mutex_enter(&ctx->snap_lock);
+	intval = ctx->cycle_intval;
+	mutex_exit(&ctx->snap_lock);
+
+	/* protection in case the sim is paused */
+	if (t < ctx->last_collect_t + intval) {
+		dbg_log(tcas, 5, "run: not enough time has elapsed "
+		    "(t: %.1f last: %.1f)", t, ctx->last_collect_t);
+		return (B_FALSE);
+	}
+	/* in push mode, we can't do anything until we know where we are */
+	if (ctx->push && !ctx->push_own_valid)
+		return (B_FALSE);
+	collect_positions_now(ctx, t);
+
+	return (B_TRUE);
+}
+
+/*
+ * Waits until microclock() reaches `until', or we're shut down. In push
+ * mode, the ring is drained every PUSH_DRAIN_INTVAL in the meantime, so
+ * the rate at which hosts can push reports doesn't depend on our cycle
+ * rate. Must be called with worker_lock held.
+ */
+static void
+worker_wait(xtcas_ctx_t *ctx, uint64_t until)
+{
+	for (uint64_t now = microclock(); now < until &&
+	    !ctx->worker_shutdown; now = microclock()) {
+		cv_timedwait(&ctx->worker_cv, &ctx->worker_lock,
+		    ctx->push ? MIN(until, now + PUSH_DRAIN_INTVAL) : until);
+		if (ctx->push)
+			drain_push_ring(ctx);
+	}
+}
+
+static void
+main_loop(void *arg)
+{
+	xtcas_ctx_t *ctx = arg;
+
+	thread_set_name("X-TCAS");
+
+	dbg_log(tcas, 4, "main_loop: entry (%.1f)", ctx->last_cycle_t);
+
+	ASSERT(ctx->inited);
+
+	mutex_enter(&ctx->worker_lock);
+	for (uint64_t now = microclock(); !ctx->worker_shutdown;
+	    now = microclock()) {
+		double now_t = ctx->in_ops->get_time(ctx->in_ops->handle);
+		uint64_t intval;
+
+		if (ctx->push)
+			drain_push_ring(ctx);
+
+		/* If sim time hasn't advanced, we're paused. */
+		if (ctx->last_cycle_t >= now_t) {
+			dbg_log(tcas, 3, "main_loop: time hasn't progressed "
+			    "or STBY mode set (%d)", ctx->state.mode);
+			worker_wait(ctx, now + SEC2USEC(WORKER_LOOP_INTVAL));
+			continue;
+		}
 
 		/*
-		 * Dispose of the local position copy.
+		 * In push mode, we collect positions ourselves, so the
+		 * host's threads never have to do any of that work.
 		 */
-		destroy_acf_state(&other_acf);
-
-		dbg_log(tcas, 5, "main_loop: end");
+		if (ctx->push && ctx->push_own_valid)
+			collect_positions_now(ctx, now_t);
+		tcas_cycle(ctx, now_t);
 
 		/*
 		 * Jump forward at fixed intervals to guarantee our
-		 * execution schedule.
+		 * execution schedule. The interval is only ever changed
+		 * by us, in tcas_cycle.
 		 */
-		do {
-			cv_timedwait(&worker_cv, &worker_lock,
-			    now + WORKER_LOOP_INTVAL_US);
-		} while (microclock() < now + WORKER_LOOP_INTVAL_US &&
-		    !worker_shutdown);
+		intval = SEC2USEC(ctx->cycle_intval);
+		worker_wait(ctx, now + intval);
 	}
-	mutex_exit(&worker_lock);
+	mutex_exit(&ctx->worker_lock);
 
 	dbg_log(tcas, 4, "shutdown");
-
-	destroy_RA_hints(&RA_hints);
 }
 
 void
-xtcas_run(void)
+xtcas_ctx_run(xtcas_ctx_t *ctx)
 {
-	double t = in_ops->get_time(in_ops->handle);
+	double t = ctx->in_ops->get_time(ctx->in_ops->handle);
 
 	dbg_log(tcas, 4, "run: %.1f", t);
 
-	ASSERT(inited);
-
-	/* protection in case the sim is paused */
-	if (t < last_collect_t + WORKER_LOOP_INTVAL) {
-		dbg_log(tcas, 5, "run: not enough time has elapsed "
-		    "(t: %.1f last: %.1f)", t, last_collect_t);
-		return;
-	}
-	last_collect_t = t;
-
-	mutex_enter(&acf_lock);
-	update_my_position(t);
-	update_bogie_positions(t, my_acf_glob.cur_pos, my_acf_glob.agl);
+	ASSERT(ctx->inited);
+	ASSERT(!ctx->sync);
 
-	if (!my_acf_glob.trend_data_ready) {
-		mutex_exit(&acf_lock);
-		return;
-	}
-	mutex_exit(&acf_lock);
+	/* In push mode, the worker collects positions on its own. */
+	if (!ctx->push)
+		(void) collect_positions(ctx, t);
 }
 
 void
-xtcas_init(const sim_intf_input_ops_t *intf_input_ops,
-    const sim_intf_output_ops_t *intf_output_ops)
+xtcas_run(void)
 {
-	dbg_log(tcas, 1, "init");
+	xtcas_ctx_run(&dflt_ctx);
+}
 
-	inited = B_TRUE;
-	worker_shutdown = B_FALSE;
+/*
+ * Sets up a context. Unless `sync' is set, this also starts the
+ * context's worker thread.
+ */
+static void
+ctx_init(xtcas_ctx_t *ctx, const sim_intf_input_ops_t *intf_input_ops,
+    const sim_intf_output_ops_t *intf_output_ops, bool_t sync)
+{
+	ASSERT(!ctx->inited);
 
 	ASSERT(intf_input_ops != NULL);
-	ASSERT(intf_input_ops->get_time != NULL);
-	ASSERT(intf_input_ops->get_my_acf_pos != NULL);
-	ASSERT(intf_input_ops->get_oth_acf_pos != NULL);
+	ASSERT(sync || intf_input_ops->get_time != NULL);
+	ASSERT(intf_input_ops->get_my_acf_pos == NULL ||
+	    intf_input_ops->get_oth_acf_pos != NULL ||
+	    intf_input_ops->fill_oth_acf_pos != NULL);
 	if (intf_output_ops != NULL) {
 		ASSERT(intf_output_ops->update_contact != NULL);
 		ASSERT(intf_output_ops->delete_contact != NULL);
 		ASSERT(intf_output_ops->update_RA != NULL);
 	}
 
-	memset(&my_acf_glob, 0, sizeof (my_acf_glob));
-	avl_create(&other_acf_glob, acf_compar,
+	ctx->inited = B_TRUE;
+	ctx->worker_shutdown = B_FALSE;
+	ctx->sync = sync;
+
+	memset(&ctx->my_acf, 0, sizeof (ctx->my_acf));
+	avl_create(&ctx->other_acf, acf_compar,
 	    sizeof (tcas_acf_t), offsetof(tcas_acf_t, node));
-	mutex_init(&acf_lock);
+	list_create(&ctx->free_acf, sizeof (tcas_acf_t),
+	    offsetof(tcas_acf_t, free_node));
+	mutex_init(&ctx->acf_lock);
+	ctx->acf_seq = 0;
+	ctx->last_collect_t = 0;
+	ctx->pos_buf = NULL;
+	ctx->pos_buf_cap = 0;
+	ctx->push = (intf_input_ops->get_my_acf_pos == NULL);
+	if (ctx->push) {
+		xtcas_ring_init(&ctx->push_ring, sizeof (pos_report_t),
+		    PUSH_RING_SIZE);
+	}
+	ctx->push_own_valid = B_FALSE;
+	avl_create(&ctx->push_acf, acf_pos_compar, sizeof (acf_pos_t),
+	    offsetof(acf_pos_t, tree_node));
+
+	memset(ctx->snaps, 0, sizeof (ctx->snaps));
+	memset(&ctx->test_snap, 0, sizeof (ctx->test_snap));
+	mutex_init(&ctx->snap_lock);
+	ctx->snap_back = &ctx->snaps[0];
+	ctx->snap_ready = &ctx->snaps[1];
+	ctx->snap_cur = &ctx->snaps[2];
+	ctx->snap_old = &ctx->snaps[3];
+	ctx->snap_fresh = B_FALSE;
+	ctx->cycle_intval = WORKER_LOOP_INTVAL;
+	ctx->cycle_intval_avg = WORKER_LOOP_INTVAL;
+	ctx->fast_intval = 1.0 / FAST_CYCLE_RATE_DFL;
+	memset(&ctx->sched_stats, 0, sizeof (ctx->sched_stats));
+	memset(&ctx->timing, 0, sizeof (ctx->timing));
+	ctx->threat_threads = THREAT_THREADS_DFL;
+	memset(&ctx->threat_pool, 0, sizeof (ctx->threat_pool));
+	xtcas_get_dflt_params(&ctx->params);
+	ctx->params_chg = B_FALSE;
+	ctx->cur_params = ctx->params;
+	xtcas_SL_table_init(ctx->SL_table);
+	ctx->sample_t = NAN;
+	ctx->prev_sample_t = NAN;
+
+	memset(&ctx->state, 0, sizeof (ctx->state));
+	ctx->state.initial_ra_vs = NAN;
+	mutex_init(&ctx->state.test_lock);
+	ctx->state.test_start_time = NAN;
+
+	ctx->in_ops = intf_input_ops;
+	ctx->out_ops = intf_output_ops;
+
+	ctx->cur_sl = NULL;
+	ctx->SL = 0;
+	avl_create(&ctx->RA_hints, RA_hint_compar, sizeof (tcas_RA_hint_t),
+	    offsetof(tcas_RA_hint_t, node));
+	/* in synchronous mode, the time only comes from xtcas_step */
+	if (intf_input_ops->get_time != NULL)
+		ctx->last_cycle_t = ctx->in_ops->get_time(ctx->in_ops->handle);
+	else
+		ctx->last_cycle_t = 0;
+	memset(&ctx->cpa_soa, 0, sizeof (ctx->cpa_soa));
+	ctx->cpas = NULL;
+	ctx->num_cpas = 0;
+	ctx->cpas_cap = 0;
+	xtcas_arena_init(&ctx->arena, ARENA_CHUNK_SZ);
+	ctx->hints = NULL;
+	ctx->hints_cap = 0;
+	memset(ctx->ctc_rep, 0, sizeof (ctx->ctc_rep));
+	ctx->num_ctc_rep = 0;
+	ctx->ctc_rep_cap = 0;
+	ctx->num_allocs = 0;
+
+	if (!sync) {
+		mutex_init(&ctx->worker_lock);
+		cv_init(&ctx->worker_cv);
+		VERIFY(thread_create(&ctx->worker_thr, main_loop, ctx));
+	}
+}
+
+static void
+ctx_fini(xtcas_ctx_t *ctx)
+{
+	void *cookie;
+	tcas_acf_t *acf;
+	acf_pos_t *pos;
+
+	ASSERT(ctx->inited);
+
+	if (!ctx->sync) {
+		mutex_enter(&ctx->worker_lock);
+		ctx->worker_shutdown = B_TRUE;
+		cv_broadcast(&ctx->worker_cv);
+		mutex_exit(&ctx->worker_lock);
+		thread_join(&ctx->worker_thr);
+
+		cv_destroy(&ctx->worker_cv);
+		mutex_destroy(&ctx->worker_lock);
+	}
+
+	cookie = NULL;
+	while ((acf = avl_destroy_nodes(&ctx->other_acf, &cookie)) != NULL)
+		free(acf);
+	avl_destroy(&ctx->other_acf);
+	while ((acf = list_remove_head(&ctx->free_acf)) != NULL)
+		free(acf);
+	list_destroy(&ctx->free_acf);
+	free(ctx->pos_buf);
+	ctx->pos_buf = NULL;
+	ctx->pos_buf_cap = 0;
+	cookie = NULL;
+	while ((pos = avl_destroy_nodes(&ctx->push_acf, &cookie)) != NULL)
+		free(pos);
+	avl_destroy(&ctx->push_acf);
+	if (ctx->push)
+		xtcas_ring_fini(&ctx->push_ring);
+	ctx->push = B_FALSE;
+	for (size_t i = 0; i < ARRAY_NUM_ELEM(ctx->snaps); i++)
+		free(ctx->snaps[i].acf);
+	free(ctx->test_snap.acf);
+	xtcas_pool_fini(&ctx->threat_pool);
+	xtcas_cpa_soa_free(&ctx->cpa_soa);
+	free(ctx->cpas);
+	ctx->cpas = NULL;
+	destroy_RA_hints(&ctx->RA_hints);
+	avl_destroy(&ctx->RA_hints);
+	free(ctx->hints);
+	ctx->hints = NULL;
+	for (int i = 0; i < 2; i++) {
+		free(ctx->ctc_rep[i]);
+		ctx->ctc_rep[i] = NULL;
+	}
+	xtcas_arena_fini(&ctx->arena);
 
-	memset(&tcas_state, 0, sizeof (tcas_state));
-	tcas_state.initial_ra_vs = NAN;
-	mutex_init(&tcas_state.test_lock);
-	tcas_state.test_start_time = NAN;
+	mutex_destroy(&ctx->state.test_lock);
+	mutex_destroy(&ctx->snap_lock);
+	mutex_destroy(&ctx->acf_lock);
 
-	in_ops = intf_input_ops;
-	out_ops = intf_output_ops;
+	ctx->state.ra = NULL;
 
-	mutex_init(&worker_lock);
-	cv_init(&worker_cv);
-	VERIFY(thread_create(&worker_thr, main_loop, NULL));
+	ctx->sync = B_FALSE;
+	ctx->inited = B_FALSE;
+}
+
+xtcas_ctx_t *
+xtcas_ctx_create(const sim_intf_input_ops_t *intf_input_ops,
+    const sim_intf_output_ops_t *intf_output_ops)
+{
+	xtcas_ctx_t *ctx = safe_calloc(1, sizeof (*ctx));
+
+	dbg_log(tcas, 1, "ctx %p create", ctx);
+	ctx_init(ctx, intf_input_ops, intf_output_ops, B_FALSE);
+
+	return (ctx);
 }
 
 void
-xtcas_fini(void)
+xtcas_ctx_destroy(xtcas_ctx_t *ctx)
 {
-	dbg_log(tcas, 1, "fini");
+	ASSERT(ctx != &dflt_ctx);
 
-	mutex_enter(&worker_lock);
-	worker_shutdown = B_TRUE;
-	cv_broadcast(&worker_cv);
-	mutex_exit(&worker_lock);
-	thread_join(&worker_thr);
+	dbg_log(tcas, 1, "ctx %p destroy", ctx);
+	ctx_fini(ctx);
+	free(ctx);
+}
 
-	destroy_acf_state(&other_acf_glob);
+void
+xtcas_init(const sim_intf_input_ops_t *intf_input_ops,
+    const sim_intf_output_ops_t *intf_output_ops)
+{
+	dbg_log(tcas, 1, "init");
+	ctx_init(&dflt_ctx, intf_input_ops, intf_output_ops, B_FALSE);
+}
+
+xtcas_ctx_t *
+xtcas_ctx_create_sync(const sim_intf_input_ops_t *intf_input_ops,
+    const sim_intf_output_ops_t *intf_output_ops)
+{
+	xtcas_ctx_t *ctx = safe_calloc(1, sizeof (*ctx));
+
+	dbg_log(tcas, 1, "ctx %p sync create", ctx);
+	ctx_init(ctx, intf_input_ops, intf_output_ops, B_TRUE);
+
+	return (ctx);
+}
+
+void
+xtcas_ctx_step(xtcas_ctx_t *ctx, double t)
+{
+	uint64_t start = xtcas_nanoclock(), ns;
+
+	dbg_log(tcas, 4, "step: %.1f", t);
 
-	mutex_destroy(&tcas_state.test_lock);
-	mutex_destroy(&acf_lock);
+	ASSERT(ctx->inited);
+	ASSERT(ctx->sync);
+
+	if (ctx->push)
+		drain_push_ring(ctx);
+	if (collect_positions(ctx, t))
+		tcas_cycle(ctx, t);
+
+	ns = xtcas_nanoclock() - start;
+	mutex_enter(&ctx->snap_lock);
+	xtcas_stage_timing_add(&ctx->timing.step, ctx->timing.num_steps, ns);
+	ctx->timing.num_steps++;
+	mutex_exit(&ctx->snap_lock);
+}
+
+void
+xtcas_init_sync(const sim_intf_input_ops_t *intf_input_ops,
+    const sim_intf_output_ops_t *intf_output_ops)
+{
+	dbg_log(tcas, 1, "sync init");
+	ctx_init(&dflt_ctx, intf_input_ops, intf_output_ops, B_TRUE);
+}
 
-	cv_destroy(&worker_cv);
-	mutex_destroy(&worker_lock);
+void
+xtcas_step(double t)
+{
+	xtcas_ctx_step(&dflt_ctx, t);
+}
 
-	free(tcas_state.ra);
+void
+xtcas_fini(void)
+{
+	dbg_log(tcas, 1, "fini");
+	ctx_fini(&dflt_ctx);
+}
 
-	inited = B_FALSE;
+void
+xtcas_ctx_set_mode(xtcas_ctx_t *ctx, tcas_mode_t mode)
+{
+	ctx->state.mode = mode;
 }
 
 void
 xtcas_set_mode(tcas_mode_t mode)
 {
-	tcas_state.mode = mode;
+	xtcas_ctx_set_mode(&dflt_ctx, mode);
+}
+
+tcas_mode_t
+xtcas_ctx_get_mode(const xtcas_ctx_t *ctx)
+{
+	return (ctx->state.mode);
 }
 
 tcas_mode_t
 xtcas_get_mode(void)
 {
-	return (tcas_state.mode);
+	return (xtcas_ctx_get_mode(&dflt_ctx));
 }
 
 tcas_mode_t
-xtcas_get_mode_act(void)
+xtcas_ctx_get_mode_act(const xtcas_ctx_t *ctx)
 {
-	if (tcas_state.mode == TCAS_MODE_TARA && xtcas_get_SL() <= 2)
+	if (ctx->state.mode == TCAS_MODE_TARA && ctx->SL <= 2)
 		return (TCAS_MODE_TAONLY);
-	return (tcas_state.mode);
+	return (ctx->state.mode);
+}
+
+tcas_mode_t
+xtcas_get_mode_act(void)
+{
+	return (xtcas_ctx_get_mode_act(&dflt_ctx));
+}
+
+void
+xtcas_ctx_set_filter(xtcas_ctx_t *ctx, tcas_filter_t filter)
+{
+	ctx->state.filter = filter;
 }
 
 void
 xtcas_set_filter(tcas_filter_t filter)
 {
-	tcas_state.filter = filter;
+	xtcas_ctx_set_filter(&dflt_ctx, filter);
+}
+
+tcas_filter_t
+xtcas_ctx_get_filter(const xtcas_ctx_t *ctx)
+{
+	return (ctx->state.filter);
 }
 
 tcas_filter_t
 xtcas_get_filter(void)
 {
-	return (tcas_state.filter);
+	return (xtcas_ctx_get_filter(&dflt_ctx));
+}
+
+int
+xtcas_ctx_get_SL(const xtcas_ctx_t *ctx)
+{
+	return (ctx->SL);
 }
 
 int
 xtcas_get_SL(void)
 {
-	return (xtcas_SL);
+	return (xtcas_ctx_get_SL(&dflt_ctx));
+}
+
+void
+xtcas_ctx_set_has_RA(xtcas_ctx_t *ctx, bool_t flag)
+{
+	if (ctx->inited)
+		mutex_enter(&ctx->acf_lock);
+	ctx->my_acf.has_RA = flag;
+	if (ctx->inited)
+		mutex_exit(&ctx->acf_lock);
 }
 
 void
 xtcas_set_has_RA(bool_t flag)
 {
-	if (inited)
-		mutex_enter(&acf_lock);
-	my_acf_glob.has_RA = flag;
-	if (inited)
-		mutex_exit(&acf_lock);
+	xtcas_ctx_set_has_RA(&dflt_ctx, flag);
+}
+
+void
+xtcas_ctx_set_has_WOW(xtcas_ctx_t *ctx, bool_t flag)
+{
+	if (ctx->inited)
+		mutex_enter(&ctx->acf_lock);
+	ctx->my_acf.has_WOW = flag;
+	if (ctx->inited)
+		mutex_exit(&ctx->acf_lock);
 }
 
 void
 xtcas_set_has_WOW(bool_t flag)
 {
-	if (inited)
-		mutex_enter(&acf_lock);
-	my_acf_glob.has_WOW = flag;
-	if (inited)
-		mutex_exit(&acf_lock);
+	xtcas_ctx_set_has_WOW(&dflt_ctx, flag);
+}
+
+void
+xtcas_ctx_set_RA(xtcas_ctx_t *ctx, double agl_hgt_m)
+{
+	if (ctx->inited)
+		mutex_enter(&ctx->acf_lock);
+	ctx->my_acf.has_RA = !isnan(agl_hgt_m);
+	ctx->my_acf.agl = agl_hgt_m;
+	ctx->my_acf.custom_RA = B_TRUE;
+	if (ctx->inited)
+		mutex_exit(&ctx->acf_lock);
 }
 
 void
 xtcas_set_RA(double agl_hgt_m)
 {
-	if (inited)
-		mutex_enter(&acf_lock);
-	my_acf_glob.has_RA = !isnan(agl_hgt_m);
-	my_acf_glob.agl = agl_hgt_m;
-	my_acf_glob.custom_RA = B_TRUE;
-	if (inited)
-		mutex_exit(&acf_lock);
+	xtcas_ctx_set_RA(&dflt_ctx, agl_hgt_m);
+}
+
+void
+xtcas_ctx_set_WOW(xtcas_ctx_t *ctx, bool_t on_ground)
+{
+	if (ctx->inited)
+		mutex_enter(&ctx->acf_lock);
+	ctx->my_acf.has_WOW = B_TRUE;
+	ctx->my_acf.on_ground = on_ground;
+	ctx->my_acf.custom_WOW = B_TRUE;
+	if (ctx->inited)
+		mutex_exit(&ctx->acf_lock);
 }
 
 void
 xtcas_set_WOW(bool_t on_ground)
 {
-	if (inited)
-		mutex_enter(&acf_lock);
-	my_acf_glob.has_WOW = B_TRUE;
-	my_acf_glob.on_ground = on_ground;
-	my_acf_glob.custom_WOW = B_TRUE;
-	if (inited)
-		mutex_exit(&acf_lock);
+	xtcas_ctx_set_WOW(&dflt_ctx, on_ground);
+}
+
+void
+xtcas_ctx_set_gear_ext(xtcas_ctx_t *ctx, bool_t gear_ext)
+{
+	if (ctx->inited)
+		mutex_enter(&ctx->acf_lock);
+	ctx->my_acf.gear_ext = gear_ext;
+	ctx->my_acf.custom_gear_ext = B_TRUE;
+	if (ctx->inited)
+		mutex_exit(&ctx->acf_lock);
 }
 
 void
 xtcas_set_gear_ext(bool_t gear_ext)
 {
-	if (inited)
-		mutex_enter(&acf_lock);
-	my_acf_glob.gear_ext = gear_ext;
-	my_acf_glob.custom_gear_ext = B_TRUE;
-	if (inited)
-		mutex_exit(&acf_lock);
+	xtcas_ctx_set_gear_ext(&dflt_ctx, gear_ext);
 }
 
 static bool_t
-xtcas_test_check(const char **reason)
+xtcas_test_check(const xtcas_ctx_t *ctx, const char **reason)
 {
 	ASSERT(reason != NULL);
 
-	if (tcas_state.mode != TCAS_MODE_STBY) {
+	if (ctx->state.mode != TCAS_MODE_STBY) {
 		*reason = "TCAS mode not STBY";
 		return (B_FALSE);
 	}
-	if (!my_acf_glob.has_RA) {
+	if (!ctx->my_acf.has_RA) {
 		*reason = "RA INOP";
 		return (B_FALSE);
 	}
@@ -2766,38 +4262,238 @@ xtcas_test_check(const char **reason)
 }
 
 void
-xtcas_test(bool_t force_fail)
+xtcas_ctx_test(xtcas_ctx_t *ctx, bool_t force_fail)
 {
 	const char *reason = NULL;
 
 	if (force_fail) {
-#ifndef	XTCAS_NO_AUDIO
-		xtcas_play_msg(TCAS_TEST_FAIL);
-#endif
-		if (out_ops != NULL && out_ops->play_audio_msg != NULL) {
-			out_ops->play_audio_msg(out_ops->handle,
-			    TCAS_TEST_FAIL);
-		}
+		play_msg(ctx, TCAS_TEST_FAIL);
 		return;
 	}
-	if (!xtcas_test_check(&reason)) {
+	if (!xtcas_test_check(ctx, &reason)) {
 		logMsg("TCAS test fail: %s", reason);
-#ifndef	XTCAS_NO_AUDIO
-		xtcas_play_msg(TCAS_TEST_FAIL);
-#endif
-		if (out_ops != NULL && out_ops->play_audio_msg != NULL) {
-			out_ops->play_audio_msg(out_ops->handle,
-			    TCAS_TEST_FAIL);
-		}
+		play_msg(ctx, TCAS_TEST_FAIL);
 		return;
 	}
-	mutex_enter(&tcas_state.test_lock);
-	tcas_state.test_in_prog = B_TRUE;
-	mutex_exit(&tcas_state.test_lock);
+	mutex_enter(&ctx->state.test_lock);
+	ctx->state.test_in_prog = B_TRUE;
+	mutex_exit(&ctx->state.test_lock);
+}
+
+void
+xtcas_test(bool_t force_fail)
+{
+	xtcas_ctx_test(&dflt_ctx, force_fail);
+}
+
+bool_t
+xtcas_ctx_test_is_in_prog(const xtcas_ctx_t *ctx)
+{
+	return (ctx->state.test_in_prog);
 }
 
 bool_t
 xtcas_test_is_in_prog(void)
 {
-	return (tcas_state.test_in_prog);
+	return (xtcas_ctx_test_is_in_prog(&dflt_ctx));
+}
+
+void
+xtcas_ctx_set_fast_rate(xtcas_ctx_t *ctx, double rate_hz)
+{
+	rate_hz = MIN(MAX(rate_hz, 1), FAST_CYCLE_RATE_MAX);
+	mutex_enter(&ctx->snap_lock);
+	ctx->fast_intval = 1 / rate_hz;
+	mutex_exit(&ctx->snap_lock);
+}
+
+void
+xtcas_set_fast_rate(double rate_hz)
+{
+	xtcas_ctx_set_fast_rate(&dflt_ctx, rate_hz);
+}
+
+void
+xtcas_ctx_set_threat_threads(xtcas_ctx_t *ctx, unsigned nthreads)
+{
+	nthreads = MIN(MAX(nthreads, 1), THREAT_THREADS_MAX);
+	mutex_enter(&ctx->snap_lock);
+	ctx->threat_threads = nthreads;
+	mutex_exit(&ctx->snap_lock);
+}
+
+void
+xtcas_set_threat_threads(unsigned nthreads)
+{
+	xtcas_ctx_set_threat_threads(&dflt_ctx, nthreads);
+}
+
+void
+xtcas_get_dflt_params(xtcas_params_t *params)
+{
+	SL_t table[NUM_SL];
+
+	CTASSERT(NUM_SL <= XTCAS_MAX_SL);
+
+	memset(params, 0, sizeof (*params));
+	xtcas_SL_table_init(table);
+	params->num_SL = NUM_SL;
+	for (int i = 0; i < NUM_SL; i++) {
+		xtcas_SL_params_t *p = &params->SL[i];
+
+		p->tau_TA = table[i].tau_TA;
+		p->tau_RA = table[i].tau_RA;
+		p->dmod_TA = table[i].dmod_TA;
+		p->dmod_RA = table[i].dmod_RA;
+		p->zthr_TA = table[i].zthr_TA;
+		p->zthr_RA = table[i].zthr_RA;
+		p->alim_RA = table[i].alim_RA;
+	}
+	params->crossing_RA_penalty = CROSSING_RA_PENALTY;
+	params->reversal_RA_penalty = REVERSAL_RA_PENALTY;
+	params->hint_h_fact = HINT_H_INCR_FACT;
+	params->hint_v_fact = HINT_V_INCR_FACT;
+	params->state_chg_delay = STATE_CHG_DELAY;
+}
+
+void
+xtcas_ctx_set_params(xtcas_ctx_t *ctx, const xtcas_params_t *params)
+{
+	mutex_enter(&ctx->snap_lock);
+	ctx->params = *params;
+	ctx->params.num_SL = NUM_SL;
+	ctx->params_chg = B_TRUE;
+	mutex_exit(&ctx->snap_lock);
+}
+
+void
+xtcas_set_params(const xtcas_params_t *params)
+{
+	xtcas_ctx_set_params(&dflt_ctx, params);
+}
+
+void
+xtcas_ctx_get_params(xtcas_ctx_t *ctx, xtcas_params_t *params)
+{
+	mutex_enter(&ctx->snap_lock);
+	*params = ctx->params;
+	mutex_exit(&ctx->snap_lock);
+}
+
+void
+xtcas_get_params(xtcas_params_t *params)
+{
+	xtcas_ctx_get_params(&dflt_ctx, params);
+}
+
+bool_t
+xtcas_ctx_push_own(xtcas_ctx_t *ctx, geo_pos3_t pos, double t,
+    double alt_agl, double hdg, bool_t gear_ext, bool_t on_ground)
+{
+	pos_report_t rep = {
+	    .own = B_TRUE, .pos = pos, .t = t, .on_ground = on_ground,
+	    .gear_ext = gear_ext, .alt_agl = alt_agl, .hdg = hdg
+	};
+
+	ASSERT(ctx->push);
+	return (xtcas_ring_push(&ctx->push_ring, &rep));
+}
+
+bool_t
+xtcas_push_own(geo_pos3_t pos, double t, double alt_agl, double hdg,
+    bool_t gear_ext, bool_t on_ground)
+{
+	return (xtcas_ctx_push_own(&dflt_ctx, pos, t, alt_agl, hdg, gear_ext,
+	    on_ground));
+}
+
+bool_t
+xtcas_ctx_push_contact(xtcas_ctx_t *ctx, void *acf_id, geo_pos3_t pos,
+    double t, bool_t on_ground)
+{
+	pos_report_t rep = {
+	    .acf_id = acf_id, .pos = pos, .t = t, .on_ground = on_ground
+	};
+
+	ASSERT(ctx->push);
+	return (xtcas_ring_push(&ctx->push_ring, &rep));
+}
+
+bool_t
+xtcas_push_contact(void *acf_id, geo_pos3_t pos, double t, bool_t on_ground)
+{
+	return (xtcas_ctx_push_contact(&dflt_ctx, acf_id, pos, t, on_ground));
+}
+
+void
+xtcas_ctx_get_sched_stats(xtcas_ctx_t *ctx, xtcas_sched_stats_t *stats)
+{
+	mutex_enter(&ctx->snap_lock);
+	*stats = ctx->sched_stats;
+	mutex_exit(&ctx->snap_lock);
+}
+
+void
+xtcas_get_sched_stats(xtcas_sched_stats_t *stats)
+{
+	xtcas_ctx_get_sched_stats(&dflt_ctx, stats);
+}
+
+const char *
+xtcas_stage2str(xtcas_stage_t stage)
+{
+	switch (stage) {
+	case XTCAS_STAGE_SNAP:
+		return "snap";
+	case XTCAS_STAGE_SL:
+		return "SL";
+	case XTCAS_STAGE_CPA:
+		return "CPA";
+	case XTCAS_STAGE_RESOLVE:
+		return "resolve";
+	case XTCAS_STAGE_CONTACTS:
+		return "contacts";
+	case XTCAS_STAGE_CLEANUP:
+		return "cleanup";
+	case XTCAS_STAGE_CYCLE:
+		return "cycle";
+	default:
+		return "<invalid>";
+	}
+}
+
+void
+xtcas_ctx_get_timing(xtcas_ctx_t *ctx, xtcas_timing_t *timing)
+{
+	mutex_enter(&ctx->snap_lock);
+	*timing = ctx->timing;
+	mutex_exit(&ctx->snap_lock);
+
+	for (int i = 0; i < XTCAS_NUM_STAGES; i++)
+		xtcas_stage_timing_fill(&timing->stages[i], timing->num_cycles);
+	xtcas_stage_timing_fill(&timing->collect, timing->num_collects);
+	xtcas_stage_timing_fill(&timing->acf_lock_hold, timing->num_collects);
+	xtcas_stage_timing_fill(&timing->snap_lock_hold,
+	    timing->num_snap_swaps);
+	xtcas_stage_timing_fill(&timing->step, timing->num_steps);
+}
+
+void
+xtcas_get_timing(xtcas_timing_t *timing)
+{
+	xtcas_ctx_get_timing(&dflt_ctx, timing);
+}
+
+void
+xtcas_ctx_reset_timing(xtcas_ctx_t *ctx)
+{
+	mutex_enter(&ctx->snap_lock);
+	memset(&ctx->timing, 0, sizeof (ctx->timing));
+	mutex_exit(&ctx->snap_lock);
+}
+
+void
+xtcas_reset_timing(void)
+{
+	xtcas_ctx_reset_timing(&dflt_ctx);
 }
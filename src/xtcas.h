@@ -194,6 +194,7 @@ typedef enum {
 	ADV_STATE_RA
 } tcas_adv_t;
 const char *xtcas_RA_msg2text(tcas_msg_t msg);
+const char *xtcas_RA_msg2str(tcas_msg_t msg);
 
 /*
  * This is the X-TCAS simulator interface. Everything that the core of
@@ -213,7 +214,8 @@ typedef struct {
 	 * This function tells X-TCAS about the flow of time in the simulator.
 	 * It should return a monotonically increasing second counter from
 	 * some arbitrary point in the past. It needs to be at least
-	 * millisecond-accurate.
+	 * millisecond-accurate. This is not used in synchronous mode (see
+	 * xtcas_init_sync) and may be NULL there.
 	 */
 	double	(*get_time)(void *handle);
 	/*
@@ -227,6 +229,7 @@ typedef struct {
 	 * for gear extended, B_FALSE otherwise). This is only used for the
 	 * GTS 820 mode.
 	 * `on_ground' should be filled with the gear-on-ground status.
+	 * If this is NULL, X-TCAS runs in push mode (see xtcas_push_own).
 	 */
 	void	(*get_my_acf_pos)(void *handle, geo_pos3_t *pos,
 		    double *alt_agl, double *hdg, bool_t *gear_ext,
@@ -240,8 +243,42 @@ typedef struct {
 	 */
 	void	(*get_oth_acf_pos)(void *handle, acf_pos_t **pos_p,
 		    size_t *num);
+	/*
+	 * Optional alternative to get_oth_acf_pos, which avoids allocating
+	 * and freeing a new array on every position update. X-TCAS lends
+	 * the callee a reusable array `pos' with room for `cap' contacts.
+	 * The callee should fill in the acf_id, pos and on_ground fields of
+	 * as many contacts as fit and return the total number of contacts
+	 * it has. If that is more than `cap', X-TCAS grows the array and
+	 * calls this function again. The array remains owned by X-TCAS and
+	 * must not be retained after returning. If provided, this is used
+	 * instead of get_oth_acf_pos, which may then be NULL.
+	 */
+	size_t	(*fill_oth_acf_pos)(void *handle, acf_pos_t *pos, size_t cap);
 } sim_intf_input_ops_t;
 
+/*
+ * One contact of a contact frame, see update_contacts_batch. The fields
+ * have the same meaning as the arguments of update_contact.
+ */
+typedef struct {
+	void		*acf_id;
+	double		rbrg;
+	double		rdist;
+	double		ralt;
+	double		vs;
+	double		trk;
+	double		gs;
+	tcas_threat_t	level;
+} xtcas_contact_t;
+
+typedef struct {
+	void *const		*deleted;	/* acf_ids of deleted ctcs */
+	size_t			num_deleted;
+	const xtcas_contact_t	*contacts;	/* updated contacts */
+	size_t			num_contacts;
+} xtcas_contact_frame_t;
+
 typedef struct {
 	/*
 	 * OUTPUT:
@@ -255,10 +292,13 @@ typedef struct {
 
 	/*
 	 * This tells the avionics about TCAS aircraft contacts. It is called
-	 * every time X-TCAS does a position update (once every second). When
-	 * a new contact is detected, this function also represents a "new
-	 * contact" call. Contacts that have been lost will be explicitly
-	 * removed via delete_contact (see below).
+	 * when a new contact is detected (representing a "new contact"
+	 * call), when a contact's threat level changes and when it has moved
+	 * or changed its trend noticeably since it was last reported. The
+	 * avionics should keep displaying the last reported state of a
+	 * contact until it is updated again. Contacts that have been lost or
+	 * are to be hidden will be explicitly removed via delete_contact
+	 * (see below).
 	 * Please note that X-TCAS can call this function from threads other
 	 * than your main thread, so take care to lock any private structures
 	 * as necessary.
@@ -351,6 +391,22 @@ typedef struct {
 	 * X-TCAS builds with XTCAS_NO_AUDIO defined.
 	 */
 	void	(*play_audio_msg)(void *handle, tcas_msg_t msg);
+	/*
+	 * Optional batched form of update_contact and delete_contact. If
+	 * provided, X-TCAS delivers all the contact updates and deletions of
+	 * a cycle in a single call, rather than calling update_contact and
+	 * delete_contact for each contact. As with update_contact, only
+	 * contacts which have changed are included and the call is skipped
+	 * if nothing has changed. The deletions must be applied before the
+	 * updates. The frame and its arrays are only valid for the duration
+	 * of the call.
+	 * update_contact and delete_contact must still be provided, as
+	 * contacts which are lost between cycles, or which are removed at
+	 * the end of a system test, are deleted using delete_contact.
+	 * The same threading considerations as for update_contact apply.
+	 */
+	void	(*update_contacts_batch)(void *handle,
+		    const xtcas_contact_frame_t *frame);
 } sim_intf_output_ops_t;
 
 void xtcas_run(void);
@@ -358,6 +414,25 @@ void xtcas_init(const sim_intf_input_ops_t *const intf_input_ops,
     const sim_intf_output_ops_t *const intf_output_ops);
 void xtcas_fini(void);
 
+/*
+ * Synchronous mode. This runs the TCAS core inline on the caller's thread
+ * without a worker thread and without any dependency on the wall clock,
+ * e.g. from a fixed-step flight model or from a batch tool running faster
+ * than real time. xtcas_init_sync is used in place of xtcas_init and the
+ * core must then be driven by calling xtcas_step in place of xtcas_run.
+ * Every call to xtcas_step collects positions and then runs one full TCAS
+ * cycle, as soon as the simulator time `t' (in seconds) has advanced by
+ * at least the current TCAS cycle interval since the last cycle. Calls
+ * in between return right away. All of the input and output ops are
+ * called from within xtcas_step, and the get_time input op isn't used
+ * and may be NULL. The cost of each xtcas_step call is recorded in the
+ * `step' member of the timing statistics (see xtcas_get_timing). Call
+ * xtcas_fini to tear down as usual.
+ */
+void xtcas_init_sync(const sim_intf_input_ops_t *const intf_input_ops,
+    const sim_intf_output_ops_t *const intf_output_ops);
+void xtcas_step(double t);
+
 /*
  * External configuration functions.
  */
@@ -376,6 +451,274 @@ void xtcas_set_gear_ext(bool_t gear_ext);
 void xtcas_test(bool_t force_fail);
 bool_t xtcas_test_is_in_prog(void);
 
+/*
+ * Cycle scheduling. While there is no traffic of concern, the TCAS cycle
+ * (position collection, threat classification and RA logic) runs once
+ * per second. As soon as any contact is proximate traffic or above, it
+ * runs at the fast rate, which defaults to 4 Hz and can be set from 1 to
+ * 10 Hz using xtcas_set_fast_rate. Note that xtcas_run must be called
+ * at least as often for the fast rate to take effect.
+ *
+ * The decision latency is the worst-case time from a change in traffic
+ * geometry to the end of the TCAS cycle acting on it, i.e. the time from
+ * the position sample preceding the one the cycle used.
+ */
+typedef struct {
+	uint64_t	num_cycles;
+	bool_t		fast;		/* running at the fast rate */
+	double		cycle_rate;	/* effective cycle rate (Hz) */
+	double		latency;	/* decision latency of last cycle (s) */
+	double		max_latency;	/* worst decision latency so far (s) */
+} xtcas_sched_stats_t;
+
+void xtcas_set_fast_rate(double rate_hz);
+void xtcas_get_sched_stats(xtcas_sched_stats_t *stats);
+
+/*
+ * Threat classification of large contact sets (256 contacts or more) can
+ * be spread across a small pool of threads, which is started the first
+ * time it is needed. xtcas_set_threat_threads sets the number of threads
+ * used, including the TCAS worker thread itself, from 1 (no extra
+ * threads) to 16. The default is 1: every context starts its own pool, and
+ * the classification is only a part of the cycle, so measure with
+ * `xtcas_bench -T' on the target machine before enabling it (see
+ * BENCHMARKS.md). The threat levels are the same irrespective of the
+ * number of threads.
+ */
+void xtcas_set_threat_threads(unsigned nthreads);
+
+/*
+ * Runtime tuning parameters. xtcas_get_dflt_params returns the built-in
+ * values (the TCAS II v7.1 sensitivity level table, see SL.c). The host
+ * can modify these and pass them to xtcas_set_params, to try out other
+ * values without rebuilding X-TCAS. New parameters take effect at the
+ * start of the next TCAS cycle.
+ *
+ * SL[i] holds the TA and RA thresholds of sensitivity level i + 1 and
+ * only the first num_SL entries are used (num_SL is fixed by the build
+ * and ignored by xtcas_set_params). The altitude bands of the sensitivity
+ * levels can't be changed. When ranking RAs, the separation credited to
+ * a crossing RA is reduced by the fraction crossing_RA_penalty and that
+ * of a sense reversal by reversal_RA_penalty. While an RA is in effect,
+ * the TA volume is enlarged by hint_h_fact horizontally and hint_v_fact
+ * vertically to decide whether the threat is still present, so we don't
+ * issue CLEAR OF CONFLICT too early. state_chg_delay is the minimum time
+ * between two changes of the advisory state.
+ */
+#define	XTCAS_MAX_SL	8
+
+typedef struct {
+	double		tau_TA;		/* seconds */
+	double		tau_RA;		/* seconds */
+	double		dmod_TA;	/* meters */
+	double		dmod_RA;	/* meters */
+	double		zthr_TA;	/* meters */
+	double		zthr_RA;	/* meters */
+	double		alim_RA;	/* meters */
+} xtcas_SL_params_t;
+
+typedef struct {
+	unsigned		num_SL;
+	xtcas_SL_params_t	SL[XTCAS_MAX_SL];
+	double			crossing_RA_penalty;
+	double			reversal_RA_penalty;
+	double			hint_h_fact;
+	double			hint_v_fact;
+	double			state_chg_delay;	/* seconds */
+} xtcas_params_t;
+
+void xtcas_get_dflt_params(xtcas_params_t *params);
+void xtcas_set_params(const xtcas_params_t *params);
+void xtcas_get_params(xtcas_params_t *params);
+
+/*
+ * Push mode. If the get_my_acf_pos input op is NULL, X-TCAS doesn't poll
+ * the host for positions. Instead, the host pushes position reports as
+ * they arrive (e.g. for every network packet) using xtcas_push_own and
+ * xtcas_push_contact, whose arguments have the same meaning as those of
+ * get_my_acf_pos and the fields of acf_pos_t. `t' is the time of the
+ * report, on the same clock as get_time (or as the time passed to
+ * xtcas_step in synchronous mode). The aircraft's trends (speeds and
+ * track) are computed from the reports and their times, so the reports
+ * of an aircraft should arrive in order. The get_oth_acf_pos and
+ * fill_oth_acf_pos input ops aren't used and xtcas_run needn't be called.
+ *
+ * Pushing never blocks and takes constant time: the reports are placed
+ * in a lock-free ring, which the TCAS worker thread drains and processes
+ * on its own, every 50 ms irrespective of the TCAS cycle rate (or on
+ * every xtcas_step in synchronous mode). The ring holds 8192 reports, so
+ * hosts can push up to about 160000 reports per second. The push
+ * functions must not be called from more than one thread at a time.
+ * They return B_FALSE if the ring is full and the report was dropped.
+ * Only the latest report of every aircraft is used in a TCAS cycle, so
+ * a dropped report is harmless as long as a newer one follows. A contact
+ * which hasn't been reported for 5 seconds is considered lost. The same
+ * goes for our own aircraft: if it hasn't been reported for 5 seconds,
+ * all contacts are dropped until it is reported again.
+ */
+bool_t xtcas_push_own(geo_pos3_t pos, double t, double alt_agl, double hdg,
+    bool_t gear_ext, bool_t on_ground);
+bool_t xtcas_push_contact(void *acf_id, geo_pos3_t pos, double t,
+    bool_t on_ground);
+
+/*
+ * Worker pipeline timing. Every TCAS cycle times each of its stages using
+ * a monotonic nanosecond clock. Per stage, we keep the minimum, maximum
+ * and total duration, plus a histogram of durations in power-of-two
+ * buckets (bucket `i' counts durations of [2^i, 2^(i+1)) ns, with zero
+ * counted in bucket 0). The average and 99th percentile are filled in by
+ * xtcas_get_timing. The percentile is taken from the histogram, so it is
+ * accurate to within a factor of 2, but it never exceeds the maximum.
+ */
+typedef enum {
+	XTCAS_STAGE_SNAP,	/* picking up the position snapshot */
+	XTCAS_STAGE_SL,		/* sensitivity level selection */
+	XTCAS_STAGE_CPA,	/* CPA computation */
+	XTCAS_STAGE_RESOLVE,	/* threat levels & RA logic */
+	XTCAS_STAGE_CONTACTS,	/* reporting contacts to the avionics */
+	XTCAS_STAGE_CLEANUP,	/* releasing per-cycle state */
+	XTCAS_STAGE_CYCLE,	/* the entire cycle */
+	XTCAS_NUM_STAGES
+} xtcas_stage_t;
+
+#define	XTCAS_TIMING_BUCKETS	40
+
+typedef struct {
+	uint64_t	min_ns;
+	uint64_t	avg_ns;
+	uint64_t	p99_ns;
+	uint64_t	max_ns;
+	uint64_t	total_ns;
+	uint64_t	hist[XTCAS_TIMING_BUCKETS];
+} xtcas_stage_timing_t;
+
+typedef struct {
+	uint64_t		num_cycles;
+	xtcas_stage_timing_t	stages[XTCAS_NUM_STAGES];
+	unsigned		num_contacts;	/* in the last cycle */
+	unsigned		max_contacts;
+	unsigned		num_RA_cands;	/* in the last cycle */
+	unsigned		max_RA_cands;
+	/* RA separation memo lookups and hits */
+	unsigned		num_sep_lookups; /* in the last cycle */
+	unsigned		num_sep_hits;	/* in the last cycle */
+	uint64_t		total_sep_lookups;
+	uint64_t		total_sep_hits;
+	/*
+	 * Contact updates and deletions reported to the avionics, and
+	 * those suppressed because the avionics already had them.
+	 */
+	unsigned		num_ctc_reported;	/* in the last cycle */
+	unsigned		num_ctc_suppressed;	/* in the last cycle */
+	uint64_t		total_ctc_reported;
+	uint64_t		total_ctc_suppressed;
+	/*
+	 * Heap allocations made by the position collections and the TCAS
+	 * cycles since the TCAS core was initialized. Once the core has
+	 * seen the largest set of contacts and RA threats it is going to
+	 * see, this stops changing (`xtcas_bench' checks this).
+	 */
+	uint64_t		num_allocs;
+	/*
+	 * Duration of the position collections, including building the
+	 * snapshot for the TCAS cycle. Except in push mode, these run on
+	 * the thread calling xtcas_run (or xtcas_step).
+	 */
+	uint64_t		num_collects;
+	xtcas_stage_timing_t	collect;
+	/*
+	 * How long the locks shared by the collector and the worker are
+	 * held. acf_lock is held by every position collection, which also
+	 * blocks the host's xtcas_set_* calls. snap_lock is held by the
+	 * collector to publish a snapshot and by the worker to pick it up.
+	 */
+	xtcas_stage_timing_t	acf_lock_hold;	/* num_collects of them */
+	uint64_t		num_snap_swaps;
+	xtcas_stage_timing_t	snap_lock_hold;
+	/*
+	 * Duration of the xtcas_step calls in synchronous mode, including
+	 * position collection and those calls which didn't run a cycle.
+	 */
+	uint64_t		num_steps;
+	xtcas_stage_timing_t	step;
+} xtcas_timing_t;
+
+const char *xtcas_stage2str(xtcas_stage_t stage);
+void xtcas_get_timing(xtcas_timing_t *timing);
+void xtcas_reset_timing(void);
+
+/*
+ * Lets the host time its own work the same way (e.g. the X-Plane plugin
+ * times its dataref reads with these). xtcas_nanoclock is a monotonic
+ * clock in nanoseconds. xtcas_stage_timing_add adds a duration to `st',
+ * which holds `num' durations so far, and xtcas_stage_timing_fill fills
+ * in its average and 99th percentile.
+ */
+uint64_t xtcas_nanoclock(void);
+void xtcas_stage_timing_add(xtcas_stage_timing_t *st, uint64_t num,
+    uint64_t ns);
+void xtcas_stage_timing_fill(xtcas_stage_timing_t *st, uint64_t num);
+
+/*
+ * Re-entrant context API. Each context is a fully independent TCAS
+ * instance for one TCAS-equipped aircraft, with its own interface ops,
+ * contact set, advisory state and worker thread, so a host can simulate
+ * any number of TCAS-equipped aircraft in one process. The functions
+ * above operate on a built-in default context and are equivalent to
+ * calling their xtcas_ctx_* counterparts on it.
+ *
+ * xtcas_ctx_create takes the same interface ops as xtcas_init and
+ * xtcas_ctx_destroy tears the context down like xtcas_fini. Call
+ * xtcas_ctx_run from your flight loop just like xtcas_run. Each context's
+ * ops are called only for that context, so you can use the `handle'
+ * member of the ops to tell your aircraft apart. The built-in sound
+ * system is a process-wide resource and is only used by the default
+ * context. Other contexts only annunciate via the play_audio_msg output
+ * op.
+ */
+typedef struct xtcas_ctx xtcas_ctx_t;
+
+xtcas_ctx_t *xtcas_ctx_create(const sim_intf_input_ops_t *const intf_input_ops,
+    const sim_intf_output_ops_t *const intf_output_ops);
+void xtcas_ctx_destroy(xtcas_ctx_t *ctx);
+void xtcas_ctx_run(xtcas_ctx_t *ctx);
+
+void xtcas_ctx_set_mode(xtcas_ctx_t *ctx, tcas_mode_t mode);
+tcas_mode_t xtcas_ctx_get_mode(const xtcas_ctx_t *ctx);
+tcas_mode_t xtcas_ctx_get_mode_act(const xtcas_ctx_t *ctx);
+void xtcas_ctx_set_filter(xtcas_ctx_t *ctx, tcas_filter_t filter);
+tcas_filter_t xtcas_ctx_get_filter(const xtcas_ctx_t *ctx);
+int xtcas_ctx_get_SL(const xtcas_ctx_t *ctx);
+void xtcas_ctx_set_has_RA(xtcas_ctx_t *ctx, bool_t flag);
+void xtcas_ctx_set_has_WOW(xtcas_ctx_t *ctx, bool_t flag);
+void xtcas_ctx_set_RA(xtcas_ctx_t *ctx, double agl_hgt_m);
+void xtcas_ctx_set_WOW(xtcas_ctx_t *ctx, bool_t on_ground);
+void xtcas_ctx_set_gear_ext(xtcas_ctx_t *ctx, bool_t gear_ext);
+
+void xtcas_ctx_test(xtcas_ctx_t *ctx, bool_t force_fail);
+bool_t xtcas_ctx_test_is_in_prog(const xtcas_ctx_t *ctx);
+
+void xtcas_ctx_set_fast_rate(xtcas_ctx_t *ctx, double rate_hz);
+void xtcas_ctx_set_threat_threads(xtcas_ctx_t *ctx, unsigned nthreads);
+void xtcas_ctx_set_params(xtcas_ctx_t *ctx, const xtcas_params_t *params);
+void xtcas_ctx_get_params(xtcas_ctx_t *ctx, xtcas_params_t *params);
+bool_t xtcas_ctx_push_own(xtcas_ctx_t *ctx, geo_pos3_t pos, double t,
+    double alt_agl, double hdg, bool_t gear_ext, bool_t on_ground);
+bool_t xtcas_ctx_push_contact(xtcas_ctx_t *ctx, void *acf_id,
+    geo_pos3_t pos, double t, bool_t on_ground);
+void xtcas_ctx_get_sched_stats(xtcas_ctx_t *ctx, xtcas_sched_stats_t *stats);
+void xtcas_ctx_get_timing(xtcas_ctx_t *ctx, xtcas_timing_t *timing);
+void xtcas_ctx_reset_timing(xtcas_ctx_t *ctx);
+
+/*
+ * Synchronous mode for additional contexts (see xtcas_init_sync). The
+ * context is destroyed using xtcas_ctx_destroy.
+ */
+xtcas_ctx_t *xtcas_ctx_create_sync(
+    const sim_intf_input_ops_t *const intf_input_ops,
+    const sim_intf_output_ops_t *const intf_output_ops);
+void xtcas_ctx_step(xtcas_ctx_t *ctx, double t);
+
 #ifdef __cplusplus
 }
 #endif